@@ -56,6 +56,7 @@ extern "C" {
 #endif
 
 #include <cligen/cligen_buf.h>
+#include <cligen/cligen_arena.h>
 #include <cligen/cligen_cv.h>
 #include <cligen/cligen_cvec.h>
 #include <cligen/cligen_parsetree.h>
@@ -69,6 +70,7 @@ extern "C" {
 #include <cligen/cligen_io.h>
 #include <cligen/cligen_expand.h>
 #include <cligen/cligen_syntax.h>
+#include <cligen/cligen_bin.h>
 #include <cligen/cligen_util.h>
 #include <cligen/cligen_regex.h>
 #include <cligen/cligen_history.h>
@@ -0,0 +1,456 @@
+/*
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2001-2022 Olof Hagsand
+
+  This file is part of CLIgen.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 2 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+
+ *
+ * CLIgen scratch arenas
+ * Memory is allocated from chunks by incrementing an offset. Nothing is freed
+ * individually, instead all is released by cligen_arena_reset(). The largest chunk
+ * is kept on reset, so that an arena used repeatedly does not call malloc.
+ */
+
+/*
+ * Constants
+ */
+/* Default size of first chunk of an arena */
+#define ARENA_CHUNK_START 4096
+
+/* Alignment of allocations */
+#define ARENA_ALIGN       (2*sizeof(void*))
+
+/* Initial size of the table of interned strings, power of two */
+#define ARENA_INTERN_START 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "cligen_arena.h"
+#include "banned.h"
+
+/*
+ * Types
+ */
+/*! Chunk of memory of an arena
+ */
+struct arena_chunk{
+    struct arena_chunk *ac_next;  /* Older chunk */
+    size_t              ac_size;  /* Size of ac_data */
+    size_t              ac_used;  /* Bytes used of ac_data */
+    char               *ac_data;  /* Start of aligned data, after header */
+};
+
+/*! Read-only file mapping, shared by one or several arenas, see cligen_arena_mmap
+ */
+struct arena_map{
+    void               *am_addr;  /* Start of mapping */
+    size_t              am_len;   /* Length of mapping */
+    int                 am_refs;  /* Number of arenas sharing the mapping */
+};
+
+/*! Reference of an arena to a file mapping
+ */
+struct arena_mapref{
+    struct arena_mapref *ar_next; /* Older mapping */
+    struct arena_map    *ar_map;  /* Mapping */
+};
+
+/*! CLIgen arena, list of chunks where the first is the current
+ */
+struct cligen_arena{
+    struct arena_chunk *ca_chunk;     /* Current chunk, others in ac_next list */
+    size_t              ca_chunksz;   /* Size of next chunk */
+    char              **ca_intern;    /* Hash table of interned strings (malloced), or NULL */
+    size_t              ca_intern_size; /* Slots of ca_intern, power of two */
+    size_t              ca_intern_len;  /* Number of interned strings */
+    size_t              ca_intern_bytes; /* Bytes of interned strings */
+    size_t              ca_intern_saved; /* Bytes of copies avoided by interning */
+    struct arena_mapref *ca_map;      /* File mappings, released on reset and free */
+};
+
+/*! Allocate a new chunk of at least sz bytes data
+ */
+static struct arena_chunk *
+arena_chunk_new(size_t sz)
+{
+    struct arena_chunk *ac;
+    size_t              hdr;
+
+    hdr = (sizeof(*ac) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if ((ac = malloc(hdr + sz)) == NULL)
+        return NULL;
+    memset(ac, 0, sizeof(*ac));
+    ac->ac_size = sz;
+    ac->ac_data = (char*)ac + hdr;
+    return ac;
+}
+
+/*! Create a new arena
+ *
+ * @param[in] sz    Size of first chunk, 0 for default. No memory is allocated until used
+ * @retval    ca    Arena, free with cligen_arena_free
+ * @retval    NULL  Error
+ */
+cligen_arena *
+cligen_arena_new(size_t sz)
+{
+    cligen_arena *ca;
+
+    if ((ca = malloc(sizeof(*ca))) == NULL)
+        return NULL;
+    memset(ca, 0, sizeof(*ca));
+    ca->ca_chunksz = sz ? sz : ARENA_CHUNK_START;
+    return ca;
+}
+
+/*! Release all file mappings of an arena, unmap those not shared by other arenas
+ */
+static void
+arena_unmap(cligen_arena *ca)
+{
+    struct arena_mapref *ar;
+    struct arena_map    *am;
+
+    while ((ar = ca->ca_map) != NULL){
+        ca->ca_map = ar->ar_next;
+        am = ar->ar_map;
+        if (--am->am_refs == 0){
+            munmap(am->am_addr, am->am_len);
+            free(am);
+        }
+        free(ar);
+    }
+}
+
+/*! Free an arena and all memory allocated from it
+ *
+ * @param[in] ca    Arena
+ */
+void
+cligen_arena_free(cligen_arena *ca)
+{
+    struct arena_chunk *ac;
+
+    if (ca == NULL)
+        return;
+    while ((ac = ca->ca_chunk) != NULL){
+        ca->ca_chunk = ac->ac_next;
+        free(ac);
+    }
+    if (ca->ca_intern)
+        free(ca->ca_intern);
+    arena_unmap(ca);
+    free(ca);
+}
+
+/*! Allocate memory from an arena
+ *
+ * The memory is valid until the arena is reset or freed, it is not zeroed.
+ * @param[in] ca    Arena
+ * @param[in] sz    Size in bytes
+ * @retval    ptr   Aligned memory
+ * @retval    NULL  Error
+ */
+void *
+cligen_arena_alloc(cligen_arena *ca,
+                   size_t        sz)
+{
+    struct arena_chunk *ac;
+    void               *p;
+
+    sz = (sz + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if ((ac = ca->ca_chunk) == NULL || ac->ac_size - ac->ac_used < sz){
+        while (ca->ca_chunksz < sz)
+            ca->ca_chunksz *= 2;
+        if ((ac = arena_chunk_new(ca->ca_chunksz)) == NULL)
+            return NULL;
+        ac->ac_next = ca->ca_chunk;
+        ca->ca_chunk = ac;
+        ca->ca_chunksz *= 2;
+    }
+    p = ac->ac_data + ac->ac_used;
+    ac->ac_used += sz;
+    return p;
+}
+
+/*! Copy a string into an arena
+ *
+ * @param[in] ca    Arena
+ * @param[in] str   String
+ * @retval    str   Copy of string, valid until the arena is reset or freed
+ * @retval    NULL  Error
+ */
+char *
+cligen_arena_strdup(cligen_arena *ca,
+                    const char   *str)
+{
+    size_t len;
+    char  *s;
+
+    len = strlen(str) + 1;
+    if ((s = cligen_arena_alloc(ca, len)) == NULL)
+        return NULL;
+    memcpy(s, str, len);
+    return s;
+}
+
+/*! Release all memory allocated from an arena
+ *
+ * The current, largest, chunk is kept for reuse, older chunks are freed.
+ * @param[in] ca    Arena
+ */
+void
+cligen_arena_reset(cligen_arena *ca)
+{
+    struct arena_chunk *ac;
+    struct arena_chunk *ac1;
+
+    if (ca == NULL)
+        return;
+    if (ca->ca_intern){
+        free(ca->ca_intern);
+        ca->ca_intern = NULL;
+    }
+    ca->ca_intern_size = ca->ca_intern_len = 0;
+    ca->ca_intern_bytes = ca->ca_intern_saved = 0;
+    arena_unmap(ca);
+    if ((ac = ca->ca_chunk) == NULL)
+        return;
+    while ((ac1 = ac->ac_next) != NULL){
+        ac->ac_next = ac1->ac_next;
+        free(ac1);
+    }
+    ac->ac_used = 0;
+}
+
+/*! Map a file read-only for the lifetime of an arena
+ *
+ * Memory of the mapping is not counted by cligen_arena_size.
+ * @param[in] ca    Arena
+ * @param[in] fd    Open file descriptor, may be closed after the call
+ * @param[in] len   Length of file in bytes, > 0
+ * @retval    addr  Start of mapping, valid until the arena, and all arenas sharing the
+ *                  mapping, are reset or freed
+ * @retval    NULL  Error
+ * @see cligen_arena_mmap_share
+ * @see clispec_bin_read
+ */
+void *
+cligen_arena_mmap(cligen_arena *ca,
+                  int           fd,
+                  size_t        len)
+{
+    struct arena_mapref *ar;
+    struct arena_map    *am;
+    void                *addr;
+
+    if (len == 0){
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((ar = malloc(sizeof(*ar))) == NULL)
+        return NULL;
+    if ((am = malloc(sizeof(*am))) == NULL){
+        free(ar);
+        return NULL;
+    }
+    if ((addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED){
+        free(am);
+        free(ar);
+        return NULL;
+    }
+    am->am_addr = addr;
+    am->am_len = len;
+    am->am_refs = 1;
+    ar->ar_map = am;
+    ar->ar_next = ca->ca_map;
+    ca->ca_map = ar;
+    return addr;
+}
+
+/*! Share a file mapping of another arena
+ *
+ * The mapping is unmapped when the last arena sharing it is reset or freed. Several
+ * parse-trees can thereby borrow strings from a single mapping of a file.
+ * Sharing is not synchronized, arenas sharing a mapping should be reset and freed by
+ * one thread at a time.
+ * @param[in] ca    Arena
+ * @param[in] ca0   Arena with the mapping, see cligen_arena_mmap
+ * @param[in] addr  Start of mapping
+ * @retval    0     OK
+ * @retval   -1     Error, eg no such mapping in ca0
+ */
+int
+cligen_arena_mmap_share(cligen_arena *ca,
+                        cligen_arena *ca0,
+                        const void   *addr)
+{
+    struct arena_mapref *ar;
+    struct arena_mapref *ar0;
+
+    for (ar0 = ca0->ca_map; ar0 != NULL; ar0 = ar0->ar_next)
+        if (ar0->ar_map->am_addr == addr)
+            break;
+    if (ar0 == NULL){
+        errno = ENOENT;
+        return -1;
+    }
+    if ((ar = malloc(sizeof(*ar))) == NULL)
+        return -1;
+    ar->ar_map = ar0->ar_map;
+    ar->ar_map->am_refs++;
+    ar->ar_next = ca->ca_map;
+    ca->ca_map = ar;
+    return 0;
+}
+
+/*! Return the memory allocated by an arena
+ *
+ * @param[in] ca    Arena
+ * @retval    sz    Allocated bytes of all chunks
+ */
+size_t
+cligen_arena_size(cligen_arena *ca)
+{
+    struct arena_chunk *ac;
+    size_t              sz = 0;
+
+    for (ac = ca->ca_chunk; ac != NULL; ac = ac->ac_next)
+        sz += ac->ac_size;
+    return sz;
+}
+
+/*! Hash function of an interned string, FNV-1a
+ */
+static uint32_t
+arena_intern_hash(const char *str)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*str){
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*! Grow the table of interned strings to twice its size, or create it
+ *
+ * @param[in] ca    Arena
+ * @retval    0     OK
+ * @retval   -1     Error
+ */
+static int
+arena_intern_grow(cligen_arena *ca)
+{
+    char  **vec;
+    size_t  size;
+    size_t  i;
+    size_t  j;
+
+    size = ca->ca_intern_size ? 2*ca->ca_intern_size : ARENA_INTERN_START;
+    if ((vec = calloc(size, sizeof(char *))) == NULL)
+        return -1;
+    for (i=0; i<ca->ca_intern_size; i++){
+        if (ca->ca_intern[i] == NULL)
+            continue;
+        j = arena_intern_hash(ca->ca_intern[i]) & (size-1);
+        while (vec[j] != NULL)
+            j = (j+1) & (size-1);
+        vec[j] = ca->ca_intern[i];
+    }
+    if (ca->ca_intern)
+        free(ca->ca_intern);
+    ca->ca_intern = vec;
+    ca->ca_intern_size = size;
+    return 0;
+}
+
+/*! Intern a string in an arena: equal strings share one copy
+ *
+ * Interned strings of the same arena may be compared by pointer.
+ * @param[in] ca    Arena
+ * @param[in] str   String
+ * @retval    str   Shared copy of string, valid until the arena is reset or freed
+ * @retval    NULL  Error
+ * @see cligen_arena_intern_stats
+ */
+char *
+cligen_arena_intern(cligen_arena *ca,
+                    const char   *str)
+{
+    size_t i;
+    char  *s;
+
+    if (2*(ca->ca_intern_len+1) > ca->ca_intern_size &&
+        arena_intern_grow(ca) < 0)
+        return NULL;
+    i = arena_intern_hash(str) & (ca->ca_intern_size-1);
+    while ((s = ca->ca_intern[i]) != NULL){
+        if (strcmp(s, str) == 0){
+            ca->ca_intern_saved += strlen(s) + 1;
+            return s;
+        }
+        i = (i+1) & (ca->ca_intern_size-1);
+    }
+    if ((s = cligen_arena_strdup(ca, str)) == NULL)
+        return NULL;
+    ca->ca_intern[i] = s;
+    ca->ca_intern_len++;
+    ca->ca_intern_bytes += strlen(s) + 1;
+    return s;
+}
+
+/*! Return statistics of interned strings of an arena
+ *
+ * @param[in]  ca     Arena
+ * @param[out] nrp    Number of distinct interned strings
+ * @param[out] szp    Bytes of interned strings
+ * @param[out] savedp Bytes of copies avoided by interning
+ * @retval     0      OK
+ */
+int
+cligen_arena_intern_stats(cligen_arena *ca,
+                          size_t       *nrp,
+                          size_t       *szp,
+                          size_t       *savedp)
+{
+    if (nrp)
+        *nrp = ca->ca_intern_len;
+    if (szp)
+        *szp = ca->ca_intern_bytes;
+    if (savedp)
+        *savedp = ca->ca_intern_saved;
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2001-2022 Olof Hagsand
+
+  This file is part of CLIgen.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 2 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+
+ *
+ * CLIgen scratch arenas
+ * Bump allocator of short-lived objects that are all freed at once by a reset
+ * @code
+ *   cligen_arena *ca;
+ *   char         *s;
+ *   if ((ca = cligen_arena_new(0)) == NULL)
+ *      err();
+ *   if ((s = cligen_arena_strdup(ca, "go")) == NULL)
+ *      err();
+ *   cligen_arena_reset(ca); // s is no longer valid
+ *   cligen_arena_free(ca);
+ * @endcode
+ */
+
+#ifndef _CLIGEN_ARENA_H
+#define _CLIGEN_ARENA_H
+
+/*
+ * Types
+ */
+typedef struct cligen_arena cligen_arena; /* Fully defined in c-file */
+
+/*
+ * Prototypes
+ */
+cligen_arena *cligen_arena_new(size_t sz);
+void          cligen_arena_free(cligen_arena *ca);
+void         *cligen_arena_alloc(cligen_arena *ca, size_t sz);
+char         *cligen_arena_strdup(cligen_arena *ca, const char *str);
+void          cligen_arena_reset(cligen_arena *ca);
+size_t        cligen_arena_size(cligen_arena *ca);
+char         *cligen_arena_intern(cligen_arena *ca, const char *str);
+int           cligen_arena_intern_stats(cligen_arena *ca, size_t *nrp, size_t *szp, size_t *savedp);
+void         *cligen_arena_mmap(cligen_arena *ca, int fd, size_t len);
+int           cligen_arena_mmap_share(cligen_arena *ca, cligen_arena *ca0, const void *addr);
+
+#endif /* _CLIGEN_ARENA_H */
@@ -0,0 +1,1288 @@
+/*
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2001-2022 Olof Hagsand
+
+  This file is part of CLIgen.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 2 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+
+ *
+ *
+ * CLIgen compiled parse-trees, see cligen_bin.h
+ * File layout, integers are in host byte order and all records are arrays of uint32_t:
+ *   header | nodes | kids | cvs | callbacks | trees | strings
+ * A string is a byte offset into the string section, a vector is a range of records of
+ * a section. Nodes are written after their children, so a child always has a lower
+ * index than its parent, and each node is the child of exactly one parent or tree. The
+ * loader checks both so that a corrupt file cannot loop or expand into a larger tree.
+ * The header has a checksum of the rest of the file, which detects a corrupt file but is
+ * not a signature: the file is trusted as much as the clispec it is compiled from.
+ */
+#include "cligen_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+#include "cligen_buf.h"
+#include "cligen_arena.h"
+#include "cligen_cv.h"
+#include "cligen_cvec.h"
+#include "cligen_parsetree.h"
+#include "cligen_pt_head.h"
+#include "cligen_callback.h"
+#include "cligen_object.h"
+#include "cligen_handle.h"
+#include "cligen_syntax.h"
+#include "cligen_bin.h"
+#include "banned.h"
+
+/*
+ * Constants
+ */
+#define BIN_MAGIC     "CLIGENPT"
+#define BIN_VERSION   2
+#define BIN_BYTEORDER 0x01020304
+
+/* Index or offset of a NULL string or vector */
+#define BIN_NONE      0xffffffffU
+
+/* Runtime flags of objects that are not written */
+#define BIN_FLAGS_SKIP (CO_FLAGS_MARK|CO_FLAGS_MATCH|CO_FLAGS_FROZEN)
+
+/*
+ * Types
+ */
+/*! Section of the file: offset and number of records, or bytes for strings
+ */
+struct bin_sect{
+    uint32_t bs_off;
+    uint32_t bs_nr;
+};
+
+/*! Range of records in a section, bv_first is BIN_NONE for NULL
+ */
+struct bin_vec{
+    uint32_t bv_first;
+    uint32_t bv_len;
+};
+
+/*! File header
+ */
+struct bin_hdr{
+    char            bh_magic[8];  /* BIN_MAGIC, not null-terminated */
+    uint64_t        bh_hash;      /* Hash of source, see clispec_bin_hash */
+    uint64_t        bh_sum;       /* Hash of the file from bh_version to the end */
+    uint32_t        bh_version;   /* BIN_VERSION */
+    uint32_t        bh_byteorder; /* BIN_BYTEORDER written in host byte order */
+    uint32_t        bh_size;      /* Size of file in bytes */
+    uint32_t        bh_pad;
+    struct bin_sect bh_nodes;     /* struct bin_node */
+    struct bin_sect bh_kids;      /* uint32_t node index or BIN_NONE */
+    struct bin_sect bh_cvs;       /* struct bin_cv */
+    struct bin_sect bh_ccs;       /* struct bin_cc */
+    struct bin_sect bh_trees;     /* struct bin_tree */
+    struct bin_sect bh_strs;      /* Null-terminated strings */
+    struct bin_vec  bh_globals;   /* Global variables in bh_cvs */
+};
+
+/*! CLIgen variable
+ */
+struct bin_cv{
+    uint32_t bc_name;
+    uint32_t bc_value;    /* String value, see cv2str, or BIN_NONE */
+    uint32_t bc_type;     /* enum cv_type */
+    uint32_t bc_flags;    /* var_flag | var_const << 8 | dec64_n << 16 */
+};
+
+/*! Callback, see cg_callback
+ */
+struct bin_cc{
+    uint32_t       bk_fn_str;
+    uint32_t       bk_flags;
+    struct bin_vec bk_cvec;  /* Arguments in bh_cvs */
+};
+
+/*! Parse-tree object, see cg_obj
+ */
+struct bin_node{
+    uint32_t       bn_type;
+    uint32_t       bn_preference;
+    uint32_t       bn_flags;
+    uint32_t       bn_sets;     /* Child parse-tree is a set */
+    uint32_t       bn_command;
+    uint32_t       bn_prefix;
+    uint32_t       bn_helpstring;
+    struct bin_vec bn_cvec;
+    struct bin_vec bn_filter;
+    struct bin_vec bn_callbacks;
+    struct bin_vec bn_kids;     /* Child parse-tree in bh_kids */
+    /* Variable spec, CO_VARIABLE only */
+    uint32_t       bn_vtype;
+    uint32_t       bn_dec64_n;
+    uint32_t       bn_rangelen;
+    uint32_t       bn_show;
+    uint32_t       bn_expand_fn_str;
+    uint32_t       bn_translate_fn_str;
+    uint32_t       bn_choice;   /* Also keyword */
+    uint32_t       bn_choice_help;
+    struct bin_vec bn_expand_fn_vec;
+    struct bin_vec bn_regex;
+    struct bin_vec bn_rangecvv_low;
+    struct bin_vec bn_rangecvv_upp;
+};
+
+/*! Parse-tree header, see pt_head
+ */
+struct bin_tree{
+    uint32_t       bt_name;
+    uint32_t       bt_pipe;
+    uint32_t       bt_sets;
+    uint32_t       bt_pad;
+    struct bin_vec bt_kids;     /* Top-level parse-tree in bh_kids */
+};
+
+/*! Sections of a file being written
+ *
+ * Errors are recorded in bw_err and checked once when the file is written, which keeps
+ * the many small appends readable.
+ */
+struct bin_writer{
+    cbuf *bw_nodes;
+    cbuf *bw_kids;
+    cbuf *bw_cvs;
+    cbuf *bw_ccs;
+    cbuf *bw_trees;
+    cbuf *bw_strs;
+    int   bw_err;
+};
+
+/*! Hash a buffer, FNV-1a 64
+ *
+ * Successive calls can be chained to hash several buffers, eg the clispec and its name
+ * @param[in]  hash  Previous hash, or CLISPEC_BIN_HASH_INIT
+ * @param[in]  buf   Buffer
+ * @param[in]  len   Length of buffer
+ * @retval     hash  New hash
+ */
+uint64_t
+clispec_bin_hash(uint64_t    hash,
+                 const void *buf,
+                 size_t      len)
+{
+    const uint8_t *p = buf;
+    size_t         i;
+
+    for (i=0; i<len; i++){
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*! Checksum of a buffer starting with a header, see bh_sum
+ *
+ * @param[in]  buf   Header, and the sections following it if the file is mapped
+ * @param[in]  len   Length of buf
+ * @retval     sum   Hash from bh_version to end of buf, chain the remaining sections
+ */
+static uint64_t
+bin_sum(const char *buf,
+        size_t      len)
+{
+    size_t off = offsetof(struct bin_hdr, bh_version);
+
+    return clispec_bin_hash(CLISPEC_BIN_HASH_INIT, buf + off, len - off);
+}
+
+/*! Append a record to a section and return its index
+ */
+static uint32_t
+bin_append(struct bin_writer *bw,
+           cbuf              *cb,
+           void              *rec,
+           size_t             sz)
+{
+    uint32_t i;
+
+    i = cbuf_len(cb) / sz;
+    if (cbuf_append_buf(cb, rec, sz) < 0)
+        bw->bw_err++;
+    return i;
+}
+
+/*! Append a string to the string section and return its offset
+ */
+static uint32_t
+bin_str(struct bin_writer *bw,
+        const char        *str)
+{
+    uint32_t off;
+
+    if (str == NULL)
+        return BIN_NONE;
+    off = cbuf_len(bw->bw_strs);
+    if (cbuf_append_buf(bw->bw_strs, (void*)str, strlen(str)+1) < 0)
+        bw->bw_err++;
+    return off;
+}
+
+/*! Append the variables of a cvec
+ *
+ * Values are written as strings and parsed when loaded.
+ */
+static struct bin_vec
+bin_cvec(struct bin_writer *bw,
+         cvec              *cvv)
+{
+    struct bin_vec bv = {BIN_NONE, 0};
+    struct bin_cv  bc;
+    cg_var        *cv = NULL;
+    enum cv_type   type;
+    char          *str;
+
+    if (cvv == NULL)
+        return bv;
+    bv.bv_first = cbuf_len(bw->bw_cvs) / sizeof(bc);
+    while ((cv = cvec_each(cvv, cv)) != NULL){
+        type = cv_type_get(cv);
+        bc.bc_name = bin_str(bw, cv_name_get(cv));
+        bc.bc_type = type;
+        bc.bc_flags = (uint8_t)cv_flag(cv, 0xff) |
+            (uint8_t)cv_const_get(cv) << 8;
+        if (type == CGV_DEC64)
+            bc.bc_flags |= (uint32_t)cv_dec64_n_get(cv) << 16;
+        if (type == CGV_VOID){ /* A pointer cannot be written */
+            errno = EINVAL;
+            bw->bw_err++;
+            bc.bc_value = BIN_NONE;
+        }
+        else if (type == CGV_ERR || type == CGV_EMPTY)
+            bc.bc_value = BIN_NONE;
+        else if (cv_isstring(type))
+            bc.bc_value = bin_str(bw, cv_string_get(cv));
+        else if ((str = cv2str_dup(cv)) == NULL){
+            bw->bw_err++;
+            bc.bc_value = BIN_NONE;
+        }
+        else{
+            bc.bc_value = bin_str(bw, str);
+            free(str);
+        }
+        bin_append(bw, bw->bw_cvs, &bc, sizeof(bc));
+        bv.bv_len++;
+    }
+    return bv;
+}
+
+/*! Append a list of callbacks
+ */
+static struct bin_vec
+bin_callbacks(struct bin_writer *bw,
+              cg_callback       *cc0)
+{
+    struct bin_vec bv = {BIN_NONE, 0};
+    struct bin_cc  bk;
+    cg_callback   *cc;
+
+    if (cc0 == NULL)
+        return bv;
+    bv.bv_first = cbuf_len(bw->bw_ccs) / sizeof(bk);
+    for (cc = cc0; cc; cc = co_callback_next(cc)){
+        bk.bk_fn_str = bin_str(bw, cc->cc_fn_str);
+        bk.bk_flags = cc->cc_flags;
+        bk.bk_cvec = bin_cvec(bw, cc->cc_cvec);
+        bin_append(bw, bw->bw_ccs, &bk, sizeof(bk));
+        bv.bv_len++;
+    }
+    return bv;
+}
+
+static struct bin_vec bin_pt(struct bin_writer *bw, parse_tree *pt);
+
+/*! Append an object after its children and return its index
+ */
+static uint32_t
+bin_node(struct bin_writer *bw,
+         cg_obj            *co)
+{
+    struct bin_node bn;
+    parse_tree     *pt;
+
+    memset(&bn, 0, sizeof(bn));
+    pt = co_pt_get(co);
+    bn.bn_kids = bin_pt(bw, pt);
+    bn.bn_sets = pt ? pt_sets_get(pt) : 0;
+    bn.bn_type = co->co_type;
+    bn.bn_preference = co->co_preference;
+    bn.bn_flags = co->co_flags & ~BIN_FLAGS_SKIP;
+    bn.bn_command = bin_str(bw, co->co_command);
+    bn.bn_prefix = bin_str(bw, co->co_prefix);
+    bn.bn_helpstring = bin_str(bw, co->co_helpstring);
+    bn.bn_cvec = bin_cvec(bw, co->co_cvec);
+    bn.bn_filter = bin_cvec(bw, co->co_filter);
+    bn.bn_callbacks = bin_callbacks(bw, co->co_callbacks);
+    if (co->co_type == CO_VARIABLE){
+        bn.bn_vtype = co->co_vtype;
+        bn.bn_dec64_n = co->co_dec64_n;
+        bn.bn_rangelen = co->co_rangelen;
+        bn.bn_show = bin_str(bw, co->co_show);
+        bn.bn_expand_fn_str = bin_str(bw, co->co_expand_fn_str);
+        bn.bn_translate_fn_str = bin_str(bw, co->co_translate_fn_str);
+        bn.bn_choice = bin_str(bw, co->co_choice);
+        bn.bn_choice_help = bin_str(bw, co->co_choice_help);
+        bn.bn_expand_fn_vec = bin_cvec(bw, co->co_expand_fn_vec);
+        bn.bn_regex = bin_cvec(bw, co->co_regex);
+        bn.bn_rangecvv_low = bin_cvec(bw, co->co_rangecvv_low);
+        bn.bn_rangecvv_upp = bin_cvec(bw, co->co_rangecvv_upp);
+    }
+    else{
+        bn.bn_show = bn.bn_expand_fn_str = bn.bn_translate_fn_str = BIN_NONE;
+        bn.bn_choice = bn.bn_choice_help = BIN_NONE;
+        bn.bn_expand_fn_vec.bv_first = bn.bn_regex.bv_first = BIN_NONE;
+        bn.bn_rangecvv_low.bv_first = bn.bn_rangecvv_upp.bv_first = BIN_NONE;
+    }
+    return bin_append(bw, bw->bw_nodes, &bn, sizeof(bn));
+}
+
+/*! Append the objects of a parse-tree and return the range of their indexes in kids
+ */
+static struct bin_vec
+bin_pt(struct bin_writer *bw,
+       parse_tree        *pt)
+{
+    struct bin_vec bv = {BIN_NONE, 0};
+    cg_obj        *co;
+    uint32_t       kid = BIN_NONE;
+    int            i;
+
+    if (pt == NULL)
+        return bv;
+    bv.bv_first = cbuf_len(bw->bw_kids) / sizeof(kid);
+    bv.bv_len = pt_len_get(pt);
+    for (i=0; i<bv.bv_len; i++) /* Reserve, children are written below */
+        bin_append(bw, bw->bw_kids, &kid, sizeof(kid));
+    for (i=0; i<bv.bv_len; i++){
+        if ((co = pt_vec_i_get(pt, i)) == NULL)
+            continue;
+        kid = bin_node(bw, co);
+        if (bw->bw_err == 0)
+            memcpy(cbuf_get(bw->bw_kids) + (bv.bv_first+i)*sizeof(kid), &kid, sizeof(kid));
+    }
+    return bv;
+}
+
+/*! Write a buffer to a file descriptor
+ */
+static int
+bin_fd_write(int         fd,
+             const char *buf,
+             size_t      len)
+{
+    ssize_t n;
+
+    while (len > 0){
+        if ((n = write(fd, buf, len)) < 0){
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*! Write parse-trees of a handle to a binary file, skipping the first trees
+ *
+ * @param[in]  h        CLIgen handle
+ * @param[in]  skip     Number of leading parse-trees of the handle not to write
+ * @param[in]  filename File, written to a temporary file that is renamed
+ * @param[in]  hash     Hash of source
+ * @param[in]  cvv      Global variables, or NULL
+ * @retval     0        OK
+ * @retval    -1        Error
+ */
+static int
+bin_write(cligen_handle h,
+          int           skip,
+          const char   *filename,
+          uint64_t      hash,
+          cvec         *cvv)
+{
+    int               retval = -1;
+    struct bin_writer bw = {0,};
+    struct bin_hdr    bh;
+    struct bin_tree   bt;
+    pt_head          *ph = NULL;
+    parse_tree       *pt;
+    cbuf             *cbtmp = NULL;
+    cbuf             *sects[6];
+    size_t            off;
+    int               fd = -1;
+    int               i;
+
+    if ((bw.bw_nodes = cbuf_new()) == NULL ||
+        (bw.bw_kids = cbuf_new()) == NULL ||
+        (bw.bw_cvs = cbuf_new()) == NULL ||
+        (bw.bw_ccs = cbuf_new()) == NULL ||
+        (bw.bw_trees = cbuf_new()) == NULL ||
+        (bw.bw_strs = cbuf_new()) == NULL ||
+        (cbtmp = cbuf_new()) == NULL)
+        goto done;
+    memset(&bh, 0, sizeof(bh));
+    i = 0;
+    while ((ph = cligen_ph_each(h, ph)) != NULL){
+        if (i++ < skip)
+            continue;
+        memset(&bt, 0, sizeof(bt));
+        pt = cligen_ph_parsetree_get(ph);
+        bt.bt_name = bin_str(&bw, cligen_ph_name_get(ph));
+        bt.bt_pipe = bin_str(&bw, cligen_ph_pipe_get(ph));
+        bt.bt_sets = pt ? pt_sets_get(pt) : 0;
+        bt.bt_kids = bin_pt(&bw, pt);
+        bin_append(&bw, bw.bw_trees, &bt, sizeof(bt));
+    }
+    bh.bh_globals = bin_cvec(&bw, cvv);
+    if (bw.bw_err)
+        goto done;
+    memcpy(bh.bh_magic, BIN_MAGIC, sizeof(bh.bh_magic));
+    bh.bh_hash = hash;
+    bh.bh_version = BIN_VERSION;
+    bh.bh_byteorder = BIN_BYTEORDER;
+    sects[0] = bw.bw_nodes;
+    sects[1] = bw.bw_kids;
+    sects[2] = bw.bw_cvs;
+    sects[3] = bw.bw_ccs;
+    sects[4] = bw.bw_trees;
+    sects[5] = bw.bw_strs;
+    off = sizeof(bh);
+    for (i=0; i<6; i++)
+        off += cbuf_len(sects[i]);
+    if (off > UINT32_MAX){
+        errno = EFBIG;
+        goto done;
+    }
+    off = sizeof(bh);
+    bh.bh_nodes.bs_off = off;
+    bh.bh_nodes.bs_nr = cbuf_len(bw.bw_nodes) / sizeof(struct bin_node);
+    off += cbuf_len(bw.bw_nodes);
+    bh.bh_kids.bs_off = off;
+    bh.bh_kids.bs_nr = cbuf_len(bw.bw_kids) / sizeof(uint32_t);
+    off += cbuf_len(bw.bw_kids);
+    bh.bh_cvs.bs_off = off;
+    bh.bh_cvs.bs_nr = cbuf_len(bw.bw_cvs) / sizeof(struct bin_cv);
+    off += cbuf_len(bw.bw_cvs);
+    bh.bh_ccs.bs_off = off;
+    bh.bh_ccs.bs_nr = cbuf_len(bw.bw_ccs) / sizeof(struct bin_cc);
+    off += cbuf_len(bw.bw_ccs);
+    bh.bh_trees.bs_off = off;
+    bh.bh_trees.bs_nr = cbuf_len(bw.bw_trees) / sizeof(struct bin_tree);
+    off += cbuf_len(bw.bw_trees);
+    bh.bh_strs.bs_off = off;
+    bh.bh_strs.bs_nr = cbuf_len(bw.bw_strs);
+    off += cbuf_len(bw.bw_strs);
+    bh.bh_size = off;
+    bh.bh_sum = bin_sum((char*)&bh, sizeof(bh));
+    for (i=0; i<6; i++)
+        bh.bh_sum = clispec_bin_hash(bh.bh_sum, cbuf_get(sects[i]), cbuf_len(sects[i]));
+    /* Write a temporary file and rename it, a reader never sees a partial file */
+    if (cprintf(cbtmp, "%s.%d.tmp", filename, (int)getpid()) < 0)
+        goto done;
+    if ((fd = open(cbuf_get(cbtmp), O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+        goto done;
+    if (bin_fd_write(fd, (char*)&bh, sizeof(bh)) < 0)
+        goto done;
+    for (i=0; i<6; i++)
+        if (bin_fd_write(fd, cbuf_get(sects[i]), cbuf_len(sects[i])) < 0)
+            goto done;
+    if (close(fd) < 0){
+        fd = -1;
+        goto done;
+    }
+    fd = -1;
+    if (rename(cbuf_get(cbtmp), filename) < 0)
+        goto done;
+    retval = 0;
+ done:
+    if (fd != -1)
+        close(fd);
+    if (retval < 0 && cbtmp && cbuf_len(cbtmp))
+        unlink(cbuf_get(cbtmp));
+    if (cbtmp)
+        cbuf_free(cbtmp);
+    if (bw.bw_nodes)
+        cbuf_free(bw.bw_nodes);
+    if (bw.bw_kids)
+        cbuf_free(bw.bw_kids);
+    if (bw.bw_cvs)
+        cbuf_free(bw.bw_cvs);
+    if (bw.bw_ccs)
+        cbuf_free(bw.bw_ccs);
+    if (bw.bw_trees)
+        cbuf_free(bw.bw_trees);
+    if (bw.bw_strs)
+        cbuf_free(bw.bw_strs);
+    return retval;
+}
+
+/*! Write all parse-trees of a handle to a binary file
+ *
+ * Callbacks, expand and translate functions are written by name, map them with
+ * cligen_callbackv_str2fn and friends after clispec_bin_read.
+ * @param[in]  h        CLIgen handle
+ * @param[in]  filename File, replaced atomically
+ * @param[in]  hash     Hash of source, see clispec_bin_hash
+ * @param[in]  cvv      Global variables, or NULL
+ * @retval     0        OK
+ * @retval    -1        Error
+ * @see clispec_bin_read
+ */
+int
+clispec_bin_write(cligen_handle h,
+                  const char   *filename,
+                  uint64_t      hash,
+                  cvec         *cvv)
+{
+    return bin_write(h, 0, filename, hash, cvv);
+}
+
+/*! Check that a section is within the file
+ */
+static int
+bin_sect_ok(struct bin_hdr  *bh,
+            struct bin_sect *bs,
+            size_t           sz)
+{
+    return bs->bs_off >= sizeof(*bh) &&
+        bs->bs_off % sizeof(uint32_t) == 0 &&
+        (uint64_t)bs->bs_off + (uint64_t)bs->bs_nr*sz <= bh->bh_size;
+}
+
+/*! Check that a vector is within a section
+ */
+static int
+bin_vec_ok(const struct bin_vec *bv,
+           uint32_t              nr)
+{
+    if (bv->bv_first == BIN_NONE)
+        return bv->bv_len == 0;
+    return bv->bv_first <= nr && bv->bv_len <= nr - bv->bv_first;
+}
+
+/*! Check that a string is within the string section
+ */
+static int
+bin_str_ok(struct bin_hdr *bh,
+           uint32_t        off)
+{
+    return off == BIN_NONE || off < bh->bh_strs.bs_nr;
+}
+
+/*! Check that a range of kids are nodes with lower index than max, not seen before
+ *
+ * @param[in]     base  Start of mapping
+ * @param[in]     bh    Header
+ * @param[in]     bv    Range of kids
+ * @param[in]     max   Index of parent, or number of nodes if top-level
+ * @param[in,out] seen  Bitmap of nodes that are kids, a node may only be seen once
+ */
+static int
+bin_kids_ok(const char           *base,
+            struct bin_hdr       *bh,
+            const struct bin_vec *bv,
+            uint32_t              max,
+            uint8_t              *seen)
+{
+    const uint32_t *kids;
+    uint32_t        kid;
+    uint32_t        i;
+
+    if (!bin_vec_ok(bv, bh->bh_kids.bs_nr))
+        return 0;
+    kids = (const uint32_t *)(base + bh->bh_kids.bs_off);
+    for (i=0; i<bv->bv_len; i++){
+        if ((kid = kids[bv->bv_first+i]) == BIN_NONE)
+            continue;
+        if (kid >= max || seen[kid/8] & (1 << kid%8))
+            return 0;
+        seen[kid/8] |= 1 << kid%8;
+    }
+    return 1;
+}
+
+/*! Check that a range vector has a variable per range, of the type of the range
+ *
+ * Ranges of strings are length ranges of type uint64, a lower bound may be empty, see
+ * cg_range_create.
+ * @param[in]  base      Start of mapping
+ * @param[in]  bh        Header
+ * @param[in]  bv        Lower or upper bounds, within the cvs section
+ * @param[in]  rangelen  Number of ranges of the variable
+ * @param[in]  vtype     Type of the variable
+ * @param[in]  low       Lower bounds
+ */
+static int
+bin_range_ok(const char           *base,
+             struct bin_hdr       *bh,
+             const struct bin_vec *bv,
+             uint32_t              rangelen,
+             uint32_t              vtype,
+             int                   low)
+{
+    const struct bin_cv *bc;
+    uint32_t             i;
+
+    if (rangelen == 0)
+        return 1;
+    if (bv->bv_first == BIN_NONE || bv->bv_len < rangelen)
+        return 0;
+    bc = (const struct bin_cv *)(base + bh->bh_cvs.bs_off) + bv->bv_first;
+    for (i=0; i<rangelen; i++, bc++)
+        if (bc->bc_type != vtype && bc->bc_type != CGV_UINT64 &&
+            !(low && bc->bc_type == CGV_EMPTY))
+            return 0;
+    return 1;
+}
+
+/*! Validate a mapped file: all offsets and indexes are within the file
+ *
+ * @param[in]  base  Start of mapping
+ * @param[in]  bh    Header, checked by caller
+ * @retval     1     Valid
+ * @retval     0     Invalid
+ * @retval    -1     Error
+ */
+static int
+bin_validate(const char     *base,
+             struct bin_hdr *bh)
+{
+    int                    retval = -1;
+    const struct bin_node *bn;
+    const struct bin_cv   *bc;
+    const struct bin_cc   *bk;
+    const struct bin_tree *bt;
+    uint8_t               *seen = NULL;
+    uint32_t               i;
+
+    if (bin_sum(base, bh->bh_size) != bh->bh_sum)
+        return 0;
+    if (!bin_sect_ok(bh, &bh->bh_nodes, sizeof(*bn)) ||
+        !bin_sect_ok(bh, &bh->bh_kids, sizeof(uint32_t)) ||
+        !bin_sect_ok(bh, &bh->bh_cvs, sizeof(*bc)) ||
+        !bin_sect_ok(bh, &bh->bh_ccs, sizeof(*bk)) ||
+        !bin_sect_ok(bh, &bh->bh_trees, sizeof(*bt)) ||
+        bh->bh_strs.bs_off < sizeof(*bh) ||
+        (uint64_t)bh->bh_strs.bs_off + bh->bh_strs.bs_nr > bh->bh_size)
+        return 0;
+    /* All strings are null-terminated if the last is */
+    if (bh->bh_strs.bs_nr && base[bh->bh_strs.bs_off + bh->bh_strs.bs_nr - 1] != '\0')
+        return 0;
+    bc = (const struct bin_cv *)(base + bh->bh_cvs.bs_off);
+    for (i=0; i<bh->bh_cvs.bs_nr; i++, bc++)
+        if (!bin_str_ok(bh, bc->bc_name) || !bin_str_ok(bh, bc->bc_value) ||
+            bc->bc_type > CGV_EMPTY || bc->bc_type == CGV_VOID)
+            return 0;
+    bk = (const struct bin_cc *)(base + bh->bh_ccs.bs_off);
+    for (i=0; i<bh->bh_ccs.bs_nr; i++, bk++)
+        if (!bin_str_ok(bh, bk->bk_fn_str) || !bin_vec_ok(&bk->bk_cvec, bh->bh_cvs.bs_nr))
+            return 0;
+    if (!bin_vec_ok(&bh->bh_globals, bh->bh_cvs.bs_nr))
+        return 0;
+    if ((seen = calloc(bh->bh_nodes.bs_nr/8 + 1, 1)) == NULL)
+        goto done;
+    retval = 0;
+    bn = (const struct bin_node *)(base + bh->bh_nodes.bs_off);
+    for (i=0; i<bh->bh_nodes.bs_nr; i++, bn++){
+        if (bn->bn_type > CO_EMPTY || bn->bn_vtype > CGV_EMPTY)
+            goto done;
+        if (!bin_str_ok(bh, bn->bn_command) || !bin_str_ok(bh, bn->bn_prefix) ||
+            !bin_str_ok(bh, bn->bn_helpstring) || !bin_str_ok(bh, bn->bn_show) ||
+            !bin_str_ok(bh, bn->bn_expand_fn_str) ||
+            !bin_str_ok(bh, bn->bn_translate_fn_str) ||
+            !bin_str_ok(bh, bn->bn_choice) || !bin_str_ok(bh, bn->bn_choice_help))
+            goto done;
+        if (!bin_vec_ok(&bn->bn_cvec, bh->bh_cvs.bs_nr) ||
+            !bin_vec_ok(&bn->bn_filter, bh->bh_cvs.bs_nr) ||
+            !bin_vec_ok(&bn->bn_expand_fn_vec, bh->bh_cvs.bs_nr) ||
+            !bin_vec_ok(&bn->bn_regex, bh->bh_cvs.bs_nr) ||
+            !bin_vec_ok(&bn->bn_rangecvv_low, bh->bh_cvs.bs_nr) ||
+            !bin_vec_ok(&bn->bn_rangecvv_upp, bh->bh_cvs.bs_nr) ||
+            !bin_vec_ok(&bn->bn_callbacks, bh->bh_ccs.bs_nr) ||
+            !bin_kids_ok(base, bh, &bn->bn_kids, i, seen))
+            goto done;
+        /* Ranges are read up to rangelen when a variable is validated, see cv_validate */
+        if (!bin_range_ok(base, bh, &bn->bn_rangecvv_low, bn->bn_rangelen, bn->bn_vtype, 1) ||
+            !bin_range_ok(base, bh, &bn->bn_rangecvv_upp, bn->bn_rangelen, bn->bn_vtype, 0))
+            goto done;
+    }
+    bt = (const struct bin_tree *)(base + bh->bh_trees.bs_off);
+    for (i=0; i<bh->bh_trees.bs_nr; i++, bt++)
+        if (bt->bt_name == BIN_NONE ||
+            !bin_str_ok(bh, bt->bt_name) || !bin_str_ok(bh, bt->bt_pipe) ||
+            !bin_kids_ok(base, bh, &bt->bt_kids, bh->bh_nodes.bs_nr, seen))
+            goto done;
+    /* Each node is a kid exactly once */
+    for (i=0; i<bh->bh_nodes.bs_nr; i++)
+        if ((seen[i/8] & (1 << i%8)) == 0)
+            goto done;
+    retval = 1;
+ done:
+    if (seen)
+        free(seen);
+    return retval;
+}
+
+/*! Return a string of a mapped file, or NULL
+ */
+static char *
+bin_str_get(const char     *base,
+            struct bin_hdr *bh,
+            uint32_t        off)
+{
+    if (off == BIN_NONE)
+        return NULL;
+    return (char*)base + bh->bh_strs.bs_off + off;
+}
+
+/*! Set value of a variable, and decimal exponent which is needed to parse it
+ *
+ * @retval     1     OK
+ * @retval     0     Invalid value
+ * @retval    -1     Error
+ */
+static int
+bin_cv_value(const char          *base,
+             struct bin_hdr      *bh,
+             const struct bin_cv *bc,
+             cg_var              *cv)
+{
+    int   ret;
+    char *str;
+    char *reason = NULL;
+
+    if (bc->bc_type == CGV_DEC64)
+        cv_dec64_n_set(cv, (bc->bc_flags >> 16) & 0xff);
+    if ((str = bin_str_get(base, bh, bc->bc_value)) == NULL)
+        return 1;
+    if (cv_isstring(bc->bc_type))
+        return cv_string_set(cv, str) == NULL ? -1 : 1;
+    ret = cv_parse1(str, cv, &reason);
+    if (reason)
+        free(reason);
+    return ret;
+}
+
+/*! Check that the values of all variables of a mapped file can be parsed
+ *
+ * Done before any tree is created, so that a file with an invalid value is not loaded
+ * partially.
+ * @param[in]  base  Start of mapping
+ * @param[in]  bh    Header, validated
+ * @retval     1     Valid
+ * @retval     0     Invalid
+ * @retval    -1     Error
+ */
+static int
+bin_values_ok(const char     *base,
+              struct bin_hdr *bh)
+{
+    const struct bin_cv *bc;
+    cg_var              *cv;
+    uint32_t             i;
+    int                  ret = 1;
+
+    bc = (const struct bin_cv *)(base + bh->bh_cvs.bs_off);
+    for (i=0; i<bh->bh_cvs.bs_nr && ret == 1; i++, bc++){
+        if (bc->bc_value == BIN_NONE || cv_isstring(bc->bc_type))
+            continue;
+        if ((cv = cv_new(bc->bc_type)) == NULL)
+            return -1;
+        ret = bin_cv_value(base, bh, bc, cv);
+        cv_free(cv);
+    }
+    return ret;
+}
+
+/*! Set name, flags and value of a variable
+ */
+static int
+bin_cv_load(const char          *base,
+            struct bin_hdr      *bh,
+            const struct bin_cv *bc,
+            cg_var              *cv)
+{
+    char *str;
+    int   ret;
+
+    if ((str = bin_str_get(base, bh, bc->bc_name)) != NULL &&
+        cv_name_get(cv) == NULL &&
+        cv_name_set(cv, str) == NULL)
+        return -1;
+    cv_flag_set(cv, bc->bc_flags & 0xff);
+    cv_const_set(cv, (bc->bc_flags >> 8) & 0xff);
+    if ((ret = bin_cv_value(base, bh, bc, cv)) < 0)
+        return -1;
+    if (ret == 0){ /* Checked by bin_values_ok */
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/*! Create a cvec from a vector of variables
+ *
+ * @param[out] cvvp  New cvec, or NULL if the vector is NULL
+ */
+static int
+bin_cvec_load(const char           *base,
+              struct bin_hdr       *bh,
+              const struct bin_vec *bv,
+              cvec                **cvvp)
+{
+    const struct bin_cv *bc;
+    cvec                *cvv;
+    cg_var              *cv;
+    uint32_t             i;
+
+    if (bv->bv_first == BIN_NONE)
+        return 0;
+    if ((cvv = cvec_new(0)) == NULL)
+        return -1;
+    *cvvp = cvv; /* Freed by caller on error */
+    bc = (const struct bin_cv *)(base + bh->bh_cvs.bs_off) + bv->bv_first;
+    for (i=0; i<bv->bv_len; i++, bc++){
+        if ((cv = cvec_add(cvv, bc->bc_type)) == NULL)
+            return -1;
+        if (bin_cv_load(base, bh, bc, cv) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*! Create a list of callbacks
+ */
+static int
+bin_callbacks_load(const char           *base,
+                   struct bin_hdr       *bh,
+                   const struct bin_vec *bv,
+                   cg_callback         **ccp)
+{
+    const struct bin_cc *bk;
+    cg_callback         *cc;
+    uint32_t             i;
+    char                *str;
+
+    if (bv->bv_first == BIN_NONE)
+        return 0;
+    bk = (const struct bin_cc *)(base + bh->bh_ccs.bs_off) + bv->bv_first;
+    for (i=0; i<bv->bv_len; i++, bk++){
+        if ((cc = malloc(sizeof(*cc))) == NULL)
+            return -1;
+        memset(cc, 0, sizeof(*cc));
+        *ccp = cc; /* Freed by caller on error */
+        ccp = &cc->cc_next;
+        cc->cc_flags = bk->bk_flags;
+        if ((str = bin_str_get(base, bh, bk->bk_fn_str)) != NULL &&
+            (cc->cc_fn_str = strdup(str)) == NULL)
+            return -1;
+        if (bin_cvec_load(base, bh, &bk->bk_cvec, &cc->cc_cvec) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*! Duplicate a string of a mapped file, or NULL
+ */
+static int
+bin_strdup(const char     *base,
+           struct bin_hdr *bh,
+           uint32_t        off,
+           char          **strp)
+{
+    char *str;
+
+    if ((str = bin_str_get(base, bh, off)) == NULL)
+        return 0;
+    if ((*strp = strdup(str)) == NULL)
+        return -1;
+    return 0;
+}
+
+static int bin_pt_load(const char *base, struct bin_hdr *bh, const struct bin_vec *bv,
+                       parse_tree *pt, cg_obj *parent, cligen_arena *ca);
+
+/*! Create an object in the arena of its tree
+ *
+ * Command, prefix and helpstring are borrowed from the mapping of the arena, other
+ * strings and vectors are malloced as in a parsed tree.
+ * @param[in]  base    Start of mapping shared by ca
+ * @param[in]  bh      Header
+ * @param[in]  bn      Object record
+ * @param[in]  parent  Parent object, or NULL if top-level
+ * @param[in]  ca      Arena of tree
+ * @param[out] cop     New object
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+static int
+bin_node_load(const char            *base,
+              struct bin_hdr        *bh,
+              const struct bin_node *bn,
+              cg_obj                *parent,
+              cligen_arena          *ca,
+              cg_obj               **cop)
+{
+    int         retval = -1;
+    cg_obj     *co;
+    parse_tree *pt;
+
+    if ((co = co_new_only_arena(bn->bn_type, ca)) == NULL)
+        goto done;
+    co->co_preference = bn->bn_preference;
+    co->co_flags = bn->bn_flags;
+    if ((co->co_command = bin_str_get(base, bh, bn->bn_command)) != NULL)
+        co->co_borrow |= CO_BORROW_COMMAND;
+    if ((co->co_prefix = bin_str_get(base, bh, bn->bn_prefix)) != NULL)
+        co->co_borrow |= CO_BORROW_PREFIX;
+    if ((co->co_helpstring = bin_str_get(base, bh, bn->bn_helpstring)) != NULL)
+        co->co_borrow |= CO_BORROW_HELPSTRING;
+    if (bin_cvec_load(base, bh, &bn->bn_cvec, &co->co_cvec) < 0 ||
+        bin_cvec_load(base, bh, &bn->bn_filter, &co->co_filter) < 0 ||
+        bin_callbacks_load(base, bh, &bn->bn_callbacks, &co->co_callbacks) < 0)
+        goto done;
+    if (co->co_type == CO_VARIABLE){
+        co->co_vtype = bn->bn_vtype;
+        co->co_dec64_n = bn->bn_dec64_n;
+        co->co_rangelen = bn->bn_rangelen;
+        if (bin_strdup(base, bh, bn->bn_show, &co->co_show) < 0 ||
+            bin_strdup(base, bh, bn->bn_expand_fn_str, &co->co_expand_fn_str) < 0 ||
+            bin_strdup(base, bh, bn->bn_translate_fn_str, &co->co_translate_fn_str) < 0 ||
+            bin_strdup(base, bh, bn->bn_choice, &co->co_choice) < 0 ||
+            bin_strdup(base, bh, bn->bn_choice_help, &co->co_choice_help) < 0)
+            goto done;
+        if (bin_cvec_load(base, bh, &bn->bn_expand_fn_vec, &co->co_expand_fn_vec) < 0 ||
+            bin_cvec_load(base, bh, &bn->bn_regex, &co->co_regex) < 0 ||
+            bin_cvec_load(base, bh, &bn->bn_rangecvv_low, &co->co_rangecvv_low) < 0 ||
+            bin_cvec_load(base, bh, &bn->bn_rangecvv_upp, &co->co_rangecvv_upp) < 0)
+            goto done;
+    }
+    if (parent)
+        co_up_set(co, parent);
+    if (bn->bn_kids.bv_first != BIN_NONE){
+        if ((pt = pt_new_arena(ca)) == NULL)
+            goto done;
+        if (co_pt_set(co, pt) < 0){
+            pt_free(pt, 0);
+            goto done;
+        }
+        pt_sets_set(pt, bn->bn_sets);
+        if (bin_pt_load(base, bh, &bn->bn_kids, pt, co, ca) < 0)
+            goto done;
+    }
+    *cop = co;
+    co = NULL;
+    retval = 0;
+ done:
+    if (co)
+        co_free(co, 1);
+    return retval;
+}
+
+/*! Create the objects of a parse-tree
+ */
+static int
+bin_pt_load(const char           *base,
+            struct bin_hdr       *bh,
+            const struct bin_vec *bv,
+            parse_tree           *pt,
+            cg_obj               *parent,
+            cligen_arena         *ca)
+{
+    const uint32_t        *kids;
+    const struct bin_node *bn;
+    cg_obj                *co;
+    uint32_t               i;
+
+    kids = (const uint32_t *)(base + bh->bh_kids.bs_off) + bv->bv_first;
+    if (pt_vec_reserve(pt, bv->bv_len) < 0)
+        return -1;
+    for (i=0; i<bv->bv_len; i++){
+        co = NULL;
+        if (kids[i] != BIN_NONE){
+            bn = (const struct bin_node *)(base + bh->bh_nodes.bs_off) + kids[i];
+            if (bin_node_load(base, bh, bn, parent, ca, &co) < 0)
+                return -1;
+        }
+        if (pt_vec_append(pt, co) < 0){
+            if (co)
+                co_free(co, 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*! Create a parse-tree and its arena
+ *
+ * The arena of the tree shares the mapping of the file, and strings borrowed from it are
+ * valid as long as the tree.
+ * @param[in]  base  Start of mapping owned by ca0
+ * @param[in]  bh    Header
+ * @param[in]  bt    Tree record
+ * @param[in]  ca0   Arena with the mapping, see cligen_arena_mmap_share
+ * @param[out] ptp   New parse-tree, free with pt_free
+ * @retval     0     OK
+ * @retval    -1     Error
+ */
+static int
+bin_tree_load(const char            *base,
+              struct bin_hdr        *bh,
+              const struct bin_tree *bt,
+              cligen_arena          *ca0,
+              parse_tree           **ptp)
+{
+    int           retval = -1;
+    cligen_arena *ca = NULL;
+    parse_tree   *pt = NULL;
+
+    if ((ca = cligen_arena_new(0)) == NULL)
+        goto done;
+    if (cligen_arena_mmap_share(ca, ca0, base) < 0)
+        goto done;
+    if ((pt = pt_new()) == NULL)
+        goto done;
+    if (pt_arena_set(pt, ca) < 0)
+        goto done;
+    ca = NULL;
+    pt_sets_set(pt, bt->bt_sets);
+    if (bin_pt_load(base, bh, &bt->bt_kids, pt, NULL, pt_arena_get(pt)) < 0)
+        goto done;
+    *ptp = pt;
+    pt = NULL;
+    retval = 0;
+ done:
+    if (pt)
+        pt_free(pt, 1);
+    if (ca)
+        cligen_arena_free(ca);
+    return retval;
+}
+
+/*! Read parse-trees from a binary file and add them to a handle
+ *
+ * Objects of each tree are allocated in an arena of the tree, see pt_arena_set. The file
+ * is mapped once and the mapping is shared by the arenas of the trees.
+ * Trees are only added to the handle if all trees are created.
+ * Map callbacks, expand and translate functions as after clispec_parse_file.
+ * @param[in]  h        CLIgen handle
+ * @param[in]  filename File written by clispec_bin_write
+ * @param[in]  hash     Expected hash of source, see clispec_bin_hash
+ * @param[out] cvv      Global variables are added or replaced, or NULL
+ * @retval     1        OK, trees added
+ * @retval     0        File is missing, stale, of another version or invalid
+ * @retval    -1        Error
+ * @see clispec_bin_write
+ */
+int
+clispec_bin_read(cligen_handle h,
+                 const char   *filename,
+                 uint64_t      hash,
+                 cvec         *cvv)
+{
+    int                    retval = -1;
+    int                    fd = -1;
+    struct stat            st;
+    struct bin_hdr         bh;
+    cligen_arena          *ca0 = NULL;
+    char                  *base;
+    parse_tree           **ptv = NULL;
+    const struct bin_tree *bt;
+    const struct bin_cv   *bc;
+    pt_head               *ph;
+    cg_var                *cv;
+    char                  *name;
+    char                  *str;
+    uint32_t               i;
+    int                    ret;
+
+    if ((fd = open(filename, O_RDONLY)) < 0){
+        if (errno == ENOENT)
+            retval = 0;
+        goto done;
+    }
+    if (fstat(fd, &st) < 0)
+        goto done;
+    if (st.st_size < sizeof(bh) || st.st_size > UINT32_MAX){
+        retval = 0;
+        goto done;
+    }
+    if (read(fd, &bh, sizeof(bh)) != sizeof(bh))
+        goto done;
+    if (memcmp(bh.bh_magic, BIN_MAGIC, sizeof(bh.bh_magic)) != 0 ||
+        bh.bh_version != BIN_VERSION ||
+        bh.bh_byteorder != BIN_BYTEORDER ||
+        bh.bh_hash != hash ||
+        bh.bh_size != st.st_size){
+        retval = 0;
+        goto done;
+    }
+    /* The mapping is shared by the arenas of the trees and released by ca0 when done */
+    if ((ca0 = cligen_arena_new(0)) == NULL)
+        goto done;
+    if ((base = cligen_arena_mmap(ca0, fd, bh.bh_size)) == NULL)
+        goto done;
+    if ((ret = bin_validate(base, &bh)) < 0)
+        goto done;
+    if (ret == 0){
+        retval = 0;
+        goto done;
+    }
+    if ((ret = bin_values_ok(base, &bh)) < 0)
+        goto done;
+    if (ret == 0){
+        retval = 0;
+        goto done;
+    }
+    if (bh.bh_trees.bs_nr &&
+        (ptv = calloc(bh.bh_trees.bs_nr, sizeof(*ptv))) == NULL)
+        goto done;
+    bt = (const struct bin_tree *)(base + bh.bh_trees.bs_off);
+    for (i=0; i<bh.bh_trees.bs_nr; i++)
+        if (bin_tree_load(base, &bh, &bt[i], ca0, &ptv[i]) < 0)
+            goto done;
+    for (i=0; i<bh.bh_trees.bs_nr; i++){
+        if ((ph = cligen_ph_add(h, bin_str_get(base, &bh, bt[i].bt_name))) == NULL)
+            goto done;
+        if (cligen_ph_parsetree_set(ph, ptv[i]) < 0)
+            goto done;
+        ptv[i] = NULL;
+        if ((str = bin_str_get(base, &bh, bt[i].bt_pipe)) != NULL &&
+            cligen_ph_pipe_set(ph, str) < 0)
+            goto done;
+    }
+    if (cvv && bh.bh_globals.bv_first != BIN_NONE){
+        bc = (const struct bin_cv *)(base + bh.bh_cvs.bs_off) + bh.bh_globals.bv_first;
+        for (i=0; i<bh.bh_globals.bv_len; i++, bc++){
+            name = bin_str_get(base, &bh, bc->bc_name);
+            if ((cv = name ? cvec_find(cvv, name) : NULL) == NULL &&
+                (cv = cvec_add(cvv, bc->bc_type)) == NULL)
+                goto done;
+            if (bin_cv_load(base, &bh, bc, cv) < 0)
+                goto done;
+        }
+    }
+    retval = 1;
+ done:
+    if (ptv){
+        for (i=0; i<bh.bh_trees.bs_nr; i++)
+            if (ptv[i])
+                pt_free(ptv[i], 1);
+        free(ptv);
+    }
+    if (ca0)
+        cligen_arena_free(ca0);
+    if (fd != -1)
+        close(fd);
+    return retval;
+}
+
+/*! Parse a file containing a CLIgen spec, using a binary file of its parsed trees
+ *
+ * If the binary file matches the spec, the trees are read from it, otherwise the spec
+ * is parsed and the binary file is written for the next time. The match is made on a
+ * hash of the spec, its name and treename. Failure to write the binary file is not an
+ * error, eg if its directory is read-only.
+ * @param[in]  h        CLIgen handle
+ * @param[in]  f        Open stdio file handle
+ * @param[in]  name     Debug string identifying the spec, typically a filename
+ * @param[in]  treename Initial treename, overriden by treename= in the clispec (or NULL)
+ * @param[in]  binfile  Binary file of parsed trees
+ * @param[out] cvv      Global variables, or NULL
+ * @retval     0        OK
+ * @retval    -1        Error
+ * @see clispec_parse_file  Does not add commands to an existing tree
+ */
+int
+clispec_parse_file_cache(cligen_handle h,
+                         FILE         *f,
+                         const char   *name,
+                         const char   *treename,
+                         const char   *binfile,
+                         cvec         *cvv)
+{
+    int      retval = -1;
+    cbuf    *cb = NULL;
+    cvec    *globals = NULL;
+    pt_head *ph = NULL;
+    char     buf[4096];
+    size_t   len;
+    uint64_t hash;
+    int      skip;
+    int      ret;
+
+    if ((cb = cbuf_new()) == NULL)
+        goto done;
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+        if (cbuf_append_buf(cb, buf, len) < 0)
+            goto done;
+    if (ferror(f))
+        goto done;
+    hash = clispec_bin_hash(CLISPEC_BIN_HASH_INIT, cbuf_get(cb), cbuf_len(cb));
+    hash = clispec_bin_hash(hash, name, strlen(name)+1);
+    if (treename)
+        hash = clispec_bin_hash(hash, treename, strlen(treename)+1);
+    if ((ret = clispec_bin_read(h, binfile, hash, cvv)) < 0)
+        goto done;
+    if (ret == 1)
+        goto ok;
+    if ((globals = cvv) == NULL &&
+        (globals = cvec_new(0)) == NULL)
+        goto done;
+    skip = 0;
+    while ((ph = cligen_ph_each(h, ph)) != NULL)
+        skip++;
+    if (clispec_parse_str(h, cbuf_get(cb), name, treename, NULL, globals) < 0)
+        goto done;
+    bin_write(h, skip, binfile, hash, globals);
+ ok:
+    retval = 0;
+ done:
+    if (globals && globals != cvv)
+        cvec_free(globals);
+    if (cb)
+        cbuf_free(cb);
+    return retval;
+}
@@ -0,0 +1,69 @@
+/*
+  ***** BEGIN LICENSE BLOCK *****
+
+  Copyright (C) 2001-2022 Olof Hagsand
+
+  This file is part of CLIgen.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  Alternatively, the contents of this file may be used under the terms of
+  the GNU General Public License Version 2 or later (the "GPL"),
+  in which case the provisions of the GPL are applicable instead
+  of those above. If you wish to allow use of your version of this file only
+  under the terms of the GPL, and not to allow others to
+  use your version of this file under the terms of Apache License version 2, indicate
+  your decision by deleting the provisions above and replace them with the
+  notice and other provisions required by the GPL. If you do not delete
+  the provisions above, a recipient may use your version of this file under
+  the terms of any one of the Apache License version 2 or the GPL.
+
+  ***** END LICENSE BLOCK *****
+
+ *
+ * CLIgen compiled parse-trees
+ * Parsed trees of a clispec are written to a binary file that is loaded with mmap on
+ * the next start instead of parsing the clispec again. All references in the file are
+ * offsets or indexes, the file is not relocated when loaded.
+ * The file is validated with a hash of the clispec source, see clispec_bin_hash.
+ * @code
+ *   if ((ret = clispec_bin_read(h, "spec.bin", hash, globals)) < 0)
+ *      err();
+ *   if (ret == 0){ // missing or stale
+ *      if (clispec_parse_file(h, f, "spec", NULL, NULL, globals) < 0)
+ *         err();
+ *      clispec_bin_write(h, "spec.bin", hash, globals);
+ *   }
+ * @endcode
+ * @see clispec_parse_file_cache
+ */
+
+#ifndef _CLIGEN_BIN_H
+#define _CLIGEN_BIN_H
+
+/*
+ * Constants
+ */
+/* Initial value of clispec_bin_hash, FNV-1a 64 offset basis */
+#define CLISPEC_BIN_HASH_INIT 0xcbf29ce484222325ULL
+
+/*
+ * Prototypes
+ */
+uint64_t clispec_bin_hash(uint64_t hash, const void *buf, size_t len);
+int      clispec_bin_write(cligen_handle h, const char *filename, uint64_t hash, cvec *cvv);
+int      clispec_bin_read(cligen_handle h, const char *filename, uint64_t hash, cvec *cvv);
+int      clispec_parse_file_cache(cligen_handle h, FILE *f, const char *name, const char *treename,
+                                  const char *binfile, cvec *cvv);
+
+#endif /* _CLIGEN_BIN_H */
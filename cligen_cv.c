@@ -54,6 +54,7 @@
 #include <errno.h>
 
 #include "cligen_buf.h"
+#include "cligen_arena.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
 #include "cligen_parsetree.h"
@@ -1319,14 +1320,13 @@ parse_dec64(const char *str,
             int64_t    *dec64_i,
             char      **reason)
 {
-    int      retval = 1;
-    char    *s0 = NULL; /* the whole string, eg aaa.bbb*/
-    char    *s1;        /* the first part (eg aaa)  */
-    char    *s2;        /* the second part (eg bbb)  */
-    char    *ss = NULL; /* Help string */
-    int      len1;
-    int      len2 = 0;
-    int      i;
+    int         retval = 1;
+    const char *s2;        /* the second part (eg bbb) of the whole string, eg aaa.bbb */
+    char        buf[64];   /* Help string if it fits */
+    char       *ss = NULL; /* Help string */
+    int         len1;
+    int         len2 = 0;
+    int         i;
 
 /*
      +----------------+-----------------------+----------------------+
@@ -1345,18 +1345,17 @@ parse_dec64(const char *str,
         retval = 0;
         goto done;
     }
-    if ((s0 = strdup(str)) == NULL){
-        retval = -1; /* malloc */
-        goto done;
-    }
-    s2 = s0;
-    s1 = strsep(&s2, ".");
-    len1 = strlen(s1);
-    if ((ss = malloc(strlen(str)+n+2)) == NULL){
+    if ((s2 = strchr(str, '.')) != NULL)
+        len1 = s2++ - str;
+    else
+        len1 = strlen(str);
+    if (strlen(str)+n+2 <= sizeof(buf))
+        ss = buf;
+    else if ((ss = malloc(strlen(str)+n+2)) == NULL){
         retval = -1; /* malloc */
         goto done;
     }
-    memcpy(ss, s1, len1);
+    memcpy(ss, str, len1);
 
     /*
      *     | s1 |.| s2 |
@@ -1385,9 +1384,7 @@ parse_dec64(const char *str,
     /* XXX: remove any beginning zeros */
     retval = parse_int64_base(ss, 10, INT64_MIN, INT64_MAX, dec64_i, reason);
   done:
-    if (s0)
-        free(s0);
-    if (ss)
+    if (ss && ss != buf)
         free(ss);
     return retval;
 }
@@ -2916,54 +2913,120 @@ string_remove_backslash(char *str)
     return 0;
 }
 
-/*! Parse cv from string.
+/*! Classify a string in one pass: compute the mask of types it may be parsed as
  *
- * This function expects an initialized cv as created by cv_new() or
- * prepared by cv_reset().
- * The following is required of a cv before calling this function:
- *  - A type field. So that the parser knows how to parse the string
- *  - For decimal64 the fraction_digits (n) must be known.
- *
- * See also cv_parse() which has simpler error handling.
- * and cv_validate() where the cv is validated against a cligen object specification.
+ * The mask is conservative: if a type is not in the mask, cv_parse1() of str with
+ * that type is certain to fail, but a type in the mask may still fail to parse.
+ * Used to reject typed variables before allocating a cv and parsing.
+ * @param[in]  str   Input string
+ * @retval     mask  Bitmask of plausible types, test with cv_typemask(type)
+ * @see cv_parse1
+ */
+uint64_t
+cv_str2typemask(const char *str)
+{
+    uint64_t    mask;
+    const char *s;
+    size_t      len;
+    int         digits = 0;  /* Number of 0-9 */
+    int         dots = 0;    /* Number of '.' */
+    int         colons = 0;  /* Number of ':' */
+    int         slash = 0;   /* Contains '/' */
+    int         numeric = 1; /* Only strtoll characters: sign, space, hex digits and x */
+    int         decimal = 1; /* Only sign, space, digits and '.' */
+    int         addr4 = 1;   /* Only digits and '.' */
+    int         addr6 = 1;   /* Only hex digits, ':' and '.' */
+    int         c;
+
+    /* Never rejected: free-form types and types without a string syntax */
+    mask = cv_typemask(CGV_ERR) | cv_typemask(CGV_REST) | cv_typemask(CGV_STRING) |
+        cv_typemask(CGV_INTERFACE) | cv_typemask(CGV_VOID) | cv_typemask(CGV_EMPTY);
+    if (str == NULL || *str == '\0')
+        return mask | cv_typemask(CGV_DEC64); /* "" may be fraction-digits zeroes */
+    for (s = str; *s != '\0'; s++){
+        c = (unsigned char)*s;
+        if (isdigit(c))
+            digits++;
+        else if (c == '.'){
+            dots++;
+            numeric = 0;
+            continue;
+        }
+        else if (c == ':'){
+            colons++;
+            numeric = decimal = addr4 = 0;
+            continue;
+        }
+        else if (c == '/'){
+            slash++;
+            numeric = decimal = addr4 = addr6 = 0;
+            continue;
+        }
+        else if (isxdigit(c)){
+            decimal = addr4 = 0;
+            continue;
+        }
+        else if (c == 'x' || c == 'X'){
+            decimal = addr4 = addr6 = 0;
+            continue;
+        }
+        else if (c == '-' || c == '+' || isspace(c)){
+            addr4 = addr6 = 0;
+            continue;
+        }
+        else
+            numeric = decimal = addr4 = addr6 = 0;
+    }
+    len = s - str;
+    if (numeric && digits)
+        mask |= cv_typemask(CGV_INT8) | cv_typemask(CGV_INT16) |
+            cv_typemask(CGV_INT32) | cv_typemask(CGV_INT64) |
+            cv_typemask(CGV_UINT8) | cv_typemask(CGV_UINT16) |
+            cv_typemask(CGV_UINT32) | cv_typemask(CGV_UINT64);
+    if (decimal)
+        mask |= cv_typemask(CGV_DEC64);
+    if (strchr("tfoed", *str) != NULL) /* true, false, on, off, enable, disable */
+        mask |= cv_typemask(CGV_BOOL);
+    if (addr4 && dots == 3)
+        mask |= cv_typemask(CGV_IPV4ADDR);
+    if (slash && dots >= 3)
+        mask |= cv_typemask(CGV_IPV4PFX);
+    if (addr6 && colons >= 2)
+        mask |= cv_typemask(CGV_IPV6ADDR);
+    if (slash && colons >= 2)
+        mask |= cv_typemask(CGV_IPV6PFX);
+    if (len == 17 && colons == 5)
+        mask |= cv_typemask(CGV_MACADDR);
+    if (colons && slash >= 2)
+        mask |= cv_typemask(CGV_URL);
+    if (len == 36)
+        mask |= cv_typemask(CGV_UUID);
+    if (len >= 10 && isdigit((unsigned char)str[0]) && str[4] == '-')
+        mask |= cv_typemask(CGV_TIME);
+    return mask;
+}
+
+/*! Parse cv from a string that may be modified
  *
- * @param[in]  str0   Input string. Example, number variable, str can be "7834" or "0x7634"
- * @param[in]  cv     cligen variable, as prepared by cv_reset()/cv_new()
- * @param[out] reason If given, and if return value is 0, contains a malloced string
- *                    describing the reason why the validation failed. If given must be NULL.
+ * @param[in]  str    Input string, modified
+ * @param[in]  cv     cligen variable
+ * @param[in]  borrow If set, string types point to str instead of a malloced copy
+ * @param[out] reason If given, malloced err string on validation error
  * @retval     1      Validation OK
  * @retval     0      Validation not OK, malloced reason is returned
  * @retval    -1      Error (fatal), with errno set to indicate error
- *
- * @code
- *  cg_var *cv = cv_new(CGV_STRING);
- *  char   *reason=NULL;
- *  if (cv_parse1("mystring", cv, &reason) < 0)
- *    cv_free(cv);
- *  free(reason);
- * @endcode
+ * @see cv_parse1
  */
-int
-cv_parse1(const char   *str0,
-          cg_var       *cv,
-          char        **reason)
+static int
+cv_parse_str(char    *str,
+             cg_var  *cv,
+             int      borrow,
+             char   **reason)
 {
     int    retval = -1;
-    char  *str;
     char  *mask;
     int    masklen = 0;
 
-    if (reason && (*reason != NULL)){
-        fprintf(stderr, "reason must be NULL on calling\n");
-        return -1;
-    }
-    if (str0 == NULL){
-        if ((str = strdup("")) == NULL)
-            goto done;
-    }
-    else
-        if ((str = strdup(str0)) == NULL)
-            goto done;
     switch (cv->var_type) {
     case CGV_INT8:
         retval = parse_int8(str, &cv->var_int8, reason);
@@ -2997,6 +3060,11 @@ cv_parse1(const char   *str0,
         break;
     case CGV_REST:
         string_remove_backslash(str);
+        if (borrow){
+            cv->var_rest = str;
+            retval = 1;
+            break;
+        }
         if (cv->var_rest)
             free(cv->var_rest);
         if ((cv->var_rest = strdup(str)) == NULL)
@@ -3005,6 +3073,11 @@ cv_parse1(const char   *str0,
         break;
     case CGV_STRING:
         string_remove_backslash(str);
+        if (borrow){
+            cv->var_string = str;
+            retval = 1;
+            break;
+        }
         if (cv->var_string){
             free(cv->var_string);
             cv->var_string = NULL;
@@ -3014,6 +3087,11 @@ cv_parse1(const char   *str0,
         retval = 1;
         break;
     case CGV_INTERFACE:
+        if (borrow){
+            cv->var_interface = str;
+            retval = 1;
+            break;
+        }
         if (cv->var_interface)
             free(cv->var_interface);
         if ((cv->var_interface = strdup(str)) == NULL)
@@ -3105,10 +3183,91 @@ cv_parse1(const char   *str0,
         break;
     } /* switch */
  done:
-    if (str)
-        free (str);
+    return retval;
+}
+
+/*! Parse cv from string.
+ *
+ * This function expects an initialized cv as created by cv_new() or
+ * prepared by cv_reset().
+ * The following is required of a cv before calling this function:
+ *  - A type field. So that the parser knows how to parse the string
+ *  - For decimal64 the fraction_digits (n) must be known.
+ *
+ * See also cv_parse() which has simpler error handling.
+ * and cv_validate() where the cv is validated against a cligen object specification.
+ *
+ * @param[in]  str0   Input string. Example, number variable, str can be "7834" or "0x7634"
+ * @param[in]  cv     cligen variable, as prepared by cv_reset()/cv_new()
+ * @param[out] reason If given, and if return value is 0, contains a malloced string
+ *                    describing the reason why the validation failed. If given must be NULL.
+ * @retval     1      Validation OK
+ * @retval     0      Validation not OK, malloced reason is returned
+ * @retval    -1      Error (fatal), with errno set to indicate error
+ *
+ * @code
+ *  cg_var *cv = cv_new(CGV_STRING);
+ *  char   *reason=NULL;
+ *  if (cv_parse1("mystring", cv, &reason) < 0)
+ *    cv_free(cv);
+ *  free(reason);
+ * @endcode
+ */
+int
+cv_parse1(const char   *str0,
+          cg_var       *cv,
+          char        **reason)
+{
+    int    retval = -1;
+    char  *str;
+
+    if (reason && (*reason != NULL)){
+        fprintf(stderr, "reason must be NULL on calling\n");
+        return -1;
+    }
+    if ((str = strdup(str0 ? str0 : "")) == NULL)
+        goto done;
+    retval = cv_parse_str(str, cv, 0, reason);
+    free(str);
+    if (reason && *reason)
+        assert(retval == 0); /* validation error only on reason */
+ done:
+    return retval;
+}
+
+/*! Parse cv from string into a scratch cv, without malloc for the common types
+ *
+ * As cv_parse1() but the string copy is made in an arena, and strings, rest and
+ * interfaces point into it. Use for short-lived values, eg validation.
+ * @param[in]  str0   Input string
+ * @param[in]  cv     cligen variable, prepared by cv_init()
+ * @param[in]  ca     Scratch arena, valid as long as cv is used
+ * @param[out] reason If given, and if return value is 0, contains a malloced string
+ * @retval     1      Validation OK
+ * @retval     0      Validation not OK, malloced reason is returned
+ * @retval    -1      Error (fatal), with errno set to indicate error
+ * @note Release cv with cv_reset_scratch(), not cv_reset() or cv_free()
+ * @see cligen_scratch  Arena of a CLIgen handle
+ */
+int
+cv_parse_scratch(const char   *str0,
+                 cg_var       *cv,
+                 cligen_arena *ca,
+                 char        **reason)
+{
+    int    retval = -1;
+    char  *str;
+
+    if (reason && (*reason != NULL)){
+        fprintf(stderr, "reason must be NULL on calling\n");
+        return -1;
+    }
+    if ((str = cligen_arena_strdup(ca, str0 ? str0 : "")) == NULL)
+        goto done;
+    retval = cv_parse_str(str, cv, 1, reason);
     if (reason && *reason)
         assert(retval == 0); /* validation error only on reason */
+ done:
     return retval;
 }
 
@@ -3179,6 +3338,8 @@ outofrange(cg_var     *cv0,
     cg_var *cv2;
     int     i;
 
+    if (reason == NULL) /* Only create message if asked for */
+        return 0;
     if ((cb = cbuf_new()) == NULL)
         goto done;
     cprintf(cb, "Number ");
@@ -3214,6 +3375,8 @@ outoflength(uint64_t    u64,
     cg_var *cv2;
     int     i;
 
+    if (reason == NULL) /* Only create message if asked for */
+        return 0;
     if ((cb = cbuf_new()) == NULL)
         goto done;
     cprintf(cb, "String length %" PRIu64 " out of range: ", u64);
@@ -3490,6 +3653,227 @@ cv_validate(cligen_handle h,
     return retval;
 }
 
+/*! Get integer range bound widened to 64 bits, a missing (empty) bound is 0
+ */
+static void
+cv_int_widen(cg_var   *cv,
+             int64_t  *i64,
+             uint64_t *u64)
+{
+    *i64 = 0;
+    *u64 = 0;
+    switch (cv->var_type){
+    case CGV_INT8:
+        *i64 = cv->var_int8;
+        break;
+    case CGV_INT16:
+        *i64 = cv->var_int16;
+        break;
+    case CGV_INT32:
+        *i64 = cv->var_int32;
+        break;
+    case CGV_INT64:
+        *i64 = cv->var_int64;
+        break;
+    case CGV_UINT8:
+        *u64 = cv->var_uint8;
+        break;
+    case CGV_UINT16:
+        *u64 = cv->var_uint16;
+        break;
+    case CGV_UINT32:
+        *u64 = cv->var_uint32;
+        break;
+    case CGV_UINT64:
+        *u64 = cv->var_uint64;
+        break;
+    default:
+        break;
+    }
+}
+
+/*! Error message for int violating the range of its type, as parse_int64_base() */
+static int
+outoftyperange(const char *str,
+               int         issigned,
+               int64_t     imin,
+               int64_t     imax,
+               uint64_t    umax,
+               char      **reason)
+{
+    if (reason == NULL) /* Only create message if asked for */
+        return 0;
+    if (issigned)
+        *reason = cligen_reason("Number %s out of range: %" PRId64 " - %" PRId64, str, imin, imax);
+    else
+        *reason = cligen_reason("Number %s out of range: 0 - %" PRIu64, str, umax);
+    if (*reason == NULL)
+        return -1;
+    return 0;
+}
+
+/*! Parse and validate an integer cv in one pass
+ *
+ * The string is parsed once as a 64-bit number which is checked against the ranges
+ * of the specification, and thereafter against the range of the type of cv.
+ * Same result and error as cv_parse1() as 64-bit type, cv_validate() and cv_parse1()
+ * as specific type, without parsing twice.
+ * @param[in]  str           Input string, NULL is same as ""
+ * @param[in]  cv            Cligen variable of an int type, value is set if OK
+ * @param[in]  cs            Variable specification of same type as cv, or NULL
+ * @param[out] reason        If given and no match, malloced error string
+ * @param[out] is_constraint Set to 1 if no match is due to a range of cs, not the type
+ * @retval     1             OK
+ * @retval     0             No match
+ * @retval    -1             Error
+ * @see cv_parse1, cv_validate
+ */
+int
+cv_parse_int1(const char *str,
+              cg_var     *cv,
+              cg_varspec *cs,
+              char      **reason,
+              int        *is_constraint)
+{
+    int          retval = -1;
+    enum cv_type t;
+    int          issigned;
+    int64_t      imin = 0;
+    int64_t      imax = 0;
+    uint64_t     umax = 0;
+    int64_t      i64 = 0;
+    uint64_t     u64 = 0;
+    int64_t      ilo = 0;
+    int64_t      iup = 0;
+    uint64_t     ulo = 0;
+    uint64_t     uup = 0;
+    char        *ep;
+    int          j;
+    int          ok;
+    cg_var       cv64;       /* Value as 64-bit for error message */
+
+    if (is_constraint)
+        *is_constraint = 0;
+    if (str == NULL)
+        str = "";
+    t = cv->var_type;
+    switch (t){
+    case CGV_INT8:
+        imin = INT8_MIN; imax = INT8_MAX;
+        break;
+    case CGV_INT16:
+        imin = INT16_MIN; imax = INT16_MAX;
+        break;
+    case CGV_INT32:
+        imin = INT32_MIN; imax = INT32_MAX;
+        break;
+    case CGV_INT64:
+        imin = INT64_MIN; imax = INT64_MAX;
+        break;
+    case CGV_UINT8:
+        umax = UINT8_MAX;
+        break;
+    case CGV_UINT16:
+        umax = UINT16_MAX;
+        break;
+    case CGV_UINT32:
+        umax = UINT32_MAX;
+        break;
+    case CGV_UINT64:
+        umax = UINT64_MAX;
+        break;
+    default:
+        errno = EINVAL;
+        goto done;
+    }
+    issigned = t <= CGV_INT64;
+    errno = 0;
+    if (issigned)
+        i64 = strtoll(str, &ep, 0);
+    else
+        u64 = strtoull(str, &ep, 0);
+    if (str[0] == '\0' || *ep != '\0'){
+        if (reason &&
+            (*reason = cligen_reason("'%s' is not a number", str)) == NULL)
+            goto done;
+        retval = 0;
+        goto done;
+    }
+    /* Overflow of 64 bits, or strtoull of negative number: out of range of type */
+    if (errno == ERANGE || (!issigned && strchr(str, '-') != NULL)){
+        errno = 0;
+        if (outoftyperange(str, issigned, imin, imax, umax, reason) < 0)
+            goto done;
+        retval = 0;
+        goto done;
+    }
+    /* Ranges of specification */
+    if (cs && cs->cgs_rangelen){
+        ok = 0;         /* At least one should pass */
+        for (j=0; j<cs->cgs_rangelen; j++){
+            cv_int_widen(cvec_i(cs->cgs_rangecvv_low, j), &ilo, &ulo);
+            cv_int_widen(cvec_i(cs->cgs_rangecvv_upp, j), &iup, &uup);
+            if (issigned ? (i64 >= ilo && i64 <= iup) : (u64 >= ulo && u64 <= uup)){
+                ok = 1;
+                break;
+            }
+        }
+        if (!ok){
+            if (is_constraint)
+                *is_constraint = 1;
+            memset(&cv64, 0, sizeof(cv64));
+            if (issigned){
+                cv64.var_type = CGV_INT64;
+                cv64.var_int64 = i64;
+            }
+            else{
+                cv64.var_type = CGV_UINT64;
+                cv64.var_uint64 = u64;
+            }
+            if (outofrange(&cv64, cs, reason) < 0)
+                goto done;
+            retval = 0;
+            goto done;
+        }
+    }
+    /* Range of type */
+    if (issigned ? (i64 < imin || i64 > imax) : u64 > umax){
+        if (outoftyperange(str, issigned, imin, imax, umax, reason) < 0)
+            goto done;
+        retval = 0;
+        goto done;
+    }
+    switch (t){
+    case CGV_INT8:
+        cv->var_int8 = (int8_t)i64;
+        break;
+    case CGV_INT16:
+        cv->var_int16 = (int16_t)i64;
+        break;
+    case CGV_INT32:
+        cv->var_int32 = (int32_t)i64;
+        break;
+    case CGV_INT64:
+        cv->var_int64 = i64;
+        break;
+    case CGV_UINT8:
+        cv->var_uint8 = (uint8_t)u64;
+        break;
+    case CGV_UINT16:
+        cv->var_uint16 = (uint16_t)u64;
+        break;
+    case CGV_UINT32:
+        cv->var_uint32 = (uint32_t)u64;
+        break;
+    default:
+        cv->var_uint64 = u64;
+        break;
+    }
+    retval = 1;
+ done:
+    return retval;
+}
+
 static int
 cv_cmp_int64_uint64(int64_t  i64,
                     uint64_t u64)
@@ -3809,6 +4193,35 @@ cv_new(enum cv_type type)
     return cv;
 }
 
+/*! Initialize caller-provided storage of a CLIgen variable, eg on the stack
+ *
+ * @param[in] cv    Storage of a cv, see struct cg_var in cligen_cv_internal.h
+ * @param[in] type  Type of variable
+ * @retval    cv    Initialized cv
+ * @see cv_parse_scratch
+ */
+cg_var *
+cv_init(cg_var      *cv,
+        enum cv_type type)
+{
+    memset(cv, 0, sizeof(*cv));
+    cv->var_type = type;
+    return cv;
+}
+
+/*! Reset a cv parsed by cv_parse_scratch, only free what is not in the arena
+ *
+ * The type is maintained after reset.
+ * @param[in] cv    CLIgen variable
+ */
+int
+cv_reset_scratch(cg_var *cv)
+{
+    if (cv_isstring(cv->var_type))
+        cv->var_string = NULL;  /* All strings have the same address */
+    return cv_reset(cv);
+}
+
 /*! Free pointers and resets a single CLIgen variable cv
  *
  * But does not free the cgv itself!
@@ -91,6 +91,9 @@ enum cv_type{
                     (t)==CGV_UINT8  || (t)==CGV_UINT16|| \
                     (t)==CGV_UINT32 || (t)==CGV_UINT64)
 
+/* Bit of type in a mask as returned by cv_str2typemask() */
+#define cv_typemask(t) ((uint64_t)1<<(t))
+
 /* No pointers to value */
 #define cv_inline(t)((t)==CGV_ERR      || cv_isint(t)|| \
                      (t)==CGV_DEC64    || (t)==CGV_BOOL|| \
@@ -120,6 +123,8 @@ struct cg_obj;     /* forward declaration. Original in cligen_object.h */
 
 struct cg_varspec; /* forward declaration. Original in cligen_object.h */
 
+struct cligen_arena; /* forward declaration. Original in cligen_arena.c */
+
 /*
  * Prototypes
  */
@@ -224,11 +229,16 @@ int     cv_cp(cg_var *n, cg_var *old);
 cg_var *cv_dup(cg_var *old);
 int     cv_parse(const char *str, cg_var *cgv);
 int     cv_parse1(const char *str, cg_var *cgv, char **reason); /* better err-handling */
+int     cv_parse_scratch(const char *str, cg_var *cv, struct cligen_arena *ca, char **reason);
+uint64_t cv_str2typemask(const char *str);
 
 int     cv_validate(cligen_handle h, cg_var *cv, struct cg_varspec *cs, const char *cmd, char **reason);
+int     cv_parse_int1(const char *str, cg_var *cv, struct cg_varspec *cs, char **reason, int *is_constraint);
 int     cv_reset(cg_var *cgv); /* not free cgv itself */ /* XXX: free_only */
 int     cv_free(cg_var *cv);   /* free cgv itself */
 cg_var *cv_new(enum cv_type type);
+cg_var *cv_init(cg_var *cv, enum cv_type type);
+int     cv_reset_scratch(cg_var *cv);
 
 size_t  cv_size(cg_var *cv);
 
@@ -56,6 +56,7 @@
 #include "cligen_buf.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
+#include "cligen_arena.h"
 #include "cligen_parsetree.h"
 #include "cligen_callback.h"
 #include "cligen_object.h"
@@ -155,6 +156,7 @@ cvec_init(cvec *cvv,
           int   len)
 {
     cvv->vr_len = len;
+    cvv->vr_names = 0;
     if (len && (cvv->vr_vec = calloc(cvv->vr_len, sizeof(cg_var))) == NULL)
         return -1;
     return 0;
@@ -236,6 +238,7 @@ cvec_add(cvec        *cvv,
         cvv->vr_vec = tmp;
     }
     cvv->vr_len = len;
+    cvv->vr_names = 0;
     cv = cvec_i(cvv, len-1);
     memset(cv, 0, sizeof(*cv));
     cv->var_type = type;
@@ -295,6 +298,7 @@ cvec_del(cvec   *cvv,
     }
     if (i >= cvec_len(cvv)) /* Not found !?! */
         return cvec_len(cvv);
+    cvv->vr_names = 0;
 
     if (i != cvec_len(cvv)-1) /* If not last entry, move the remaining cv's */
         memmove(&cvv->vr_vec[i], &cvv->vr_vec[i+1],
@@ -340,6 +344,7 @@ cvec_del_i(cvec *cvv,
                 (cvv->vr_len-i-1) * sizeof(cvv->vr_vec[0]));
 
     cvv->vr_len--;
+    cvv->vr_names = 0;
 
     return cvec_len(cvv);
 }
@@ -692,6 +697,44 @@ cvec_size(cvec *cvv)
     return sz;
 }
 
+/*! Get a signature of the names of the elements of a cligen variable vector
+ *
+ * Each name sets one of 63 bits given by a hash of the name. If the signatures of two
+ * vectors have no bit in common, no name is in both vectors. Otherwise names need to be
+ * compared.
+ * The signature is computed on first use and kept until an element is added or deleted.
+ * @param[in]  cvv  Cligen variable vector, or NULL
+ * @retval     sig  Signature of names, 0 if there are no names
+ * @note Renaming an element in place with cv_name_set() is not seen until the vector is
+ *       modified
+ */
+uint64_t
+cvec_names_sig(cvec *cvv)
+{
+    uint64_t sig;
+    uint64_t hash;
+    cg_var  *cv = NULL;
+    char    *s;
+
+    if (cvv == NULL)
+        return 0;
+    if (cvv->vr_names)
+        return cvv->vr_names & ~CVEC_NAMES_VALID;
+    sig = 0;
+    while ((cv = cvec_each(cvv, cv)) != NULL){
+        if ((s = cv_name_get(cv)) == NULL)
+            continue;
+        hash = 14695981039346656037ULL; /* FNV-1a */
+        while (*s){
+            hash ^= (uint8_t)*s++;
+            hash *= 1099511628211ULL;
+        }
+        sig |= 1ULL << (hash % 63);
+    }
+    cvv->vr_names = sig | CVEC_NAMES_VALID;
+    return sig;
+}
+
 int
 cligen_txt2cvv(const char *str,
                cvec      **cvp)
@@ -758,15 +801,17 @@ cligen_txt2cvv(const char *str,
  * @param[out] token0   A malloced token.  NOTE: token must be freed after use.
  * @param[out] rest0    A remaining (rest) string.  NOTE: NOT malloced.
  * @param[out] leading0 If leading delimiters eg " thisisatoken"
+ * @param[in]  ca       Scratch arena of token, or NULL to use malloc
  * Example:
  *   s0 = "  foo bar"
  * results in token="foo", leading=1
  */
 static int
-next_token(char **s0,
-           char **token0,
-           char **rest0,
-           int   *leading0)
+next_token(char         **s0,
+           char         **token0,
+           char         **rest0,
+           int           *leading0,
+           cligen_arena  *ca)
 {
     char  *s;
     char  *st;
@@ -840,7 +885,11 @@ next_token(char **s0,
             goto done;
         }
     }
-    if ((token=malloc(len+1)) == NULL){
+    if (ca)
+        token = cligen_arena_alloc(ca, len+1);
+    else
+        token = malloc(len+1);
+    if (token == NULL){
         fprintf(stderr, "%s: malloc: %s\n", __FUNCTION__, strerror(errno));
         return -1;
     }
@@ -853,31 +902,71 @@ next_token(char **s0,
     return 0;
 }
 
-/*! Split a CLIgen command string into a cligen variable vector using delimeters and escape quotes
+/*! Append a string cv to a token vector of cligen_str2cvv
+ *
+ * @param[in]  cvv   Cligen variable vector
+ * @param[in]  type  Type of cv
+ * @param[in]  name  Name of cv, or NULL
+ * @param[in]  str   String value, copied
+ * @param[in]  ca    Scratch arena of vector and strings, or NULL to use malloc
+ * @retval     0     OK
+ * @retval    -1     Error
+ * In the arena the vector is reallocated when its length is a power of two from 8,
+ * the old vector is released with the arena.
+ */
+static int
+str2cvv_add(cvec         *cvv,
+            enum cv_type  type,
+            const char   *name,
+            const char   *str,
+            cligen_arena *ca)
+{
+    cg_var *cv;
+    cg_var *vec;
+    int     len;
+
+    if (ca == NULL){
+        if ((cv = cvec_add(cvv, type)) == NULL)
+            return -1;
+        if (name && cv_name_set(cv, name) == NULL)
+            return -1;
+        if (cv_string_set(cv, str) == NULL) /* XXX memleak */
+            return -1;
+        return 0;
+    }
+    len = cvv->vr_len;
+    if (len == 0 || (len >= 8 && (len & (len-1)) == 0)){
+        if ((vec = cligen_arena_alloc(ca, (len?2*len:8)*sizeof(cg_var))) == NULL)
+            return -1;
+        if (len)
+            memcpy(vec, cvv->vr_vec, len*sizeof(cg_var));
+        cvv->vr_vec = vec;
+    }
+    cv = &cvv->vr_vec[len];
+    memset(cv, 0, sizeof(*cv));
+    cv->var_type = type;
+    if (name && (cv->var_name = cligen_arena_strdup(ca, name)) == NULL)
+        return -1;
+    if ((cv->var_string = cligen_arena_strdup(ca, str)) == NULL)
+        return -1;
+    cvv->vr_len++;
+    return 0;
+}
+
+/*! Split a command string into token and rest vectors, see cligen_str2cvv
  *
  * @param[in]  string String to split
+ * @param[in]  ca     Scratch arena of vectors and strings, or NULL to use malloc
  * @param[out] cvtp   CLIgen variable vector, containing all tokens.
  * @param[out] cvrp   CLIgen variable vector, containing the remaining strings.
  * @retval     0      OK
  * @retval    -1      Error
- * @code
- *   cvec  *cvt = NULL;
- *   cvec  *cvr = NULL;
- *   if (cligen_str2cvv("a=b&c=d", " \t", "\"", &cvt, &cvt) < 0)
- *     err;
- *   ...
- *   cvec_free(cvt);
- *   cvec_free(cvr);
- * @endcode
- * Example, input string "aa bb cc" (0th element is always whole string)
- *   cvp : ["aa bb cc", "aa", "bb", "cc"]
- *   cvr : ["aa bb cc", "aa bb cc", "bb cc", "cc"]
- * @note both out cvv:s should be freed with cvec_free()
  */
-int
-cligen_str2cvv(const char *string,
-               cvec      **cvtp,
-               cvec      **cvrp)
+static int
+str2cvv(const char   *string,
+        cligen_arena *ca,
+        cvec        **cvtp,
+        cvec        **cvrp)
 {
     int     retval = -1;
     char   *s;
@@ -885,22 +974,34 @@ cligen_str2cvv(const char *string,
     char   *s0 = NULL;;
     cvec   *cvt = NULL; /* token vector */
     cvec   *cvr = NULL; /* rest vector */
-    cg_var *cv;
     char   *t = NULL;
     int     trail;
     int     i;
 
-    if ((s0 = strdup(string)) == NULL)
-        goto done;
+    if (ca){
+        if ((s0 = cligen_arena_strdup(ca, string)) == NULL ||
+            (cvt = cligen_arena_alloc(ca, sizeof(*cvt))) == NULL ||
+            (cvr = cligen_arena_alloc(ca, sizeof(*cvr))) == NULL)
+            goto done;
+        memset(cvt, 0, sizeof(*cvt));
+        memset(cvr, 0, sizeof(*cvr));
+        if (str2cvv_add(cvt, CGV_REST, "cmd", string, ca) < 0 ||
+            str2cvv_add(cvr, CGV_REST, "cmd", string, ca) < 0)
+            goto done;
+    }
+    else{
+        if ((s0 = strdup(string)) == NULL)
+            goto done;
+        if ((cvt = cvec_start(string)) ==NULL)
+            goto done;
+        if ((cvr = cvec_start(string)) ==NULL)
+            goto done;
+    }
     s = s0;
-    if ((cvt = cvec_start(string)) ==NULL)
-        goto done;
-    if ((cvr = cvec_start(string)) ==NULL)
-        goto done;
     i = 0;
     while (s != NULL) {
         t = NULL;
-        if (next_token(&s, &t, &sr, &trail) < 0)
+        if (next_token(&s, &t, &sr, &trail, ca) < 0)
             goto done;
         /* If there is no token, stop,
          * unless it is the intial token (empty string) OR there are trailing whitespace
@@ -908,15 +1009,11 @@ cligen_str2cvv(const char *string,
          */
         if (t == NULL && !trail && i > 0)
             break;
-        if ((cv = cvec_add(cvr, CGV_STRING)) == NULL)
-            goto done;
-        if (cv_string_set(cv, sr?sr:"") == NULL) /* XXX memleak */
+        if (str2cvv_add(cvr, CGV_STRING, NULL, sr?sr:"", ca) < 0)
             goto done;
-        if ((cv = cvec_add(cvt, CGV_STRING)) == NULL)
+        if (str2cvv_add(cvt, CGV_STRING, NULL, t?t:"", ca) < 0)
             goto done;
-        if (cv_string_set(cv, t?t:"") == NULL) /* XXX memleak */
-            goto done;
-        if (t){
+        if (t && ca == NULL){
             free(t);
             t = NULL;
         }
@@ -932,17 +1029,75 @@ cligen_str2cvv(const char *string,
         cvr = NULL;
     }
  done:
-    if (t)
-        free(t);
-    if (s0)
-        free(s0);
-    if (cvt)
-        cvec_free(cvt);
-    if (cvr)
-        cvec_free(cvr);
+    if (ca == NULL){
+        if (t)
+            free(t);
+        if (s0)
+            free(s0);
+        if (cvt)
+            cvec_free(cvt);
+        if (cvr)
+            cvec_free(cvr);
+    }
     return retval;
 }
 
+/*! Split a CLIgen command string into a cligen variable vector using delimeters and escape quotes
+ *
+ * @param[in]  string String to split
+ * @param[out] cvtp   CLIgen variable vector, containing all tokens.
+ * @param[out] cvrp   CLIgen variable vector, containing the remaining strings.
+ * @retval     0      OK
+ * @retval    -1      Error
+ * @code
+ *   cvec  *cvt = NULL;
+ *   cvec  *cvr = NULL;
+ *   if (cligen_str2cvv("a=b&c=d", " \t", "\"", &cvt, &cvt) < 0)
+ *     err;
+ *   ...
+ *   cvec_free(cvt);
+ *   cvec_free(cvr);
+ * @endcode
+ * Example, input string "aa bb cc" (0th element is always whole string)
+ *   cvp : ["aa bb cc", "aa", "bb", "cc"]
+ *   cvr : ["aa bb cc", "aa bb cc", "bb cc", "cc"]
+ * @note both out cvv:s should be freed with cvec_free()
+ * @see cligen_str2cvv_scratch
+ */
+int
+cligen_str2cvv(const char *string,
+               cvec      **cvtp,
+               cvec      **cvrp)
+{
+    return str2cvv(string, NULL, cvtp, cvrp);
+}
+
+/*! Split a CLIgen command string into token vectors in a scratch arena
+ *
+ * As cligen_str2cvv but the vectors and their strings are allocated in the arena,
+ * typically the arena of a request, see cligen_scratch_request
+ * @param[in]  string String to split
+ * @param[in]  ca     Scratch arena, valid as long as the vectors are used
+ * @param[out] cvtp   CLIgen variable vector, containing all tokens.
+ * @param[out] cvrp   CLIgen variable vector, containing the remaining strings.
+ * @retval     0      OK
+ * @retval    -1      Error
+ * @note Do not free the vectors, or reset or add to them. Removing the last elements
+ *       with cvec_del_i() is allowed
+ */
+int
+cligen_str2cvv_scratch(const char          *string,
+                       struct cligen_arena *ca,
+                       cvec               **cvtp,
+                       cvec               **cvrp)
+{
+    if (ca == NULL){
+        errno = EINVAL;
+        return -1;
+    }
+    return str2cvv(string, ca, cvtp, cvrp);
+}
+
 /*! Replace the original string in first position with expanded string
  *
  * @param[in,out]  cvv  Change first element
@@ -72,8 +72,10 @@ char   *cvec_find_str(cvec *vr, const char *name);
 char   *cvec_name_get(cvec *vr);
 char   *cvec_name_set(cvec *vr, const char *name);
 size_t  cvec_size(cvec *cvv);
+uint64_t cvec_names_sig(cvec *cvv);
 int     cligen_txt2cvv(const char *str, cvec **cvp);
 int     cligen_str2cvv(const char *string, cvec **cvp, cvec **cvr);
+int     cligen_str2cvv_scratch(const char *string, struct cligen_arena *ca, cvec **cvp, cvec **cvr);
 int     cvec_expand_first(cvec *cvv);
 int     cvec_exclude_keys(cvec *cvv);
 
@@ -38,6 +38,11 @@
 #ifndef _CLIGEN_CVEC_INTERNAL_H_
 #define _CLIGEN_CVEC_INTERNAL_H_
 
+/*
+ * Constants
+ */
+#define CVEC_NAMES_VALID 0x8000000000000000ULL /* vr_names is computed */
+
 /*
  * Types
  */
@@ -45,6 +50,8 @@ struct cvec{
     cg_var         *vr_vec;  /* vector of CLIgen variables */
     int             vr_len;  /* length of vector */
     char           *vr_name; /* name of cvec, can be NULL */
+    uint64_t        vr_names; /* Signature of names of elements, 0 if not computed,
+                               * reset when elements are added or deleted, see cvec_names_sig */
 };
 
 #endif /* _CLIGEN_CVEC_INTERNAL_H_ */
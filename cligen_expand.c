@@ -60,7 +60,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/time.h>
 #include <netinet/in.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "cligen_buf.h"
 #include "cligen_cv.h"
@@ -73,17 +77,278 @@
 #include "cligen_print.h"
 #include "cligen_expand.h"
 #include "cligen_syntax.h"
+#include "cligen_handle_internal.h"
 #include "banned.h"
 
+/*
+ * Constants
+ */
+/* Max number of expanded parse-trees in the expand cache of a handle */
+#define PT_EXPAND_CACHE_MAX 64
+
+/* Max number of shallow expansions of tree references in the treeref cache of a handle */
+#define PT_TREEREF_CACHE_MAX 64
+
+/* Max number of cached expand callback results of a handle */
+#define PT_EXPAND_FN_CACHE_MAX 128
+
+/* Helptext of a variable whose expand callback has not returned before the deadline */
+#define PT_EXPAND_FN_LOADING "(still loading)"
+
+/* Max number of expand callbacks running in worker threads of a handle */
+#define PT_EXPAND_FN_JOBS_MAX 16
+
+/* Time in ms the result of an asynchronous expand callback without time-to-live is kept */
+#define PT_EXPAND_FN_ASYNC_TTL 10000
+
+/*
+ * Types
+ */
+/*! Parse-trees an expansion depends on and their generations when it was made
+ *
+ * The expanded tree and the trees resolved by tree references, see pt_expand_deps_add
+ */
+struct pt_expand_deps{
+    int                 pd_len;  /* Number of trees */
+    parse_tree        **pd_ptv;  /* Trees */
+    uint64_t           *pd_genv; /* Generations of trees, see pt_tree_generation_get */
+};
+
+/*! Cached expanded parse-tree
+ *
+ * The key is the original parse-tree and the parameters the expansion depends on
+ * @see pt_expand_cached
+ */
+struct pt_expand_entry{
+    struct pt_expand_entry *pe_next;
+    parse_tree  *pe_pt;        /* Key: original parse-tree */
+    cvec        *pe_filter;    /* Key: filter labels of parent (copy) */
+    char        *pe_pipe;      /* Key: name of default output pipe tree, or NULL */
+    char        *pe_prefix;    /* Key: prefix of tree reference keywords, or NULL */
+    int          pe_hide;      /* Key: hidden commands are not included */
+    int          pe_expandvar; /* Key: variables are expanded */
+    parse_tree  *pe_ptn;       /* Expanded parse-tree */
+    int          pe_busy;      /* Used by an ongoing match, see pt_expand_release */
+    int          pe_stale;     /* Flushed while busy, free on release */
+    uint64_t     pe_id;        /* Unique id of this entry in the handle, never reused */
+    struct pt_expand_deps pe_deps; /* Trees the expansion depends on */
+};
+
+/*! Cache of expanded parse-trees of a CLIgen handle
+ */
+struct pt_expand_cache{
+    uint64_t                pc_generation; /* Global parse-tree generation of the entries */
+    uint64_t                pc_ph_generation; /* Parse-tree head generation of the handle */
+    int                     pc_volatile;   /* Incremented when an expansion depends on input */
+    int                     pc_len;        /* Number of entries */
+    struct pt_expand_entry *pc_entries;    /* Entries, most recently used first */
+};
+
+/*! Cached shallow expansion of a tree reference
+ *
+ * The top-level objects of the referenced tree copied by co_expand_treeref_copy_shallow.
+ * The copies depend on the reference object: its parent, co_ref and filter labels.
+ * @see pt_expand_reference
+ */
+struct pt_treeref_entry{
+    struct pt_treeref_entry *te_next;
+    cg_obj      *te_coref;     /* Key: tree reference object */
+    parse_tree  *te_ptco;      /* Key: parse-tree of tree reference object */
+    parse_tree  *te_ptref;     /* Key: referenced tree, after tree resolve wrapper */
+    uint32_t     te_flags;     /* Key: flags of treeref flags callback */
+    parse_tree  *te_pttmp;     /* Shallow expansion */
+    int          te_busy;      /* Used by an ongoing expansion */
+    int          te_stale;     /* Flushed while busy, free when not used */
+    struct pt_expand_deps te_deps; /* Trees the expansion depends on */
+};
+
+/*! Cache of shallow expansions of tree references of a CLIgen handle
+ */
+struct pt_treeref_cache{
+    uint64_t                 tc_generation; /* Global parse-tree generation of the entries */
+    uint64_t                 tc_ph_generation; /* Parse-tree head generation of the handle */
+    int                      tc_volatile;   /* Incremented when a tree is resolved by callback */
+    int                      tc_len;        /* Number of entries */
+    struct pt_treeref_entry *tc_entries;    /* Entries, most recently used first */
+};
+
+/*! Options of an expand callback
+ *
+ * @see pt_expand_fn_ttl_set
+ * @see pt_expand_fn_async_set
+ */
+struct pt_expand_fn_opt{
+    struct pt_expand_fn_opt *eo_next;
+    char                    *eo_fn_str; /* Name of expand callback, NULL for default */
+    uint32_t                 eo_ttl;    /* Time-to-live of cached results in ms, 0: not cached */
+    int                      eo_async;  /* Invoke callback in a worker thread */
+};
+
+/*! Cached result of an expand callback
+ *
+ * The key is the callback name, its arguments, and the labels and variables it
+ * was called with
+ * @see pt_expand_fn
+ */
+struct pt_expand_fn_entry{
+    struct pt_expand_fn_entry *ee_next;
+    char                      *ee_fn_str;    /* Name of expand callback */
+    char                      *ee_key;       /* Key: encoded callback name and input */
+    cvec                      *ee_commands;  /* Commands returned by callback */
+    cvec                      *ee_helptexts; /* Helptexts returned by callback */
+    struct timeval             ee_expires;   /* Entry is valid until this time */
+    int                        ee_once;      /* Removed when used, see pt_expand_fn_reap */
+};
+
+#ifdef HAVE_LIBPTHREAD
+/*! Expand callback invoked in a worker thread
+ *
+ * @see pt_expand_fn_async
+ */
+struct pt_expand_fn_job{
+    struct pt_expand_fn_job   *ej_next;
+    char                      *ej_key;       /* Encoded callback name and input, as ee_key */
+    char                      *ej_fn_str;    /* Name of expand callback */
+    expand_cb                 *ej_fn;        /* Expand callback */
+    void                      *ej_h;         /* Handle given to callback */
+    cvec                      *ej_cvv;       /* Variables (copy) */
+    cvec                      *ej_argv;      /* Callback arguments (copy) */
+    cvec                      *ej_commands;  /* Commands returned by callback */
+    cvec                      *ej_helptexts; /* Helptexts returned by callback */
+    uint32_t                   ej_ttl;       /* Time-to-live of result in the cache */
+    int                        ej_stale;     /* Invalidated while running, result is dropped */
+    pthread_mutex_t            ej_mutex;     /* Protects ej_retval, ej_done and ej_detached */
+    pthread_cond_t             ej_cond;      /* Signalled when the callback has returned */
+    int                        ej_retval;    /* Return value of callback */
+    int                        ej_done;      /* Callback has returned */
+    int                        ej_detached;  /* Abandoned by the handle, the worker frees the job */
+    pthread_t                  ej_thread;    /* Worker thread */
+};
+#endif /* HAVE_LIBPTHREAD */
+
+/*! Cache of expand callback results of a CLIgen handle
+ */
+struct pt_expand_fn_cache{
+    struct pt_expand_fn_opt   *ec_opts;    /* Options of expand callbacks */
+    struct pt_expand_fn_entry *ec_entries; /* Entries, most recently used first */
+    int                        ec_len;     /* Number of entries */
+#ifdef HAVE_LIBPTHREAD
+    struct pt_expand_fn_job   *ec_jobs;    /* Jobs not yet collected */
+    int                        ec_njobs;   /* Number of jobs */
+#endif
+};
+
+/*! Mark that the ongoing expansion depends on input or callbacks and cannot be cached
+ *
+ * @param[in]  h   CLIgen handle
+ * @see pt_expand_cached
+ */
+static void
+pt_expand_volatile(cligen_handle h)
+{
+    struct pt_expand_cache *pc;
+
+    if ((pc = handle(h)->ch_expand_cache) != NULL)
+        pc->pc_volatile++;
+}
+
+/*! Add a parse-tree to the trees an expansion depends on
+ *
+ * @param[in]  pd   Dependencies, or NULL if not collected
+ * @param[in]  pt   Parse-tree
+ * @param[in]  gen  Generation of pt when used
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+pt_expand_deps_add(struct pt_expand_deps *pd,
+                   parse_tree            *pt,
+                   uint64_t               gen)
+{
+    parse_tree **ptv;
+    uint64_t    *genv;
+    int          i;
+
+    if (pd == NULL || pt == NULL)
+        return 0;
+    for (i=0; i<pd->pd_len; i++)
+        if (pd->pd_ptv[i] == pt)
+            return 0;
+    if ((ptv = realloc(pd->pd_ptv, (pd->pd_len+1)*sizeof(*ptv))) == NULL)
+        return -1;
+    pd->pd_ptv = ptv;
+    if ((genv = realloc(pd->pd_genv, (pd->pd_len+1)*sizeof(*genv))) == NULL)
+        return -1;
+    pd->pd_genv = genv;
+    pd->pd_ptv[pd->pd_len] = pt;
+    pd->pd_genv[pd->pd_len] = gen;
+    pd->pd_len++;
+    return 0;
+}
+
+/*! Add the dependencies of a cached expansion used by the ongoing expansion
+ *
+ * @param[in]  pd   Dependencies of the ongoing expansion, or NULL if not collected
+ * @param[in]  pd1  Dependencies of the cached expansion
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+pt_expand_deps_merge(struct pt_expand_deps *pd,
+                     struct pt_expand_deps *pd1)
+{
+    int i;
+
+    for (i=0; i<pd1->pd_len; i++)
+        if (pt_expand_deps_add(pd, pd1->pd_ptv[i], pd1->pd_genv[i]) < 0)
+            return -1;
+    return 0;
+}
+
+/*! Check that none of the trees an expansion depends on has changed
+ *
+ * The trees are alive: they are the original tree of the expansion, which is the key of
+ * its cache entry, and trees of parse-tree heads, whose changes flush the cache.
+ * @param[in]  pd   Dependencies
+ * @retval     1    Valid
+ * @retval     0    A tree has changed
+ */
+static int
+pt_expand_deps_valid(struct pt_expand_deps *pd)
+{
+    int i;
+
+    for (i=0; i<pd->pd_len; i++)
+        if (pt_tree_generation_get(pd->pd_ptv[i]) != pd->pd_genv[i])
+            return 0;
+    return 1;
+}
+
+/*! Free the vectors of dependencies
+ */
+static void
+pt_expand_deps_free(struct pt_expand_deps *pd)
+{
+    if (pd->pd_ptv)
+        free(pd->pd_ptv);
+    if (pd->pd_genv)
+        free(pd->pd_genv);
+    memset(pd, 0, sizeof(*pd));
+}
+
 /*! Copy and expand a cligen object.
  *
  * This object could actually give rise to several if it is a variable
  * with expand (co_exp) or choice (co_choice) set.
  * Set co_ref to point back to the original.
+ * The new object is a proxy: it borrows command, prefix, callbacks, cvec, helpstring
+ * and variable spec from the original instead of copying them, see CO_BORROW_*.
+ * Only value, filter, flags and refs are owned by the proxy.
  * @param[in]  co0      Original cg_obj
  * @param[in]  coparent Parent of original co object (as well as of conp)
  * @param[out] conp     New "shadow" object
  * @see pt_expand_treeref_one
+ * @see co_unborrow  Before modifying borrowed fields in place
  */
 static int
 co_expand_sub(cg_obj  *co0,
@@ -101,70 +366,35 @@ co_expand_sub(cg_obj  *co0,
     /* Point to same underlying pt */
     con->co_ptvec = NULL;
     con->co_pt_len = 0;
+    con->co_flags &= ~CO_FLAGS_FROZEN;
+    con->co_filter = NULL;
+    con->co_value = NULL;
+    /* Borrow non-NULL fields, fields set later on the proxy are owned */
+    con->co_borrow = 0;
+    if (con->co_command)
+        con->co_borrow |= CO_BORROW_COMMAND;
+    if (con->co_prefix)
+        con->co_borrow |= CO_BORROW_PREFIX;
+    if (con->co_callbacks)
+        con->co_borrow |= CO_BORROW_CALLBACKS;
+    if (con->co_cvec)
+        con->co_borrow |= CO_BORROW_CVEC;
+    if (con->co_helpstring)
+        con->co_borrow |= CO_BORROW_HELPSTRING;
+    if (con->co_type == CO_VARIABLE)
+        con->co_borrow |= CO_BORROW_VARSPEC;
+    /* co0 is itself expanded and may be freed first: only borrow what it borrows */
+    if (co0->co_ref &&
+        co_unborrow(con, ~co0->co_borrow) < 0)
+        goto done;
     if (co_pt_set(con, co_pt_get(co0)) < 0)
         goto done;
-    /* Replace all pointers */
     co_up_set(con, coparent);
-    if (co0->co_command)
-        if ((con->co_command = strdup(co0->co_command)) == NULL){
-            fprintf(stderr, "%s: strdup: %s\n", __FUNCTION__, strerror(errno));
-            goto done;
-        }
-    if (co0->co_prefix)
-        if ((con->co_prefix = strdup(co0->co_prefix)) == NULL){
-            fprintf(stderr, "%s: strdup: %s\n", __FUNCTION__, strerror(errno));
-            goto done;
-        }
-    if (co0->co_cvec)
-        con->co_cvec = cvec_dup(co0->co_cvec);
-    if (co0->co_filter)
-        co_filter_set(con, co0->co_filter);
-    if (co_callback_copy(co0->co_callbacks, &con->co_callbacks) < 0)
+    if (co0->co_filter &&
+        co_filter_set(con, co0->co_filter) == NULL)
+        goto done;
+    if (co_value_set(con, co0->co_value) < 0)
         goto done;
-    if (co0->co_helpstring)
-        if ((con->co_helpstring = strdup(co0->co_helpstring)) == NULL)
-            goto done;
-    if (co0->co_type == CO_VARIABLE){
-        if (co0->co_expand_fn_str)
-            if ((con->co_expand_fn_str = strdup(co0->co_expand_fn_str)) == NULL){
-                fprintf(stderr, "%s: strdup: %s\n", __FUNCTION__, strerror(errno));
-                goto done;
-            }
-        if (co0->co_expand_fn_vec)
-            if ((con->co_expand_fn_vec = cvec_dup(co0->co_expand_fn_vec)) == NULL)
-                goto done;
-        if (co0->co_translate_fn_str)
-            if ((con->co_translate_fn_str = strdup(co0->co_translate_fn_str)) == NULL){
-                fprintf(stderr, "%s: strdup: %s\n", __FUNCTION__, strerror(errno));
-                goto done;
-            }
-        if (co0->co_show)
-            if ((con->co_show = strdup(co0->co_show)) == NULL){
-                fprintf(stderr, "%s: strdup: %s\n", __FUNCTION__, strerror(errno));
-                goto done;
-            }
-        if (co0->co_rangecvv_low)
-            if ((con->co_rangecvv_low = cvec_dup(co0->co_rangecvv_low)) == NULL)
-                goto done;
-        if (co0->co_rangecvv_upp)
-            if ((con->co_rangecvv_upp = cvec_dup(co0->co_rangecvv_upp)) == NULL)
-                goto done;
-        if (co0->co_choice)
-            if ((con->co_choice = strdup(co0->co_choice)) == NULL){
-                fprintf(stderr, "%s: strdup: %s\n", __FUNCTION__, strerror(errno));
-                goto done;
-            }
-        if (co0->co_choice_help)
-            if ((con->co_choice_help = strdup(co0->co_choice_help)) == NULL){
-                fprintf(stderr, "%s: strdup: %s\n", __FUNCTION__, strerror(errno));
-                goto done;
-            }
-        if (co0->co_regex)
-            if ((con->co_regex = cvec_dup(co0->co_regex)) == NULL){
-                fprintf(stderr, "%s: cvec_dup: %s\n", __FUNCTION__, strerror(errno));
-                goto done;
-            }
-    } /* CO_VARIABLE */
     con->co_ref = co0; /* Backpointer to the original node */
     *conp = con;
     con = NULL;
@@ -182,12 +412,34 @@ co_expand_sub(cg_obj  *co0,
  * @param[in]  co        The variable to transform to a command
  * @param[in]  cmd       Command name (must be malloced, consumed here)
  * @param[in]  helptext  Helptext of command, can be NULL already malloced is consumed
+ * @param[in]  borrow    If set, cmd and helptext are borrowed, not malloced, see CO_BORROW_*
  */
 static int
 transform_var_to_cmd(cg_obj *co,
                      char   *cmd,
-                     char   *helptext)
+                     char   *helptext,
+                     int     borrow)
 {
+    /* Borrowed fields are dropped, not freed */
+    if (co->co_borrow & CO_BORROW_COMMAND)
+        co->co_command = NULL;
+    if (helptext && (co->co_borrow & CO_BORROW_HELPSTRING))
+        co->co_helpstring = NULL;
+    if (co->co_borrow & CO_BORROW_VARSPEC){
+        co->co_expand_fn_str = NULL;
+        co->co_expand_fn_vec = NULL;
+        co->co_translate_fn_str = NULL;
+        co->co_show = NULL;
+        co->co_rangecvv_low = NULL;
+        co->co_rangecvv_upp = NULL;
+        co->co_choice = NULL;
+        co->co_choice_help = NULL;
+        co->co_choices = NULL;
+        co->co_regex = NULL;
+    }
+    co->co_borrow &= ~(CO_BORROW_COMMAND|CO_BORROW_VARSPEC);
+    if (helptext)
+        co->co_borrow &= ~CO_BORROW_HELPSTRING;
     if (co->co_command)
         free(co->co_command);
     co->co_command = cmd;
@@ -232,11 +484,20 @@ transform_var_to_cmd(cg_obj *co,
         free(co->co_choice_help);
         co->co_choice_help = NULL;
     }
+    if (co->co_choices){
+        free(co->co_choices);
+        co->co_choices = NULL;
+    }
     if (co->co_regex){
         cvec_free(co->co_regex);
         co->co_regex = NULL;
     }
     co->co_type = CO_COMMAND;
+    if (borrow){
+        co->co_borrow |= CO_BORROW_COMMAND;
+        if (helptext)
+            co->co_borrow |= CO_BORROW_HELPSTRING;
+    }
     return 0;
 }
 
@@ -267,13 +528,20 @@ tree_resolve(cligen_handle h,
     treename = coref->co_command;
     cligen_tree_resolve_wrapper_get(h, &fn, &arg);
     if (fn){
+        pt_expand_volatile(h);
+        if (handle(h)->ch_treeref_cache)
+            handle(h)->ch_treeref_cache->tc_volatile++;
         if (fn(h, treename, cvt, arg, &treename2) < 0)
             goto done;
         if (treename2)
             treename = treename2;
     }
-    /* Get parse tree header */
-    if ((ph = cligen_ph_find(h, treename)) == NULL) {
+    /* Get parse tree header, memoized per reference unless renamed by the wrapper */
+    if (treename2 == NULL)
+        ph = cligen_ph_find_ref(h, coref);
+    else
+        ph = cligen_ph_find(h, treename);
+    if (ph == NULL) {
         fprintf(stderr, "CLIgen tree '%s' not found\n", treename);
         goto done;
     }
@@ -284,6 +552,9 @@ tree_resolve(cligen_handle h,
         *ptrefp = co_pt_get(cow);
     else
         *ptrefp = cligen_ph_parsetree_get(ph);
+    if (pt_expand_deps_add(handle(h)->ch_expand_deps, *ptrefp,
+                           pt_tree_generation_get(*ptrefp)) < 0)
+        goto done;
     retval = 0;
  done:
     if (treename2)
@@ -430,11 +701,11 @@ co_expand_treeref_copy_shallow(cligen_handle h,
              * This actually seems to be to the treehead?
              */
             con->co_ref = co0;
-            co_flags_set(con, CO_FLAGS_TOPOFTREE); /* Mark expanded refd tree */
+            /* Mark expanded refd tree and propagate application-defined flags from the
+             * enclosing expansion. The copy is in no tree yet, so the tree of its parent
+             * is not changed */
+            con->co_flags |= CO_FLAGS_TOPOFTREE | inherit_flags;
             con->co_treeref_orig = cot;
-            /* Propagate application-defined flags from the enclosing expansion */
-            if (inherit_flags)
-                co_flags_set(con, inherit_flags);
             if (cvec_len(cvv_filter) &&
                 co_filter_set(con, cvv_filter) == NULL)
                 goto done;
@@ -542,199 +813,849 @@ cligen_escape_do(const char *s0)
     return s1;
 }
 
-/*! Call expand callback and insert expanded commands in place of variable
+/*! Free a cached expand callback result
+ */
+static void
+pt_expand_fn_entry_free(struct pt_expand_fn_entry *ee)
+{
+    if (ee->ee_key)
+        free(ee->ee_key);
+    if (ee->ee_fn_str)
+        free(ee->ee_fn_str);
+    if (ee->ee_commands)
+        cvec_free(ee->ee_commands);
+    if (ee->ee_helptexts)
+        cvec_free(ee->ee_helptexts);
+    free(ee);
+}
+
+/*! Get options of an expand callback
  *
- * Variable argument callback variant
- * @param[in]  h          CLIgen handle
- * @param[in]  co         CLIgen object
- * @param[in]  co_parent  CLIgen object parent
- * @param[out] cvv_var    Cligen variable vector containing vars/values pair for completion
- * @param[in]  cvv_filter Add these to expanded nodes co_filter, eg remove them
- * @param[in]  callbacks  Callback structure of expanded treeref
- * @param[in]  transient  co may be "transient" if so use co->co_ref as new co_ref,...
- * @param[out] ptn        New parse-tree initially an empty pointer, its value is returned.
- * @retval     0          OK
- * @retval    -1          Error
- * This is the only place where expand callbacks are invoked
- * @see cligen_eval where cligen callbacks are invoked
+ * @param[in]  h       CLIgen handle
+ * @param[in]  fn_str  Name of expand callback
+ * @retval     eo      Options of the callback, or the default options
+ * @retval     NULL    No options, ie results are not cached and callback is synchronous
  */
-static int
-pt_expand_fn(cligen_handle h,
-             cg_obj       *co,
-             cg_obj       *co_parent,
-             cvec         *cvv_var,
-             cvec         *cvv_filter,
-             cg_callback  *callbacks,
-             int           transient,
-             parse_tree   *ptn)
+static struct pt_expand_fn_opt *
+pt_expand_fn_opt(cligen_handle h,
+                 const char   *fn_str)
 {
-    int         retval = -1;
-    cvec       *commands = NULL;
-    cvec       *helptexts = NULL;
-    cg_var     *cv;
-    char       *helpstr = NULL;
-    cg_obj     *con = NULL;
-    int         i;
-    const char *value;
-    const char *cmd;
-    cvec       *cvv1 = NULL; /* Modified */
-    int         co_cvec_add = 0;
+    struct pt_expand_fn_cache *ec;
+    struct pt_expand_fn_opt   *eo;
+    struct pt_expand_fn_opt   *eodef = NULL;
 
-    if (cvv_var == NULL){
-        errno = EINVAL;
-        goto done;
-    }
-    if ((commands = cvec_new(0)) == NULL)
-        goto done;
-    if ((helptexts = cvec_new(0)) == NULL)
-        goto done;
-    /* Make a copy of cvv argument for modifications */
-    if ((cvv1 = cvec_dup(cvv_var)) == NULL)
-        goto done;
-    /* Make modifications to cvv */
-    if (cvec_exclude_keys(cvv1) < 0)
-        goto done;
-    if (callbacks && callbacks->cc_cvec){
-        cligen_callback_arguments_set(h, callbacks->cc_cvec);
-    }
-    cligen_co_match_set(h, co);     /* For eventual use in callback */
-    /* Temporary add all labels with prefix @add: */
-    cv = NULL;
-    while ((cv = cvec_each(cvv_filter, cv)) != NULL){
-        if (cv_bool_get(cv)){
-            cvec_append_var(co->co_cvec, cv);
-            co_cvec_add++;
-        }
-    }
-    if ((*co->co_expand_fn)(cligen_userhandle(h)?cligen_userhandle(h):h,
-                            co->co_expand_fn_str,
-                            cvv1,
-                            co->co_expand_fn_vec,
-                            commands,
-                            helptexts) < 0)
-        goto done;
-    /* Revert @add:s */
-    if (co_cvec_add){
-        for (i=0; i<co_cvec_add; i++){
-            if ((cv = cvec_i(co->co_cvec, cvec_len(co->co_cvec)-1)) != NULL){
-                cv_reset(cv);
-                cvec_del_i(co->co_cvec, cvec_len(co->co_cvec)-1);
-            }
-        }
-    }
-    i = 0;
-    cv = NULL;
-    while ((cv = cvec_each(commands, cv)) != NULL) {
-        if (i < cvec_len(helptexts)){
-            if ((helpstr = strdup(cv_string_get(cvec_i(helptexts, i)))) == NULL)
-                goto done;
-        }
-        else
-            helpstr = NULL;
-        i++;
-        con = NULL;
-        if (co_expand_sub(co, co_parent, &con) < 0)
-            goto done;
-        if (transient && con->co_ref){
-            con->co_ref = co->co_ref;
-        }
-        if (pt_vec_append(ptn, con) < 0)
-            goto done;
-        if (cvv_filter && cvec_len(cvv_filter))
-            if (co_filter_set(con, cvv_filter) == NULL)
-                goto done;
-        value = cv_string_get(cv);
-        if ((cmd = strdup(value)) == NULL)
-            goto done;
-        /* 'cmd' always points to mutable string, helpstr is consumed */
-        if (transform_var_to_cmd(con, (char*)cmd, helpstr) < 0){
-            helpstr = NULL;
-            goto done;
-        }
-        helpstr = NULL;
-        /* Save the unescaped string */
-        if (cmd != value)
-            co_value_set(con, (char*)value);
+    if ((ec = handle(h)->ch_expand_fn_cache) == NULL)
+        return NULL;
+    for (eo = ec->ec_opts; eo; eo = eo->eo_next){
+        if (eo->eo_fn_str == NULL)
+            eodef = eo;
+        else if (fn_str && strcmp(eo->eo_fn_str, fn_str) == 0)
+            return eo;
     }
-    retval = 0;
- done:
-    if (commands)
-        cvec_free(commands);
-    if (helptexts)
-        cvec_free(helptexts);
-    if (callbacks && callbacks->cc_cvec)
-        cligen_callback_arguments_set(h, NULL);
-    if (cvv1)
-        cvec_free(cvv1);
-    if (helpstr)
-        free(helpstr);
-    return retval;
+    return eodef;
 }
 
-/*! Expand a choice rule with actual commands
+/*! Encode a string with its length in a cache key
+ */
+static void
+pt_expand_fn_key_str(cbuf       *cb,
+                     const char *str)
+{
+    if (str == NULL)
+        str = "";
+    cprintf(cb, "%zu:%s", strlen(str), str);
+}
+
+/*! Encode name and values of a cligen vector in a cache key
  *
- * @param[in]  co         Original cligen object (to expand into ptn)
- * @param[in]  cvv_filter Add these to expanded nodes co_filter, eg remove them
- * @param[out] ptn        New parse-tree initially an empty pointer, its value is returned.
- * @retval     0          OK
- * @retval    -1          Error
+ * @param[in]  cb   Cache key
+ * @param[in]  cvv  Cligen variable vector, may be NULL
+ * @param[in]  i0   Index of first element to encode
  */
 static int
-pt_expand_choice(cg_obj       *co,
-                 cvec         *cvv_filter,
-                 parse_tree   *ptn)
+pt_expand_fn_key_cvec(cbuf *cb,
+                      cvec *cvv,
+                      int   i0)
 {
     int     retval = -1;
-    char   *ccmd;
-    char   *cp = NULL;
-    char   *cp_help = NULL;
-    char   *c;
-    char   *cdup;
-    cg_obj *con = NULL;
-    char   *helptext;
+    cg_var *cv;
+    char   *str;
+    int     i;
 
-    /* parse co_choice and get alternatives, with optional parallel help texts in co_choice_help */
-    if (co->co_choice){
-        char *helps = co->co_choice_help;   /* parallel '|'-separated helptexts, may be NULL */
-        if (helps && (cp_help = strdup(helps)) == NULL)
-            goto done;
-        char *hcmd = cp_help;
-        if ((cp = strdup(co->co_choice)) == NULL)
+    cprintf(cb, "%d|", cvec_len(cvv));
+    for (i=i0; i<cvec_len(cvv); i++){
+        cv = cvec_i(cvv, i);
+        pt_expand_fn_key_str(cb, cv_name_get(cv));
+        if ((str = cv2str_dup(cv)) == NULL)
             goto done;
-        ccmd = cp;
-        while ((c = strsep(&ccmd, ",|")) != NULL){
-            char *h = hcmd ? strsep(&hcmd, "|") : NULL;
-            helptext = NULL;
-            if (h && *h && (helptext = strdup(h)) == NULL)
-                goto done;
-            if (co_expand_sub(co, NULL, &con) < 0)
-                goto done;
-            if ((cdup = strdup(c)) == NULL)
-                goto done;
-            if (transform_var_to_cmd(con, cdup, helptext) < 0)
-                goto done;
-            if (cvv_filter && co_filter_set(con, cvv_filter) == NULL)
-                goto done;
-            /* con may be deleted in the call and need to be replaced */
-            if (co_insert1(ptn, con, 0) == NULL)
-                goto done;
-            con = NULL;
-        }
+        pt_expand_fn_key_str(cb, str);
+        free(str);
     }
     retval = 0;
  done:
-    if (cp_help)
-        free(cp_help);
-    if (con)
-        co_free(con, 0);
-    if (cp)
-        free(cp);
     return retval;
 }
 
-/*! Check if label is filtered in co
+/*! Find a cached result of an expand callback that has not expired
  *
- * @retval    1   Yes, it is filtered, remove it
+ * Expired entries are removed, and a found entry is moved first.
+ * @param[in]  ec   Expand callback cache
+ * @param[in]  key  Encoded callback name and input
+ * @retval     ee   Cached entry
+ * @retval     NULL Not found
+ */
+static struct pt_expand_fn_entry *
+pt_expand_fn_lookup(struct pt_expand_fn_cache *ec,
+                    const char                *key)
+{
+    struct pt_expand_fn_entry  *ee;
+    struct pt_expand_fn_entry **eep;
+    struct timeval              now;
+
+    gettimeofday(&now, NULL);
+    eep = &ec->ec_entries;
+    while ((ee = *eep) != NULL){
+        if (timercmp(&ee->ee_expires, &now, <)){
+            *eep = ee->ee_next;
+            pt_expand_fn_entry_free(ee);
+            ec->ec_len--;
+            continue;
+        }
+        if (strcmp(ee->ee_key, key) == 0){
+            *eep = ee->ee_next;
+            ee->ee_next = ec->ec_entries;
+            ec->ec_entries = ee;
+            return ee;
+        }
+        eep = &ee->ee_next;
+    }
+    return NULL;
+}
+
+/*! Remove an entry from the expand callback cache and free it
+ */
+static void
+pt_expand_fn_remove(struct pt_expand_fn_cache *ec,
+                    struct pt_expand_fn_entry *ee)
+{
+    struct pt_expand_fn_entry **eep;
+
+    for (eep = &ec->ec_entries; *eep; eep = &(*eep)->ee_next)
+        if (*eep == ee){
+            *eep = ee->ee_next;
+            pt_expand_fn_entry_free(ee);
+            ec->ec_len--;
+            break;
+        }
+}
+
+/*! Add result of an expand callback to the cache
+ *
+ * @param[in]  ec         Expand callback cache
+ * @param[in]  key        Encoded callback name and input
+ * @param[in]  fn_str     Name of expand callback
+ * @param[in]  ttl        Time-to-live in ms
+ * @param[in]  once       Remove entry when used
+ * @param[in]  commands   Commands returned by callback (copied)
+ * @param[in]  helptexts  Helptexts returned by callback (copied)
+ * @retval     0          OK
+ * @retval    -1          Error
+ */
+static int
+pt_expand_fn_store(struct pt_expand_fn_cache *ec,
+                   const char                *key,
+                   const char                *fn_str,
+                   uint32_t                   ttl,
+                   int                        once,
+                   cvec                      *commands,
+                   cvec                      *helptexts)
+{
+    int                         retval = -1;
+    struct pt_expand_fn_entry  *ee = NULL;
+    struct pt_expand_fn_entry **eep;
+    struct timeval              t;
+
+    if ((ee = malloc(sizeof(*ee))) == NULL)
+        goto done;
+    memset(ee, 0, sizeof(*ee));
+    if ((ee->ee_key = strdup(key)) == NULL)
+        goto done;
+    if (fn_str && (ee->ee_fn_str = strdup(fn_str)) == NULL)
+        goto done;
+    if ((ee->ee_commands = cvec_dup(commands)) == NULL)
+        goto done;
+    if ((ee->ee_helptexts = cvec_dup(helptexts)) == NULL)
+        goto done;
+    gettimeofday(&ee->ee_expires, NULL);
+    t.tv_sec = ttl/1000;
+    t.tv_usec = (ttl%1000)*1000;
+    timeradd(&ee->ee_expires, &t, &ee->ee_expires);
+    ee->ee_once = once;
+    ee->ee_next = ec->ec_entries;
+    ec->ec_entries = ee;
+    ee = NULL;
+    /* Evict least recently used */
+    if (++ec->ec_len > PT_EXPAND_FN_CACHE_MAX){
+        for (eep = &ec->ec_entries; (*eep)->ee_next; eep = &(*eep)->ee_next)
+            ;
+        pt_expand_fn_entry_free(*eep);
+        *eep = NULL;
+        ec->ec_len--;
+    }
+    retval = 0;
+ done:
+    if (ee)
+        pt_expand_fn_entry_free(ee);
+    return retval;
+}
+
+#ifdef HAVE_LIBPTHREAD
+/*! Free an expand callback job, the worker thread must have returned
+ */
+static void
+pt_expand_fn_job_free(struct pt_expand_fn_job *ej)
+{
+    if (ej->ej_key)
+        free(ej->ej_key);
+    if (ej->ej_fn_str)
+        free(ej->ej_fn_str);
+    if (ej->ej_cvv)
+        cvec_free(ej->ej_cvv);
+    if (ej->ej_argv)
+        cvec_free(ej->ej_argv);
+    if (ej->ej_commands)
+        cvec_free(ej->ej_commands);
+    if (ej->ej_helptexts)
+        cvec_free(ej->ej_helptexts);
+    pthread_cond_destroy(&ej->ej_cond);
+    pthread_mutex_destroy(&ej->ej_mutex);
+    free(ej);
+}
+
+/*! Worker thread invoking an expand callback
+ *
+ * If the job has been abandoned by the handle while the callback was running, the worker
+ * frees it.
+ */
+static void *
+pt_expand_fn_worker(void *arg)
+{
+    struct pt_expand_fn_job *ej = (struct pt_expand_fn_job *)arg;
+    int                      ret;
+    int                      detached;
+
+    ret = (*ej->ej_fn)(ej->ej_h,
+                       ej->ej_fn_str,
+                       ej->ej_cvv,
+                       ej->ej_argv,
+                       ej->ej_commands,
+                       ej->ej_helptexts);
+    pthread_mutex_lock(&ej->ej_mutex);
+    ej->ej_retval = ret;
+    ej->ej_done = 1;
+    detached = ej->ej_detached;
+    pthread_cond_broadcast(&ej->ej_cond);
+    pthread_mutex_unlock(&ej->ej_mutex);
+    if (detached)
+        pt_expand_fn_job_free(ej);
+    return NULL;
+}
+
+/*! Check if the callback of a job has returned
+ */
+static int
+pt_expand_fn_job_done(struct pt_expand_fn_job *ej)
+{
+    int done;
+
+    pthread_mutex_lock(&ej->ej_mutex);
+    done = ej->ej_done;
+    pthread_mutex_unlock(&ej->ej_mutex);
+    return done;
+}
+
+/*! Abandon a job, eg when the handle is freed, without waiting for its callback
+ *
+ * If the callback is still running, the worker thread is detached and frees the job
+ * when the callback returns.
+ * @param[in]  ej   Job, unlinked from the handle
+ */
+static void
+pt_expand_fn_job_detach(struct pt_expand_fn_job *ej)
+{
+    pthread_t thread = ej->ej_thread; /* ej may be freed by the worker when detached */
+    int       done;
+
+    pthread_mutex_lock(&ej->ej_mutex);
+    if ((done = ej->ej_done) == 0)
+        ej->ej_detached = 1;
+    pthread_mutex_unlock(&ej->ej_mutex);
+    if (done){
+        pthread_join(thread, NULL);
+        pt_expand_fn_job_free(ej);
+    }
+    else
+        pthread_detach(thread);
+}
+
+/*! Collect the results of expand callbacks that have returned in worker threads
+ *
+ * Results are stored in the expand callback cache, where a later expansion with the same
+ * input finds them. Results of callbacks without time-to-live are removed when used, or at
+ * the latest after PT_EXPAND_FN_ASYNC_TTL ms. Results of callbacks that failed or whose
+ * results were invalidated while running are dropped.
+ * @param[in]  ec   Expand callback cache
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+pt_expand_fn_reap(struct pt_expand_fn_cache *ec)
+{
+    int                       retval = -1;
+    struct pt_expand_fn_job  *ej;
+    struct pt_expand_fn_job **ejp;
+
+    ejp = &ec->ec_jobs;
+    while ((ej = *ejp) != NULL){
+        if (!pt_expand_fn_job_done(ej)){
+            ejp = &ej->ej_next;
+            continue;
+        }
+        *ejp = ej->ej_next;
+        ec->ec_njobs--;
+        pthread_join(ej->ej_thread, NULL);
+        if (ej->ej_retval >= 0 && !ej->ej_stale &&
+            pt_expand_fn_store(ec, ej->ej_key, ej->ej_fn_str,
+                               ej->ej_ttl?ej->ej_ttl:PT_EXPAND_FN_ASYNC_TTL,
+                               ej->ej_ttl == 0,
+                               ej->ej_commands, ej->ej_helptexts) < 0){
+            pt_expand_fn_job_free(ej);
+            goto done;
+        }
+        pt_expand_fn_job_free(ej);
+    }
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Invoke expand callback in a worker thread and wait for it until the expand deadline
+ *
+ * Only used when completing, evaluation invokes the callback directly. Wait at most the
+ * expand deadline of the handle. If the callback has not returned by then, the job is
+ * kept: a later expansion with the same input waits for it, or finds its result in the
+ * expand callback cache, see pt_expand_fn_reap, instead of invoking the callback again.
+ * At most PT_EXPAND_FN_JOBS_MAX callbacks are running, further callbacks are not invoked
+ * until a job is collected.
+ * @param[in]     h          CLIgen handle
+ * @param[in]     co         Variable with expand callback
+ * @param[in]     key        Encoded callback name and input, see pt_expand_fn_key_cvec
+ * @param[in]     cvv        Variables given to callback
+ * @param[in]     ttl        Time-to-live of the result in the cache, if collected later
+ * @param[in,out] commands   Commands returned by callback (replaced)
+ * @param[in,out] helptexts  Helptexts returned by callback (replaced)
+ * @retval        1          Callback has returned, result in commands and helptexts
+ * @retval        0          Deadline passed, callback is still running or not invoked
+ * @retval       -1          Error, or callback returned error
+ * @see cligen_expand_deadline_set
+ */
+static int
+pt_expand_fn_async(cligen_handle h,
+                   cg_obj       *co,
+                   const char   *key,
+                   cvec         *cvv,
+                   uint32_t      ttl,
+                   cvec        **commands,
+                   cvec        **helptexts)
+{
+    int                        retval = -1;
+    struct cligen_handle      *ch = handle(h);
+    struct pt_expand_fn_cache *ec = ch->ch_expand_fn_cache;
+    struct pt_expand_fn_job   *ej;
+    struct pt_expand_fn_job  **ejp;
+    struct pt_expand_fn_job   *ejnew = NULL;
+    struct timeval             tv;
+    struct timespec            ts;
+    uint32_t                   deadline;
+    int                        done;
+    int                        ret = 0;
+
+    for (ej = ec->ec_jobs; ej; ej = ej->ej_next)
+        if (!ej->ej_stale && strcmp(ej->ej_key, key) == 0)
+            break;
+    if (ej == NULL){
+        if (ec->ec_njobs >= PT_EXPAND_FN_JOBS_MAX){
+            retval = 0; /* Too many callbacks running */
+            goto done;
+        }
+        if ((ejnew = malloc(sizeof(*ejnew))) == NULL)
+            goto done;
+        memset(ejnew, 0, sizeof(*ejnew));
+        pthread_mutex_init(&ejnew->ej_mutex, NULL);
+        pthread_cond_init(&ejnew->ej_cond, NULL);
+        ejnew->ej_fn = co->co_expand_fn;
+        ejnew->ej_h = cligen_userhandle(h)?cligen_userhandle(h):h;
+        ejnew->ej_ttl = ttl;
+        if ((ejnew->ej_key = strdup(key)) == NULL)
+            goto done;
+        if (co->co_expand_fn_str &&
+            (ejnew->ej_fn_str = strdup(co->co_expand_fn_str)) == NULL)
+            goto done;
+        if ((ejnew->ej_cvv = cvec_dup(cvv)) == NULL)
+            goto done;
+        if (co->co_expand_fn_vec &&
+            (ejnew->ej_argv = cvec_dup(co->co_expand_fn_vec)) == NULL)
+            goto done;
+        if ((ejnew->ej_commands = cvec_new(0)) == NULL)
+            goto done;
+        if ((ejnew->ej_helptexts = cvec_new(0)) == NULL)
+            goto done;
+        if ((errno = pthread_create(&ejnew->ej_thread, NULL, pt_expand_fn_worker, ejnew)) != 0)
+            goto done;
+        ej = ejnew;
+        ejnew = NULL;
+        ej->ej_next = ec->ec_jobs;
+        ec->ec_jobs = ej;
+        ec->ec_njobs++;
+    }
+    deadline = ch->ch_expand_deadline;
+    gettimeofday(&tv, NULL);
+    ts.tv_sec = tv.tv_sec + deadline/1000;
+    ts.tv_nsec = tv.tv_usec*1000 + (deadline%1000)*1000000;
+    if (ts.tv_nsec >= 1000000000){
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&ej->ej_mutex);
+    while (!ej->ej_done && ret != ETIMEDOUT)
+        ret = pthread_cond_timedwait(&ej->ej_cond, &ej->ej_mutex, &ts);
+    done = ej->ej_done;
+    pthread_mutex_unlock(&ej->ej_mutex);
+    if (!done){
+        retval = 0;
+        goto done;
+    }
+    /* Collect result */
+    for (ejp = &ec->ec_jobs; *ejp != ej; ejp = &(*ejp)->ej_next)
+        ;
+    *ejp = ej->ej_next;
+    ec->ec_njobs--;
+    pthread_join(ej->ej_thread, NULL);
+    if (ej->ej_retval < 0){
+        pt_expand_fn_job_free(ej);
+        goto done;
+    }
+    cvec_free(*commands);
+    *commands = ej->ej_commands;
+    ej->ej_commands = NULL;
+    cvec_free(*helptexts);
+    *helptexts = ej->ej_helptexts;
+    ej->ej_helptexts = NULL;
+    pt_expand_fn_job_free(ej);
+    retval = 1;
+ done:
+    if (ejnew)
+        pt_expand_fn_job_free(ejnew);
+    return retval;
+}
+#endif /* HAVE_LIBPTHREAD */
+
+/*! Insert a variable with an expand callback that is still running
+ *
+ * The variable is inserted as is, ie not expanded, with a helptext telling that its
+ * values are still loading.
+ * @param[in]  co         Variable with expand callback
+ * @param[in]  co_parent  CLIgen object parent
+ * @param[in]  cvv_filter Add these to expanded nodes co_filter, eg remove them
+ * @param[in]  transient  co may be "transient" if so use co->co_ref as new co_ref
+ * @param[out] ptn        New expanded parse-tree
+ * @retval     0          OK
+ * @retval    -1          Error
+ */
+static int
+pt_expand_fn_loading(cg_obj     *co,
+                     cg_obj     *co_parent,
+                     cvec       *cvv_filter,
+                     int         transient,
+                     parse_tree *ptn)
+{
+    int     retval = -1;
+    cg_obj *con = NULL;
+
+    if (co_expand_sub(co, co_parent, &con) < 0)
+        goto done;
+    if (transient && con->co_ref)
+        con->co_ref = co->co_ref;
+    con->co_expand_fn = NULL;
+    if (con->co_helpstring && (con->co_borrow & CO_BORROW_HELPSTRING) == 0)
+        free(con->co_helpstring);
+    con->co_borrow &= ~CO_BORROW_HELPSTRING;
+    if ((con->co_helpstring = strdup(PT_EXPAND_FN_LOADING)) == NULL)
+        goto done;
+    if (cvv_filter && cvec_len(cvv_filter) &&
+        co_filter_set(con, cvv_filter) == NULL)
+        goto done;
+    if (pt_vec_append(ptn, con) < 0)
+        goto done;
+    con = NULL;
+    retval = 0;
+ done:
+    if (con)
+        co_free(con, 0);
+    return retval;
+}
+
+/*! Call expand callback and insert expanded commands in place of variable
+ *
+ * Variable argument callback variant
+ * @param[in]  h          CLIgen handle
+ * @param[in]  co         CLIgen object
+ * @param[in]  co_parent  CLIgen object parent
+ * @param[out] cvv_var    Cligen variable vector containing vars/values pair for completion
+ * @param[in]  cvv_filter Add these to expanded nodes co_filter, eg remove them
+ * @param[in]  callbacks  Callback structure of expanded treeref
+ * @param[in]  transient  co may be "transient" if so use co->co_ref as new co_ref,...
+ * @param[out] ptn        New parse-tree initially an empty pointer, its value is returned.
+ * @retval     0          OK
+ * @retval    -1          Error
+ * This is the only place where expand callbacks are invoked
+ * @see cligen_eval where cligen callbacks are invoked
+ */
+static int
+pt_expand_fn(cligen_handle h,
+             cg_obj       *co,
+             cg_obj       *co_parent,
+             cvec         *cvv_var,
+             cvec         *cvv_filter,
+             cg_callback  *callbacks,
+             int           transient,
+             parse_tree   *ptn)
+{
+    int         retval = -1;
+    cvec       *commands = NULL;
+    cvec       *helptexts = NULL;
+    cg_var     *cv;
+    char       *helpstr = NULL;
+    cg_obj     *con = NULL;
+    int         i;
+    const char *value;
+    const char *cmd;
+    cvec       *cvv1 = NULL; /* Modified */
+    int         co_cvec_add = 0;
+    cg_obj     *coa = NULL;  /* Copy of co with added labels if co is frozen */
+    uint32_t    ttl = 0;
+    int         async = 0;
+    int         loading = 0;
+    struct pt_expand_fn_cache *ec;
+    cbuf       *cbkey = NULL;
+    struct pt_expand_fn_opt   *eo;
+    struct pt_expand_fn_entry *ee = NULL;
+#ifdef HAVE_LIBPTHREAD
+    int         ret;
+#endif
+
+    if (cvv_var == NULL){
+        errno = EINVAL;
+        goto done;
+    }
+    pt_expand_volatile(h);
+    if ((commands = cvec_new(0)) == NULL)
+        goto done;
+    if ((helptexts = cvec_new(0)) == NULL)
+        goto done;
+    /* Make a copy of cvv argument for modifications */
+    if ((cvv1 = cvec_dup(cvv_var)) == NULL)
+        goto done;
+    /* Make modifications to cvv */
+    if (cvec_exclude_keys(cvv1) < 0)
+        goto done;
+    if (callbacks && callbacks->cc_cvec){
+        cligen_callback_arguments_set(h, callbacks->cc_cvec);
+    }
+    cligen_co_match_set(h, co);     /* For eventual use in callback */
+    /* Temporary add all labels with prefix @add:, to a copy if co is in a frozen tree */
+    if (cvec_len(cvv_filter) &&
+        co_flags_get(co, CO_FLAGS_FROZEN)){
+        cv = NULL;
+        while ((cv = cvec_each(cvv_filter, cv)) != NULL)
+            if (cv_bool_get(cv))
+                break;
+        if (cv != NULL){
+            if (co_expand_sub(co, co_up(co), &coa) < 0)
+                goto done;
+            cligen_co_match_set(h, coa);
+        }
+    }
+    if (cvec_len(cvv_filter) &&
+        co_unborrow(coa?coa:co, CO_BORROW_CVEC) < 0)
+        goto done;
+    cv = NULL;
+    while ((cv = cvec_each(cvv_filter, cv)) != NULL){
+        if (cv_bool_get(cv)){
+            cvec_append_var(coa?coa->co_cvec:co->co_cvec, cv);
+            co_cvec_add++;
+        }
+    }
+    /* Look for an earlier result of the callback with the same input, if cached */
+    if ((eo = pt_expand_fn_opt(h, co->co_expand_fn_str)) != NULL){
+        ttl = eo->eo_ttl;
+#ifdef HAVE_LIBPTHREAD
+        async = eo->eo_async && cligen_expand_deadline_get(h) != 0;
+#endif
+    }
+    ec = handle(h)->ch_expand_fn_cache;
+    if (ttl || async){
+#ifdef HAVE_LIBPTHREAD
+        /* Results of callbacks that returned in worker threads are added to the cache */
+        if (async && pt_expand_fn_reap(ec) < 0)
+            goto done;
+#endif
+        if ((cbkey = cbuf_new()) == NULL)
+            goto done;
+        pt_expand_fn_key_str(cbkey, co->co_expand_fn_str);
+        /* The first element of cvv1 is the whole command line which is not part of the key */
+        if (pt_expand_fn_key_cvec(cbkey, co->co_expand_fn_vec, 0) < 0 ||
+            pt_expand_fn_key_cvec(cbkey, callbacks?callbacks->cc_cvec:NULL, 0) < 0 ||
+            pt_expand_fn_key_cvec(cbkey, coa?coa->co_cvec:co->co_cvec, 0) < 0 ||
+            pt_expand_fn_key_cvec(cbkey, cvv1, 1) < 0)
+            goto done;
+        if ((ee = pt_expand_fn_lookup(ec, cbuf_get(cbkey))) != NULL){
+            cvec_free(commands);
+            cvec_free(helptexts);
+            helptexts = NULL;
+            if ((commands = cvec_dup(ee->ee_commands)) == NULL)
+                goto done;
+            if ((helptexts = cvec_dup(ee->ee_helptexts)) == NULL)
+                goto done;
+            if (ee->ee_once)
+                pt_expand_fn_remove(ec, ee);
+        }
+    }
+    if (ee != NULL)
+        ; /* Cached */
+#ifdef HAVE_LIBPTHREAD
+    else if (async && handle(h)->ch_expand_completing){
+        /* Completion waits at most the deadline, evaluation invokes the callback below */
+        if ((ret = pt_expand_fn_async(h, co, cbuf_get(cbkey), cvv1, ttl,
+                                      &commands, &helptexts)) < 0)
+            goto done;
+        loading = (ret == 0);
+    }
+#endif
+    else if ((*co->co_expand_fn)(cligen_userhandle(h)?cligen_userhandle(h):h,
+                                 co->co_expand_fn_str,
+                                 cvv1,
+                                 co->co_expand_fn_vec,
+                                 commands,
+                                 helptexts) < 0)
+        goto done;
+    if (ee == NULL && !loading && ttl &&
+        pt_expand_fn_store(ec, cbuf_get(cbkey),
+                           co->co_expand_fn_str, ttl, 0, commands, helptexts) < 0)
+        goto done;
+    /* Revert @add:s */
+    if (coa){
+        cligen_co_match_set(h, co);
+        co_free(coa, 0);
+        coa = NULL;
+    }
+    else if (co_cvec_add){
+        for (i=0; i<co_cvec_add; i++){
+            if ((cv = cvec_i(co->co_cvec, cvec_len(co->co_cvec)-1)) != NULL){
+                cv_reset(cv);
+                cvec_del_i(co->co_cvec, cvec_len(co->co_cvec)-1);
+            }
+        }
+    }
+    if (loading &&
+        pt_expand_fn_loading(co, co_parent, cvv_filter, transient, ptn) < 0)
+        goto done;
+    i = 0;
+    cv = NULL;
+    while ((cv = cvec_each(commands, cv)) != NULL) {
+        if (i < cvec_len(helptexts)){
+            if ((helpstr = strdup(cv_string_get(cvec_i(helptexts, i)))) == NULL)
+                goto done;
+        }
+        else
+            helpstr = NULL;
+        i++;
+        con = NULL;
+        if (co_expand_sub(co, co_parent, &con) < 0)
+            goto done;
+        if (transient && con->co_ref){
+            con->co_ref = co->co_ref;
+        }
+        if (pt_vec_append(ptn, con) < 0)
+            goto done;
+        if (cvv_filter && cvec_len(cvv_filter))
+            if (co_filter_set(con, cvv_filter) == NULL)
+                goto done;
+        value = cv_string_get(cv);
+        if ((cmd = strdup(value)) == NULL)
+            goto done;
+        /* 'cmd' always points to mutable string, helpstr is consumed */
+        if (transform_var_to_cmd(con, (char*)cmd, helpstr, 0) < 0){
+            helpstr = NULL;
+            goto done;
+        }
+        helpstr = NULL;
+        /* Save the unescaped string */
+        if (cmd != value)
+            co_value_set(con, (char*)value);
+    }
+    retval = 0;
+ done:
+    if (commands)
+        cvec_free(commands);
+    if (helptexts)
+        cvec_free(helptexts);
+    if (callbacks && callbacks->cc_cvec)
+        cligen_callback_arguments_set(h, NULL);
+    if (cvv1)
+        cvec_free(cvv1);
+    if (cbkey)
+        cbuf_free(cbkey);
+    if (helpstr)
+        free(helpstr);
+    if (coa){
+        cligen_co_match_set(h, co);
+        co_free(coa, 0);
+    }
+    return retval;
+}
+
+/*! Return prefix that keywords of tree references and choices must match to be expanded, if any
+ *
+ * @param[in]  h       Cligen handle
+ * @retval     prefix  Token to be matched with the expansion
+ * @retval     NULL    All keywords are expanded, eg when listing
+ * @see match_pattern_sets where the prefix is set
+ */
+static char *
+pt_expand_prefix(cligen_handle h)
+{
+    char *prefix = handle(h)->ch_expand_prefix;
+
+    if (prefix == NULL || *prefix == '\0')
+        return NULL;
+    return prefix;
+}
+
+/*! Check if a keyword name may match a token prefix
+ *
+ * @param[in]  h       Cligen handle
+ * @param[in]  name    Keyword name
+ * @param[in]  prefix  Token prefix
+ * @retval     1       Keyword is escaped, or may match prefix
+ * @retval     0       Keyword does not match prefix
+ */
+static int
+pt_expand_prefix_str(cligen_handle h,
+                     const char   *name,
+                     const char   *prefix)
+{
+    if (*name == '\"') /* escaped */
+        return 1;
+    if (cligen_caseignore_get(h))
+        return strncasecmp(name, prefix, strlen(prefix)) == 0;
+    else
+        return strncmp(name, prefix, strlen(prefix)) == 0;
+}
+
+/*! Check if a keyword may match a token prefix
+ *
+ * @param[in]  h       Cligen handle
+ * @param[in]  co      Cligen object
+ * @param[in]  prefix  Token prefix
+ * @retval     1       Not a keyword, or keyword may match prefix
+ * @retval     0       Keyword does not match prefix
+ * @see match_object
+ */
+static int
+pt_expand_prefix_match(cligen_handle h,
+                       cg_obj       *co,
+                       const char   *prefix)
+{
+    if (co->co_type != CO_COMMAND ||
+        co->co_command == NULL)
+        return 1;
+    return pt_expand_prefix_str(h, co->co_command, prefix);
+}
+
+/*! Expand a choice rule with actual commands
+ *
+ * The choices are split once into an array, see co_choices_get. If matching a next token,
+ * only choices that may match it become commands, see pt_expand_prefix.
+ * @param[in]  h          Cligen handle
+ * @param[in]  co         Original cligen object (to expand into ptn)
+ * @param[in]  cvv_filter Add these to expanded nodes co_filter, eg remove them
+ * @param[in]  transient  co may be "transient" if so use co->co_ref as new co_ref
+ * @param[out] ptn        New parse-tree initially an empty pointer, its value is returned.
+ * @retval     0          OK
+ * @retval    -1          Error
+ * As for tree references, one choice not matching the prefix is kept.
+ */
+static int
+pt_expand_choice(cligen_handle h,
+                 cg_obj       *co,
+                 cvec         *cvv_filter,
+                 int           transient,
+                 parse_tree   *ptn)
+{
+    int         retval = -1;
+    cg_choices *cc;
+    cg_obj     *con = NULL;
+    char       *prefix;
+    char       *cmd;
+    char       *helptext = NULL;
+    int         borrow;
+    int         kept = 0;      /* A choice not matching prefix has been expanded */
+    int         i;
+
+    if ((cc = co_choices_get(co)) == NULL)
+        goto done;
+    /* Borrow names and help texts if co may be borrowed from, see co_expand_sub */
+    borrow = co->co_ref == NULL || (co->co_borrow & CO_BORROW_VARSPEC);
+    prefix = pt_expand_prefix(h);
+    for (i=0; i<cc->cc_len; i++){
+        if (prefix && !pt_expand_prefix_str(h, cc->cc_name[i], prefix)){
+            if (kept++)
+                continue;
+        }
+        if (co_expand_sub(co, NULL, &con) < 0)
+            goto done;
+        if (transient && co->co_ref)
+            con->co_ref = co->co_ref;
+        cmd = cc->cc_name[i];
+        helptext = cc->cc_help[i];
+        if (!borrow){
+            if ((cmd = strdup(cmd)) == NULL)
+                goto done;
+            if (helptext && (helptext = strdup(helptext)) == NULL){
+                free(cmd);
+                goto done;
+            }
+        }
+        if (transform_var_to_cmd(con, cmd, helptext, borrow) < 0)
+            goto done;
+        if (cvv_filter && co_filter_set(con, cvv_filter) == NULL)
+            goto done;
+        /* con may be deleted in the call and need to be replaced */
+        if (co_insert1(ptn, con, 0) == NULL)
+            goto done;
+        con = NULL;
+    }
+    retval = 0;
+ done:
+    if (con)
+        co_free(con, 0);
+    return retval;
+}
+
+/*! Check if label is filtered in co
+ *
+ * @retval    1   Yes, it is filtered, remove it
  * @retval    0   No, label is not in co_filter, keep it
  * @see co_filter_bool
  */
@@ -798,6 +1719,7 @@ node_callbacks(cligen_handle h,
     if (cligen_node_filter_get(h, &node_filter_fn, &node_filter_arg) < 0)
         goto done;
     if (node_filter_fn != NULL){
+        pt_expand_volatile(h);
         if (node_filter_fn(h, co, cvv_var, node_filter_arg, &skip) < 0)
             goto done;
         if (skip)
@@ -811,6 +1733,40 @@ node_callbacks(cligen_handle h,
     goto done;
 }
 
+/*! Check if any label of an object is filtered, by object or parent filters
+ *
+ * Signatures of labels and filters are compared first, and labels by name only if the
+ * signatures have bits in common
+ * @param[in]  co            CLIgen object
+ * @param[in]  cvv_filter    Filter labels of parent
+ * @param[in]  filter_labels Signature of cvv_filter, see cvec_names_sig
+ * @retval     1             Yes, a label is filtered, remove co
+ * @retval     0             No, keep co
+ * @see co_isfilter
+ */
+static int
+co_labels_filtered(cg_obj   *co,
+                   cvec     *cvv_filter,
+                   uint64_t  filter_labels)
+{
+    uint64_t filter;
+    cg_var  *cv;
+    char    *label;
+
+    filter = filter_labels | cvec_names_sig(co->co_filter);
+    if ((cvec_names_sig(co->co_cvec) & filter) == 0)
+        return 0;
+    cv = NULL;
+    while ((cv = cvec_each(co->co_cvec, cv)) != NULL){
+        label = cv_name_get(cv);
+        if (co->co_filter && co_isfilter(co->co_filter, label))
+            return 1;
+        if (cvv_filter && co_isfilter(cvv_filter, label))
+            return 1;
+    }
+    return 0;
+}
+
 /*! pt_expand function for expanding children to parse-tree
  *
  * @param[in]     h          Cligen handle
@@ -819,8 +1775,10 @@ node_callbacks(cligen_handle h,
  * @param[in]     expandvar  Set if VARS should be expanded, eg ? <tab>
  * @param[in]     cvv_var    Cligen variable vector containing vars/values pair for completion
  * @param[in]     cvv_filter Add these to expanded nodes co_filter, eg remove them
+ * @param[in]     filter_labels Signature of cvv_filter, see cvec_names_sig
  * @param[in]     callbacks  Callback structure of expanded treeref
  * @param[in]     transient  co may be "transient" if so use co->co_ref as new co_ref,...
+ * @param[in]     filtered   Set if co is skipped by the batched node filter, see pt_filter_batch
  * @param[in,out] ptn        New expanded parse-tree
  * @retval        0          OK
  * @retval       -1          Error
@@ -832,31 +1790,26 @@ pt_expand1_co(cligen_handle h,
               int           expandvar,
               cvec         *cvv_var,
               cvec         *cvv_filter,
+              uint64_t      filter_labels,
               cg_callback  *callbacks,
               int           transient,
+              int           filtered,
               parse_tree   *ptn)
 {
     int     retval = -1;
-    cg_var *cv;
     cg_obj *con = NULL;
-    char   *label;
     int     ret;
 
-    if (co_value_set(co, NULL) < 0)
+    if (!co_flags_get(co, CO_FLAGS_FROZEN) &&
+        co_value_set(co, NULL) < 0)
         goto done;
     if (hide && co_flags_get(co, CO_FLAGS_HIDE))
         goto ok;
-    /* Loop labels from object itself and see if any of the elements are filtered, if so skip it
-     */
-    cv = NULL;
-    while ((cv = cvec_each(co->co_cvec, cv)) != NULL){
-        label = cv_name_get(cv);
-        if (co->co_filter && co_isfilter(co->co_filter, label))
-            break;
-        if (cvv_filter && co_isfilter(cvv_filter, label))
-            break;
-    }
-    if (cv) /* found: break in the while loop ^ */
+    /* See if any of the labels of the object itself are filtered, if so skip it */
+    if (co->co_cvec &&
+        co_labels_filtered(co, cvv_filter, filter_labels))
+        goto ok;
+    if (filtered)
         goto ok;
     if ((ret = node_callbacks(h, co, cvv_var)) < 0)
         goto done;
@@ -867,7 +1820,7 @@ pt_expand1_co(cligen_handle h,
      * of the variable
      */
     if (co->co_type == CO_VARIABLE && co->co_choice != NULL){
-        if (pt_expand_choice(co, cvv_filter, ptn) < 0) // XXX filter
+        if (pt_expand_choice(h, co, cvv_filter, transient, ptn) < 0) // XXX filter
             goto done;
     }
     /* Expand variable - call expand callback and insert expanded
@@ -893,50 +1846,491 @@ pt_expand1_co(cligen_handle h,
                 goto done;
         }
     }
-    else if (co->co_type == CO_VARIABLE &&
-             co->co_expand_fn == NULL &&
-             expandvar &&
-             co_filter_bool(cvv_filter, "ac-strict-expand")){
-        /* Dont show generic variable if strict-expand and there are expand rules */
+    else if (co->co_type == CO_VARIABLE &&
+             co->co_expand_fn == NULL &&
+             expandvar &&
+             co_filter_bool(cvv_filter, "ac-strict-expand")){
+        /* Dont show generic variable if strict-expand and there are expand rules */
+        goto ok;
+    }
+    else{
+        /* Copy original cg_obj to shadow list*/
+        con = NULL;
+        if (co_expand_sub(co, NULL, &con) < 0)
+            goto done;
+        /* con may be deleted in the call and need to be replaced */
+        if ((con = co_insert1(ptn, con, 0)) == NULL)
+            goto done;
+        if (transient && con->co_ref){
+            con->co_ref = co->co_ref;
+        }
+        if (cvv_filter && cvec_len(cvv_filter))
+            if (co_filter_set(con, cvv_filter) == NULL)
+                goto done;
+    }
+ ok:
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Return name of local pipe reference, if any
+ */
+char *
+pt_local_pipe(parse_tree *pt)
+{
+    int     i;
+    cg_obj *co;
+
+    for (i=0; i<pt_len_get(pt); i++){ /* From pt (orig) build ptn (new) */
+        if ((co = pt_vec_i_get(pt, i)) != NULL &&
+            co->co_type == CO_REFERENCE &&
+            *co->co_command == '|'){
+            return co->co_command;
+        }
+    }
+    return NULL;
+}
+
+/*! Free a cached shallow expansion of a tree reference
+ */
+static void
+pt_treeref_entry_free(struct pt_treeref_entry *te)
+{
+    if (te->te_pttmp)
+        pt_free(te->te_pttmp, 0);
+    pt_expand_deps_free(&te->te_deps);
+    free(te);
+}
+
+/*! Remove all entries of the treeref cache, except those in use which are marked as stale
+ */
+static void
+pt_treeref_cache_clear(struct pt_treeref_cache *tc)
+{
+    struct pt_treeref_entry  *te;
+    struct pt_treeref_entry **tep;
+
+    tep = &tc->tc_entries;
+    while ((te = *tep) != NULL){
+        if (te->te_busy){
+            te->te_stale = 1;
+            tep = &te->te_next;
+        }
+        else{
+            *tep = te->te_next;
+            pt_treeref_entry_free(te);
+            tc->tc_len--;
+        }
+    }
+}
+
+/*! Get shallow expansion of a tree reference, from the treeref cache if possible
+ *
+ * The expansion is cached per reference object, referenced tree and treeref flags.
+ * It is not cached if a nested tree reference is resolved by the tree resolve wrapper,
+ * since it may then depend on input.
+ * An entry is invalid when the tree of the reference object or a referenced tree has
+ * changed, see pt_tree_generation_get(). The cache is flushed when a parse-tree head of the
+ * handle changes, eg the tree or workpoint of the referenced tree, or the global generation,
+ * see pt_generation_get().
+ * @param[in]  h       Cligen handle
+ * @param[in]  coref   Tree reference cligen object
+ * @param[in]  cvt     Tokenized string: vector of tokens
+ * @param[in]  ptref   Referenced tree, after tree resolve wrapper
+ * @param[in]  flags   Flags of treeref flags callback
+ * @param[in]  ptco    Parse-tree of coref if result may be cached, ie coref outlives the
+ *                     cache entry, otherwise NULL
+ * @param[out] ptp     Shallow expansion, release with pt_treeref_release
+ * @retval     0       OK
+ * @retval    -1       Error
+ */
+static int
+pt_treeref_cached(cligen_handle h,
+                  cg_obj       *coref,
+                  cvec         *cvt,
+                  parse_tree   *ptref,
+                  uint32_t      flags,
+                  parse_tree   *ptco,
+                  parse_tree  **ptp)
+{
+    int                      retval = -1;
+    struct cligen_handle    *ch = handle(h);
+    struct pt_treeref_cache *tc;
+    struct pt_treeref_entry *te = NULL;
+    struct pt_treeref_entry *teprev = NULL;
+    struct pt_treeref_entry *telast;
+    parse_tree              *pttmp = NULL;
+    cvec                    *cvv2 = NULL;
+    int                      vol;
+    struct pt_expand_deps    deps = {0,};
+    struct pt_expand_deps   *pdouter;
+
+    pdouter = ch->ch_expand_deps;
+    if ((tc = ch->ch_treeref_cache) == NULL){
+        if ((tc = malloc(sizeof(*tc))) == NULL){
+            fprintf(stderr, "%s: malloc: %s\n", __FUNCTION__, strerror(errno));
+            goto done;
+        }
+        memset(tc, 0, sizeof(*tc));
+        tc->tc_generation = pt_generation_get();
+        tc->tc_ph_generation = ch->ch_ph_generation;
+        ch->ch_treeref_cache = tc;
+    }
+    else if (tc->tc_generation != pt_generation_get() ||
+             tc->tc_ph_generation != ch->ch_ph_generation){
+        pt_treeref_cache_clear(tc);
+        tc->tc_generation = pt_generation_get();
+        tc->tc_ph_generation = ch->ch_ph_generation;
+    }
+    if (ptco){
+        for (te = tc->tc_entries; te; te = te->te_next){
+            if (te->te_stale == 0 &&
+                te->te_coref == coref &&
+                te->te_ptco == ptco &&
+                te->te_ptref == ptref &&
+                te->te_flags == flags)
+                break;
+            teprev = te;
+        }
+        if (te != NULL && !pt_expand_deps_valid(&te->te_deps)){
+            /* Stale: the tree of the reference or a referenced tree has changed */
+            if (te->te_busy)
+                te->te_stale = 1;
+            else{
+                if (teprev)
+                    teprev->te_next = te->te_next;
+                else
+                    tc->tc_entries = te->te_next;
+                pt_treeref_entry_free(te);
+                tc->tc_len--;
+            }
+            te = NULL;
+        }
+        if (te != NULL){ /* Hit */
+            if (teprev){ /* Move first */
+                teprev->te_next = te->te_next;
+                te->te_next = tc->tc_entries;
+                tc->tc_entries = te;
+            }
+            if (pt_expand_deps_merge(pdouter, &te->te_deps) < 0)
+                goto done;
+            te->te_busy++;
+            *ptp = te->te_pttmp;
+            goto ok;
+        }
+    }
+    /* pttmp is a transient copy of the expanded tree */
+    if ((pttmp = pt_new()) == NULL)
+        goto done;
+    pt_transient_set(pttmp, 1);
+    if ((cvv2 = cvec_new(0)) == NULL)
+        goto done;
+    if (co_find_label_filters(h, coref, cvv2) < 0)
+        goto done;
+    vol = tc->tc_volatile;
+    if (pt_expand_deps_add(&deps, ptco, ptco?pt_tree_generation_get(ptco):0) < 0 ||
+        pt_expand_deps_add(&deps, ptref, pt_tree_generation_get(ptref)) < 0)
+        goto done;
+    /* Collect trees resolved by nested tree references */
+    ch->ch_expand_deps = &deps;
+    retval = co_expand_treeref_copy_shallow(h, coref, NULL, cvv2, cvt, ptref, flags, pttmp);
+    ch->ch_expand_deps = pdouter;
+    if (retval < 0)
+        goto done;
+    retval = -1;
+    if (pt_expand_deps_merge(pdouter, &deps) < 0)
+        goto done;
+    if (ptco &&
+        tc->tc_volatile == vol &&
+        tc->tc_generation == pt_generation_get() &&
+        tc->tc_ph_generation == ch->ch_ph_generation &&
+        pt_expand_deps_valid(&deps)){
+        if ((te = malloc(sizeof(*te))) == NULL){
+            fprintf(stderr, "%s: malloc: %s\n", __FUNCTION__, strerror(errno));
+            goto done;
+        }
+        memset(te, 0, sizeof(*te));
+        te->te_coref = coref;
+        te->te_ptco = ptco;
+        te->te_ptref = ptref;
+        te->te_flags = flags;
+        te->te_pttmp = pttmp;
+        te->te_deps = deps;
+        memset(&deps, 0, sizeof(deps));
+        te->te_busy = 1;
+        te->te_next = tc->tc_entries;
+        tc->tc_entries = te;
+        tc->tc_len++;
+        /* Evict least recently used entry not in use */
+        if (tc->tc_len > PT_TREEREF_CACHE_MAX){
+            telast = NULL;
+            teprev = NULL;
+            for (te = tc->tc_entries; te->te_next; te = te->te_next)
+                if (te->te_next->te_busy == 0){
+                    teprev = te;
+                    telast = te->te_next;
+                }
+            if (telast){
+                teprev->te_next = telast->te_next;
+                pt_treeref_entry_free(telast);
+                tc->tc_len--;
+            }
+        }
+    }
+    *ptp = pttmp;
+    pttmp = NULL;
+ ok:
+    retval = 0;
+ done:
+    pt_expand_deps_free(&deps);
+    if (cvv2)
+        cvec_free(cvv2);
+    if (pttmp)
+        pt_free(pttmp, 0);
+    return retval;
+}
+
+/*! Release a shallow expansion returned by pt_treeref_cached
+ *
+ * If the expansion is cached it is kept for later use, otherwise it is freed
+ * @param[in]  h      Cligen handle
+ * @param[in]  pttmp  Shallow expansion of tree reference
+ */
+static void
+pt_treeref_release(cligen_handle h,
+                   parse_tree   *pttmp)
+{
+    struct pt_treeref_cache  *tc;
+    struct pt_treeref_entry  *te = NULL;
+    struct pt_treeref_entry **tep = NULL;
+
+    if ((tc = handle(h)->ch_treeref_cache) != NULL){
+        tep = &tc->tc_entries;
+        while ((te = *tep) != NULL){
+            if (te->te_pttmp == pttmp)
+                break;
+            tep = &te->te_next;
+        }
+    }
+    if (te == NULL){
+        pt_free(pttmp, 0);
+        return;
+    }
+    if (--te->te_busy == 0 && te->te_stale){
+        *tep = te->te_next;
+        pt_treeref_entry_free(te);
+        tc->tc_len--;
+    }
+}
+
+/*! Shallow expansion of a tree reference, ie the referenced tree with flags applied
+ *
+ * @param[in]  h        Cligen handle
+ * @param[in]  coref    Tree reference cligen object
+ * @param[in]  cvt      Tokenized string: vector of tokens
+ * @param[in]  cvv_var  Cligen variable vector containing vars/values pair for completion
+ * @param[in]  ptco     Parse-tree of coref if the expansion may be cached, see pt_treeref_cached
+ * @param[out] pttmp    Expanded tree, release with pt_treeref_release
+ * @retval     0        OK
+ * @retval    -1        Error
+ */
+static int
+pt_expand_reference_tree(cligen_handle h,
+                         cg_obj       *coref,
+                         cvec         *cvt,
+                         cvec         *cvv_var,
+                         parse_tree   *ptco,
+                         parse_tree  **pttmp)
+{
+    int                      retval = -1;
+    parse_tree              *ptref = NULL;   /* tree referenced by pt0 orig */
+    cligen_treeref_flags_fn *flags_fn = NULL;
+    uint32_t                 flags = 0;
+
+    if (tree_resolve(h, coref, cvt, &ptref) < 0)
+        goto done;
+    /* Ask the application callback what flags to apply to all copies from this
+     * top-level tree reference.  With no callback, no flags are set. */
+    cligen_treeref_flags_fn_get(h, &flags_fn);
+    if (flags_fn != NULL){
+        if (flags_fn(h, coref->co_command, 0, &flags) < 0)
+            goto done;
+    }
+    if (pt_treeref_cached(h, coref, cvv_var, ptref, flags, ptco, pttmp) < 0)
+        goto done;
+    retval = 0;
+ done:
+    return retval;
+}
+
+/*! Candidates of one level of an expansion and the result of the batched node filter
+ *
+ * Candidates are collected, and later consumed by pt_filter_batch_skip, in the order
+ * they are expanded by pt_expand and pt_expand_reference.
+ */
+struct pt_filter_batch {
+    cg_obj      **fb_vec;    /* Candidate objects */
+    int           fb_len;    /* Length of fb_vec */
+    int           fb_i;      /* Next candidate to consume */
+    uint8_t      *fb_skip;   /* Skip bitmap of fb_vec, NULL if no batched filter */
+    parse_tree  **fb_pttmp;  /* Expanded tree references, indexed as the original tree */
+    int           fb_ptlen;  /* Length of fb_pttmp */
+};
+
+/*! Add candidates of an expanded tree reference to a batch
+ *
+ * @param[in]     h       Cligen handle
+ * @param[in]     pttmp   Shallow expansion of the tree reference
+ * @param[in]     prefix  Keywords not matching prefix are not candidates, see pt_expand_reference
+ * @param[in,out] fb      Filter batch
+ * @retval        0       OK
+ * @retval       -1       Error
+ */
+static int
+pt_filter_batch_add(cligen_handle           h,
+                    parse_tree             *pttmp,
+                    char                   *prefix,
+                    struct pt_filter_batch *fb)
+{
+    cg_obj  *cot;
+    cg_obj **vec;
+    int      i;
+
+    /* Leave room also for the remaining objects of the original tree */
+    if ((vec = realloc(fb->fb_vec, (fb->fb_len + pt_len_get(pttmp) + fb->fb_ptlen + 1)*sizeof(cg_obj*))) == NULL)
+        return -1;
+    fb->fb_vec = vec;
+    for (i=0; i<pt_len_get(pttmp); i++){
+        if ((cot = pt_vec_i_get(pttmp, i)) == NULL)
+            continue;
+        if (prefix && !pt_expand_prefix_match(h, cot, prefix))
+            continue;
+        fb->fb_vec[fb->fb_len++] = cot;
+    }
+    return 0;
+}
+
+/*! Call the batched node filter callback on the candidates of a batch
+ *
+ * @param[in]     h       Cligen handle
+ * @param[in]     fn      Batched node filter callback
+ * @param[in]     arg     Argument of fn
+ * @param[in]     cvv_var Cligen variable vector containing vars/values pair for completion
+ * @param[in,out] fb      Filter batch
+ * @retval        0       OK
+ * @retval       -1       Error
+ */
+static int
+pt_filter_batch_call(cligen_handle                h,
+                     cligen_node_filter_batch_fn *fn,
+                     void                        *arg,
+                     cvec                        *cvv_var,
+                     struct pt_filter_batch      *fb)
+{
+    /* The result depends on the application and on cvv_var */
+    pt_expand_volatile(h);
+    if ((fb->fb_skip = calloc(fb->fb_len/8 + 1, sizeof(uint8_t))) == NULL)
+        return -1;
+    fb->fb_i = 0;
+    if (fb->fb_len && fn(h, fb->fb_vec, fb->fb_len, cvv_var, arg, fb->fb_skip) < 0)
+        return -1;
+    return 0;
+}
+
+/*! Consume the next candidate of a batch
+ *
+ * @param[in,out] fb   Filter batch, or NULL
+ * @retval        1    Candidate is skipped by the batched node filter
+ * @retval        0    Candidate is kept, or there is no batched node filter
+ */
+static int
+pt_filter_batch_skip(struct pt_filter_batch *fb)
+{
+    int i;
+
+    if (fb == NULL || fb->fb_skip == NULL || fb->fb_i >= fb->fb_len)
+        return 0;
+    i = fb->fb_i++;
+    return CLIGEN_SKIP_ISSET(fb->fb_skip, i);
+}
+
+/*! Collect all candidates of a level and call the batched node filter callback once
+ *
+ * Tree references of pt are expanded here and kept in fb_pttmp, so that they are not
+ * expanded again by pt_expand_reference
+ * @param[in]     h       Cligen handle
+ * @param[in]     pt      Original parse-tree of the level
+ * @param[in]     cvt     Tokenized string: vector of tokens
+ * @param[in]     cvv_var Cligen variable vector containing vars/values pair for completion
+ * @param[in]     prefix  If set, only keywords of tree references matching this prefix
+ * @param[out]    fb      Filter batch, free with pt_filter_batch_free
+ * @retval        0       OK
+ * @retval       -1       Error
+ */
+static int
+pt_filter_batch(cligen_handle           h,
+                parse_tree             *pt,
+                cvec                   *cvt,
+                cvec                   *cvv_var,
+                char                   *prefix,
+                struct pt_filter_batch *fb)
+{
+    int                          retval = -1;
+    cligen_node_filter_batch_fn *fn = NULL;
+    void                        *arg = NULL;
+    cg_obj                      *co;
+    int                          i;
+
+    memset(fb, 0, sizeof(*fb));
+    if (cligen_node_filter_batch_get(h, &fn, &arg) < 0)
+        goto done;
+    if (fn == NULL)
         goto ok;
-    }
-    else{
-        /* Copy original cg_obj to shadow list*/
-        con = NULL;
-        if (co_expand_sub(co, NULL, &con) < 0)
-            goto done;
-        /* con may be deleted in the call and need to be replaced */
-        if ((con = co_insert1(ptn, con, 0)) == NULL)
-            goto done;
-        if (transient && con->co_ref){
-            con->co_ref = co->co_ref;
-        }
-        if (cvv_filter && cvec_len(cvv_filter))
-            if (co_filter_set(con, cvv_filter) == NULL)
+    if ((fb->fb_pttmp = calloc(pt_len_get(pt) + 1, sizeof(parse_tree*))) == NULL)
+        goto done;
+    fb->fb_ptlen = pt_len_get(pt);
+    if ((fb->fb_vec = calloc(pt_len_get(pt) + 1, sizeof(cg_obj*))) == NULL)
+        goto done;
+    for (i=0; i<pt_len_get(pt); i++){
+        if ((co = pt_vec_i_get(pt, i)) == NULL)
+            continue;
+        if (co->co_type == CO_REFERENCE){
+            if (pt_expand_reference_tree(h, co, cvt, cvv_var, pt, &fb->fb_pttmp[i]) < 0)
                 goto done;
+            if (pt_filter_batch_add(h, fb->fb_pttmp[i], prefix, fb) < 0)
+                goto done;
+        }
+        else
+            fb->fb_vec[fb->fb_len++] = co;
     }
+    if (pt_filter_batch_call(h, fn, arg, cvv_var, fb) < 0)
+        goto done;
  ok:
     retval = 0;
  done:
     return retval;
 }
 
-/*! Return name of local pipe reference, if any
+/*! Free a filter batch and release its expanded tree references
  */
-char *
-pt_local_pipe(parse_tree *pt)
+static void
+pt_filter_batch_free(cligen_handle           h,
+                     struct pt_filter_batch *fb)
 {
-    int     i;
-    cg_obj *co;
+    int i;
 
-    for (i=0; i<pt_len_get(pt); i++){ /* From pt (orig) build ptn (new) */
-        if ((co = pt_vec_i_get(pt, i)) != NULL &&
-            co->co_type == CO_REFERENCE &&
-            *co->co_command == '|'){
-            return co->co_command;
-        }
+    if (fb->fb_pttmp){
+        for (i=0; i<fb->fb_ptlen; i++)
+            if (fb->fb_pttmp[i])
+                pt_treeref_release(h, fb->fb_pttmp[i]);
+        free(fb->fb_pttmp);
     }
-    return NULL;
+    if (fb->fb_vec)
+        free(fb->fb_vec);
+    if (fb->fb_skip)
+        free(fb->fb_skip);
+    memset(fb, 0, sizeof(*fb));
 }
 
 /*! Sub-routine to pt_expand for tree reference nodes
@@ -946,74 +2340,92 @@ pt_local_pipe(parse_tree *pt)
  * @param[in]     cvt        Tokenized string: vector of tokens
  * @param[in]     cvv_var    Cligen variable vector containing vars/values pair for completion
  * @param[in]     cvv_filter Add these to expanded nodes co_filter, eg remove them
+ * @param[in]     filter_labels Signature of cvv_filter, see cvec_names_sig
  * @param[in]     hide       If 0, include hidden commands. If 1, do not include hidden commands.
  * @param[in]     expandvar  Set if VARS should be expanded, eg ? <tab>
  * @param[in]     callbacks  Callback structure of expanded treeref
+ * @param[in]     ptco       Parse-tree of coref if its shallow expansion may be cached, see
+ *                            pt_treeref_cached, otherwise NULL
+ * @param[in]     prefix     If set, only expand keywords matching this token prefix
+ * @param[in]     pttmp0     Shallow expansion of co made by pt_filter_batch, or NULL
+ * @param[in,out] fb         Filter batch of the level, or NULL to make one for co only
  * @param[in,out] ptn        New expanded parse-tree
  * @retval        0          OK
  * @retval       -1          Error
+ * Keywords not matching prefix are skipped, except one: the expansion is then
+ * still non-empty, so that matching terminates, and fails, as if all were expanded.
  */
 static int
-pt_expand_reference(cligen_handle h,
-                    cg_obj       *coref,
-                    cvec         *cvt,
-                    cvec         *cvv_var,
-                    cvec         *cvv_filter,
-                    int           hide,
-                    int           expandvar,
-                    cg_callback  *callbacks,
-                    parse_tree   *ptn)
+pt_expand_reference(cligen_handle           h,
+                    cg_obj                 *coref,
+                    cvec                   *cvt,
+                    cvec                   *cvv_var,
+                    cvec                   *cvv_filter,
+                    uint64_t                filter_labels,
+                    int                     hide,
+                    int                     expandvar,
+                    cg_callback            *callbacks,
+                    parse_tree             *ptco,
+                    char                   *prefix,
+                    parse_tree             *pttmp0,
+                    struct pt_filter_batch *fb,
+                    parse_tree             *ptn)
 {
-    int         retval = -1;
-    parse_tree *ptref = NULL;   /* tree referenced by pt0 orig */
-    cvec       *cvv2 = NULL;
-    parse_tree *pttmp = NULL;
-    cg_obj     *cot;
-    int         i;
+    int                          retval = -1;
+    parse_tree                  *pttmp = NULL;
+    cg_obj                      *cot;
+    int                          i;
+    int                          skip;
+    int                          filtered;
+    int                          kept = 0;       /* A skipped keyword has been expanded */
+    int                          len;
+    struct pt_filter_batch       fb0 = {0,};
+    cligen_node_filter_batch_fn *fn = NULL;
+    void                        *arg = NULL;
 
-    ptref = NULL;
-    if (tree_resolve(h, coref, cvt, &ptref) < 0)
+    /* Expand ptref to pttmp, unless already made for the filter batch */
+    if ((pttmp = pttmp0) == NULL &&
+        pt_expand_reference_tree(h, coref, cvt, cvv_var, ptco, &pttmp) < 0)
         goto done;
-    /* pttmp is a transient copy of the expanded tree */
-    if ((pttmp = pt_new()) == NULL)
-        goto done;
-    if ((cvv2 = cvec_new(0)) == NULL)
-        goto done;
-    if (co_find_label_filters(h, coref, cvv2) < 0)
-        goto done;
-    /* Expand ptref to pttmp.
-     * Ask the application callback what flags to apply to all copies from this
-     * top-level tree reference.  With no callback, no flags are set. */
-    {
-        cligen_treeref_flags_fn *flags_fn = NULL;
-        uint32_t                 flags = 0;
-        cligen_treeref_flags_fn_get(h, &flags_fn);
-        if (flags_fn != NULL){
-            if (flags_fn(h, coref->co_command, 0, &flags) < 0)
+    if (fb == NULL){
+        if (cligen_node_filter_batch_get(h, &fn, &arg) < 0)
+            goto done;
+        if (fn != NULL){
+            fb = &fb0;
+            if (pt_filter_batch_add(h, pttmp, prefix, fb) < 0)
+                goto done;
+            if (pt_filter_batch_call(h, fn, arg, cvv_var, fb) < 0)
                 goto done;
         }
-        if (co_expand_treeref_copy_shallow(h, coref, NULL, cvv2, cvv_var, ptref, flags, pttmp) < 0)
-            goto done;
     }
     /* Copy the expand tree to the final tree.
      */
     for (i=0; i<pt_len_get(pttmp); i++){
         if ((cot = pt_vec_i_get(pttmp, i)) == NULL)
             continue;
+        skip = prefix && !pt_expand_prefix_match(h, cot, prefix);
+        /* Same candidates as pt_filter_batch_add */
+        filtered = !skip && pt_filter_batch_skip(fb);
+        if (skip && kept)
+            continue;
+        len = pt_len_get(ptn);
         if (pt_expand1_co(h, cot, hide, expandvar,
                           cvv_var,
                           cvv_filter,
+                          filter_labels,
                           callbacks,
                           1,
+                          filtered,
                           ptn) < 0)
             goto done;
+        if (skip && pt_len_get(ptn) > len)
+            kept++;
     }
     retval = 0;
  done:
-    if (cvv2)
-        cvec_free(cvv2);
-    if (pttmp)
-        pt_free(pttmp, 0);
+    pt_filter_batch_free(h, &fb0);
+    if (pttmp && pttmp0 == NULL)
+        pt_treeref_release(h, pttmp);
     return retval;
 }
 
@@ -1065,6 +2477,9 @@ pt_expand(cligen_handle h,
     int         i;
     cvec       *cvv_filter = NULL;
     cg_obj     *cop;
+    char       *prefix;
+    uint64_t    filter_labels;
+    struct pt_filter_batch fb = {0,};
 
     if (pt_len_get(ptn) != 0){
         errno = EINVAL;
@@ -1072,9 +2487,18 @@ pt_expand(cligen_handle h,
     }
     /* Maybe require */
     cvv_filter = co0?co0->co_filter:NULL;
+    filter_labels = cvec_names_sig(cvv_filter);
+    prefix = pt_expand_prefix(h);
+    pt_transient_set(ptn, 1);
     pt_sets_set(ptn, pt_sets_get(pt));
     if (pt_len_get(pt) == 0)
         goto ok;
+    /* Filter all candidates of this level at once, if there is a batched node filter */
+    if (pt_filter_batch(h, pt, cvt, cvv_var, prefix, &fb) < 0)
+        goto done;
+    /* Most objects are copied once, references and expansions may grow it further */
+    if (pt_vec_reserve(ptn, pt_len_get(pt)) < 0)
+        goto done;
     /* There is already a @|pipe menu on this level, no need for default */
     for (i=0; i<pt_len_get(pt); i++){ /* From pt (orig) build ptn (new) */
         if ((co = pt_vec_i_get(pt, i)) == NULL){
@@ -1084,8 +2508,13 @@ pt_expand(cligen_handle h,
             if (co->co_type == CO_REFERENCE){
                 if (pt_expand_reference(h, co, cvt, cvv_var,
                                         cvv_filter,
+                                        filter_labels,
                                         hide, expandvar,
                                         callbacks,
+                                        pt,
+                                        prefix,
+                                        fb.fb_pttmp?fb.fb_pttmp[i]:NULL,
+                                        &fb,
                                         ptn) < 0)
                     goto done;
             }
@@ -1093,8 +2522,10 @@ pt_expand(cligen_handle h,
                 if (pt_expand1_co(h, co, hide, expandvar,
                                   cvv_var,
                                   cvv_filter,
+                                  filter_labels,
                                   callbacks,
                                   0,
+                                  pt_filter_batch_skip(&fb),
                                   ptn) < 0)
                     goto done;
                 /* Given a terminal and output-pipe, add default output pipe tree reference
@@ -1105,14 +2536,21 @@ pt_expand(cligen_handle h,
                     (cop = co->co_prev) != NULL &&
                     cop->co_callbacks &&
                     co_pipe != NULL){
+                    /* Copies refer to co_pipe which does not outlive the match */
+                    pt_expand_volatile(h);
                     if (co0 && co0->co_callbacks){
                         if (co_callback_copy(co0->co_callbacks, &co_pipe->co_callbacks) < 0)
                             goto done;
                     }
                     if (pt_expand_reference(h, co_pipe, cvt, cvv_var,
                                             cvv_filter,
+                                            filter_labels,
                                             hide, expandvar,
                                             callbacks,
+                                            NULL,
+                                            prefix,
+                                            NULL,
+                                            NULL,
                                             ptn) < 0)
                         goto done;
                 }
@@ -1130,9 +2568,576 @@ pt_expand(cligen_handle h,
  ok:
     retval = 0;
  done:
+    pt_filter_batch_free(h, &fb);
+    return retval;
+}
+
+/*! Compare two filter label vectors
+ *
+ * @retval  1  Equal
+ * @retval  0  Not equal
+ */
+static int
+pt_expand_filter_eq(cvec *f0,
+                    cvec *f1)
+{
+    cg_var *cv0;
+    cg_var *cv1;
+    char   *name0;
+    char   *name1;
+    int     i;
+
+    if (cvec_len(f0) != cvec_len(f1))
+        return 0;
+    for (i=0; i<cvec_len(f0); i++){
+        cv0 = cvec_i(f0, i);
+        cv1 = cvec_i(f1, i);
+        name0 = cv_name_get(cv0);
+        name1 = cv_name_get(cv1);
+        if (name0 == NULL || name1 == NULL){
+            if (name0 != name1)
+                return 0;
+        }
+        else if (strcmp(name0, name1) != 0)
+            return 0;
+        if (cv_cmp(cv0, cv1) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/*! Free a cached expanded parse-tree
+ */
+static void
+pt_expand_entry_free(struct pt_expand_entry *pe)
+{
+    if (pe->pe_ptn)
+        pt_free(pe->pe_ptn, 0);
+    if (pe->pe_filter)
+        cvec_free(pe->pe_filter);
+    if (pe->pe_pipe)
+        free(pe->pe_pipe);
+    if (pe->pe_prefix)
+        free(pe->pe_prefix);
+    pt_expand_deps_free(&pe->pe_deps);
+    free(pe);
+}
+
+/*! Remove all entries of the expand cache, except those in use which are marked as stale
+ */
+static void
+pt_expand_cache_clear(struct pt_expand_cache *pc)
+{
+    struct pt_expand_entry *pe;
+    struct pt_expand_entry **pep;
+
+    pep = &pc->pc_entries;
+    while ((pe = *pep) != NULL){
+        if (pe->pe_busy){
+            pe->pe_stale = 1;
+            pep = &pe->pe_next;
+        }
+        else{
+            *pep = pe->pe_next;
+            pt_expand_entry_free(pe);
+            pc->pc_len--;
+        }
+    }
+}
+
+/*! Expand a parse-tree using a cache of earlier expansions of the same tree
+ *
+ * Same as pt_expand but the result is cached in the handle and reused by later calls with
+ * the same original parse-tree and parameters, eg when the same command is matched on every
+ * TAB or '?'.
+ * An expansion is not cached if it depends on input or application callbacks, ie if it
+ * invokes expand callbacks, the node filter callback, the tree resolve wrapper or a
+ * default output pipe. The treeref flags callback is assumed to be deterministic.
+ * An entry is invalid when the original tree or a tree it references has changed, see
+ * pt_tree_generation_get(). The cache is flushed when a parse-tree head of the handle
+ * changes, or the global generation, see pt_generation_get().
+ * @param[in]  h         Cligen handle
+ * @param[in]  co0       Parent, if any
+ * @param[in]  pt        Original parse-tree consisting of a vector of cligen objects
+ * @param[in]  cvt       Tokenized string: vector of tokens
+ * @param[in]  cvv_var   Cligen variable vector containing vars/values pair for completion
+ * @param[in]  hide      If 0, include hidden commands. If 1, do not include hidden commands.
+ * @param[in]  expandvar Set if VARS should be expanded, eg ? <tab>
+ * @param[in]  callbacks Callback structure of expanded treeref
+ * @param[in]  co_pipe   Pipe output extra default menu
+ * @param[out] ptnp      Expanded parse-tree, release with pt_expand_release, do not modify
+ * @retval     0         OK
+ * @retval    -1         Error
+ * @see pt_expand
+ * @see pt_expand_cache_flush
+ */
+int
+pt_expand_cached(cligen_handle h,
+                 cg_obj       *co0,
+                 parse_tree   *pt,
+                 cvec         *cvt,
+                 cvec         *cvv_var,
+                 int           hide,
+                 int           expandvar,
+                 cg_callback  *callbacks,
+                 cg_obj       *co_pipe,
+                 parse_tree  **ptnp)
+{
+    int                     retval = -1;
+    struct cligen_handle   *ch = handle(h);
+    struct pt_expand_cache *pc;
+    struct pt_expand_entry *pe;
+    struct pt_expand_entry *peprev = NULL;
+    struct pt_expand_entry *pelast;
+    parse_tree             *ptn = NULL;
+    cvec                   *filter;
+    char                   *pipe;
+    char                   *prefix;
+    int                     vol;
+    struct pt_expand_deps   deps = {0,};
+    struct pt_expand_deps  *pdouter;
+
+    if (pt == NULL || ptnp == NULL){
+        errno = EINVAL;
+        goto done;
+    }
+    filter = co0?co0->co_filter:NULL;
+    pipe = co_pipe?co_pipe->co_command:NULL;
+    prefix = pt_expand_prefix(h);
+    if ((pc = ch->ch_expand_cache) == NULL){
+        if ((pc = malloc(sizeof(*pc))) == NULL){
+            fprintf(stderr, "%s: malloc: %s\n", __FUNCTION__, strerror(errno));
+            goto done;
+        }
+        memset(pc, 0, sizeof(*pc));
+        pc->pc_generation = pt_generation_get();
+        pc->pc_ph_generation = ch->ch_ph_generation;
+        ch->ch_expand_cache = pc;
+    }
+    else if (pc->pc_generation != pt_generation_get() ||
+             pc->pc_ph_generation != ch->ch_ph_generation){
+        pt_expand_cache_clear(pc);
+        pc->pc_generation = pt_generation_get();
+        pc->pc_ph_generation = ch->ch_ph_generation;
+    }
+    pdouter = ch->ch_expand_deps;
+    for (pe = pc->pc_entries; pe; pe = pe->pe_next){
+        if (pe->pe_stale == 0 &&
+            pe->pe_pt == pt &&
+            pe->pe_hide == hide &&
+            pe->pe_expandvar == expandvar &&
+            ((pe->pe_pipe == NULL && pipe == NULL) ||
+             (pe->pe_pipe && pipe && strcmp(pe->pe_pipe, pipe) == 0)) &&
+            ((pe->pe_prefix == NULL && prefix == NULL) ||
+             (pe->pe_prefix && prefix && strcmp(pe->pe_prefix, prefix) == 0)) &&
+            pt_expand_filter_eq(pe->pe_filter, filter))
+            break;
+        peprev = pe;
+    }
+    if (pe != NULL && !pt_expand_deps_valid(&pe->pe_deps)){
+        /* Stale: the original tree or a referenced tree has changed */
+        if (pe->pe_busy)
+            pe->pe_stale = 1;
+        else{
+            if (peprev)
+                peprev->pe_next = pe->pe_next;
+            else
+                pc->pc_entries = pe->pe_next;
+            pt_expand_entry_free(pe);
+            pc->pc_len--;
+        }
+        pe = NULL;
+    }
+    if (pe != NULL && pe->pe_busy == 0){ /* Hit */
+        if (peprev){ /* Move first */
+            peprev->pe_next = pe->pe_next;
+            pe->pe_next = pc->pc_entries;
+            pc->pc_entries = pe;
+        }
+        if (pt_expand_deps_merge(pdouter, &pe->pe_deps) < 0)
+            goto done;
+        pe->pe_busy++;
+        *ptnp = pe->pe_ptn;
+        goto ok;
+    }
+    /* Miss, or the entry is used by an enclosing match (eg recursive tree): expand */
+    if ((ptn = pt_new()) == NULL)
+        goto done;
+    vol = pc->pc_volatile;
+    if (pt_expand_deps_add(&deps, pt, pt_tree_generation_get(pt)) < 0)
+        goto done;
+    /* Collect trees resolved by tree references */
+    ch->ch_expand_deps = &deps;
+    retval = pt_expand(h, co0, pt, cvt, cvv_var, hide, expandvar, callbacks, co_pipe, ptn);
+    ch->ch_expand_deps = pdouter;
+    if (retval < 0)
+        goto done;
+    retval = -1;
+    if (pt_expand_deps_merge(pdouter, &deps) < 0)
+        goto done;
+    if (pe == NULL &&
+        pc->pc_volatile == vol &&
+        pc->pc_generation == pt_generation_get() &&
+        pc->pc_ph_generation == ch->ch_ph_generation &&
+        pt_expand_deps_valid(&deps)){
+        if ((pe = malloc(sizeof(*pe))) == NULL){
+            fprintf(stderr, "%s: malloc: %s\n", __FUNCTION__, strerror(errno));
+            goto done;
+        }
+        memset(pe, 0, sizeof(*pe));
+        pe->pe_pt = pt;
+        pe->pe_hide = hide;
+        pe->pe_expandvar = expandvar;
+        if (cvec_len(filter) && (pe->pe_filter = cvec_dup(filter)) == NULL){
+            pt_expand_entry_free(pe);
+            goto done;
+        }
+        if (pipe && (pe->pe_pipe = strdup(pipe)) == NULL){
+            pt_expand_entry_free(pe);
+            goto done;
+        }
+        if (prefix && (pe->pe_prefix = strdup(prefix)) == NULL){
+            pt_expand_entry_free(pe);
+            goto done;
+        }
+        pe->pe_ptn = ptn;
+        pe->pe_deps = deps;
+        memset(&deps, 0, sizeof(deps));
+        pe->pe_busy = 1;
+        pe->pe_id = ++ch->ch_expand_id;
+        pe->pe_next = pc->pc_entries;
+        pc->pc_entries = pe;
+        pc->pc_len++;
+        /* Evict least recently used entry not in use */
+        if (pc->pc_len > PT_EXPAND_CACHE_MAX){
+            pelast = NULL;
+            peprev = NULL;
+            for (pe = pc->pc_entries; pe->pe_next; pe = pe->pe_next)
+                if (pe->pe_next->pe_busy == 0){
+                    peprev = pe;
+                    pelast = pe->pe_next;
+                }
+            if (pelast){
+                peprev->pe_next = pelast->pe_next;
+                pt_expand_entry_free(pelast);
+                pc->pc_len--;
+            }
+        }
+    }
+    *ptnp = ptn;
+    ptn = NULL;
+ ok:
+    retval = 0;
+ done:
+    pt_expand_deps_free(&deps);
+    if (ptn)
+        pt_free(ptn, 0);
     return retval;
 }
 
+/*! Release an expanded parse-tree returned by pt_expand_cached
+ *
+ * If the parse-tree is cached it is kept for later use, otherwise it is freed
+ * @param[in]  h    Cligen handle
+ * @param[in]  ptn  Expanded parse-tree
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+int
+pt_expand_release(cligen_handle h,
+                  parse_tree   *ptn)
+{
+    struct pt_expand_cache  *pc;
+    struct pt_expand_entry  *pe = NULL;
+    struct pt_expand_entry **pep = NULL;
+    cg_obj                  *co;
+    int                      i;
+
+    if ((pc = handle(h)->ch_expand_cache) != NULL){
+        pep = &pc->pc_entries;
+        while ((pe = *pep) != NULL){
+            if (pe->pe_ptn == ptn)
+                break;
+            pep = &pe->pe_next;
+        }
+    }
+    if (pe == NULL)
+        return pt_free(ptn, 0);
+    /* Match flags are normally cleared by the matching code, but not on error */
+    for (i=0; i<pt_len_get(ptn); i++)
+        if ((co = pt_vec_i_get(ptn, i)) != NULL)
+            co_flags_reset(co, CO_FLAGS_MATCH);
+    if (--pe->pe_busy == 0 && pe->pe_stale){
+        *pep = pe->pe_next;
+        pt_expand_entry_free(pe);
+        pc->pc_len--;
+    }
+    return 0;
+}
+
+/*! Return unique id of a cached expanded parse-tree
+ *
+ * The id identifies an expanded parse-tree as long as it is cached. Ids are never reused,
+ * so that data derived from an expanded parse-tree can be stored together with its id and
+ * safely be reused if the id is still valid.
+ * @param[in]  h    Cligen handle
+ * @param[in]  ptn  Expanded parse-tree, as returned by pt_expand_cached
+ * @retval     id   Unique id of cached parse-tree
+ * @retval     0    Not cached, or not valid
+ */
+uint64_t
+pt_expand_cached_id(cligen_handle h,
+                    parse_tree   *ptn)
+{
+    struct pt_expand_cache *pc;
+    struct pt_expand_entry *pe;
+
+    if ((pc = handle(h)->ch_expand_cache) == NULL ||
+        pc->pc_generation != pt_generation_get() ||
+        pc->pc_ph_generation != handle(h)->ch_ph_generation)
+        return 0;
+    for (pe = pc->pc_entries; pe; pe = pe->pe_next)
+        if (pe->pe_ptn == ptn)
+            return (pe->pe_stale || !pt_expand_deps_valid(&pe->pe_deps)) ? 0 : pe->pe_id;
+    return 0;
+}
+
+/*! Flush the expand cache of a handle, including cached expansions of tree references
+ *
+ * The cache is flushed automatically when parse-trees change. Call this if the outcome of
+ * an expansion changes in a way that cannot be detected, such as when cligen objects are
+ * modified in place.
+ * @param[in]  h    Cligen handle
+ * @retval     0    OK
+ * @see pt_expand_cached
+ * @see pt_generation_inc
+ */
+int
+pt_expand_cache_flush(cligen_handle h)
+{
+    struct cligen_handle    *ch = handle(h);
+    struct pt_expand_cache  *pc;
+    struct pt_treeref_cache *tc;
+
+    if ((pc = ch->ch_expand_cache) != NULL){
+        pt_expand_cache_clear(pc);
+        if (pc->pc_entries == NULL){
+            free(pc);
+            ch->ch_expand_cache = NULL;
+        }
+    }
+    if ((tc = ch->ch_treeref_cache) != NULL){
+        pt_treeref_cache_clear(tc);
+        if (tc->tc_entries == NULL){
+            free(tc);
+            ch->ch_treeref_cache = NULL;
+        }
+    }
+    return 0;
+}
+
+/*! Find or create options of an expand callback
+ *
+ * @param[in]  h       CLIgen handle
+ * @param[in]  fn_str  Name of expand callback, or NULL for default
+ * @retval     eo      Options of the callback
+ * @retval     NULL    Error
+ */
+static struct pt_expand_fn_opt *
+pt_expand_fn_opt_get(cligen_handle h,
+                     const char   *fn_str)
+{
+    struct cligen_handle      *ch = handle(h);
+    struct pt_expand_fn_cache *ec;
+    struct pt_expand_fn_opt   *eo;
+
+    if ((ec = ch->ch_expand_fn_cache) == NULL){
+        if ((ec = malloc(sizeof(*ec))) == NULL)
+            return NULL;
+        memset(ec, 0, sizeof(*ec));
+        ch->ch_expand_fn_cache = ec;
+    }
+    for (eo = ec->ec_opts; eo; eo = eo->eo_next){
+        if (fn_str == NULL ? eo->eo_fn_str == NULL :
+            eo->eo_fn_str != NULL && strcmp(eo->eo_fn_str, fn_str) == 0)
+            return eo;
+    }
+    if ((eo = malloc(sizeof(*eo))) == NULL)
+        return NULL;
+    memset(eo, 0, sizeof(*eo));
+    if (fn_str && (eo->eo_fn_str = strdup(fn_str)) == NULL){
+        free(eo);
+        return NULL;
+    }
+    eo->eo_next = ec->ec_opts;
+    ec->ec_opts = eo;
+    return eo;
+}
+
+/*! Remove options of expand callbacks that are all default
+ */
+static void
+pt_expand_fn_opt_purge(struct pt_expand_fn_cache *ec)
+{
+    struct pt_expand_fn_opt  *eo;
+    struct pt_expand_fn_opt **eop;
+
+    eop = &ec->ec_opts;
+    while ((eo = *eop) != NULL){
+        if (eo->eo_ttl == 0 && eo->eo_async == 0){
+            *eop = eo->eo_next;
+            if (eo->eo_fn_str)
+                free(eo->eo_fn_str);
+            free(eo);
+        }
+        else
+            eop = &eo->eo_next;
+    }
+}
+
+/*! Cache results of an expand callback for a time
+ *
+ * Results of expand callbacks are by default not cached: the callback is invoked on every
+ * TAB, '?' and evaluation. If a time-to-live is set, the commands and helptexts returned
+ * by the callback are reused for later calls with the same callback arguments, labels,
+ * treeref callback arguments and variables until the time has passed.
+ * @param[in]  h       CLIgen handle
+ * @param[in]  fn_str  Name of expand callback, or NULL for default of all expand callbacks
+ * @param[in]  ttl     Time-to-live in ms, 0 to not cache results
+ * @retval     0       OK
+ * @retval    -1       Error
+ * @see pt_expand_fn_invalidate  When the data behind a callback has changed
+ */
+int
+pt_expand_fn_ttl_set(cligen_handle h,
+                     const char   *fn_str,
+                     uint32_t      ttl)
+{
+    struct pt_expand_fn_opt *eo;
+
+    if ((eo = pt_expand_fn_opt_get(h, fn_str)) == NULL)
+        return -1;
+    eo->eo_ttl = ttl;
+    pt_expand_fn_opt_purge(handle(h)->ch_expand_fn_cache);
+    /* Earlier results may have been cached with another ttl */
+    return pt_expand_fn_invalidate(h, fn_str);
+}
+
+/*! Invoke an expand callback in a worker thread when completing
+ *
+ * A slow expand callback otherwise blocks TAB and '?' until it returns. If set, and an
+ * expand deadline is set with cligen_expand_deadline_set(), completion waits at most the
+ * deadline for the callback. If it has not returned, the variable is shown with the helptext
+ * "(still loading)" and a later TAB or '?' with the same input picks up the result.
+ * At most 16 callbacks of a handle run at the same time.
+ * Evaluation of a command invokes the callback directly, unless a result is picked up.
+ * The callback is invoked with copies of the variables and arguments, and must be thread-safe:
+ * it must not access the CLIgen handle, eg cligen_co_match() or callback arguments.
+ * Callbacks still running when the handle is freed are not waited for.
+ * @param[in]  h       CLIgen handle
+ * @param[in]  fn_str  Name of expand callback, or NULL for default of all expand callbacks
+ * @param[in]  async   If set, invoke callback in worker thread
+ * @retval     0       OK
+ * @retval    -1       Error, eg no thread support (errno ENOTSUP)
+ */
+int
+pt_expand_fn_async_set(cligen_handle h,
+                       const char   *fn_str,
+                       int           async)
+{
+#ifdef HAVE_LIBPTHREAD
+    struct pt_expand_fn_opt *eo;
+
+    if ((eo = pt_expand_fn_opt_get(h, fn_str)) == NULL)
+        return -1;
+    eo->eo_async = async;
+    pt_expand_fn_opt_purge(handle(h)->ch_expand_fn_cache);
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/*! Remove cached results of an expand callback
+ *
+ * Call this when the data an expand callback returns has changed, so that the
+ * callback is invoked at the next expansion
+ * @param[in]  h       CLIgen handle
+ * @param[in]  fn_str  Name of expand callback, or NULL for all expand callbacks
+ * @retval     0       OK
+ * @see pt_expand_fn_ttl_set
+ */
+int
+pt_expand_fn_invalidate(cligen_handle h,
+                        const char   *fn_str)
+{
+    struct pt_expand_fn_cache  *ec;
+    struct pt_expand_fn_entry  *ee;
+    struct pt_expand_fn_entry **eep;
+#ifdef HAVE_LIBPTHREAD
+    struct pt_expand_fn_job    *ej;
+#endif
+
+    if ((ec = handle(h)->ch_expand_fn_cache) == NULL)
+        return 0;
+#ifdef HAVE_LIBPTHREAD
+    /* Results of callbacks still running are dropped */
+    for (ej = ec->ec_jobs; ej; ej = ej->ej_next)
+        if (fn_str == NULL ||
+            (ej->ej_fn_str && strcmp(ej->ej_fn_str, fn_str) == 0))
+            ej->ej_stale = 1;
+#endif
+    eep = &ec->ec_entries;
+    while ((ee = *eep) != NULL){
+        if (fn_str == NULL ||
+            (ee->ee_fn_str && strcmp(ee->ee_fn_str, fn_str) == 0)){
+            *eep = ee->ee_next;
+            pt_expand_fn_entry_free(ee);
+            ec->ec_len--;
+        }
+        else
+            eep = &ee->ee_next;
+    }
+    return 0;
+}
+
+/*! Free the expand callback cache including options
+ *
+ * Expand callbacks still running in worker threads are not waited for, see pt_expand_fn_job_detach
+ * @param[in]  h    CLIgen handle
+ * @retval     0    OK
+ */
+int
+pt_expand_fn_cache_free(cligen_handle h)
+{
+    struct cligen_handle      *ch = handle(h);
+    struct pt_expand_fn_cache *ec;
+    struct pt_expand_fn_opt   *eo;
+#ifdef HAVE_LIBPTHREAD
+    struct pt_expand_fn_job   *ej;
+#endif
+
+    if ((ec = ch->ch_expand_fn_cache) == NULL)
+        return 0;
+#ifdef HAVE_LIBPTHREAD
+    while ((ej = ec->ec_jobs) != NULL){
+        ec->ec_jobs = ej->ej_next;
+        pt_expand_fn_job_detach(ej);
+    }
+#endif
+    pt_expand_fn_invalidate(h, NULL);
+    while ((eo = ec->ec_opts) != NULL){
+        ec->ec_opts = eo->eo_next;
+        if (eo->eo_fn_str)
+            free(eo->eo_fn_str);
+        free(eo);
+    }
+    free(ec);
+    ch->ch_expand_fn_cache = NULL;
+    return 0;
+}
+
 /*! Go through tree and clean & delete all extra memory from pt_expand and pt_expand_treeref
  *
  * @param[in] h    CLIgen handle
@@ -1149,12 +3154,16 @@ pt_expand_cleanup(cligen_handle h,
     int         i;
     cg_obj     *co;
 
+    /* Values are not set in a frozen tree */
+    if (pt_frozen_get(pt) == 1)
+        goto ok;
     for (i=0; i<pt_len_get(pt); i++){
         if ((co = pt_vec_i_get(pt, i)) != NULL){
             if (co_value_set(co, NULL) < 0)
                 goto done;
         }
     }
+ ok:
     retval = 0;
  done:
     return retval;
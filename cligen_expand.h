@@ -66,6 +66,16 @@ char *pt_local_pipe(parse_tree *pt);
 int   pt_expand(cligen_handle h, cg_obj *co, parse_tree *pt, cvec *cvt, cvec *cvv,
               int hide, int expandvar, cg_callback *callbacks,
               cg_obj *co_pipe, parse_tree *ptn);
+int   pt_expand_cached(cligen_handle h, cg_obj *co0, parse_tree *pt, cvec *cvt, cvec *cvv,
+                     int hide, int expandvar, cg_callback *callbacks,
+                     cg_obj *co_pipe, parse_tree **ptnp);
+int   pt_expand_release(cligen_handle h, parse_tree *ptn);
+uint64_t pt_expand_cached_id(cligen_handle h, parse_tree *ptn);
+int   pt_expand_cache_flush(cligen_handle h);
+int   pt_expand_fn_ttl_set(cligen_handle h, const char *fn_str, uint32_t ttl);
+int   pt_expand_fn_async_set(cligen_handle h, const char *fn_str, int async);
+int   pt_expand_fn_invalidate(cligen_handle h, const char *fn_str);
+int   pt_expand_fn_cache_free(cligen_handle h);
 int   pt_expand_cleanup(cligen_handle h, parse_tree *pt);
 int   reference_path_match(cg_obj *co1, parse_tree *pt0, cg_obj **co0p);
 
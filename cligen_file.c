@@ -298,10 +298,14 @@ usage(char *argv)
             "\t-E \t\tExclude keys in callback cvv. Default include keys\n"
             "\t-c \t\tExpand first arg of callback cvv to string matching keywords\n"
             "\t-n <name> \tHide node with this command name via node filter callback (repeatable)\n"
+            "\t-N <name> \tHide node with this command name via batched node filter callback (repeatable)\n"
             "\t-P <mode> \tSet preference mode: 1: tiebreak terminals, 2: also non-terminals\n"
             "\t-t <nr> \tSet tab mode: 1:columns, 2: same pref for vars, 4: all steps\n"
             "\t-s <nr> \tScrolling 0: disable line scrolling, 1: enable line scrolling (default 1)\n"
             "\t-u \t\tEnable experimental UTF-8 mode\n"
+            "\t-A \t\tAllocate parsed trees in arenas\n"
+            "\t-F \t\tFreeze parsed trees (read-only)\n"
+            "\t-B <file> \tCache parsed trees in binary file\n"
             ,
             argv);
     exit(0);
@@ -338,6 +342,43 @@ node_filter_cb(cligen_handle h,
     return 0;
 }
 
+/*! Batched node filter callback: skip nodes whose co_command appears in the skip-list
+ *
+ * @param[in]  h    CLIgen handle
+ * @param[in]  vec  Candidate nodes of a level
+ * @param[in]  len  Length of vec
+ * @param[in]  cvv  Accumulated matched tokens
+ * @param[in]  arg  cvec of node names to skip (string values)
+ * @param[out] skip Skip bitmap, set bit i to exclude vec[i]
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+node_filter_batch_cb(cligen_handle h,
+                     cg_obj      **vec,
+                     int           len,
+                     cvec         *cvv,
+                     void         *arg,
+                     uint8_t      *skip)
+{
+    cvec   *skip_names = (cvec *)arg;
+    cg_var *cv = NULL;
+    int     i;
+
+    for (i=0; i<len; i++){
+        if (vec[i]->co_type != CO_COMMAND)
+            continue;
+        cv = NULL;
+        while ((cv = cvec_each(skip_names, cv)) != NULL){
+            if (strcmp(cv_string_get(cv), vec[i]->co_command) == 0){
+                CLIGEN_SKIP_SET(skip, i);
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
 /* Main */
 int
 main(int   argc,
@@ -361,12 +402,17 @@ main(int   argc,
     int         scrollmode = 0;
     int         exclude_keys = 0;
     int         expand_first = 0;
+    int         freeze = 0;
+    char       *binfile = NULL;
     cvec       *skip_names = NULL;   /* Node names to hide via node filter callback */
+    cvec       *batch_names = NULL;  /* Node names to hide via batched node filter callback */
 
     if ((h = cligen_init()) == NULL)
         goto done;
     if ((skip_names = cvec_new(0)) == NULL)
         goto done;
+    if ((batch_names = cvec_new(0)) == NULL)
+        goto done;
     argv++;argc--;
     for (;(argc>0)&& *argv; argc--, argv++){
         if (**argv != '-')
@@ -409,6 +455,15 @@ main(int   argc,
                 cv_string_set(cv, *argv);
             }
             break;
+        case 'N': /* Batched node filter: hide node by name */
+            argc--;argv++;
+            {
+                cg_var *cv;
+                if ((cv = cvec_add(batch_names, CGV_STRING)) == NULL)
+                    goto done;
+                cv_string_set(cv, *argv);
+            }
+            break;
         case 'P': /* Return first if several have same preference, for terminals */
             argc--;argv++;
             set_preference = atoi(*argv);
@@ -432,6 +487,16 @@ main(int   argc,
         case 'u': /* UTF-8 experimental */
             cligen_utf8_set(h, 1);
             break;
+        case 'A': /* Parse arena */
+            cligen_parse_arena_set(h, 1);
+            break;
+        case 'F': /* Freeze parsed trees */
+            freeze++;
+            break;
+        case 'B': /* Binary file of parsed trees */
+            argc--;argv++;
+            binfile = *argv;
+            break;
         default:
             usage(argv0);
             break;
@@ -446,12 +511,19 @@ main(int   argc,
     if (cvec_len(skip_names) > 0)
         if (cligen_node_filter_set(h, node_filter_cb, skip_names) < 0)
             goto done;
+    if (cvec_len(batch_names) > 0)
+        if (cligen_node_filter_batch_set(h, node_filter_batch_cb, batch_names) < 0)
+            goto done;
     if (set_preference)
         cligen_preference_mode_set(h, set_preference);
 //    cligen_parse_debug(1);
     if ((globals = cvec_new(0)) == NULL)
         goto done;
-    if (clispec_parse_file(h, f, filename?filename:"stdin", NULL, NULL, globals) < 0)
+    if (binfile){
+        if (clispec_parse_file_cache(h, f, filename?filename:"stdin", NULL, binfile, globals) < 0)
+            goto done;
+    }
+    else if (clispec_parse_file(h, f, filename?filename:"stdin", NULL, NULL, globals) < 0)
         goto done;
     ph = NULL;
     while ((ph = cligen_ph_each(h, ph)) != NULL){
@@ -461,6 +533,8 @@ main(int   argc,
             if (set_expand &&
                 cligen_expand_str2fn(pt, str2fn_exp, NULL) < 0) /* expand */
                 goto done;
+            if (freeze && cligen_pt_freeze(pt) < 0)
+                goto done;
         }
     }
     if ((str = cvec_find_str(globals, "prompt")) != NULL)
@@ -488,6 +562,13 @@ main(int   argc,
                 size_t sz = 0;
                 pt_stats(pt, &nr, &sz);
                 fprintf(stdout, "nr:%" PRIu64 ", size:%zu\n", nr, sz);
+                if (pt_arena_get(pt) != NULL){
+                    size_t inr = 0;
+                    size_t isaved = 0;
+
+                    cligen_arena_intern_stats(pt_arena_get(pt), &inr, &sz, &isaved);
+                    fprintf(stdout, "interned:%zu, size:%zu, saved:%zu\n", inr, sz, isaved);
+                }
                 pt_dump(stdout, pt);
                 fflush(stdout);
             }
@@ -501,6 +582,8 @@ main(int   argc,
     fclose(f);
     if (skip_names)
         cvec_free(skip_names);
+    if (batch_names)
+        cvec_free(batch_names);
     if (h)
         cligen_exit(h);
     return retval;
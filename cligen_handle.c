@@ -52,6 +52,7 @@
 #include <sys/ioctl.h>
 
 #include "cligen_buf.h"
+#include "cligen_arena.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
 #include "cligen_parsetree.h"
@@ -66,6 +67,8 @@
 #include "cligen_print.h"
 #include "cligen_history.h"
 #include "cligen_getline.h"
+#include "cligen_expand.h"
+#include "cligen_match.h"
 #include "cligen_handle_internal.h"
 #include "cligen_history.h"
 #include "cligen_history_internal.h"
@@ -215,6 +218,12 @@ cligen_exit(cligen_handle h)
         ch->ch_pt_head = ph->ph_next;
         cligen_ph_free(ph);
     }
+    cligen_ph_index_free(h);
+    match_memo_free(h);
+    pt_expand_cache_flush(h);
+    pt_expand_fn_cache_free(h);
+    if (ch->ch_scratch)
+        cligen_arena_free(ch->ch_scratch);
     free(ch);
     return 0;
 }
@@ -340,6 +349,7 @@ cligen_pt_head_set(cligen_handle h,
     struct cligen_handle *ch = handle(h);
 
     ch->ch_pt_head = ph;
+    cligen_ph_index_free(h); /* Rebuilt on next lookup */
     return 0;
 }
 
@@ -1343,6 +1353,72 @@ cligen_expand_first_set(cligen_handle h,
     return 0;
 }
 
+/*! Get expand deadline
+ *
+ * @param[in] h       CLIgen handle
+ * @retval    ms      Max time in ms completion waits for asynchronous expand callbacks
+ * @see cligen_expand_deadline_set
+ */
+uint32_t
+cligen_expand_deadline_get(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+
+    return ch->ch_expand_deadline;
+}
+
+/*! Set expand deadline
+ *
+ * TAB and '?' wait at most this time for expand callbacks invoked asynchronously.
+ * @param[in] h       CLIgen handle
+ * @param[in] ms      Max time in ms, 0: asynchronous expand callbacks are disabled
+ * @retval    0       OK
+ * @see pt_expand_fn_async_set
+ */
+int
+cligen_expand_deadline_set(cligen_handle h,
+                           uint32_t      ms)
+{
+    struct cligen_handle *ch = handle(h);
+
+    ch->ch_expand_deadline = ms;
+    return 0;
+}
+
+/*! Get parse arena mode
+ *
+ * @param[in] h       CLIgen handle
+ * @retval    1       Parsed trees are allocated in an arena per tree
+ * @retval    0       Parsed trees are allocated with malloc
+ * @see cligen_parse_arena_set
+ */
+int
+cligen_parse_arena_get(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+
+    return ch->ch_parse_arena;
+}
+
+/*! Set parse arena mode
+ *
+ * If set, objects of trees parsed by clispec_parse_str, their commands, helptexts and
+ * sub-trees, are allocated in an arena per tree, and released at once when the tree is freed.
+ * @param[in] h       CLIgen handle
+ * @param[in] mode    0: malloc (default), 1: arena
+ * @retval    0       OK
+ * @see pt_arena_set
+ */
+int
+cligen_parse_arena_set(cligen_handle h,
+                       int           mode)
+{
+    struct cligen_handle *ch = handle(h);
+
+    ch->ch_parse_arena = mode;
+    return 0;
+}
+
 /*! Changes cvec find function behaviour, exclude keywords or include them.
  *
  * @param[in] h
@@ -1493,6 +1569,48 @@ cligen_node_filter_get(cligen_handle          h,
     return 0;
 }
 
+/*! Set CLIgen batched node filter callback
+ *
+ * The callback is invoked once for all candidate nodes of a level during expand/completion.
+ * It may be combined with cligen_node_filter_set, a node is then excluded if any skips it.
+ * @param[in]  h    CLIgen handle
+ * @param[in]  fn   Batched filter function, or NULL to clear
+ * @param[in]  arg  Argument passed to fn
+ * @retval     0    OK
+ */
+int
+cligen_node_filter_batch_set(cligen_handle                h,
+                             cligen_node_filter_batch_fn *fn,
+                             void                        *arg)
+{
+    struct cligen_handle *ch = handle(h);
+
+    ch->ch_node_filter_batch_fn = fn;
+    ch->ch_node_filter_batch_arg = arg;
+    return 0;
+}
+
+/*! Get CLIgen batched node filter callback
+ *
+ * @param[in]  h    CLIgen handle
+ * @param[out] fn   Registered batched filter function (may be NULL)
+ * @param[out] arg  Argument registered with the function
+ * @retval     0    OK
+ */
+int
+cligen_node_filter_batch_get(cligen_handle                 h,
+                             cligen_node_filter_batch_fn **fn,
+                             void                        **arg)
+{
+    struct cligen_handle *ch = handle(h);
+
+    if (fn)
+        *fn = ch->ch_node_filter_batch_fn;
+    if (arg)
+        *arg = ch->ch_node_filter_batch_arg;
+    return 0;
+}
+
 /*! Get the treeref-flags callback
  *
  * @param[in]  h    CLIgen handle
@@ -1526,3 +1644,77 @@ cligen_treeref_flags_fn_set(cligen_handle           h,
     ch->ch_treeref_flags_fn = fn;
     return 0;
 }
+
+/*! Get scratch arena of CLIgen handle, create if not exists
+ *
+ * For short-lived data of a match. Reset on each call of match_pattern outside of a
+ * request, so memory allocated from it must not be kept across calls
+ * @param[in]  h    CLIgen handle
+ * @retval     ca   Scratch arena
+ * @retval     NULL Error
+ * @see cv_parse_scratch
+ * @see cligen_scratch_begin
+ */
+cligen_arena *
+cligen_scratch(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+
+    if (ch->ch_scratch == NULL)
+        ch->ch_scratch = cligen_arena_new(0);
+    return ch->ch_scratch;
+}
+
+/*! Begin a request, eg parsing or completing a line, using the scratch arena
+ *
+ * Tokens, match results and other transient data of the request are allocated in the
+ * scratch arena, which is reset once when the request ends instead of on each match.
+ * Requests may be nested, only the end of the outermost request resets the arena.
+ * @param[in]  h    CLIgen handle
+ * @retval     0    OK
+ * @retval    -1    Error
+ * @see cligen_scratch_end
+ */
+int
+cligen_scratch_begin(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+
+    if (cligen_scratch(h) == NULL)
+        return -1;
+    ch->ch_scratch_depth++;
+    return 0;
+}
+
+/*! End a request, reset the scratch arena if it is the outermost request
+ *
+ * @param[in]  h    CLIgen handle
+ * @retval     0    OK
+ * @see cligen_scratch_begin
+ */
+int
+cligen_scratch_end(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+
+    if (ch->ch_scratch_depth > 0 && --ch->ch_scratch_depth == 0)
+        cligen_arena_reset(ch->ch_scratch);
+    return 0;
+}
+
+/*! Get scratch arena of the current request
+ *
+ * @param[in]  h    CLIgen handle
+ * @retval     ca   Scratch arena, valid until the outermost request ends
+ * @retval     NULL Not in a request, use malloc
+ * @see cligen_scratch_begin
+ */
+cligen_arena *
+cligen_scratch_request(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+
+    if (ch->ch_scratch_depth == 0)
+        return NULL;
+    return ch->ch_scratch;
+}
@@ -125,6 +125,26 @@ typedef int (cligen_hist_fn)(cligen_handle h, const char *cmd, const char *cmd_e
  */
 typedef int (cligen_node_filter_fn)(cligen_handle h, cg_obj *co, cvec *cvv, void *arg, int *skip);
 
+/* Bit i of a node filter skip bitmap, see cligen_node_filter_batch_fn */
+#define CLIGEN_SKIP_SET(skip, i)   ((skip)[(i)/8] |= (uint8_t)(1 << ((i)%8)))
+#define CLIGEN_SKIP_ISSET(skip, i) (((skip)[(i)/8] & (1 << ((i)%8))) != 0)
+
+/*! Callback type: filter all candidate nodes of a level from expand/completion at once
+ *
+ * Batched variant of cligen_node_filter_fn, called once per expanded level with all
+ * candidate nodes of the level, including those of expanded tree references.
+ * Set bit i of skip with CLIGEN_SKIP_SET to exclude vec[i].
+ * @param[in]  h    CLIgen handle
+ * @param[in]  vec  Vector of candidate cligen objects
+ * @param[in]  len  Length of vec
+ * @param[in]  cvv  Accumulated matched tokens so far, see cligen_node_filter_fn
+ * @param[in]  arg  Argument provided at registration time
+ * @param[out] skip Bitmap of (len+7)/8 bytes, cleared on entry
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+typedef int (cligen_node_filter_batch_fn)(cligen_handle h, cg_obj **vec, int len, cvec *cvv, void *arg, uint8_t *skip);
+
 /*! Callback type: determine CO_FLAGS_TREEREF propagation during tree-reference expansion
  *
  * Called by CLIgen for each CO_REFERENCE encountered during expansion.
@@ -242,6 +262,10 @@ int   cligen_caseignore_set(cligen_handle h, int ignorecase);
 
 int   cligen_expand_first_get(cligen_handle h);
 int   cligen_expand_first_set(cligen_handle h, int cvv0expand);
+uint32_t cligen_expand_deadline_get(cligen_handle h);
+int   cligen_expand_deadline_set(cligen_handle h, uint32_t ms);
+int   cligen_parse_arena_get(cligen_handle h);
+int   cligen_parse_arena_set(cligen_handle h, int mode);
 
 int   cligen_exclude_keys_set(cligen_handle h, int status);
 int   cligen_exclude_keys_get(cligen_handle h);
@@ -254,8 +278,15 @@ int   cligen_tree_resolve_wrapper_get(cligen_handle h, cligen_tree_resolve_wrapp
 
 int   cligen_node_filter_set(cligen_handle h, cligen_node_filter_fn *fn, void *arg);
 int   cligen_node_filter_get(cligen_handle h, cligen_node_filter_fn **fn, void **arg);
+int   cligen_node_filter_batch_set(cligen_handle h, cligen_node_filter_batch_fn *fn, void *arg);
+int   cligen_node_filter_batch_get(cligen_handle h, cligen_node_filter_batch_fn **fn, void **arg);
 
 int cligen_treeref_flags_fn_set(cligen_handle h, cligen_treeref_flags_fn *fn);
 int cligen_treeref_flags_fn_get(cligen_handle h, cligen_treeref_flags_fn **fn);
 
+struct cligen_arena *cligen_scratch(cligen_handle h);
+int     cligen_scratch_begin(cligen_handle h);
+int     cligen_scratch_end(cligen_handle h);
+struct cligen_arena *cligen_scratch_request(cligen_handle h);
+
 #endif /* _CLIGEN_HANDLE_H_ */
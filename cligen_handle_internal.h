@@ -69,6 +69,7 @@ typedef struct pt_head  { /* Linked list of cligen parse-trees */
     cg_obj          *ph_workpt;    /* Shortcut to "working point" cligen object, or more
                                     * specifically its parse-tree sub vector. */
     char           *ph_output_pipe; /* Name of output-pipe tree associated w this tree */
+    void           *ph_handle;     /* CLIgen handle of this head, see cligen_ph_add */
 } pt_head;
 
 /* CLIgen handle. Its members should be hidden and only the typedef visible */
@@ -79,6 +80,9 @@ struct cligen_handle{
     char       *ch_prompt;       /* current prompt used */
     pt_head    *ch_pt_head;      /* Linked list of parsetrees */
     pt_head    *ch_pt_head_active; /* Pointer to the currently acrive parsetree */
+    struct ph_index *ch_ph_index; /* Hash index of parsetrees by name, see cligen_ph_find */
+    uint64_t    ch_ph_names;     /* Incremented when parsetree heads are added, removed or renamed */
+    uint64_t    ch_ph_generation; /* Incremented when parsetree heads or their trees change */
     char       *ch_treename_keyword; /* Name of treename parsing keyword */
     cg_obj     *ch_co_match;     /* Matching object in latest evaluation */
     cvec       *ch_callback_arguments; /* Callback arguments */
@@ -112,6 +116,7 @@ struct cligen_handle{
     int         ch_preference_mode;   /* Relaxed variable match preference handling */
     int         ch_ignore_case;  /* Set if ignore case of commands, eg aA = aa */
     int         ch_expand_first; /* Set if expand arg 1 of callback cvv */
+    int         ch_parse_arena;  /* Set if parsed trees are allocated in arenas */
     int         ch_exclude_keys; /* Set if exclude keywords from callback cvv */
     cligen_eval_wrap_fn *ch_eval_wrap_fn;  /* Wrap function check state around cligen_eval */
     void        *ch_eval_wrap_arg; /* Argument to eval wrap function */
@@ -119,7 +124,20 @@ struct cligen_handle{
     void        *ch_tree_resolve_wrapper_arg; /* Argument to treeref wrap function */
     cligen_node_filter_fn *ch_node_filter_fn; /* Callback to filter nodes from expand/completion */
     void        *ch_node_filter_arg;          /* Argument to node filter callback */
+    cligen_node_filter_batch_fn *ch_node_filter_batch_fn; /* Callback to filter a level of nodes */
+    void        *ch_node_filter_batch_arg;    /* Argument to batched node filter callback */
     cligen_treeref_flags_fn *ch_treeref_flags_fn; /* Callback to compute CO_FLAGS_TREEREF propagation */
+    struct pt_expand_cache *ch_expand_cache; /* Cached expanded parse-trees, see pt_expand_cached */
+    uint64_t    ch_expand_id;         /* Last id given to a cached expanded parse-tree */
+    struct pt_treeref_cache *ch_treeref_cache; /* Cached expansions of tree references, see pt_expand_reference */
+    struct pt_expand_deps *ch_expand_deps; /* Trees the ongoing cached expansion depends on */
+    struct pt_expand_fn_cache *ch_expand_fn_cache; /* Cached expand callback results, see pt_expand_fn_ttl_set */
+    uint32_t    ch_expand_deadline;   /* Max ms completion waits for async expand callbacks */
+    int         ch_expand_completing; /* Set while matching for completion, see match_pattern */
+    char       *ch_expand_prefix;     /* Only expand treeref keywords matching this token */
+    struct match_memo *ch_match_memo;        /* Token matches of last input, see match_vec_memo */
+    struct cligen_arena *ch_scratch;         /* Scratch memory of a match, see cligen_scratch */
+    int         ch_scratch_depth;     /* Nesting of requests, see cligen_scratch_begin */
 };
 
 #endif /* _CLIGEN_HANDLE_INTERNAL_H_ */
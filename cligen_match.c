@@ -55,6 +55,7 @@
 #include <arpa/inet.h>
 
 #include "cligen_buf.h"
+#include "cligen_arena.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
 #include "cligen_parsetree.h"
@@ -67,6 +68,8 @@
 #include "cligen_result.h"
 #include "cligen_read.h"
 #include "cligen_match.h"
+#include "cligen_handle_internal.h"
+#include "cligen_cv_internal.h"
 #include "banned.h"
 
 #ifndef MIN
@@ -76,6 +79,42 @@
 /* Development debugging for sets matching */
 #undef _DEBUG_SETS
 
+/* Number of memoized token matches per level, see match_vec_memo */
+#define MATCH_MEMO_WAYS 4
+
+/*! Memoized result of matching one token against one parse-tree
+ *
+ * Saved per level so that matching a line that only differs from the previous line in its
+ * last tokens, eg on every TAB or '?', resumes at the first changed token.
+ * @see match_vec_memo
+ */
+struct match_memo_entry{
+    parse_tree *me_pt;         /* Key: parse-tree, NULL if entry is empty */
+    uint64_t    me_id;         /* Key: expand cache id of pt, 0 if pt is an original tree */
+    uint64_t    me_generation; /* Key: generation of pt if pt is an original tree, otherwise 0 */
+    char       *me_token;      /* Key: token */
+    int         me_lasttoken;  /* Key: token is last */
+    int         me_best;       /* Key: only best match */
+    int         me_prefmode;   /* Key: preference mode */
+    int         me_caseignore; /* Key: case ignore */
+    cg_obj    **me_vec;        /* Matching objects in pt (not copies) */
+    int         me_len;        /* Length of me_vec */
+    uint32_t    me_pref;       /* Preference of matches */
+    char       *me_reason;     /* Reason if no match */
+    uint64_t    me_used;       /* Last used, for replacement */
+    int         me_common;     /* Common prefix of matching commands, see mr_common_get */
+    int         me_unique;     /* Matching commands are equal */
+};
+
+/*! Per-level memo of token matches of a CLIgen handle
+ */
+struct match_memo{
+    uint64_t                 mm_generation; /* Global parse-tree generation of the entries */
+    uint64_t                 mm_clock;      /* Incremented on every lookup */
+    int                      mm_levels;     /* Number of levels */
+    struct match_memo_entry *mm_vec;        /* MATCH_MEMO_WAYS entries per level */
+};
+
 /*! Match variable against input string
  *
  * @param[in]  h             CLIgen handle
@@ -88,7 +127,8 @@
  * @retval    -1             Error (print msg on stderr)
  * Who prints errors?
  * @see cvec_match where actual allocation of variables is made not only sanity
- * For ints a double parse for most specific error, see https://github.com/clicon/clixon/issues/319
+ * For ints the error is of the specification range if violated, otherwise of the type range,
+ * see https://github.com/clicon/clixon/issues/319
  */
 static int
 match_variable(cligen_handle h,
@@ -97,55 +137,37 @@ match_variable(cligen_handle h,
                char        **reason,
                int          *is_constraint)
 {
-    int         retval = -1;
-    cg_var     *cv; /* Just a temporary cv for validation */
-    cg_varspec *cs;
-    enum cv_type t;
+    int           retval = -1;
+    cg_var        cv; /* Just a temporary cv for validation, strings in scratch arena */
+    cligen_arena *ca;
+    cg_varspec   *cs;
+    enum cv_type  t;
 
     cs = &co->u.cou_var;
     t = co->co_vtype;
+    cv_init(&cv, t);
     if (is_constraint)
         *is_constraint = 0;
-    /* First parse as least specific type */
-    if (t==CGV_INT8 || t==CGV_INT16|| t==CGV_INT32)
-        t = CGV_INT64;
-    else if (t==CGV_UINT8 || t==CGV_UINT16|| t==CGV_UINT32)
-        t = CGV_UINT64;
-    if ((cv = cv_new(t)) == NULL)
+    /* Ints: one parse for value, range of specification and of type */
+    if (cv_isint(t)){
+        retval = cv_parse_int1(str, &cv, cs, reason, is_constraint);
+        goto done;
+    }
+    if ((ca = cligen_scratch(h)) == NULL)
         goto done;
     if (t == CGV_DEC64) /* XXX: Seems misplaced? / too specific */
-        cv_dec64_n_set(cv, cs->cgs_dec64_n);
-    if ((retval = cv_parse1(str, cv, reason)) <= 0){
-        /* If broad type parse failed, re-parse with specific type for correct error message */
-        if (retval == 0 && t != co->co_vtype){
-            if (reason != NULL && *reason != NULL){
-                free(*reason);
-                *reason = NULL;
-            }
-            cv_reset(cv);
-            cv_type_set(cv, co->co_vtype);
-            retval = cv_parse1(str, cv, reason);
-            if (retval > 0)
-                retval = 0;
-        }
+        cv_dec64_n_set(&cv, cs->cgs_dec64_n);
+    if ((retval = cv_parse_scratch(str, &cv, ca, reason)) <= 0)
         goto done;
-    }
     /* Validate value: failure here is constraint violation, not a type mismatch */
-    if ((retval = cv_validate(h, cv, cs, co->co_command, reason)) <= 0){
+    if ((retval = cv_validate(h, &cv, cs, co->co_command, reason)) <= 0){
         if (is_constraint)
             *is_constraint = 1;
         goto done;
     }
-    if (t != co->co_vtype){         /* Second parse as specific type */
-        cv_reset(cv);
-        cv_type_set(cv, co->co_vtype);
-        if ((retval = cv_parse1(str, cv, reason)) <= 0)
-            goto done;
-    }
     /* here retval should be 1 */
   done:
-    if (cv)
-        cv_free(cv);
+    cv_reset_scratch(&cv);
     return retval;
 }
 
@@ -375,6 +397,13 @@ add_cov_to_cvec(cligen_handle h,
     return cv;
 }
 
+static int
+match_poscmp(const void *a,
+             const void *b)
+{
+    return *(int *)a - *(int *)b;
+}
+
 /*! Match a parse-tree (pt) with a command vector (cvt/cvr)
  *
  * @param[in]  h        CLIgen handle
@@ -384,17 +413,19 @@ add_cov_to_cvec(cligen_handle h,
  * @param[in]  best     Only return best match (for command evaluation) instead of
  *                      all possible options
  * @param[out] mr       Match result, when retval = 0
+ * @param[out] me       If set, also record the matching objects of pt, see match_vec_memo
  * @retval     0        OK. result in mr parameter
  * @retval    -1        Error
  */
 static int
-match_vec(cligen_handle h,
-          parse_tree   *pt,
-          char         *token,
-          char         *resttokens,
-          int           lasttoken,
-          int           best,
-          match_result *mr)
+match_vec(cligen_handle            h,
+          parse_tree              *pt,
+          char                    *token,
+          char                    *resttokens,
+          int                      lasttoken,
+          int                      best,
+          match_result            *mr,
+          struct match_memo_entry *me)
 {
     int     retval = -1;
     int32_t pref_lower = INT32_MAX; /* Preference lower bound */
@@ -406,37 +437,101 @@ match_vec(cligen_handle h,
     cg_obj *co;
     cg_obj *cop = NULL;
     int     match;
+    int     wantreason;             /* Reason of no-match may be saved */
     int     is_constraint;          /* Rejection was a constraint violation, not type mismatch */
     int     pref_lower_is_constraint = 0; /* is_constraint for the pref_lower winner */
+    pt_candidates cd;               /* Candidates of command index, see pt_index_candidates */
+    int     indexed = 0;            /* cd is set */
+    const int *cmdv = NULL;         /* Commands of cd in parse-tree order */
+    int    *candv = NULL;           /* Sorted copy of commands of cd if not in parse-tree order */
+    int     candlen;
+    int     ci = 0;                 /* Next command of cd */
+    int     oi = 0;                 /* Next other object of cd */
+    int     fromcmd;                /* Object is a command of cd */
+    int     ncmdmatch = 0;          /* Matching commands of cd */
+    int     j;
+    uint64_t typemask = 0;          /* Types token may be parsed as, see cv_str2typemask */
+    cg_obj *colazy = NULL;          /* Skipped variable whose reason is saved, made at end */
 #ifdef CLIGEN_DONT_MATCH_PARTIAL_EXPANDS
     cg_obj *coref;
 #endif
 
+    /* Large levels of original or cached trees: only try commands with token as prefix */
+    candlen = pt_len_get(pt);
+    if (token != NULL && *token != '\0' &&
+        candlen >= PT_INDEX_MIN &&
+        (!pt_transient_get(pt) || pt_expand_cached_id(h, pt) != 0)){
+        if (pt_index_candidates(pt, token, cligen_caseignore_get(h), &cd) < 0)
+            goto done;
+        indexed = 1;
+        cmdv = cd.cd_cmdv;
+        if (!cd.cd_ordered && cd.cd_cmdlen > 1){
+            /* Match in parse-tree order, not in index order */
+            if ((candv = malloc(cd.cd_cmdlen*sizeof(*candv))) == NULL)
+                goto done;
+            memcpy(candv, cd.cd_cmdv, cd.cd_cmdlen*sizeof(*candv));
+            qsort(candv, cd.cd_cmdlen, sizeof(*candv), match_poscmp);
+            cmdv = candv;
+        }
+        candlen = cd.cd_cmdlen + cd.cd_otherlen;
+    }
     /* Loop through parse-tree at this level to find matches */
-    for (i=0; i<pt_len_get(pt); i++){
+    for (j=0; j<candlen; j++){
+        /* Merge commands and other objects of the index in parse-tree order */
+        fromcmd = 0;
+        if (!indexed)
+            i = j;
+        else if (oi < cd.cd_otherlen &&
+                 (ci == cd.cd_cmdlen || cd.cd_otherv[oi] < cmdv[ci]))
+            i = cd.cd_otherv[oi++];
+        else{
+            i = cmdv[ci++];
+            fromcmd = 1;
+        }
         if ((co = pt_vec_i_get(pt, i)) == NULL)
             continue;
+        /* Only the reason of a variable with lower preference than any earlier
+         * no-match can be saved below, do not create reasons that would be discarded
+         * (variable preference does not depend on exact)
+         */
+        wantreason = co->co_type == CO_VARIABLE && co_pref(co, 0) < pref_lower;
+        /* Skip variables whose type token cannot be parsed as, and defer the reason */
+        if (co->co_type == CO_VARIABLE && !ISREST(co) &&
+            token != NULL && *token != '\0'){
+            if (typemask == 0)
+                typemask = cv_str2typemask(token);
+            if ((typemask & cv_typemask(co->co_vtype)) == 0){
+                if (wantreason){
+                    pref_lower = co_pref(co, 0);
+                    pref_lower_is_constraint = 0;
+                    mr_reason_set(mr, NULL);
+                    colazy = co;
+                }
+                continue;
+            }
+        }
         /* Return -1: error, 0: nomatch, 1: match */
         tmpreason = NULL;
         is_constraint = 0;
         if ((match = match_object(h,
                                   ISREST(co)?resttokens:token,
                                   co, best, &exact,
-                                  &tmpreason,     /* if match == 0 */
+                                  wantreason?&tmpreason:NULL, /* if match == 0 */
                                   &is_constraint
                                   )) < 0)
             goto done;
         p = co_pref(co, exact); /* get match preferences (higher is better match) */
         if (match == 0){ /* No match */
-            assert(tmpreason != NULL);
+            assert(!wantreason || tmpreason != NULL);
             /* If all fails, save lowest(widest) preference error message,
              * for variables only
              */
-            if (p < pref_lower && co->co_type == CO_VARIABLE){
+            if (wantreason){
                 pref_lower = p;
                 pref_lower_is_constraint = is_constraint;
                 mr_reason_set(mr, tmpreason);
                 tmpreason = NULL;
+                colazy = NULL;
             }
             if (tmpreason){
                 free(tmpreason);
@@ -452,6 +547,7 @@ match_vec(cligen_handle h,
                 if ((r = strdup("Already matched")) == NULL)
                     goto done;
                 mr_reason_set(mr, r);
+                colazy = NULL;
             }
         }
         else { /* Match: if best compare and save highest preference */
@@ -480,6 +576,8 @@ match_vec(cligen_handle h,
                         if (mr_pt_append(mr, co, ISREST(co)?resttokens:token) < 0)
                             goto done;
                         mr_pref_set(mr, p);
+                        if (me)
+                            me->me_vec[me->me_len++] = co;
                     }
                 }
                 else if (p > pref_upper){ /* Start again at this level */
@@ -490,6 +588,10 @@ match_vec(cligen_handle h,
                         goto done;
                     mr_pref_set(mr, p);
                     cop = co;
+                    if (me){
+                        me->me_vec[0] = co;
+                        me->me_len = 1;
+                    }
                 }
                 else{ /* p < pref_upper : skip */
                 }
@@ -498,6 +600,10 @@ match_vec(cligen_handle h,
                 if (mr_pt_append(mr, co, ISREST(co)?resttokens:token) < 0)
                     goto done;
                 mr_pref_set(mr, p);
+                if (me)
+                    me->me_vec[me->me_len++] = co;
+                if (fromcmd && co->co_value == NULL)
+                    ncmdmatch++;
             }
         } /* switch match */
         assert(tmpreason == NULL);
@@ -519,10 +625,13 @@ match_vec(cligen_handle h,
         coref->co_expand_fn != NULL
         ){
         mr_pt_reset(mr); /* remove match */
+        if (me)
+            me->me_len = 0;
         if ((tmpreason = strdup("Partial match")) == NULL)
-            return -1;
+            goto done;
         mr_reason_set(mr, tmpreason);
         tmpreason = NULL;
+        colazy = NULL;
     }
 #endif
     if (mr_pt_len_get(mr) != 0){
@@ -542,13 +651,212 @@ match_vec(cligen_handle h,
              * all valid completions remain visible regardless of sibling failures.
              */
             mr_pt_reset(mr);
+            if (me)
+                me->me_len = 0;
         }
         else
             mr_reason_set(mr, NULL);
     }
+    else if (colazy != NULL){ /* Make the reason of the skipped variable */
+        if (match_object(h, token, colazy, best, &exact, &tmpreason, NULL) < 0)
+            goto done;
+        mr_reason_set(mr, tmpreason);
+        tmpreason = NULL;
+    }
+    /* All matches are the commands with token as prefix: their common prefix is known */
+    if (indexed && !best && !cligen_caseignore_get(h) &&
+        ncmdmatch > 0 && ncmdmatch == cd.cd_cmdlen && mr_pt_len_get(mr) == ncmdmatch)
+        mr_common_set(mr, cd.cd_common, cd.cd_unique);
+    retval = 0;
+ done:
+    if (candv)
+        free(candv);
+    return retval;
+}
+
+/*! Clear a memoized token match
+ */
+static void
+match_memo_entry_clear(struct match_memo_entry *me)
+{
+    if (me->me_token)
+        free(me->me_token);
+    if (me->me_vec)
+        free(me->me_vec);
+    if (me->me_reason)
+        free(me->me_reason);
+    memset(me, 0, sizeof(*me));
+}
+
+/*! Match a parse-tree with a token, reusing the result of an earlier match if possible
+ *
+ * Same as match_vec but the matching objects are saved per level in the handle. When the
+ * same token is matched against the same parse-tree again, eg when TAB or '?' is typed
+ * after editing the end of a line, the saved objects are used instead of matching the token
+ * against every object of the parse-tree. Thereby matching effectively resumes at the first
+ * changed token.
+ * Only original parse-trees and cached expansions are memoized, since the saved objects
+ * must stay valid. Sets and parse-trees with REST variables are not memoized since their
+ * result also depends on earlier matches and on the rest of the line.
+ * @param[in]  h          CLIgen handle
+ * @param[in]  pt         Parse-tree
+ * @param[in]  level      Current command level
+ * @param[in]  token      Token to match at this level
+ * @param[in]  resttokens Rest of tokens at this level
+ * @param[in]  lasttoken  Token is last token
+ * @param[in]  best       Only return best match
+ * @param[out] mr         Match result, when retval = 0
+ * @retval     0          OK. result in mr parameter
+ * @retval    -1          Error
+ * @see match_vec
+ */
+static int
+match_vec_memo(cligen_handle h,
+               parse_tree   *pt,
+               int           level,
+               char         *token,
+               char         *resttokens,
+               int           lasttoken,
+               int           best,
+               match_result *mr)
+{
+    int                      retval = -1;
+    struct cligen_handle    *ch = handle(h);
+    struct match_memo       *mm;
+    struct match_memo_entry *me = NULL;
+    struct match_memo_entry *vec;
+    uint64_t                 id = 0;
+    uint64_t                 gen = 0;
+    int                      prefmode;
+    int                      caseignore;
+    int                      i;
+    cg_obj                  *co;
+    char                    *r;
+
+    if (pt == NULL || token == NULL || level < 0 || pt_sets_get(pt))
+        return match_vec(h, pt, token, resttokens, lasttoken, best, mr, NULL);
+    if (pt_transient_get(pt)){
+        if ((id = pt_expand_cached_id(h, pt)) == 0)
+            return match_vec(h, pt, token, resttokens, lasttoken, best, mr, NULL);
+    }
+    else
+        gen = pt_tree_generation_get(pt);
+    if ((mm = ch->ch_match_memo) == NULL){
+        if ((mm = malloc(sizeof(*mm))) == NULL){
+            fprintf(stderr, "%s: malloc: %s\n", __FUNCTION__, strerror(errno));
+            goto done;
+        }
+        memset(mm, 0, sizeof(*mm));
+        mm->mm_generation = pt_generation_get();
+        ch->ch_match_memo = mm;
+    }
+    else if (mm->mm_generation != pt_generation_get()){
+        for (i=0; i<mm->mm_levels*MATCH_MEMO_WAYS; i++)
+            match_memo_entry_clear(&mm->mm_vec[i]);
+        mm->mm_generation = pt_generation_get();
+    }
+    if (level >= mm->mm_levels){
+        if ((vec = realloc(mm->mm_vec, (level+1)*MATCH_MEMO_WAYS*sizeof(*vec))) == NULL){
+            fprintf(stderr, "%s: realloc: %s\n", __FUNCTION__, strerror(errno));
+            goto done;
+        }
+        memset(&vec[mm->mm_levels*MATCH_MEMO_WAYS], 0,
+               (level+1-mm->mm_levels)*MATCH_MEMO_WAYS*sizeof(*vec));
+        mm->mm_vec = vec;
+        mm->mm_levels = level+1;
+    }
+    prefmode = cligen_preference_mode(h);
+    caseignore = cligen_caseignore_get(h);
+    mm->mm_clock++;
+    vec = &mm->mm_vec[level*MATCH_MEMO_WAYS];
+    for (i=0; i<MATCH_MEMO_WAYS; i++){
+        if (vec[i].me_pt == pt &&
+            vec[i].me_id == id &&
+            vec[i].me_generation == gen &&
+            vec[i].me_lasttoken == lasttoken &&
+            vec[i].me_best == best &&
+            vec[i].me_prefmode == prefmode &&
+            vec[i].me_caseignore == caseignore &&
+            strcmp(vec[i].me_token, token) == 0)
+            break;
+        if (me == NULL || vec[i].me_used < me->me_used)
+            me = &vec[i];
+    }
+    if (i < MATCH_MEMO_WAYS){ /* Hit: replay saved result */
+        me = &vec[i];
+        me->me_used = mm->mm_clock;
+        for (i=0; i<me->me_len; i++)
+            if (mr_pt_append(mr, me->me_vec[i], token) < 0)
+                goto done;
+        mr_pref_set(mr, me->me_pref);
+        mr_common_set(mr, me->me_common, me->me_unique);
+        if (me->me_reason){
+            if ((r = strdup(me->me_reason)) == NULL)
+                goto done;
+            mr_reason_set(mr, r);
+        }
+        goto ok;
+    }
+    /* Miss: REST variables match the rest of the line which is not part of the key */
+    for (i=0; i<pt_len_get(pt); i++)
+        if ((co = pt_vec_i_get(pt, i)) != NULL &&
+            (ISREST(co) || co_flags_get(co, CO_FLAGS_MATCH)))
+            break;
+    if (i < pt_len_get(pt))
+        return match_vec(h, pt, token, resttokens, lasttoken, best, mr, NULL);
+    /* Replace least recently used entry of this level */
+    match_memo_entry_clear(me);
+    if ((me->me_token = strdup(token)) == NULL)
+        goto done;
+    if (pt_len_get(pt) &&
+        (me->me_vec = calloc(pt_len_get(pt), sizeof(cg_obj *))) == NULL)
+        goto fail;
+    if (match_vec(h, pt, token, resttokens, lasttoken, best, mr, me) < 0)
+        goto fail;
+    if (mr_reason_get(mr) &&
+        (me->me_reason = strdup(mr_reason_get(mr))) == NULL)
+        goto fail;
+    me->me_pref = mr_pref_get(mr);
+    me->me_common = mr_common_get(mr, &me->me_unique);
+    me->me_pt = pt;
+    me->me_id = id;
+    me->me_generation = gen;
+    me->me_lasttoken = lasttoken;
+    me->me_best = best;
+    me->me_prefmode = prefmode;
+    me->me_caseignore = caseignore;
+    me->me_used = mm->mm_clock;
+ ok:
     retval = 0;
  done:
     return retval;
+ fail:
+    match_memo_entry_clear(me);
+    goto done;
+}
+
+/*! Free the memoized token matches of a handle
+ *
+ * @param[in]  h    CLIgen handle
+ * @retval     0    OK
+ * @see match_vec_memo
+ */
+int
+match_memo_free(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+    struct match_memo    *mm;
+    int                   i;
+
+    if ((mm = ch->ch_match_memo) != NULL){
+        for (i=0; i<mm->mm_levels*MATCH_MEMO_WAYS; i++)
+            match_memo_entry_clear(&mm->mm_vec[i]);
+        if (mm->mm_vec)
+            free(mm->mm_vec);
+        free(mm);
+        ch->ch_match_memo = NULL;
+    }
+    return 0;
 }
 
 /*! Bind vars and constants to variable vectors used for completion and callbacks
@@ -637,7 +945,7 @@ match_pattern_sets_local(cligen_handle  h,
     char         *resttokens;
     match_result *mr0 = NULL;
 
-    if ((mr0 = mr_new()) == NULL)
+    if ((mr0 = mr_new_arena(cligen_scratch_request(h))) == NULL)
         goto done;
     /* Tokens of this level */
     token = cvec_i_str(cvt, level+1);
@@ -649,11 +957,11 @@ match_pattern_sets_local(cligen_handle  h,
     mr_level_set(mr0, level);
 
     /* How many matches of cvt[level+1] in pt */
-    if (match_vec(h,
-                  pt, token, resttokens,
-                  lasttoken,
-                  lasttoken?best:1, /* use best preference match in non-terminal matching*/
-                  mr0) < 0)
+    if (match_vec_memo(h,
+                       pt, level, token, resttokens,
+                       lasttoken,
+                       lasttoken?best:1, /* use best preference match in non-terminal matching*/
+                       mr0) < 0)
         goto done;
     /* Number of matches is 0 (no match), 1 (exact) or many */
     switch (mr_pt_len_get(mr0)){
@@ -728,7 +1036,8 @@ match_pattern_sets_local(cligen_handle  h,
         break;
     case 1:
         if (co_match->co_type == CO_COMMAND &&
-            co_orig && co_orig->co_type == CO_VARIABLE)
+            co_orig && co_orig->co_type == CO_VARIABLE &&
+            !co_flags_get(co_orig, CO_FLAGS_FROZEN))
             if (co_value_set(co_orig, co_match->co_command) < 0)
                 goto done;
         break;
@@ -906,6 +1215,7 @@ match_pattern_sets(cligen_handle  h,
     char         *pipe_local;
     cg_obj       *co_pipe = NULL;
     cbuf         *cb = NULL;
+    int           ret;
 
     token = cvec_i_str(cvt, level+1); /* for debugging */
 #ifdef _DEBUG_SETS
@@ -971,18 +1281,25 @@ match_pattern_sets(cligen_handle  h,
             goto done;
         co_pipe->co_type = CO_REFERENCE;
     }
-    if ((ptn = pt_new()) == NULL)
-        goto done;
-    if (pt_expand(h,
-                  co_match,
-                  co_pt_get(co_match),
-                  cvt,
-                  cvv,
-                  !best,  /* If best is set, include hidden commands, otherwise do not */
-                  1,      /* VARS are expanded, eg ? <tab> */
-                  callbacks,
-                  co_pipe,
-                  ptn) < 0) /* expand/choice variables */
+    /* Only tree reference keywords that may match the next token need to be expanded,
+     * but not for sets, where the expansion is matched with several tokens */
+    if (co_pt_get(co_match) != NULL &&
+        pt_sets_get(co_pt_get(co_match)) == 0 &&
+        level+2 < cvec_len(cvt))
+        handle(h)->ch_expand_prefix = cvec_i_str(cvt, level+2);
+    /* Expanded trees are cached and reused, do not modify ptn */
+    ret = pt_expand_cached(h,
+                           co_match,
+                           co_pt_get(co_match),
+                           cvt,
+                           cvv,
+                           !best,  /* If best is set, include hidden commands, otherwise do not */
+                           1,      /* VARS are expanded, eg ? <tab> */
+                           callbacks,
+                           co_pipe,
+                           &ptn); /* expand/choice variables */
+    handle(h)->ch_expand_prefix = NULL;
+    if (ret < 0)
         goto done;
     if (pipe_local)
         pipe_default = pipe_local;
@@ -1092,7 +1409,7 @@ match_pattern_sets(cligen_handle  h,
         mr_free(mrcprev);
     }
     if (ptn)
-        pt_free(ptn, 0);
+        pt_expand_release(h, ptn);
     if (mrc)
         mr_free(mrc);
     if (mr0)
@@ -1149,6 +1466,11 @@ match_pattern(cligen_handle  h,
         perror("No active cligen tree");
         goto done;
     }
+    /* Scratch memory of previous match is not used anymore, unless in a request */
+    if (cligen_scratch_request(h) == NULL)
+        cligen_arena_reset(handle(h)->ch_scratch);
+    /* Completion waits at most the expand deadline for async expand callbacks */
+    handle(h)->ch_expand_completing = !best;
     if (match_pattern_sets(h, cvt, cvr,
                            cligen_ph_pipe_get(ph),
                            pt,
@@ -1162,8 +1484,9 @@ match_pattern(cligen_handle  h,
         errno = EFAULT;
         goto done;
     }
-    /* Clear all CO_FLAGS_MATCH recursively */
-    pt_apply(pt, co_clearflag, 1, (void*)CO_FLAGS_MATCH);
+    /* Clear all CO_FLAGS_MATCH recursively, match flags are only set on copies of a frozen tree */
+    if (!pt_frozen_get(pt))
+        pt_apply(pt, co_clearflag, 1, (void*)CO_FLAGS_MATCH);
     /* Lots of complex code follows,
      * Good news is that these have been moved from calling functions to here
      * Hopefully it may be easier to simplify
@@ -1251,7 +1574,7 @@ match_pattern(cligen_handle  h,
          * Special case: if a NULL child is not found, then set result == CG_NOMATCH
          */
         if ((ptc = co_pt_get(co1)) != NULL && best){
-            if ((ptn = pt_new()) == NULL)
+            if ((ptn = pt_new_arena(cligen_scratch_request(h))) == NULL)
                 goto done;
             if ((cvv1 = cvec_new(0)) == NULL)
                 goto done;
@@ -1281,6 +1604,7 @@ match_pattern(cligen_handle  h,
     mr = NULL;
     retval = 0;
  done:
+    handle(h)->ch_expand_completing = 0;
     if (mr)
         mr_free(mr);
     if (cvv1)
@@ -1383,6 +1707,8 @@ match_complete_mr(cligen_handle  h,
     size_t   len;
     char    *command;
     char    *command1 = NULL;
+    int      common;
+    int      unique = 0;
 
     string = *stringp;
     if (mr == NULL || mr_pt_len_get(mr) == 0){
@@ -1390,36 +1716,46 @@ match_complete_mr(cligen_handle  h,
         goto done;
     }
     equal = 1;
-    for (i=0; i<mr_pt_len_get(mr); i++){
-        co = mr_pt_i_get(mr, i);
-        if (co == NULL){
-            retval = 0;
-            goto done;
-        }
-        if ((cligen_tabmode(h) & CLIGEN_TABMODE_VARS) == 0){
-            if (co->co_type != CO_COMMAND)
-                continue;
-        }
-        command = co->co_value?co->co_value:co->co_command;
-        if (co1 == NULL){
-            slen = strlen(mr_token_get(mr));
-            minmatch = strlen(command);
-            co1 = co;
-            command1 = command;
-        }
-        else{
-            command1 = co1->co_value?co1->co_value:co1->co_command;
-            if (!cligen_caseignore_get(h) && strcmp(command1, command)==0)
-                ; /* equal */
-            else if (cligen_caseignore_get(h) && strcasecmp(command1, command)==0)
-                ; /* equal */
+    if ((common = mr_common_get(mr, &unique)) >= 0){
+        /* Matches are the commands with the token as prefix, see pt_index_candidates */
+        co1 = mr_pt_i_get(mr, 0);
+        command1 = co1->co_command;
+        slen = strlen(mr_token_get(mr));
+        minmatch = common;
+        equal = unique;
+    }
+    else{
+        for (i=0; i<mr_pt_len_get(mr); i++){
+            co = mr_pt_i_get(mr, i);
+            if (co == NULL){
+                retval = 0;
+                goto done;
+            }
+            if ((cligen_tabmode(h) & CLIGEN_TABMODE_VARS) == 0){
+                if (co->co_type != CO_COMMAND)
+                    continue;
+            }
+            command = co->co_value?co->co_value:co->co_command;
+            if (co1 == NULL){
+                slen = strlen(mr_token_get(mr));
+                minmatch = strlen(command);
+                co1 = co;
+                command1 = command;
+            }
             else{
-                equal = 0;
-                len = MIN(strlen(command1), strlen(command));
-                for (j=0; j<len; j++)
-                    if (command1[j] != command[j])
-                        break;
-                minmatch = MIN(minmatch, j);
+                command1 = co1->co_value?co1->co_value:co1->co_command;
+                if (!cligen_caseignore_get(h) && strcmp(command1, command)==0)
+                    ; /* equal */
+                else if (cligen_caseignore_get(h) && strcasecmp(command1, command)==0)
+                    ; /* equal */
+                else{
+                    equal = 0;
+                    len = MIN(strlen(command1), strlen(command));
+                    for (j=0; j<len; j++)
+                        if (command1[j] != command[j])
+                            break;
+                    minmatch = MIN(minmatch, j);
+                }
             }
         }
     }
@@ -1469,7 +1805,9 @@ match_complete(cligen_handle h,
     cvec         *cvr = NULL;
     match_result *mr = NULL;
 
-    if (cligen_str2cvv(*stringp, &cvt, &cvr) < 0)
+    if (cligen_scratch_begin(h) < 0)
+        return -1;
+    if (cligen_str2cvv_scratch(*stringp, cligen_scratch_request(h), &cvt, &cvr) < 0)
         goto done;
     if (match_pattern(h, cvt, cvr,
                       pt,
@@ -1479,11 +1817,8 @@ match_complete(cligen_handle h,
         goto done;
     retval = match_complete_mr(h, mr, stringp, slenp);
   done:
-    if (cvt)
-        cvec_free(cvt);
-    if (cvr)
-        cvec_free(cvr);
     if (mr)
         mr_free(mr);
+    cligen_scratch_end(h);
     return retval;
 }
@@ -60,5 +60,6 @@ int match_complete(cligen_handle h, parse_tree *pt,
                    char **stringp, size_t *slen, cvec *cvec);
 int match_complete_mr(cligen_handle h, match_result *mr,
                       char **stringp, size_t *slenp);
+int match_memo_free(cligen_handle h);
 
 #endif /* _CLIGEN_MATCH_H */
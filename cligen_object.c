@@ -56,6 +56,7 @@
 #endif /* HAVE_STRVERSCMP */
 #include <errno.h>
 #include "cligen_buf.h"
+#include "cligen_arena.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
 #include "cligen_parsetree.h"
@@ -70,7 +71,7 @@
 #include "cligen_getline.h"
 #include "banned.h"
 
-/* Stats: nr of created cligen objects */
+/* Stats: nr of created cligen objects, atomic since handles may be used in several threads */
 uint64_t _co_created = 0;
 uint64_t _co_count = 0;
 
@@ -83,8 +84,8 @@ int
 co_stats_global(uint64_t *created,
                 uint64_t *nr)
 {
-    *created = _co_created;
-    *nr =   _co_count;
+    *created = __atomic_load_n(&_co_created, __ATOMIC_RELAXED);
+    *nr =   __atomic_load_n(&_co_count, __ATOMIC_RELAXED);
     return 0;
 }
 
@@ -103,11 +104,12 @@ co_stats_one(cg_obj   *co,
     struct cg_callback *cc;
     struct cg_varspec  *cgs;
 
-    sz += sizeof(struct cg_obj);
+    sz += co_size(co->co_type);
     sz += co->co_pt_len*sizeof(struct parse_tree*);
-    if (co->co_command)
+    /* Borrowed strings are counted by their owner, eg interned in the arena, see pt_stats */
+    if (co->co_command && (co->co_borrow & CO_BORROW_COMMAND) == 0)
         sz += strlen(co->co_command) + 1;
-    if (co->co_prefix)
+    if (co->co_prefix && (co->co_borrow & CO_BORROW_PREFIX) == 0)
         sz += strlen(co->co_prefix) + 1;
     for (cc = co->co_callbacks; cc; cc=cc->cc_next)
         sz += co_callback_size(cc);
@@ -115,7 +117,7 @@ co_stats_one(cg_obj   *co,
         sz += cvec_size(co->co_cvec);
     if (co->co_filter)
         sz += cvec_size(co->co_filter);
-    if (co->co_helpstring)
+    if (co->co_helpstring && (co->co_borrow & CO_BORROW_HELPSTRING) == 0)
         sz += strlen(co->co_helpstring) + 1;
     if (co->co_value)
         sz += strlen(co->co_value) + 1;
@@ -134,6 +136,10 @@ co_stats_one(cg_obj   *co,
             sz += strlen(cgs->cgs_choice) + 1;
         if (cgs->cgs_choice_help)
             sz += strlen(cgs->cgs_choice_help) + 1;
+        if (cgs->cgs_choices)
+            sz += sizeof(cg_choices) + 2*cgs->cgs_choices->cc_len*sizeof(char*) +
+                strlen(cgs->cgs_choice) + 1 +
+                (cgs->cgs_choice_help ? strlen(cgs->cgs_choice_help) + 1 : 0);
         if (cgs->cgs_rangecvv_low)
             sz += cvec_size(cgs->cgs_rangecvv_low);
         if (cgs->cgs_rangecvv_upp)
@@ -259,9 +265,14 @@ co_pt_set(cg_obj     *co,
         if (co_pt_realloc(co) < 0)
             return -1;
     }
-    else {
-        if (co->co_ptvec[0])
+    else if (co->co_ptvec[0] != pt){
+        /* Data derived from any tree may refer to the freed sub-tree */
+        if (co->co_ptvec[0]){
             pt_free(co->co_ptvec[0], 1);
+            pt_generation_inc();
+        }
+        else
+            pt_co_changed(co);
     }
     co->co_ptvec[0] = pt;
     return 0;
@@ -286,6 +297,8 @@ co_pt_clear(cg_obj *co)
         if (co_pt_realloc(co) < 0)
             return -1;
     }
+    else if (co->co_ptvec[0])
+        pt_co_changed(co);
     co->co_ptvec[0] = NULL;
     return 0;
 }
@@ -294,6 +307,8 @@ void
 co_flags_set(cg_obj  *co,
              uint32_t flag)
 {
+    if ((flag & CO_FLAGS_HIDE) && !(co->co_flags & CO_FLAGS_HIDE))
+        pt_co_changed(co); /* Hidden nodes are not expanded */
     co->co_flags |= flag;
 }
 
@@ -301,6 +316,8 @@ void
 co_flags_reset(cg_obj  *co,
                uint32_t flag)
 {
+    if (flag & co->co_flags & CO_FLAGS_HIDE)
+        pt_co_changed(co);
     co->co_flags &= ~flag;
 }
 
@@ -343,9 +360,11 @@ co_prefix_set(cg_obj     *co,
               const char *prefix)
 {
     if (co->co_prefix != NULL){
-        free(co->co_prefix);
+        if ((co->co_borrow & CO_BORROW_PREFIX) == 0)
+            free(co->co_prefix);
         co->co_prefix = NULL;
     }
+    co->co_borrow &= ~CO_BORROW_PREFIX;
     if (prefix &&
         (co->co_prefix = strdup(prefix)) == NULL)
         return -1;
@@ -362,6 +381,80 @@ co_filter_set(cg_obj *co,
     return co->co_filter;
 }
 
+/*! Split choices of a choice variable into an immutable array
+ *
+ * Names are separated by ',' or '|', help texts by '|'. Help texts are optional, empty or
+ * missing help texts are NULL.
+ * @param[in]  choice   Choices, eg "a|b|c"
+ * @param[in]  help     Help texts parallel to choice, eg "ahelp|bhelp|chelp", or NULL
+ * @retval     cc       Choices, free with free()
+ * @retval     NULL     Error
+ * @see co_choices_get
+ */
+cg_choices *
+co_choices_new(const char *choice,
+               const char *help)
+{
+    cg_choices *cc;
+    size_t      clen;
+    size_t      hlen;
+    int         len;
+    int         i;
+    char       *c;
+    char       *h;
+
+    if (choice == NULL){
+        errno = EINVAL;
+        return NULL;
+    }
+    clen = strlen(choice) + 1;
+    hlen = help ? strlen(help) + 1 : 0;
+    len = 1;
+    for (i=0; choice[i]; i++)
+        if (choice[i] == ',' || choice[i] == '|')
+            len++;
+    if ((cc = malloc(sizeof(*cc) + 2*len*sizeof(char*) + clen + hlen)) == NULL)
+        return NULL;
+    cc->cc_len = len;
+    cc->cc_name = (char**)(cc + 1);
+    cc->cc_help = cc->cc_name + len;
+    c = (char*)(cc->cc_help + len);
+    memcpy(c, choice, clen);
+    h = NULL;
+    if (help){
+        h = c + clen;
+        memcpy(h, help, hlen);
+    }
+    for (i=0; i<len; i++){
+        cc->cc_name[i] = strsep(&c, ",|");
+        cc->cc_help[i] = h ? strsep(&h, "|") : NULL;
+        if (cc->cc_help[i] && *cc->cc_help[i] == '\0')
+            cc->cc_help[i] = NULL;
+    }
+    return cc;
+}
+
+/*! Get choices of a choice variable split into an array, split on first use
+ *
+ * Normally split when parsed, and shared by expanded objects borrowing the variable spec.
+ * If not split, a borrowed variable spec is first copied, see co_unborrow
+ * @param[in]  co    CLIgen variable object with co_choice set
+ * @retval     cc    Choices, owned by the variable spec
+ * @retval     NULL  Error, or not a choice variable
+ */
+cg_choices *
+co_choices_get(cg_obj *co)
+{
+    if (co->co_type != CO_VARIABLE || co->co_choice == NULL)
+        return NULL;
+    if (co->co_choices == NULL){
+        if (co_unborrow(co, CO_BORROW_VARSPEC) < 0)
+            return NULL;
+        co->co_choices = co_choices_new(co->co_choice, co->co_choice_help);
+    }
+    return co->co_choices;
+}
+
 /*! Assign a preference to a cligen variable object
  *
  * Prefer more specific commands/variables  if you have to choose from several.
@@ -551,17 +644,38 @@ co_size(enum cg_objtype type)
  */
 cg_obj *
 co_new_only(enum cg_objtype type)
+{
+    return co_new_only_arena(type, NULL);
+}
+
+/*! Allocate a CLIgen object in an arena
+ *
+ * The object is not freed by co_free, but with the arena, see CO_BORROW_ARENA
+ * @param[in] type  Type of cligen object
+ * @param[in] ca    Arena of the tree of the object, or NULL to use malloc
+ * @retval    co    OK
+ * @retval    NULL  Error
+ */
+cg_obj *
+co_new_only_arena(enum cg_objtype type,
+                  cligen_arena   *ca)
 {
     cg_obj *co;
     size_t  size;
 
     size = co_size(type);
-    if ((co = malloc(size)) == NULL)
+    if (ca)
+        co = cligen_arena_alloc(ca, size);
+    else
+        co = malloc(size);
+    if (co == NULL)
         return NULL;
     memset(co, 0, size);
     co->co_type = type;
-    _co_count++;
-    _co_created++;
+    if (ca)
+        co->co_borrow |= CO_BORROW_ARENA;
+    __atomic_add_fetch(&_co_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&_co_created, 1, __ATOMIC_RELAXED);
     return co;
 }
 
@@ -578,25 +692,51 @@ co_new_only(enum cg_objtype type)
 cg_obj *
 co_new(const char *cmd,
        cg_obj     *parent)
+{
+    return co_new_arena(cmd, parent, NULL);
+}
+
+/*! Create new cligen parse-tree command object in an arena
+ *
+ * The object, its command and its parse-tree are allocated in the arena
+ * @param[in]  cmd   Initial command value
+ * @param[in]  prev  parent object (or NULL)
+ * @param[in]  ca    Arena of the tree of the object, or NULL to use malloc
+ * @retval     co    Created cligen object. Free with co_free()
+ * @retval     NULL  Error
+ * @see pt_arena_set
+ */
+cg_obj *
+co_new_arena(const char   *cmd,
+             cg_obj       *parent,
+             cligen_arena *ca)
 {
     cg_obj     *co;
     parse_tree *pt;
 
-    if ((co = co_new_only(CO_COMMAND)) == NULL)
-        return NULL;
-    if (cmd && (co->co_command = strdup(cmd)) == NULL){
-        free(co);
+    if ((co = co_new_only_arena(CO_COMMAND, ca)) == NULL)
         return NULL;
+    if (cmd){
+        if (ca){
+            co->co_command = cligen_arena_intern(ca, cmd);
+            co->co_borrow |= CO_BORROW_COMMAND;
+        }
+        else
+            co->co_command = strdup(cmd);
+        if (co->co_command == NULL){
+            co_free(co, 0);
+            return NULL;
+        }
     }
     co_up_set(co, parent);
     /* parse-tree created implicitly */
-    if ((pt = pt_new()) == NULL){
-        free(co);
+    if ((pt = pt_new_arena(ca)) == NULL){
+        co_free(co, 0);
         return NULL;
     }
     if (co_pt_set(co, pt) < 0){
-        free(pt);
-        free(co);
+        pt_free(pt, 0);
+        co_free(co, 0);
         return NULL;
     }
     return co;
@@ -615,24 +755,41 @@ co_new(const char *cmd,
 cg_obj *
 cov_new(enum cv_type cvtype,
         cg_obj      *parent)
+{
+    return cov_new_arena(cvtype, parent, NULL);
+}
+
+/*! Create new cligen parse-tree variable object in an arena
+ *
+ * @param[in]  cvtype  Cligen variable type
+ * @param[in]  parent  parent object (or NULL)
+ * @param[in]  ca      Arena of the tree of the object, or NULL to use malloc
+ * @retval     co      Created cligen object. Free with co_free()
+ * @retval     NULL    Error
+ * @see co_new_arena
+ */
+cg_obj *
+cov_new_arena(enum cv_type  cvtype,
+              cg_obj       *parent,
+              cligen_arena *ca)
 {
     cg_obj     *co;
     parse_tree *pt;
 
-    if ((co = co_new_only(CO_VARIABLE)) == NULL)
+    if ((co = co_new_only_arena(CO_VARIABLE, ca)) == NULL)
         return NULL;
     co->co_vtype   = cvtype;
     if (parent)
         co_up_set(co, parent);
     co->co_dec64_n = CGV_DEC64_N_DEFAULT;
     /* parse-tree created implicitly */
-    if ((pt = pt_new()) == NULL){
-        free(co);
+    if ((pt = pt_new_arena(ca)) == NULL){
+        co_free(co, 0);
         return NULL;
     }
     if (co_pt_set(co, pt) < 0){
-        free(pt);
-        free(co);
+        pt_free(pt, 0);
+        co_free(co, 0);
         return NULL;
     }
     return co;
@@ -667,12 +824,13 @@ co_copy(cg_obj  *co,
     memcpy(con, co, size);
     con->co_ptvec = NULL;
     con->co_pt_len = 0;
+    con->co_borrow = 0;
     con->co_ref = NULL;
     /* If called from pt_expand_treeref: the copy (of a tree instance) points to the original tree
      */
     if (flags & CO_COPY_FLAGS_TREEREF)
         con->co_treeref_orig = co;
-    co_flags_reset(con, CO_FLAGS_MARK);
+    co_flags_reset(con, CO_FLAGS_MARK|CO_FLAGS_FROZEN);
     /* Replace all pointers */
     co_up_set(con, parent);
     if (co->co_command)
@@ -726,6 +884,10 @@ co_copy(cg_obj  *co,
             if ((con->co_choice_help = strdup(co->co_choice_help)) == NULL)
                 goto done;
         }
+        con->co_choices = NULL;
+        if (co->co_choices &&
+            (con->co_choices = co_choices_new(con->co_choice, con->co_choice_help)) == NULL)
+            goto done;
         if (co->co_regex){
             if ((con->co_regex = cvec_dup(co->co_regex)) == NULL)
                 goto done;
@@ -763,6 +925,31 @@ co_copy1(cg_obj  *co,
          int      recursive,
          uint32_t flags,
          cg_obj **conp)
+{
+    return co_copy1_arena(co, parent, recursive, flags, NULL, conp);
+}
+
+/*! Copy a single cligen object into an arena, non-recursively
+ *
+ * As co_copy1, but the object, its command, prefix and helpstring are allocated in
+ * the arena, eg the scratch arena of a request. Other fields are malloced.
+ * @param[in]  co        The object to copy from
+ * @param[in]  parent    The parent of the new object, need not be same as parent of co
+ * @param[in]  recursive If set copy recursive, otherwise, only first level object
+ * @param[in]  flags     Copy flags
+ * @param[in]  ca        Arena of the copy, or NULL to use malloc
+ * @param[out] conp      Pointer to the object to copy to (is allocated)
+ * @retval     0         OK
+ * @retval    -1         Error
+ * @note Free the copy with co_free, its arena fields are released when the arena is reset
+ */
+int
+co_copy1_arena(cg_obj       *co,
+               cg_obj       *parent,
+               int           recursive,
+               uint32_t      flags,
+               cligen_arena *ca,
+               cg_obj      **conp)
 {
     int         retval = -1;
     cg_obj     *con = NULL;
@@ -770,24 +957,38 @@ co_copy1(cg_obj  *co,
     parse_tree *ptn;
     size_t      size;
 
-    if ((con = co_new_only(co->co_type)) == NULL)
+    if ((con = co_new_only_arena(co->co_type, ca)) == NULL)
         goto done;
     size = co_size(con->co_type);
     memcpy(con, co, size);
     con->co_ptvec = NULL;
     con->co_pt_len = 0;
+    con->co_borrow = 0;
+    if (ca){
+        con->co_borrow = CO_BORROW_ARENA|CO_BORROW_COMMAND|CO_BORROW_PREFIX|CO_BORROW_HELPSTRING;
+        con->co_command = con->co_prefix = con->co_helpstring = NULL;
+        if (co->co_command &&
+            (con->co_command = cligen_arena_strdup(ca, co->co_command)) == NULL)
+            goto done;
+        if (co->co_prefix &&
+            (con->co_prefix = cligen_arena_strdup(ca, co->co_prefix)) == NULL)
+            goto done;
+        if (co->co_helpstring &&
+            (con->co_helpstring = cligen_arena_strdup(ca, co->co_helpstring)) == NULL)
+            goto done;
+    }
 
     /* If called from pt_expand_treeref: the copy (of a tree instance) points to the original tree
      */
     if (flags & CO_COPY_FLAGS_TREEREF)
         con->co_treeref_orig = co;
-    co_flags_reset(con, CO_FLAGS_MARK);
+    co_flags_reset(con, CO_FLAGS_MARK|CO_FLAGS_FROZEN);
     /* Replace all pointers */
     co_up_set(con, parent);
-    if (co->co_command)
+    if (ca == NULL && co->co_command)
         if ((con->co_command = strdup(co->co_command)) == NULL)
             goto done;
-    if (co->co_prefix)
+    if (ca == NULL && co->co_prefix)
         if ((con->co_prefix = strdup(co->co_prefix)) == NULL)
             goto done;
     if (co_callback_copy(co->co_callbacks, &con->co_callbacks) < 0)
@@ -809,7 +1010,7 @@ co_copy1(cg_obj  *co,
                 goto done;
         }
     }
-    if (co->co_helpstring)
+    if (ca == NULL && co->co_helpstring)
         if ((con->co_helpstring = strdup(co->co_helpstring)) == NULL)
             goto done;
     con->co_value = NULL;
@@ -842,6 +1043,10 @@ co_copy1(cg_obj  *co,
             if ((con->co_choice_help = strdup(co->co_choice_help)) == NULL)
                 goto done;
         }
+        con->co_choices = NULL;
+        if (co->co_choices &&
+            (con->co_choices = co_choices_new(con->co_choice, con->co_choice_help)) == NULL)
+            goto done;
         if (co->co_regex){
             if ((con->co_regex = cvec_dup(co->co_regex)) == NULL)
                 goto done;
@@ -856,6 +1061,108 @@ co_copy1(cg_obj  *co,
     return retval;
 }
 
+/*! Take ownership of borrowed fields of an expanded object by copying them
+ *
+ * Expanded objects borrow immutable fields from their original, see co_expand_sub.
+ * Call this before modifying such a field in place.
+ * @param[in]  co    CLIgen object
+ * @param[in]  bits  Fields to copy, see CO_BORROW_*
+ * @retval     0     OK
+ * @retval    -1     Error
+ * @note On error, fields that could not be copied are NULL
+ */
+int
+co_unborrow(cg_obj  *co,
+            uint16_t bits)
+{
+    int          retval = -1;
+    char        *str;
+    cg_callback *cc;
+    cvec        *cvv;
+    cg_varspec  *cgs;
+    cg_varspec   cgs0;
+
+    bits &= co->co_borrow & ~CO_BORROW_ARENA;
+    co->co_borrow &= ~bits;
+    if (bits & CO_BORROW_COMMAND){
+        str = co->co_command;
+        co->co_command = NULL;
+        if (str && (co->co_command = strdup(str)) == NULL)
+            goto done;
+    }
+    if (bits & CO_BORROW_PREFIX){
+        str = co->co_prefix;
+        co->co_prefix = NULL;
+        if (str && (co->co_prefix = strdup(str)) == NULL)
+            goto done;
+    }
+    if (bits & CO_BORROW_HELPSTRING){
+        str = co->co_helpstring;
+        co->co_helpstring = NULL;
+        if (str && (co->co_helpstring = strdup(str)) == NULL)
+            goto done;
+    }
+    if (bits & CO_BORROW_CVEC){
+        cvv = co->co_cvec;
+        co->co_cvec = NULL;
+        if (cvv && (co->co_cvec = cvec_dup(cvv)) == NULL)
+            goto done;
+    }
+    if (bits & CO_BORROW_CALLBACKS){
+        cc = co->co_callbacks;
+        co->co_callbacks = NULL;
+        if (co_callback_copy(cc, &co->co_callbacks) < 0)
+            goto done;
+    }
+    if ((bits & CO_BORROW_VARSPEC) && co->co_type == CO_VARIABLE){
+        cgs = co2varspec(co);
+        cgs0 = *cgs;
+        cgs->cgs_show = NULL;
+        cgs->cgs_expand_fn_str = NULL;
+        cgs->cgs_expand_fn_vec = NULL;
+        cgs->cgs_translate_fn_str = NULL;
+        cgs->cgs_choice = NULL;
+        cgs->cgs_choice_help = NULL;
+        cgs->cgs_choices = NULL;
+        cgs->cgs_rangecvv_low = NULL;
+        cgs->cgs_rangecvv_upp = NULL;
+        cgs->cgs_regex = NULL;
+        if (cgs0.cgs_show &&
+            (cgs->cgs_show = strdup(cgs0.cgs_show)) == NULL)
+            goto done;
+        if (cgs0.cgs_expand_fn_str &&
+            (cgs->cgs_expand_fn_str = strdup(cgs0.cgs_expand_fn_str)) == NULL)
+            goto done;
+        if (cgs0.cgs_expand_fn_vec &&
+            (cgs->cgs_expand_fn_vec = cvec_dup(cgs0.cgs_expand_fn_vec)) == NULL)
+            goto done;
+        if (cgs0.cgs_translate_fn_str &&
+            (cgs->cgs_translate_fn_str = strdup(cgs0.cgs_translate_fn_str)) == NULL)
+            goto done;
+        if (cgs0.cgs_choice &&
+            (cgs->cgs_choice = strdup(cgs0.cgs_choice)) == NULL)
+            goto done;
+        if (cgs0.cgs_choice_help &&
+            (cgs->cgs_choice_help = strdup(cgs0.cgs_choice_help)) == NULL)
+            goto done;
+        if (cgs0.cgs_choices &&
+            (cgs->cgs_choices = co_choices_new(cgs->cgs_choice, cgs->cgs_choice_help)) == NULL)
+            goto done;
+        if (cgs0.cgs_rangecvv_low &&
+            (cgs->cgs_rangecvv_low = cvec_dup(cgs0.cgs_rangecvv_low)) == NULL)
+            goto done;
+        if (cgs0.cgs_rangecvv_upp &&
+            (cgs->cgs_rangecvv_upp = cvec_dup(cgs0.cgs_rangecvv_upp)) == NULL)
+            goto done;
+        if (cgs0.cgs_regex &&
+            (cgs->cgs_regex = cvec_dup(cgs0.cgs_regex)) == NULL)
+            goto done;
+    }
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! Compare two strings, extends strcmp
  *
  * Basically strcmp but there are some complexities which one may enable.
@@ -872,12 +1179,13 @@ co_copy1(cg_obj  *co,
  * strcmp orders:  1b 16 6b
  * wheras strverscmp orders: 1b 6b 16
  * If we use strverscmp we also must use it in e.g. complete
+ * Equal pointers, eg strings interned in the arena of a tree, are equal without compare
  */
 static inline int
 str_cmp(const char *s1,
         const char *s2)
 {
-    if (s1 == NULL && s2 == NULL)
+    if (s1 == s2)
         return 0;
     if (s1 == NULL) /* empty string first */
         return -1;
@@ -1037,21 +1345,22 @@ co_free(cg_obj *co,
 {
     parse_tree  *pt;
 
-    if (co->co_helpstring)
+    if (co->co_helpstring && (co->co_borrow & CO_BORROW_HELPSTRING) == 0)
         free(co->co_helpstring);
-    if (co->co_command)
+    if (co->co_command && (co->co_borrow & CO_BORROW_COMMAND) == 0)
         free(co->co_command);
-    if (co->co_prefix)
+    if (co->co_prefix && (co->co_borrow & CO_BORROW_PREFIX) == 0)
         free(co->co_prefix);
     if (co->co_value)
         free(co->co_value);
-    if (co->co_cvec)
+    if (co->co_cvec && (co->co_borrow & CO_BORROW_CVEC) == 0)
         cvec_free(co->co_cvec);
     if (co->co_filter)
         cvec_free(co->co_filter);
-    if (co->co_callbacks)
+    if (co->co_callbacks && (co->co_borrow & CO_BORROW_CALLBACKS) == 0)
         co_callbacks_free(&co->co_callbacks);
-    if (co->co_type == CO_VARIABLE){
+    if (co->co_type == CO_VARIABLE &&
+        (co->co_borrow & CO_BORROW_VARSPEC) == 0){
         if (co->co_expand_fn_str)
             free(co->co_expand_fn_str);
         if (co->co_translate_fn_str)
@@ -1064,6 +1373,8 @@ co_free(cg_obj *co,
             free(co->co_choice);
         if (co->co_choice_help)
             free(co->co_choice_help);
+        if (co->co_choices)
+            free(co->co_choices);
         if (co->co_regex)
             cvec_free(co->co_regex);
         if (co->co_rangecvv_low)
@@ -1076,8 +1387,10 @@ co_free(cg_obj *co,
     }
     if (co->co_ptvec != NULL)
         free(co->co_ptvec);
-    free(co);
-    _co_count--;
+    /* Objects in an arena are freed with the arena of their tree */
+    if ((co->co_borrow & CO_BORROW_ARENA) == 0)
+        free(co);
+    __atomic_sub_fetch(&_co_count, 1, __ATOMIC_RELAXED);
     return 0;
 }
 
@@ -126,6 +126,17 @@ typedef int (cligen_interrupt_cb_t)(cligen_handle h);
 
 typedef struct parse_tree parse_tree;
 
+/*
+ * Choices of a choice variable, eg "a|b|c", split once into an immutable array.
+ * Allocated as one block, free with free(), see co_choices_new
+ */
+struct cg_choices{
+    int             cc_len;            /* Number of choices */
+    char          **cc_name;           /* Choice names */
+    char          **cc_help;           /* Per-choice help texts, NULL entry if none */
+};
+typedef struct cg_choices cg_choices;
+
 /*
  * If cligen object is a variable, this is its variable spec.
  * But it is not complete, it is a part of a cg_obj.
@@ -144,6 +155,7 @@ struct cg_varspec{
         char           *cgs_keyword;   /* keyword string (mutually exclusive with cgs_choice) */
     };
     char           *cgs_choice_help;   /* per-choice help texts, eg "ahelp|bhelp|chelp", parallel to cgs_choice */
+    cg_choices     *cgs_choices;       /* cgs_choice and cgs_choice_help split, see co_choices_get */
     /* int range / str length of cvv_low/upper bound intervals. Note, the two
      * range-cvvs must have the same length. */
     int             cgs_rangelen;
@@ -168,11 +180,25 @@ typedef struct cg_varspec cg_varspec;
 #define CO_FLAGS_MATCH     0x10  /* For sets: avoid selecting same more than once */
 #define CO_FLAGS_ALIAS     0x20  /* Added as an alias (see cligen_alias_cb) */
 #define CO_FLAGS_TREEREF   0x40  /* Set by application treeref-flags callback; propagated to all copies within a tagged expansion */
+#define CO_FLAGS_FROZEN    0x80  /* In a frozen parse-tree, not set on copies, see cligen_pt_freeze */
 
 /* Flags for pt_copy and co_copy
  */
 #define CO_COPY_FLAGS_TREEREF 0x01 /* If called from pt_expand_treeref: the copy point to the original */
 
+/* Fields of an expanded cg_obj borrowed from the original (co_ref), neither owned nor freed
+ * Fields of a parsed cg_obj may also be allocated in the arena of its tree
+ * @see co_expand_sub
+ * @see co_new_arena
+ */
+#define CO_BORROW_COMMAND    0x01  /* co_command */
+#define CO_BORROW_PREFIX     0x02  /* co_prefix */
+#define CO_BORROW_CALLBACKS  0x04  /* co_callbacks */
+#define CO_BORROW_CVEC       0x08  /* co_cvec */
+#define CO_BORROW_HELPSTRING 0x10  /* co_helpstring */
+#define CO_BORROW_VARSPEC    0x20  /* All strings and vectors of the variable spec */
+#define CO_BORROW_ARENA      0x40  /* The object itself is in the arena of its tree, see pt_arena_set */
+
 /*! Adjusted (smaller) cg-obj for commands used for CO_COMMAND and CO_REFERENCE
  *
  * other cg-obj types (CO_VARIABLE) uses cg_obj
@@ -185,6 +211,7 @@ struct cg_obj_common{
     enum cg_objtype     coc_type;      /* Type of object: command, variable or tree
                                          reference */
     uint16_t            coc_preference; /* Overrides default variable preference if != 0*/
+    uint16_t            coc_borrow;    /* Fields borrowed from co_ref, see CO_BORROW_* */
     char               *coc_command;   /* malloc:ed matching string / name or type */
     char               *coc_prefix;    /* Prefix. Can be used in cases where co_command is not unique */
     cg_callback        *coc_callbacks; /* linked list of callbacks and arguments */
@@ -244,6 +271,7 @@ typedef struct cg_obj cg_obj;
 #define co_prev          co_common.coc_prev
 #define co_type          co_common.coc_type
 #define co_preference    co_common.coc_preference
+#define co_borrow        co_common.coc_borrow
 #define co_command       co_common.coc_command
 #define co_prefix        co_common.coc_prefix
 #define co_callbacks     co_common.coc_callbacks
@@ -269,6 +297,7 @@ typedef struct cg_obj cg_obj;
 #define co_choice        u.cou_var.cgs_choice
 #define co_keyword       u.cou_var.cgs_keyword
 #define co_choice_help   u.cou_var.cgs_choice_help
+#define co_choices       u.cou_var.cgs_choices
 #define co_rangelen      u.cou_var.cgs_rangelen
 #define co_rangecvv_low  u.cou_var.cgs_rangecvv_low
 #define co_rangecvv_upp  u.cou_var.cgs_rangecvv_upp
@@ -296,13 +325,20 @@ void        co_sets_set(cg_obj *co, int sets);
 char       *co_prefix_get(cg_obj *co);
 int         co_prefix_set(cg_obj *co, const char *prefix);
 cvec       *co_filter_set(cg_obj *co, cvec *cvv);
+cg_choices *co_choices_new(const char *choice, const char *help);
+cg_choices *co_choices_get(cg_obj *co);
 size_t      co_size(enum cg_objtype type);
 cg_obj     *co_new_only(enum cg_objtype type);
+cg_obj     *co_new_only_arena(enum cg_objtype type, struct cligen_arena *ca);
 cg_obj     *co_new(const char *cmd, cg_obj *prev);
+cg_obj     *co_new_arena(const char *cmd, cg_obj *prev, struct cligen_arena *ca);
 cg_obj     *cov_new(enum cv_type cvtype, cg_obj *prev);
+cg_obj     *cov_new_arena(enum cv_type cvtype, cg_obj *prev, struct cligen_arena *ca);
 int         co_pref(cg_obj *co, int exact);
 int         co_copy(cg_obj *co, cg_obj *parent, uint32_t flags, cg_obj **conp);
 int         co_copy1(cg_obj *co, cg_obj *parent, int recursive, uint32_t flags, cg_obj **conp);
+int         co_copy1_arena(cg_obj *co, cg_obj *parent, int recursive, uint32_t flags, struct cligen_arena *ca, cg_obj **conp);
+int         co_unborrow(cg_obj *co, uint16_t bits);
 int         co_eq(cg_obj *co1, cg_obj *co2);
 int         co_free(cg_obj *co, int recursive);
 cg_obj     *co_insert1(parse_tree *pt, cg_obj *co, int recursive);
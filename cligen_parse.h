@@ -84,6 +84,7 @@ struct cligen_parse_yacc{
     int                   cy_optional;     /* Keep track of [] level, 0..n. All co objects
                                             * created when this flag > 0 will have
                                             * CO_FLAGS_OPTION set */
+    struct cligen_arena  *cy_arena;        /* Arena of current tree, if any, see pt_arena_set */
 };
 typedef struct cligen_parse_yacc cligen_yacc;
 
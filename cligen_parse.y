@@ -111,6 +111,7 @@ typedef void *yyscan_t;
 #include <net/if.h>
 
 #include "cligen_buf.h"
+#include "cligen_arena.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
 #include "cligen_parsetree.h"
@@ -277,8 +278,16 @@ cgy_treename(cligen_yacc *cy,
         /* 3. Create new parse-tree XXX */
         if ((pt = pt_new()) == NULL)
             goto done;
-        co_pt_clear(cot);
-        co_pt_set(cot, pt);
+        /* The old arena was moved with the old parse-tree, the new tree gets its own */
+        if (cy->cy_arena){
+            if ((cy->cy_arena = cligen_arena_new(0)) == NULL){
+                pt_free(pt, 0);
+                goto done;
+            }
+            pt_arena_set(pt, cy->cy_arena);
+        }
+        /* The fake top object is not in any tree, set its tree without invalidating any */
+        cot->co_ptvec[0] = pt;
         if ((cv = cvec_find(cy->cy_globals, "pipetree")) != NULL){
             char *str;
             if ((str = cv_string_get(cv)) != NULL && strlen(str))
@@ -530,7 +539,7 @@ cgy_var_create(cligen_yacc *cy)
     cg_obj *co;
 
     /* Create unassigned variable object */
-    if ((co = cov_new(CGV_ERR, NULL)) == NULL){
+    if ((co = cov_new_arena(CGV_ERR, NULL, cy->cy_arena)) == NULL){
         fprintf(stderr, "%s: malloc: %s\n", __FUNCTION__, strerror(errno));
         cligen_parseerror1(cy, "Allocating cligen object");
         return NULL;
@@ -553,12 +562,24 @@ cgy_var_name_type(cligen_yacc *cy,
                   char        *name,
                   char        *type)
 {
-    cy->cy_var->co_command = name;
-    if ((cy->cy_var->co_vtype = cv_str2type(type)) == CGV_ERR){
+    cg_obj *co = cy->cy_var;
+
+    co->co_command = name;
+    if ((co->co_vtype = cv_str2type(type)) == CGV_ERR){
         cligen_parseerror1(cy, "Invalid type");
         fprintf(stderr, "%s: Invalid type: %s\n", __FUNCTION__, type);
         return -1;
     }
+    /* Variable names in the arena of the tree are interned, name may be equal to type */
+    if (cy->cy_arena && (co->co_borrow & CO_BORROW_ARENA)){
+        if ((co->co_command = cligen_arena_intern(cy->cy_arena, name)) == NULL){
+            co->co_command = name;
+            cligen_parseerror1(cy, "Allocating variable name");
+            return -1;
+        }
+        co->co_borrow |= CO_BORROW_COMMAND;
+        free(name);
+    }
     return 0;
 }
 
@@ -591,6 +612,12 @@ cgy_var_post(cligen_yacc *cy)
         cligen_parseerror1(cy, "Wrong or unassigned variable type");
         return -1;
     }
+    /* Split choices once, copies below get their own */
+    if (coy->co_choice &&
+        (coy->co_choices = co_choices_new(coy->co_choice, coy->co_choice_help)) == NULL){
+        cligen_parseerror1(cy, "Allocating choices");
+        return -1;
+    }
 #if 0 /* XXX dont really know what i am doing but variables dont behave nice in choice */
     if (cy->cy_opt){     /* get coparent from stack */
         if (cy->cy_stack == NULL){
@@ -641,7 +668,7 @@ cgy_cmd(cligen_yacc *cy,
         if (debug)
             fprintf(stderr, "%s: %s parent:%s\n",
                     __FUNCTION__, cmd, cop->co_command);
-        if ((conew = co_new(cmd, cop)) == NULL) {
+        if ((conew = co_new_arena(cmd, cop, cy->cy_arena)) == NULL) {
             cligen_parseerror1(cy, "Allocating cligen object");
             return -1;
         }
@@ -683,7 +710,7 @@ cgy_reference(cligen_yacc *cy,
     for (cl=cy->cy_list; cl; cl = cl->cl_next){
         /* Add a treeref 'stub' which is expanded in pt_expand to a sub-tree */
         cop = cl->cl_obj;
-        if ((cot = co_new(cbuf_get(cb), cop)) == NULL) {
+        if ((cot = co_new_arena(cbuf_get(cb), cop, cy->cy_arena)) == NULL) {
             cligen_parseerror1(cy, "Allocating cligen object");
             goto done;
         }
@@ -736,6 +763,23 @@ cgy_helpstring(cligen_yacc *cy,
                     cligen_parseerror1(cy, "Allocating helpstr: size overflow");
                     goto done;
                 }
+                if (co->co_borrow & CO_BORROW_HELPSTRING){
+                    /* Interned in the arena of the tree, intern the merged string */
+                    if ((tmp = malloc(olen + alen + 2)) == NULL){
+                        cligen_parseerror1(cy, "Allocating helpstr");
+                        goto done;
+                    }
+                    memcpy(tmp, co->co_helpstring, olen);
+                    tmp[olen] = '\n';
+                    memcpy(tmp + olen + 1, helpstr, alen + 1);
+                    co->co_helpstring = cligen_arena_intern(cy->cy_arena, tmp);
+                    free(tmp);
+                    if (co->co_helpstring == NULL){
+                        cligen_parseerror1(cy, "Allocating helpstr");
+                        goto done;
+                    }
+                    continue;
+                }
                 if ((tmp = realloc(co->co_helpstring, olen + alen + 2)) == NULL){
                     cligen_parseerror1(cy, "Allocating helpstr");
                     goto done;
@@ -745,6 +789,13 @@ cgy_helpstring(cligen_yacc *cy,
                 memcpy(tmp + olen + 1, helpstr, alen + 1);
             }
         }
+        else if (cy->cy_arena && (co->co_borrow & CO_BORROW_ARENA)){
+            if ((co->co_helpstring = cligen_arena_intern(cy->cy_arena, helpstr)) == NULL){
+                cligen_parseerror1(cy, "Allocating helpstr");
+                goto done;
+            }
+            co->co_borrow |= CO_BORROW_HELPSTRING;
+        }
         else
             if ((co->co_helpstring = strdup(helpstr)) == NULL){
                 cligen_parseerror1(cy, "Allocating helpstr");
@@ -882,7 +933,7 @@ cgy_terminal(cligen_yacc *cy)
                     break;
             }
             if (i == pt_len_get(ptc)){ /* Insert empty child if ';' */
-                if ((coi = co_new(NULL, co)) == NULL) {
+                if ((coi = co_new_arena(NULL, co, cy->cy_arena)) == NULL) {
                     cligen_parseerror1(cy, "Allocating cligen object");
                     return -1;
                 }
@@ -61,6 +61,7 @@
 #include <errno.h>
 
 #include "cligen_buf.h"
+#include "cligen_arena.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
 #include "cligen_parsetree.h"
@@ -73,6 +74,7 @@
 #include "cligen_parse.h"
 #include "cligen_handle.h"
 #include "cligen_getline.h"
+#include "cligen_expand.h"
 #include "banned.h"
 
 /* Private definition of parsetree. Public is defined in cligen_parsetree.h
@@ -82,9 +84,182 @@
 struct parse_tree{
     struct cg_obj     **pt_vec;    /* vector of pointers to parse-tree nodes */
     unsigned int        pt_len;    /* length of vector */
+    unsigned int        pt_cap;    /* Allocated slots of vector, see pt_vec_reserve */
     char                pt_set;    /* Parse-tree is a SET */
+    char                pt_transient; /* Expanded or result tree, changes do not bump generation */
+    struct pt_index    *pt_index[2]; /* Command index, case-sensitive and case-insensitive,
+                                       * see pt_index_candidates */
+    uint64_t            pt_generation; /* Changed when this tree changes, see pt_tree_generation_get */
+    char                pt_inarena; /* This struct is allocated in the arena of its tree */
+    cligen_arena       *pt_arena;  /* Arena of objects of a parsed tree, see pt_arena_set */
+    char                pt_frozen; /* Read-only, see cligen_pt_freeze */
+    int                 pt_refs;   /* Holders of a frozen top-level tree, see cligen_pt_hold */
 };
 
+/*! Command of a parse-tree index
+ */
+struct pt_index_entry{
+    char *pie_cmd;   /* Command name, not copied */
+    int   pie_pos;   /* Position in parse-tree */
+};
+
+/*! Node of a radix tree over sorted commands of a parse-tree index
+ *
+ * All commands of a node share their first pr_depth characters and are adjacent in the
+ * sorted command vector. Commands that end at pr_depth come first, followed by the
+ * children which are sorted on their first character at pr_depth.
+ */
+struct pt_radix{
+    int           pr_lo;     /* First command in pi_cmdv */
+    int           pr_hi;     /* Last command + 1 in pi_cmdv */
+    int           pr_depth;  /* Length of common prefix */
+    int           pr_child;  /* First child in pi_radix, children are adjacent */
+    int           pr_nchild; /* Number of children */
+    unsigned char pr_ch;     /* Character at depth of parent that leads to this node */
+};
+
+/*! Index of the commands of a parse-tree sorted by name for prefix lookup
+ *
+ * Parse-trees are sorted with co_eq which may use strverscmp, where commands with a common
+ * prefix are not necessarily adjacent. Therefore commands are indexed in plain strcmp (or
+ * strcasecmp) order. A radix tree over the sorted commands finds the commands with a
+ * given prefix in time proportional to the length of the prefix.
+ * @see pt_index_candidates
+ */
+struct pt_index{
+    uint64_t               pi_generation; /* Global parse-tree generation when built */
+    int                    pi_caseignore; /* Commands sorted case-insensitive */
+    struct pt_index_entry *pi_cmdv;       /* Commands, sorted by name */
+    int                    pi_cmdlen;     /* Length of pi_cmdv */
+    int                   *pi_posv;       /* Positions of pi_cmdv, see pt_index_candidates */
+    int                    pi_ordered;    /* pi_posv is increasing, ie in parse-tree order */
+    int                   *pi_otherv;     /* Positions of all other objects, in parse-tree order */
+    int                    pi_otherlen;   /* Length of pi_otherv */
+    struct pt_radix       *pi_radix;      /* Radix tree over pi_cmdv, root first */
+    int                    pi_radixlen;   /* Number of radix tree nodes */
+};
+
+/* Global parse-tree generation, incremented to invalidate data derived from all trees
+ * Atomic since handles in different threads may share frozen trees
+ * @see pt_generation_get
+ */
+static uint64_t _pt_generation = 0;
+
+/* Last generation given to a single parse-tree, see pt_tree_generation_get */
+static uint64_t _pt_tree_generation = 0;
+
+/*! Get a new unique generation of a single parse-tree
+ */
+static inline uint64_t
+pt_tree_generation_new(void)
+{
+    return __atomic_add_fetch(&_pt_tree_generation, 1, __ATOMIC_RELAXED);
+}
+
+/*! Get global parse-tree generation
+ *
+ * The global generation is only incremented by pt_generation_inc, when a change cannot be
+ * attributed to a single parse-tree. Changes of a tree change its own generation.
+ * @retval  gen  Generation number
+ * @see pt_generation_inc
+ * @see pt_tree_generation_get
+ */
+uint64_t
+pt_generation_get(void)
+{
+    return __atomic_load_n(&_pt_generation, __ATOMIC_RELAXED);
+}
+
+/*! Increment global parse-tree generation and thereby invalidate all data derived from parse-trees
+ *
+ * An application that modifies cligen objects in place, eg labels or helpstrings, without
+ * using the parse-tree API should call this.
+ */
+void
+pt_generation_inc(void)
+{
+    __atomic_add_fetch(&_pt_generation, 1, __ATOMIC_RELAXED);
+}
+
+/*! Get generation of a parse-tree
+ *
+ * The generation is changed whenever the parse-tree, ie its vector of objects, or an object
+ * of the vector is changed via the API. It is unique: a tree allocated where another was
+ * freed gets a new generation. Data derived from a tree is valid as long as both the
+ * generation of the tree and the global generation are unchanged.
+ * Changes of sub-trees do not change the generation of their parents.
+ * @param[in]  pt   Parse-tree
+ * @retval     gen  Generation number
+ * @see pt_generation_get
+ */
+uint64_t
+pt_tree_generation_get(parse_tree *pt)
+{
+    return pt->pt_generation;
+}
+
+/*! Mark that an object of a parse-tree has changed, eg its flags or sub-tree
+ *
+ * Changes the generation of the parse-tree containing co, ie the tree of the parent of co.
+ * Top-level objects have no parent, then the global generation is incremented.
+ * @param[in]  co   CLIgen object
+ * @see pt_tree_generation_get
+ */
+void
+pt_co_changed(cg_obj *co)
+{
+    cg_obj     *cop;
+    parse_tree *pt;
+
+    if ((cop = co_up(co)) != NULL &&
+        (pt = co_pt_get(cop)) != NULL){
+        if (pt->pt_transient == 0)
+            pt->pt_generation = pt_tree_generation_new();
+    }
+    else
+        pt_generation_inc();
+}
+
+/*! Free a command index
+ */
+static void
+pt_index_free1(struct pt_index *pi)
+{
+    if (pi->pi_cmdv)
+        free(pi->pi_cmdv);
+    if (pi->pi_posv)
+        free(pi->pi_posv);
+    if (pi->pi_otherv)
+        free(pi->pi_otherv);
+    if (pi->pi_radix)
+        free(pi->pi_radix);
+    free(pi);
+}
+
+/*! Free command indexes of parse-tree
+ */
+static void
+pt_index_free(parse_tree *pt)
+{
+    int i;
+
+    for (i=0; i<2; i++)
+        if (pt->pt_index[i] != NULL){
+            pt_index_free1(pt->pt_index[i]);
+            pt->pt_index[i] = NULL;
+        }
+}
+
+/*! Mark parse-tree as changed, change its generation unless it is transient
+ */
+static inline void
+pt_changed(parse_tree *pt)
+{
+    pt_index_free(pt);
+    if (pt->pt_transient == 0)
+        pt->pt_generation = pt_tree_generation_new();
+}
+
 static int
 pt_stats_one(parse_tree *pt,
              size_t     *szp)
@@ -92,7 +267,7 @@ pt_stats_one(parse_tree *pt,
     size_t              sz = 0;
 
     sz += sizeof(struct parse_tree);
-    sz += pt->pt_len*sizeof(struct cg_obj*);
+    sz += pt->pt_cap*sizeof(struct cg_obj*);
     if (szp)
         *szp = sz;
     return 0;
@@ -105,6 +280,7 @@ pt_stats_one(parse_tree *pt,
  * @param[out]  szp  Size of this pt + objects recursively
  * @retval      0    OK
  * @retval     -1    Error
+ * Strings interned in the arena of the tree are counted once, see cligen_arena_intern_stats
  */
 int
 pt_stats(parse_tree *pt,
@@ -113,12 +289,15 @@ pt_stats(parse_tree *pt,
 {
     cg_obj *co;
     size_t  sz = 0;
+    size_t  isz = 0;
     int     i;
 
     *nrp += 1;
     pt_stats_one(pt, &sz);
+    if (pt->pt_arena)
+        cligen_arena_intern_stats(pt->pt_arena, NULL, &isz, NULL);
     if (szp)
-        *szp += sz;
+        *szp += sz + isz;
     for (i=0; i<pt_len_get(pt); i++){
         if ((co = pt_vec_i_get(pt, i)) != NULL)
             co_stats(co, nrp, szp);
@@ -174,7 +353,12 @@ pt_vec_i_clear(parse_tree *pt,
         errno = EFAULT;
         return -1;
     }
+    if (pt->pt_frozen){
+        errno = EROFS;
+        return -1;
+    }
     pt->pt_vec[i] = NULL;
+    pt_changed(pt);
     return 0;
 }
 
@@ -251,6 +435,10 @@ pt_vec_i_delete(parse_tree *pt,
         errno = EFAULT;
         goto done;
     }
+    if (pt->pt_frozen){
+        errno = EROFS;
+        goto done;
+    }
     co = pt->pt_vec[i];
     pt->pt_vec[i] = NULL;
     co_free(co, recurse);
@@ -259,6 +447,7 @@ pt_vec_i_delete(parse_tree *pt,
                 &pt->pt_vec[i+1],
                 size);
     pt->pt_len--;
+    pt_changed(pt);
     retval = 0;
  done:
     return retval;
@@ -297,26 +486,267 @@ pt_sets_set(parse_tree *pt,
        errno = EINVAL;
        return -1;
     }
-    pt->pt_set = sets;
+    if (pt->pt_set != sets){
+        if (pt->pt_frozen){
+            errno = EROFS;
+            return -1;
+        }
+        pt->pt_set = sets;
+        pt_changed(pt);
+    }
     return 0;
 }
 
+/*! Get transient flag of parse-tree
+ *
+ * @param[in]  pt  Parse tree
+ * @retval     1   Transient, eg expanded or match result tree
+ * @retval     0   Not transient
+ */
+int
+pt_transient_get(parse_tree *pt)
+{
+    if (pt == NULL){
+       errno = EINVAL;
+       return -1;
+    }
+    return pt->pt_transient;
+}
+
+/*! Mark parse-tree as transient
+ *
+ * A transient parse-tree is a short-lived tree, such as the result of pt_expand, whose changes
+ * do not change its generation.
+ * @param[in]  pt         Parse tree
+ * @param[in]  transient  Set if transient
+ * @retval     0          OK
+ * @retval    -1          Error
+ * @see pt_tree_generation_get
+ */
+int
+pt_transient_set(parse_tree *pt,
+                 int         transient)
+{
+    if (pt == NULL){
+       errno = EINVAL;
+       return -1;
+    }
+    pt->pt_transient = transient;
+    return 0;
+}
+
+/*! Get arena of a parsed tree
+ *
+ * @param[in]  pt   Top-level parse-tree
+ * @retval     ca   Arena owning objects of the tree
+ * @retval     NULL No arena
+ */
+cligen_arena *
+pt_arena_get(parse_tree *pt)
+{
+    return pt->pt_arena;
+}
+
+/*! Set arena of a parsed tree
+ *
+ * The arena is freed with the tree, after all its objects, see pt_free
+ * Objects allocated in the arena must not be moved to other trees.
+ * @param[in]  pt   Top-level parse-tree
+ * @param[in]  ca   Arena, consumed
+ * @retval     0    OK
+ * @retval    -1    Error
+ * @see clispec_parse_str
+ */
+int
+pt_arena_set(parse_tree   *pt,
+             cligen_arena *ca)
+{
+    if (pt == NULL || pt->pt_arena != NULL){
+       errno = EINVAL;
+       return -1;
+    }
+    pt->pt_arena = ca;
+    return 0;
+}
+
+static int pt_index_build(parse_tree *pt, int caseignore);
+
+/*! Freeze a parse-tree and its sub-trees recursively
+ *
+ * @param[in]  pt   Parse-tree
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+pt_freeze1(parse_tree *pt)
+{
+    cg_obj *co;
+    int     i;
+
+    if (pt == NULL || pt->pt_frozen)
+        return 0;
+    pt->pt_frozen = 1;
+    for (i=0; i<pt_len_get(pt); i++){
+        if ((co = pt_vec_i_get(pt, i)) == NULL)
+            continue;
+        /* Compute what is otherwise computed and stored on first use */
+        cvec_names_sig(co->co_cvec);
+        cvec_names_sig(co->co_filter);
+        if (co->co_type == CO_VARIABLE && co->co_choice &&
+            co_choices_get(co) == NULL)
+            return -1;
+        co_flags_set(co, CO_FLAGS_FROZEN);
+        if (pt_freeze1(co_pt_get(co)) < 0)
+            return -1;
+    }
+    /* Indexes of frozen trees are not built on demand, see pt_index_candidates */
+    if (pt_len_get(pt) >= PT_INDEX_MIN &&
+        (pt_index_build(pt, 0) < 0 ||
+         pt_index_build(pt, 1) < 0))
+        return -1;
+    return 0;
+}
+
+/*! Make a parse-tree read-only so that it can be shared by several handles
+ *
+ * Matching, expanding, completing and showing help do not write to a frozen tree, all
+ * state of a request is kept in the handle and in copies. A single tree can therefore be
+ * used by several handles, also in different threads if each thread has its own handle.
+ * Functions modifying the parse-tree vectors fail with EROFS. Objects of a frozen tree
+ * must not be modified in place, eg with co_flags_set or co_value_set.
+ * Callbacks and expand functions should be mapped before freezing, see
+ * cligen_callbackv_str2fn. A tree cannot be thawed, make a copy with pt_dup instead.
+ * @param[in]  pt   Top-level parse-tree
+ * @retval     0    OK
+ * @retval    -1    Error
+ * @code
+ *    cligen_pt_freeze(pt);
+ *    cligen_ph_parsetree_set(ph2, cligen_pt_hold(pt)); // ph2 of another handle
+ * @endcode
+ * @see cligen_pt_hold
+ */
+int
+cligen_pt_freeze(parse_tree *pt)
+{
+    if (pt == NULL){
+       errno = EINVAL;
+       return -1;
+    }
+    if (pt->pt_frozen)
+        return 0;
+    if (pt_freeze1(pt) < 0)
+        return -1;
+    __atomic_store_n(&pt->pt_refs, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*! Get frozen flag of parse-tree
+ *
+ * @param[in]  pt  Parse tree
+ * @retval     1   Frozen, see cligen_pt_freeze
+ * @retval     0   Not frozen
+ */
+int
+pt_frozen_get(parse_tree *pt)
+{
+    if (pt == NULL){
+       errno = EINVAL;
+       return -1;
+    }
+    return pt->pt_frozen;
+}
+
+/*! Add a holder of a frozen parse-tree
+ *
+ * Each holder frees the tree with pt_free, eg via cligen_ph_free, and the tree is freed by
+ * the last holder. The holders are counted atomically, so handles in different threads may
+ * hold and free the same tree. The caller must itself hold the tree it holds again.
+ * @param[in]  pt   Frozen top-level parse-tree
+ * @retval     pt   Same parse-tree
+ * @retval     NULL Error, not frozen
+ * @see cligen_pt_freeze
+ */
+parse_tree *
+cligen_pt_hold(parse_tree *pt)
+{
+    if (pt == NULL || __atomic_load_n(&pt->pt_refs, __ATOMIC_ACQUIRE) == 0){
+       errno = EINVAL;
+       return NULL;
+    }
+    __atomic_fetch_add(&pt->pt_refs, 1, __ATOMIC_RELAXED);
+    return pt;
+}
+
 /*! Allocate a new parsetree
  *
  * @see pt_free
  */
 parse_tree *
 pt_new(void)
+{
+    return pt_new_arena(NULL);
+}
+
+/*! Allocate a new parsetree in an arena
+ *
+ * @param[in]  ca   Arena of the tree, or NULL to use malloc
+ * @see pt_free
+ */
+parse_tree *
+pt_new_arena(cligen_arena *ca)
 {
     parse_tree *pt = NULL;
 
-    if ((pt = malloc(sizeof(parse_tree))) == NULL)
+    if (ca)
+        pt = cligen_arena_alloc(ca, sizeof(parse_tree));
+    else
+        pt = malloc(sizeof(parse_tree));
+    if (pt == NULL)
         return NULL;
     memset(pt, 0, sizeof(parse_tree));
+    pt->pt_inarena = (ca != NULL);
+    pt->pt_generation = pt_tree_generation_new();
     return pt;
 }
 
-/*! Enlarge the child-vector (pattern) of a parse-tree
+/*! Reserve room for n objects in the child-vector of a parse-tree
+ *
+ * The vector grows geometrically: at least doubled, so that adding n objects one by one
+ * costs O(n) reallocs and copying in total. Use it to allocate the vector once if the
+ * number of objects is known.
+ * @param[in] pt  Parse tree
+ * @param[in] n   Number of objects the vector should have room for
+ * @retval    0   OK
+ * @retval   -1   Error
+ */
+int
+pt_vec_reserve(parse_tree *pt,
+               int         n)
+{
+    cg_obj     **vec;
+    unsigned int cap;
+
+    if (pt == NULL || n < 0){
+        errno = EINVAL;
+        return -1;
+    }
+    if (n <= pt->pt_cap)
+        return 0;
+    if (pt->pt_frozen){
+        errno = EROFS;
+        return -1;
+    }
+    cap = 2*pt->pt_cap;
+    if (cap < n)
+        cap = n;
+    if ((vec = realloc(pt->pt_vec, cap*sizeof(cg_obj *))) == NULL)
+        return -1;
+    pt->pt_vec = vec;
+    pt->pt_cap = cap;
+    return 0;
+}
+
+/*! Enlarge the child-vector (pattern) of a parse-tree with one object
  *
  * @param[in] pt  Cligen object vector
  * @retval    0   OK
@@ -336,11 +766,16 @@ pt_new(void)
 int
 pt_realloc(parse_tree *pt)
 {
-    pt->pt_len++;
-    /* Allocate larger cg_obj vector */
-    if ((pt->pt_vec = realloc(pt->pt_vec, (pt->pt_len)*sizeof(cg_obj *))) == 0)
+    if (pt->pt_frozen){
+        errno = EROFS;
+        return -1;
+    }
+    /* Allocate larger cg_obj vector if full */
+    if (pt->pt_len == pt->pt_cap &&
+        pt_vec_reserve(pt, pt->pt_len + 1) < 0)
         return -1;
-    pt->pt_vec[pt->pt_len - 1] = NULL; /* init field */
+    pt->pt_vec[pt->pt_len++] = NULL; /* init field */
+    pt_changed(pt);
     return 0;
 }
 
@@ -383,6 +818,7 @@ pt_copy(parse_tree *pt,
         fprintf(stderr, "%s: malloc: %s\n", __FUNCTION__, strerror(errno));
         goto done;
     }
+    ptn->pt_cap = pt_len_get(ptn);
     j=0;
     for (i=0; i<pt_len_get(pt); i++){
         if ((co = pt_vec_i_get(pt, i)) != NULL){
@@ -428,8 +864,113 @@ pt_dup(parse_tree *pt,
     return ptn;
 }
 
+/*! Help function to qsort for sorting entries in pattern file.
+ *
+ * @param[in]  arg1
+ * @param[in]  arg2
+ * @retval     0    If equal
+ * @retval    <0    If arg1 is less than arg2
+ * @retval    >0    If arg1 is greater than arg2
+ */
+static int
+co_cmp(const void* arg1,
+       const void* arg2)
+{
+    cg_obj* co1 = *(cg_obj**)arg1;
+    cg_obj* co2 = *(cg_obj**)arg2;
+
+    if (co1 == NULL){
+        if (co2 == NULL)
+            return 0;
+        else
+            return -1;
+    }
+    else if (co2 == NULL)
+        return 1;
+    else
+        return co_eq(co1, co2);
+}
+
+/*! Check if the n first objects of a parse-tree are sorted
+ */
+static int
+pt_vec_sorted(parse_tree *pt,
+              int         n)
+{
+    int i;
+
+    for (i=1; i<n; i++)
+        if (co_cmp(&pt->pt_vec[i-1], &pt->pt_vec[i]) > 0)
+            return 0;
+    return 1;
+}
+
+/*! Search for an object equal to co among the n first objects of a parse-tree
+ *
+ * @param[in]  pt      Parse-tree
+ * @param[in]  n       Search the n first objects
+ * @param[in]  sorted  The n first objects are sorted, use binary search
+ * @param[in]  co      Object to find, or NULL for the empty child
+ * @retval     i       Position of an equal object
+ * @retval    -1       Not found
+ */
+static int
+pt_vec_find(parse_tree *pt,
+            int         n,
+            int         sorted,
+            cg_obj     *co)
+{
+    int low = 0;
+    int upper = n - 1;
+    int mid;
+    int cmp;
+
+    if (!sorted){
+        for (mid=0; mid<n; mid++)
+            if (co_cmp(&co, &pt->pt_vec[mid]) == 0)
+                return mid;
+        return -1;
+    }
+    while (low <= upper){
+        mid = (low + upper) / 2;
+        if ((cmp = co_cmp(&co, &pt->pt_vec[mid])) == 0)
+            return mid;
+        if (cmp < 0)
+            upper = mid - 1;
+        else
+            low = mid + 1;
+    }
+    return -1;
+}
+
+/*! Merge object co1 into the equal object co0
+ *
+ * Children of co1 are copied into co0
+ */
+static int
+co_merge(cg_obj *co0,
+         cg_obj *co1)
+{
+    if (co0->co_callbacks == NULL && co1->co_callbacks != NULL){
+        /* Cornercase: co0 callback is NULL and co1 callback is not
+         * Copy from co1 to co0
+         */
+        if (co_callback_copy(co1->co_callbacks, &co0->co_callbacks) < 0)
+            return -1;
+    }
+    return cligen_parsetree_merge(co_pt_get(co0), co0, co_pt_get(co1));
+}
+
+static int pt_vec_sort_merge_from(parse_tree *pt, int from, int recursive);
+static int pt_vec_merge_sorted(parse_tree *pt, int n);
+
 /*! Recursively merge two parse-trees: pt1 into pt0
  *
+ * Objects of pt1 that are not in pt0 are copied and appended, and only the appended
+ * objects are sorted and merged with each other, see pt_vec_sort_merge. Objects already
+ * in pt0 are never freed. pt0 is normally sorted, as built by co_insert: it is then
+ * searched with binary search and the appended objects are merged into it in order.
+ * Otherwise it is searched linearly and sorted as a whole.
  * @param[in,out] pt0     parse-tree 0. On exit contains pt1 too
  * @param[in]     parent  Parent of pt0
  * @param[in]     pt1     parse-tree 1. Merge this into pt0
@@ -442,85 +983,191 @@ cligen_parsetree_merge(parse_tree *pt0,
                        parse_tree *pt1)
 {
     int     retval = -1;
-    cg_obj *co0 = NULL;
     cg_obj *co1;
     cg_obj *co1c;
+    int     n0;
+    int     sorted;
     int     i;
     int     j;
-    int     exist;
 
+    n0 = pt_len_get(pt0);
+    if (pt_vec_reserve(pt0, n0 + pt_len_get(pt1)) < 0)
+        goto done;
+    sorted = pt_vec_sorted(pt0, n0);
     for (j=0; j<pt_len_get(pt1); j++){
         co1 = pt_vec_i_get(pt1, j);
-        exist = 0;
-        for (i=0; i<pt_len_get(pt0); i++){
-            co0 = pt_vec_i_get(pt0, i);
-            if (co0 == NULL && co1 == NULL){
-                exist = 1;
-                break;
-            }
-            if (co0 && co1 && co_eq(co0, co1)==0){
-                if (co0->co_callbacks == NULL && co1->co_callbacks != NULL){
-                    /* Cornercase: co0 callback is NULL and co1 callback is not
-                     * Copy from co1 to co0
-                     */
-                    if (co_callback_copy(co1->co_callbacks, &co0->co_callbacks) < 0)
-                        goto done;
-                }
-                exist = 1;
-                break;
-            }
-        }
-        if (co1==NULL){ /* empty */
-            if (exist)
-                continue;
-            if (pt_realloc(pt0) < 0)
+        if ((i = pt_vec_find(pt0, n0, sorted, co1)) < 0){
+            co1c = NULL;
+            if (co1 && co_copy(co1, parent, 0x0, &co1c) < 0)
                 goto done;
-            pt0->pt_vec[pt_len_get(pt0)-1] = NULL;
-            continue;
-        }
-        if (exist){
-            if (cligen_parsetree_merge(co_pt_get(co0), co0, co_pt_get(co1)) < 0)
+            if (pt_vec_append(pt0, co1c) < 0){
+                if (co1c)
+                    co_free(co1c, 1);
                 goto done;
+            }
         }
-        else{
-            if (pt_realloc(pt0) < 0)
-                goto done;
-            if (co_copy(co1, parent, 0x0, &co1c) < 0)
+        else if (co1 != NULL){
+            if (co_merge(pt_vec_i_get(pt0, i), co1) < 0)
                 goto done;
-            pt0->pt_vec[pt_len_get(pt0)-1] = co1c;
         }
     }
-    cligen_parsetree_sort(pt0, 0);
+    /* Sort the appended objects once, this also merges objects that are equal within pt1 */
+    if (pt_len_get(pt0) > n0 &&
+        pt_vec_sort_merge_from(pt0, n0, 1) < 0)
+        goto done;
+    if (!sorted)
+        cligen_parsetree_sort(pt0, 0);
+    else if (pt_len_get(pt0) > n0 &&
+             pt_vec_merge_sorted(pt0, n0) < 0)
+        goto done;
     retval = 0;
   done:
     return retval;
 }
 
-/*! Help function to qsort for sorting entries in pattern file.
+/*! Object of a parse-tree and its position, for stable sorting
+ */
+struct pt_sort_entry{
+    cg_obj *pse_co;
+    int     pse_pos;
+};
+
+static int
+pt_sort_cmp(const void *a,
+            const void *b)
+{
+    const struct pt_sort_entry *pse1 = (const struct pt_sort_entry *)a;
+    const struct pt_sort_entry *pse2 = (const struct pt_sort_entry *)b;
+    int                         cmp;
+
+    if ((cmp = co_cmp(&pse1->pse_co, &pse2->pse_co)) != 0)
+        return cmp;
+    return pse1->pse_pos - pse2->pse_pos;
+}
+
+/*! Sort the objects of a parse-tree from a position and merge equal objects among them
  *
- * @param[in]  arg1
- * @param[in]  arg2
- * @retval     0    If equal
- * @retval    <0    If arg1 is less than arg2
- * @retval    >0    If arg1 is greater than arg2
+ * Objects before the position are not moved or freed.
+ * @param[in]  pt         CLIgen parse-tree, not frozen
+ * @param[in]  from       Position of first object to sort
+ * @param[in]  recursive  Free merged objects recursively
+ * @retval     0          OK
+ * @retval    -1          Error
+ * @see pt_vec_sort_merge
  */
 static int
-co_cmp(const void* arg1,
-       const void* arg2)
+pt_vec_sort_merge_from(parse_tree *pt,
+                       int         from,
+                       int         recursive)
 {
-    cg_obj* co1 = *(cg_obj**)arg1;
-    cg_obj* co2 = *(cg_obj**)arg2;
+    int                   retval = -1;
+    struct pt_sort_entry *sv = NULL;
+    cg_obj               *co;
+    int                   n;
+    int                   i;
+    int                   j;
 
-    if (co1 == NULL){
-        if (co2 == NULL)
-            return 0;
+    if ((n = pt_len_get(pt) - from) < 2)
+        goto ok;
+    if ((sv = malloc(n*sizeof(*sv))) == NULL)
+        goto done;
+    for (i=0; i<n; i++){
+        sv[i].pse_co = pt->pt_vec[from+i];
+        sv[i].pse_pos = i;
+    }
+    qsort(sv, n, sizeof(*sv), pt_sort_cmp);
+    j = from;
+    for (i=0; i<n; i++){
+        co = sv[i].pse_co;
+        if (j > from && co_cmp(&pt->pt_vec[j-1], &co) == 0){
+            if (co == NULL)
+                continue;
+            if (co_merge(pt->pt_vec[j-1], co) < 0){
+                /* Keep the objects not merged */
+                for (; i<n; i++)
+                    pt->pt_vec[j++] = sv[i].pse_co;
+                pt->pt_len = j;
+                pt_changed(pt);
+                goto done;
+            }
+            co_free(co, recursive);
+            continue;
+        }
+        pt->pt_vec[j++] = co;
+    }
+    pt->pt_len = j;
+    pt_changed(pt);
+ ok:
+    retval = 0;
+ done:
+    if (sv)
+        free(sv);
+    return retval;
+}
+
+/*! Sort a parse-tree built by appending objects and merge equal objects
+ *
+ * Bulk builder: append objects with pt_vec_append and sort once, instead of inserting
+ * every object in order with co_insert which moves the rest of the vector.
+ * Equal objects are merged into the first appended as co_insert does: children are merged,
+ * callbacks are copied if the first has none, and the others are freed. Only one empty
+ * child is kept.
+ * @param[in]  pt         CLIgen parse-tree
+ * @param[in]  recursive  Free merged objects recursively
+ * @retval     0          OK
+ * @retval    -1          Error
+ * @see cligen_parsetree_merge
+ */
+int
+pt_vec_sort_merge(parse_tree *pt,
+                  int         recursive)
+{
+    if (pt == NULL){
+        errno = EINVAL;
+        return -1;
+    }
+    if (pt->pt_frozen){
+        errno = EROFS;
+        return -1;
+    }
+    return pt_vec_sort_merge_from(pt, 0, recursive);
+}
+
+/*! Merge the sorted objects of a parse-tree from a position into the sorted objects before
+ *
+ * The two ranges have no equal objects. Objects before the position keep their order.
+ * @param[in]  pt   CLIgen parse-tree, not frozen
+ * @param[in]  n    Position of first object of the second range
+ * @retval     0    OK
+ * @retval    -1    Error
+ */
+static int
+pt_vec_merge_sorted(parse_tree *pt,
+                    int         n)
+{
+    cg_obj **vec;
+    int      len;
+    int      i;
+    int      j;
+    int      k;
+
+    len = pt_len_get(pt);
+    if (n == 0 || n == len)
+        return 0;
+    if ((vec = malloc(len*sizeof(*vec))) == NULL)
+        return -1;
+    i = 0;
+    j = n;
+    for (k=0; k<len; k++){
+        if (j == len || (i < n && co_cmp(&pt->pt_vec[i], &pt->pt_vec[j]) <= 0))
+            vec[k] = pt->pt_vec[i++];
         else
-            return -1;
+            vec[k] = pt->pt_vec[j++];
     }
-    else if (co2 == NULL)
-        return 1;
-    else
-        return co_eq(co1, co2);
+    memcpy(pt->pt_vec, vec, len*sizeof(*vec));
+    free(vec);
+    pt_changed(pt);
+    return 0;
 }
 
 /*! Sort CLIgen parse-tree, optionally recursive
@@ -537,7 +1184,10 @@ cligen_parsetree_sort(parse_tree *pt,
     int         i;
     parse_tree *pt1;
 
+    if (pt->pt_frozen)
+        return;
     qsort(pt->pt_vec, pt_len_get(pt), sizeof(cg_obj*), co_cmp);
+    pt_changed(pt);
     for (i=0; i<pt_len_get(pt); i++){
         if ((co = pt_vec_i_get(pt, i)) == NULL)
             continue;
@@ -558,26 +1208,41 @@ cligen_parsetree_sort(parse_tree *pt,
  * @param[in]  recursive  If 0 free pt and objects only, if 1 free recursive
  * @retval     0          OK
  * @retval    -1          Error
+ * If pt has an arena, it is freed last, see pt_arena_set
  */
 int
 pt_free(parse_tree *pt,
         int         recursive)
 {
-    int     i;
-    cg_obj *co;
+    int           i;
+    cg_obj       *co;
+    cligen_arena *ca;
 
     if (pt == NULL){
         errno = EINVAL;
         return -1;
     }
+    /* A frozen tree is freed by its last holder, only one holder sees the count reach zero */
+    if (__atomic_load_n(&pt->pt_refs, __ATOMIC_ACQUIRE) != 0 &&
+        __atomic_sub_fetch(&pt->pt_refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return 0;
     if (pt->pt_vec != NULL){
         for (i=0; i<pt_len_get(pt); i++)
             if ((co = pt_vec_i_get(pt, i)) != NULL)
                 co_free(co, recursive);
         free(pt->pt_vec);
     }
+    /* Freeing an empty tree does not change anything an expansion could depend on */
+    if (pt->pt_len)
+        pt_changed(pt);
+    pt_index_free(pt);
     pt->pt_len = 0;
-    free(pt);
+    pt->pt_cap = 0;
+    ca = pt->pt_arena;
+    if (!pt->pt_inarena)
+        free(pt);
+    if (ca)
+        cligen_arena_free(ca);
     return 0;
 }
 
@@ -590,7 +1255,7 @@ cligen_parsetree_free(parse_tree *pt,
 
 /*! Trunc parse-tree to specific length
  *
- * Keep "len" objects, free the rest and reallocate the vector
+ * Keep "len" objects and free the rest. The vector keeps its size for the next objects
  * @param[in]  pt   CLIgen parse-tree
  * @retval     0    OK
  * @retval    -1    Error
@@ -610,18 +1275,315 @@ pt_trunc(parse_tree *pt,
         errno = EINVAL;
         return -1;
     }
+    if (pt->pt_frozen){
+        errno = EROFS;
+        return -1;
+    }
     if (len < pt->pt_len){
         for (i=len; i<pt_len_get(pt); i++){
             if ((co = pt_vec_i_get(pt, i)) != NULL)
                 co_free(co, 0);
         }
-        if ((pt->pt_vec = realloc(pt->pt_vec, (len)*sizeof(cg_obj *))) == 0)
-            return -1;
         pt->pt_len = len;
+        pt_changed(pt);
     }
     return 0;
 }
 
+/* Equal commands are ordered by position, so that a sorted parse-tree gives an ordered index */
+static int
+pt_index_cmp(const void *a,
+             const void *b)
+{
+    const struct pt_index_entry *pa = a;
+    const struct pt_index_entry *pb = b;
+    int                          eq;
+
+    if ((eq = strcmp(pa->pie_cmd, pb->pie_cmd)) != 0)
+        return eq;
+    return pa->pie_pos - pb->pie_pos;
+}
+
+static int
+pt_index_casecmp(const void *a,
+                 const void *b)
+{
+    const struct pt_index_entry *pa = a;
+    const struct pt_index_entry *pb = b;
+    int                          eq;
+
+    if ((eq = strcasecmp(pa->pie_cmd, pb->pie_cmd)) != 0)
+        return eq;
+    return pa->pie_pos - pb->pie_pos;
+}
+
+/*! Character of command in index order
+ */
+static inline unsigned char
+pt_index_ch(const char *cmd,
+            int         i,
+            int         caseignore)
+{
+    return caseignore?tolower((unsigned char)cmd[i]):(unsigned char)cmd[i];
+}
+
+/*! Build radix tree node and its subtree
+ *
+ * @param[in]  pi     Parse-tree index with sorted commands and allocated radix vector
+ * @param[in]  n      Node whose range is set, and whose common prefix is at least depth
+ * @param[in]  depth  Known common prefix length of commands of node
+ */
+static void
+pt_radix_build(struct pt_index *pi,
+               int              n,
+               int              depth)
+{
+    struct pt_radix *pr;
+    char            *first;
+    char            *last;
+    int              lo;
+    int              hi;
+    int              i;
+    int              nchild;
+    unsigned char    ch;
+
+    pr = &pi->pi_radix[n];
+    /* Commands are sorted: common prefix of all is common prefix of first and last */
+    first = pi->pi_cmdv[pr->pr_lo].pie_cmd;
+    last = pi->pi_cmdv[pr->pr_hi-1].pie_cmd;
+    while (first[depth] != '\0' &&
+           pt_index_ch(first, depth, pi->pi_caseignore) ==
+           pt_index_ch(last, depth, pi->pi_caseignore))
+        depth++;
+    pr->pr_depth = depth;
+    /* Skip commands ending here */
+    for (lo = pr->pr_lo; lo < pr->pr_hi; lo++)
+        if (pi->pi_cmdv[lo].pie_cmd[depth] != '\0')
+            break;
+    /* Count and reserve children */
+    nchild = 0;
+    for (i = lo; i < pr->pr_hi; i++)
+        if (i == lo ||
+            pt_index_ch(pi->pi_cmdv[i].pie_cmd, depth, pi->pi_caseignore) !=
+            pt_index_ch(pi->pi_cmdv[i-1].pie_cmd, depth, pi->pi_caseignore))
+            nchild++;
+    pr->pr_child = pi->pi_radixlen;
+    pr->pr_nchild = nchild;
+    pi->pi_radixlen += nchild;
+    /* Set range of children and build their subtrees */
+    n = pr->pr_child;
+    for (; lo < pr->pr_hi; lo = hi){
+        ch = pt_index_ch(pi->pi_cmdv[lo].pie_cmd, depth, pi->pi_caseignore);
+        for (hi = lo+1; hi < pr->pr_hi; hi++)
+            if (pt_index_ch(pi->pi_cmdv[hi].pie_cmd, depth, pi->pi_caseignore) != ch)
+                break;
+        pi->pi_radix[n].pr_lo = lo;
+        pi->pi_radix[n].pr_hi = hi;
+        pi->pi_radix[n].pr_ch = ch;
+        pt_radix_build(pi, n, depth+1); /* pi_radix is not reallocated, pr is valid */
+        n++;
+    }
+}
+
+/*! Find range of sorted commands with prefix using the radix tree
+ *
+ * @param[in]  pi      Parse-tree index
+ * @param[in]  prefix  Prefix
+ * @param[out] lop     First command with prefix
+ * @param[out] hip     Last command with prefix + 1 (hip == lop if none)
+ * @param[out] depthp  Length of common prefix of the commands in the range
+ */
+static void
+pt_radix_lookup(struct pt_index *pi,
+                const char      *prefix,
+                int             *lop,
+                int             *hip,
+                int             *depthp)
+{
+    struct pt_radix *pr;
+    char            *cmd;
+    int              i = 0;
+    int              low;
+    int              upper;
+    int              mid;
+    unsigned char    ch;
+
+    *lop = *hip = 0;
+    *depthp = 0;
+    if (pi->pi_radixlen == 0)
+        return;
+    pr = &pi->pi_radix[0];
+    while (1){
+        /* Compare prefix with common prefix of node */
+        cmd = pi->pi_cmdv[pr->pr_lo].pie_cmd;
+        for (; i < pr->pr_depth && prefix[i] != '\0'; i++)
+            if (pt_index_ch(prefix, i, pi->pi_caseignore) !=
+                pt_index_ch(cmd, i, pi->pi_caseignore))
+                return;
+        if (prefix[i] == '\0')
+            break;
+        /* Binary search children on next character */
+        ch = pt_index_ch(prefix, i, pi->pi_caseignore);
+        low = pr->pr_child;
+        upper = pr->pr_child + pr->pr_nchild;
+        while (low < upper){
+            mid = (low + upper) / 2;
+            if (pi->pi_radix[mid].pr_ch < ch)
+                low = mid + 1;
+            else
+                upper = mid;
+        }
+        if (low == pr->pr_child + pr->pr_nchild || pi->pi_radix[low].pr_ch != ch)
+            return;
+        pr = &pi->pi_radix[low];
+        i++;
+    }
+    *lop = pr->pr_lo;
+    *hip = pr->pr_hi;
+    *depthp = pr->pr_depth;
+}
+
+/*! Build command index of parse-tree
+ *
+ * Quoted commands and commands expanded from REST variables are matched differently
+ * and are not indexed.
+ * @param[in]  pt          CLIgen parse-tree
+ * @param[in]  caseignore  Sort case-insensitive
+ * @retval     0           OK
+ * @retval    -1           Error
+ */
+static int
+pt_index_build(parse_tree *pt,
+               int         caseignore)
+{
+    int              retval = -1;
+    struct pt_index *pi = NULL;
+    cg_obj          *co;
+    int              i;
+
+    if ((pi = malloc(sizeof(*pi))) == NULL)
+        goto done;
+    memset(pi, 0, sizeof(*pi));
+    pi->pi_generation = pt_generation_get();
+    pi->pi_caseignore = caseignore;
+    if (pt->pt_len){
+        if ((pi->pi_cmdv = malloc(pt->pt_len*sizeof(*pi->pi_cmdv))) == NULL)
+            goto done;
+        if ((pi->pi_posv = malloc(pt->pt_len*sizeof(*pi->pi_posv))) == NULL)
+            goto done;
+        if ((pi->pi_otherv = malloc(pt->pt_len*sizeof(*pi->pi_otherv))) == NULL)
+            goto done;
+    }
+    for (i=0; i<pt->pt_len; i++){
+        if ((co = pt->pt_vec[i]) == NULL)
+            continue;
+        if (co->co_type == CO_COMMAND &&
+            co->co_command != NULL &&
+            *co->co_command != '\"' &&
+            !ISREST(co)){
+            pi->pi_cmdv[pi->pi_cmdlen].pie_cmd = co->co_command;
+            pi->pi_cmdv[pi->pi_cmdlen].pie_pos = i;
+            pi->pi_cmdlen++;
+        }
+        else
+            pi->pi_otherv[pi->pi_otherlen++] = i;
+    }
+    qsort(pi->pi_cmdv, pi->pi_cmdlen, sizeof(*pi->pi_cmdv),
+          caseignore?pt_index_casecmp:pt_index_cmp);
+    pi->pi_ordered = 1;
+    for (i=0; i<pi->pi_cmdlen; i++){
+        pi->pi_posv[i] = pi->pi_cmdv[i].pie_pos;
+        if (i && pi->pi_posv[i] < pi->pi_posv[i-1])
+            pi->pi_ordered = 0;
+    }
+    if (pi->pi_cmdlen){
+        /* A node either has commands ending in it or at least two children */
+        if ((pi->pi_radix = malloc((2*pi->pi_cmdlen+1)*sizeof(*pi->pi_radix))) == NULL)
+            goto done;
+        pi->pi_radix[0].pr_lo = 0;
+        pi->pi_radix[0].pr_hi = pi->pi_cmdlen;
+        pi->pi_radix[0].pr_ch = 0;
+        pi->pi_radixlen = 1;
+        pt_radix_build(pi, 0, 0);
+    }
+    if (pt->pt_index[caseignore])
+        pt_index_free1(pt->pt_index[caseignore]);
+    pt->pt_index[caseignore] = pi;
+    pi = NULL;
+    retval = 0;
+ done:
+    if (pi)
+        pt_index_free1(pi);
+    return retval;
+}
+
+/*! Get positions of parse-tree objects that may match a prefix
+ *
+ * Return positions of commands that have prefix as prefix, and of all objects that are not
+ * plain commands, such as variables and references. Commands not returned cannot match
+ * the prefix.
+ * A sorted index of the commands is built on first use and kept until the parse-tree
+ * changes. Indexes of frozen trees are built when frozen and never rebuilt, so that
+ * handles in several threads may look up concurrently. Lookup is then proportional to the length of the prefix and does not allocate:
+ * the returned vectors point into the index. The commands are in parse-tree order if the
+ * parse-tree is sorted in index order, which is the case for sorted trees unless
+ * lexical order or case-insensitive sorting differs from caseignore. Otherwise it is up to
+ * the caller to sort them if the order matters.
+ * The index also gives the common prefix of the commands, and whether they are all equal,
+ * ie if the prefix is unique.
+ * @param[in]  pt          CLIgen parse-tree
+ * @param[in]  prefix      Prefix of commands, non-empty
+ * @param[in]  caseignore  Match prefix case-insensitive
+ * @param[out] cd          Candidates, valid until the parse-tree changes
+ * @retval     0           OK
+ * @retval    -1           Error, also if pt is a frozen level shorter than PT_INDEX_MIN
+ * @note Objects modified in place after the index is built require pt_generation_inc()
+ */
+int
+pt_index_candidates(parse_tree    *pt,
+                    const char    *prefix,
+                    int            caseignore,
+                    pt_candidates *cd)
+{
+    int              retval = -1;
+    struct pt_index *pi;
+    int              low;
+    int              upper;
+    int              depth;
+
+    if (pt == NULL || prefix == NULL || cd == NULL){
+        errno = EINVAL;
+        goto done;
+    }
+    caseignore = caseignore?1:0;
+    pi = pt->pt_index[caseignore];
+    if (pt->pt_frozen){
+        /* Built by pt_freeze1, frozen objects are not modified in place */
+        if (pi == NULL){
+            errno = EROFS;
+            goto done;
+        }
+    }
+    else if (pi == NULL || pi->pi_generation != pt_generation_get()){
+        if (pt_index_build(pt, caseignore) < 0)
+            goto done;
+        pi = pt->pt_index[caseignore];
+    }
+    /* Commands with prefix are adjacent */
+    pt_radix_lookup(pi, prefix, &low, &upper, &depth);
+    cd->cd_cmdv = pi->pi_posv + low;
+    cd->cd_cmdlen = upper - low;
+    cd->cd_ordered = pi->pi_ordered;
+    cd->cd_otherv = pi->pi_otherv;
+    cd->cd_otherlen = pi->pi_otherlen;
+    cd->cd_common = depth;
+    /* Sorted: if the last command ends at the common prefix, all do */
+    cd->cd_unique = upper > low && pi->pi_cmdv[upper-1].pie_cmd[depth] == '\0';
+    retval = 0;
+ done:
+    return retval;
+}
+
 /*! Apply a function call recursively on all cg_obj:s in a parse-tree
  *
  * Recursively traverse all cg_obj in a parse-tree and apply fn(arg) for each
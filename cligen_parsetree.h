@@ -62,10 +62,33 @@ typedef struct parse_tree parse_tree; /* struct defined internally in cligen_par
 */
 typedef int (cg_applyfn_t)(cg_obj *co, void *arg);
 
+/* Minimum number of objects in a parse-tree level to use its command index.
+ * Levels of frozen trees this long are indexed when frozen, see cligen_pt_freeze */
+#define PT_INDEX_MIN 16
+
+/*! Objects of a parse-tree that may match a prefix, see pt_index_candidates()
+ *
+ * The vectors point into the command index of the parse-tree and are valid until the
+ * parse-tree changes.
+ */
+typedef struct pt_candidates{
+    const int *cd_cmdv;     /* Positions of commands with the prefix */
+    int        cd_cmdlen;   /* Length of cd_cmdv */
+    int        cd_ordered;  /* cd_cmdv is in parse-tree order, otherwise in index order */
+    const int *cd_otherv;   /* Positions of all objects that are not indexed, in parse-tree order */
+    int        cd_otherlen; /* Length of cd_otherv */
+    int        cd_common;   /* Length of common prefix of the commands of cd_cmdv */
+    int        cd_unique;   /* All commands of cd_cmdv are equal */
+} pt_candidates;
+
 /*
  * Prototypes
  * Note: pt_ vs cligen_parsetree_
 vec_ */
+uint64_t    pt_generation_get(void);
+void        pt_generation_inc(void);
+uint64_t    pt_tree_generation_get(parse_tree *pt);
+void        pt_co_changed(cg_obj *co);
 int         pt_stats(parse_tree *pt, uint64_t *nrp, size_t *szp);
 cg_obj     *pt_vec_i_get(parse_tree *pt, int i);
 int         pt_vec_i_clear(parse_tree *pt, int i);
@@ -75,15 +98,27 @@ int         pt_vec_i_delete(parse_tree *pt, int i, int recurse);
 int         pt_len_get(parse_tree *pt);
 int         pt_sets_get(parse_tree *pt);
 int         pt_sets_set(parse_tree *pt, int sets);
+int         pt_transient_get(parse_tree *pt);
+int         pt_transient_set(parse_tree *pt, int transient);
 void        cligen_parsetree_sort(parse_tree *pt, int recursive);
 int         pt_realloc(parse_tree *pt);
+int         pt_vec_reserve(parse_tree *pt, int n);
+int         pt_vec_sort_merge(parse_tree *pt, int recursive);
 int         pt_copy(parse_tree *pt, cg_obj *parent, uint32_t flags, parse_tree *ptn);
 parse_tree *pt_dup(parse_tree *pt, cg_obj *cop, uint32_t flags);
 int         cligen_parsetree_merge(parse_tree *pt0, cg_obj *parent0, parse_tree *pt1);
 int         pt_free(parse_tree *pt, int recurse);
 int         cligen_parsetree_free(parse_tree *pt, int recurse);
 int         pt_trunc(parse_tree *pt, int len);
+int         pt_index_candidates(parse_tree *pt, const char *prefix, int caseignore,
+                                pt_candidates *cd);
 parse_tree *pt_new(void);
+parse_tree *pt_new_arena(struct cligen_arena *ca);
+struct cligen_arena *pt_arena_get(parse_tree *pt);
+int         pt_arena_set(parse_tree *pt, struct cligen_arena *ca);
 int         pt_apply(parse_tree *pt, cg_applyfn_t fn, int depth, void *arg);
+int         cligen_pt_freeze(parse_tree *pt);
+int         pt_frozen_get(parse_tree *pt);
+parse_tree *cligen_pt_hold(parse_tree *pt);
 
 #endif /* _CLIGEN_PARSETREE_H_ */
@@ -74,6 +74,120 @@
 #include "cligen_handle_internal.h"
 #include "banned.h"
 
+/*
+ * Constants
+ */
+/* Number of memoized tree references, a power of 2 */
+#define PH_INDEX_MEMO 256
+
+/*
+ * Types
+ */
+/*! Hash index of parse-tree heads by name, rebuilt when the registry changes
+ *
+ * Open addressing with linear probing. Only the first of several heads with the same name
+ * is indexed, as found by a linear search.
+ * @see cligen_ph_find
+ */
+struct ph_index{
+    uint64_t   px_generation;  /* Registry generation of the index, see ch_ph_names */
+    int        px_size;        /* Number of slots, a power of 2 */
+    pt_head  **px_vec;         /* Slots, NULL if empty */
+    struct {
+        cg_obj  *pm_coref;     /* Tree reference object */
+        pt_head *pm_ph;        /* Parse-tree head it resolved to */
+    }          px_memo[PH_INDEX_MEMO]; /* Resolved tree references, see cligen_ph_find_ref */
+};
+
+/*! Hash function of a tree name, FNV-1a
+ */
+static uint32_t
+ph_index_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*name){
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*! Get the name index of the parse-tree heads of a handle, rebuild if the registry has changed
+ *
+ * @param[in]  h    CLIgen handle
+ * @retval     px   Index
+ * @retval     NULL Error
+ */
+static struct ph_index *
+ph_index_get(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+    struct ph_index      *px;
+    pt_head              *ph;
+    int                   n = 0;
+    int                   size;
+    int                   i;
+
+    if ((px = ch->ch_ph_index) != NULL &&
+        px->px_generation == ch->ch_ph_names)
+        return px;
+    for (ph = ch->ch_pt_head; ph; ph = ph->ph_next)
+        n++;
+    for (size = 16; size < 2*n; size *= 2)
+        ;
+    if (px == NULL){
+        if ((px = malloc(sizeof(*px))) == NULL)
+            return NULL;
+        memset(px, 0, sizeof(*px));
+        ch->ch_ph_index = px;
+    }
+    if (px->px_size != size){
+        if (px->px_vec)
+            free(px->px_vec);
+        px->px_size = 0;
+        if ((px->px_vec = malloc(size*sizeof(pt_head *))) == NULL)
+            return NULL;
+        px->px_size = size;
+    }
+    memset(px->px_vec, 0, size*sizeof(pt_head *));
+    memset(px->px_memo, 0, sizeof(px->px_memo));
+    for (ph = ch->ch_pt_head; ph; ph = ph->ph_next){
+        if (ph->ph_name == NULL)
+            continue;
+        i = ph_index_hash(ph->ph_name) & (size-1);
+        while (px->px_vec[i] != NULL &&
+               strcmp(px->px_vec[i]->ph_name, ph->ph_name) != 0)
+            i = (i+1) & (size-1);
+        if (px->px_vec[i] == NULL)
+            px->px_vec[i] = ph;
+    }
+    px->px_generation = ch->ch_ph_names;
+    return px;
+}
+
+/*! Mark that a parse-tree head of a handle has changed
+ *
+ * Data derived from the trees of the handle, such as cached expansions, is invalidated.
+ * @param[in]  ph     Parse-tree head
+ * @param[in]  names  Set if heads are added, removed or renamed
+ * @see pt_expand_cached
+ */
+static void
+ph_changed(pt_head *ph,
+           int      names)
+{
+    struct cligen_handle *ch;
+
+    if ((ch = handle(ph->ph_handle)) == NULL){ /* Not added to a handle */
+        pt_generation_inc();
+        return;
+    }
+    ch->ch_ph_generation++;
+    if (names)
+        ch->ch_ph_names++;
+}
+
 /*
  * Access functions
  */
@@ -116,6 +230,7 @@ cligen_ph_name_set(pt_head    *ph,
     }
     else
         ph->ph_name = NULL;
+    ph_changed(ph, 1); /* Tree references may resolve differently */
     return 0;
 }
 
@@ -154,11 +269,13 @@ cligen_ph_parsetree_set(pt_head    *ph,
        errno = EINVAL;
        goto done;
     }
+    /* Dont write to a tree shared with other handles, see cligen_pt_freeze */
     for (i=0; i<pt_len_get(pt); i++){
-        if ((co = pt_vec_i_get(pt, i)) != NULL)
+        if ((co = pt_vec_i_get(pt, i)) != NULL && co_up(co) != NULL)
             co_up_set(co, NULL);
     }
     ph->ph_parsetree = pt; /* XXX not free if exists? */
+    ph_changed(ph, 0);
     retval = 0;
  done:
     return retval;
@@ -187,7 +304,10 @@ int
 cligen_ph_workpoint_set(pt_head *ph,
                         cg_obj  *wp)
 {
-    ph->ph_workpt = wp;
+    if (ph->ph_workpt != wp){
+        ph->ph_workpt = wp;
+        ph_changed(ph, 0);
+    }
     return 0;
 }
 
@@ -265,13 +385,25 @@ pt_head *
 cligen_ph_find(cligen_handle h,
                const char   *name)
 {
-    char    *phname;
-    pt_head *ph = NULL;
+    char            *phname;
+    pt_head         *ph = NULL;
+    struct ph_index *px;
+    int              i;
 
     if (name == NULL){
        errno = EINVAL;
        return NULL;
     }
+    if ((px = ph_index_get(h)) != NULL){
+        i = ph_index_hash(name) & (px->px_size-1);
+        while ((ph = px->px_vec[i]) != NULL){
+            if (strcmp(ph->ph_name, name) == 0)
+                break;
+            i = (i+1) & (px->px_size-1);
+        }
+        return ph;
+    }
+    /* Fallback if index cannot be built */
     while ((ph = cligen_ph_each(h, ph)))
         if ((phname = cligen_ph_name_get(ph)))
             if (strcmp(phname, name) == 0)
@@ -279,6 +411,63 @@ cligen_ph_find(cligen_handle h,
     return ph;
 }
 
+/*! Find the parsetree head of a tree reference, memoized per reference object
+ *
+ * Same as cligen_ph_find(h, coref->co_command), but the result is remembered for
+ * the reference object until the registry changes
+ * @param[in] h       CLIgen handle
+ * @param[in] coref   Tree reference object, eg \@tree
+ * @retval    ph      Parse-tree header
+ * @retval    NULL    Not found / error
+ * @see tree_resolve
+ */
+pt_head *
+cligen_ph_find_ref(cligen_handle h,
+                   cg_obj       *coref)
+{
+    struct ph_index *px;
+    pt_head         *ph;
+    int              i;
+
+    if (coref == NULL || coref->co_command == NULL){
+       errno = EINVAL;
+       return NULL;
+    }
+    if ((px = ph_index_get(h)) == NULL)
+        return cligen_ph_find(h, coref->co_command);
+    i = ((uintptr_t)coref >> 4) & (PH_INDEX_MEMO-1);
+    /* The object may have been freed and its memory reused, check the name */
+    if (px->px_memo[i].pm_coref == coref &&
+        (ph = px->px_memo[i].pm_ph) != NULL &&
+        strcmp(ph->ph_name, coref->co_command) == 0)
+        return ph;
+    if ((ph = cligen_ph_find(h, coref->co_command)) != NULL){
+        px->px_memo[i].pm_coref = coref;
+        px->px_memo[i].pm_ph = ph;
+    }
+    return ph;
+}
+
+/*! Free the name index of the parse-tree heads of a handle
+ *
+ * @param[in] h       CLIgen handle
+ * @retval    0       OK
+ */
+int
+cligen_ph_index_free(cligen_handle h)
+{
+    struct cligen_handle *ch = handle(h);
+    struct ph_index      *px;
+
+    if ((px = ch->ch_ph_index) != NULL){
+        if (px->px_vec)
+            free(px->px_vec);
+        free(px);
+        ch->ch_ph_index = NULL;
+    }
+    return 0;
+}
+
 /*! Free a  parsetree header
  *
  * @param[in]   ph    Parse-tree header
@@ -298,6 +487,7 @@ cligen_ph_free(pt_head *ph)
         free(ph->ph_prompt);
     if (ph->ph_output_pipe)
         free(ph->ph_output_pipe);
+    ph_changed(ph, 1);
     free(ph);
     return 0;
 }
@@ -320,6 +510,7 @@ cligen_ph_add(cligen_handle h,
         goto done;
 
     memset(ph, 0, sizeof(*ph));
+    ph->ph_handle = h;
     if (cligen_ph_name_set(ph, name) < 0){
         free(ph);
         ph = NULL;
@@ -339,6 +530,8 @@ cligen_ph_add(cligen_handle h,
     phlast->ph_next = ph;
 
  done:
+    if (ph)
+        ph_changed(ph, 1);
     return ph;
 }
 
@@ -63,6 +63,8 @@ int         cligen_ph_prompt_set(pt_head *ph, const char *prompt);
 char       *cligen_ph_pipe_get(pt_head *ph);
 int         cligen_ph_pipe_set(pt_head *ph, const char *pipe);
 pt_head    *cligen_ph_find(cligen_handle h, const char *name);
+pt_head    *cligen_ph_find_ref(cligen_handle h, cg_obj *coref);
+int         cligen_ph_index_free(cligen_handle h);
 int         cligen_ph_free(pt_head *ph);
 pt_head    *cligen_ph_add(cligen_handle h, const char *name);
 pt_head    *cligen_ph_each(cligen_handle h, pt_head *ph);
@@ -105,20 +105,19 @@ cli_show_help_commands(cligen_handle h,
     cvec         *cvv = NULL;
 
     fputs("\n", stdout);
-    if ((ptn = pt_new()) == NULL)
-        goto done;
     if ((pt = cligen_pt_active_get(h)) == NULL)
         goto ok;
     if ((cvv = cvec_start(string)) == NULL)
         goto done;
-    if (pt_expand(h, NULL,
-                  pt,
-                  NULL,
-                  cvv,
-                  1, /* Include hidden commands */
-                  0, /* VARS are not expanded, eg ? <tab> */
-                  NULL, NULL,
-                  ptn) < 0)      /* expansion */
+    /* Cached: the same expansion is used on every '?' */
+    if (pt_expand_cached(h, NULL,
+                         pt,
+                         NULL,
+                         cvv,
+                         1, /* Include hidden commands */
+                         0, /* VARS are not expanded, eg ? <tab> */
+                         NULL, NULL,
+                         &ptn) < 0)      /* expansion */
         goto done;
     if (show_help_line(h, stdout, string, ptn, cvv) < 0)
         goto done;
@@ -127,7 +126,7 @@ cli_show_help_commands(cligen_handle h,
  done:
     if (cvv)
         cvec_free(cvv);
-    if (ptn && pt_free(ptn, 0) < 0)
+    if (ptn && pt_expand_release(h, ptn) < 0)
         return -1;
     if (pt && pt_expand_cleanup(h, pt) < 0)
         return -1;
@@ -177,31 +176,30 @@ cli_tab_hook(cligen_handle h,
     cvec         *cvr = NULL;
     match_result *mr = NULL;
 
-    if ((ptn = pt_new()) == NULL)
-        goto done;
+    /* Tokens and match results of this completion are in the scratch arena */
+    if (cligen_scratch_begin(h) < 0)
+        return -1;
     if ((pt = cligen_pt_active_get(h)) == NULL)
         goto ok;
     if ((cvv = cvec_start(cligen_buf(h))) == NULL)
         goto done;
-    if (pt_expand(h, NULL,
-                  pt,
-                  NULL,
-                  cvv,
-                  1,   /* Include hidden commands */
-                  0,   /* VARS are not expanded, eg ? <tab> */
-                  NULL, NULL,
-                  ptn) < 0)      /* expansion */
+    /* Cached expansion and memoized token matches (see match_vec_memo) make repeated
+     * completion of the same line resume at the first changed token */
+    if (pt_expand_cached(h, NULL,
+                         pt,
+                         NULL,
+                         cvv,
+                         1,   /* Include hidden commands */
+                         0,   /* VARS are not expanded, eg ? <tab> */
+                         NULL, NULL,
+                         &ptn) < 0)      /* expansion */
         goto done;
     /* Compute match_pattern once and reuse for both completion and help display.
      * This avoids calling custom expansion functions multiple times (issue #92).
      */
     do {
         prev_cursor = *cursorp;
-        /* Tokenize current string for match_pattern */
-        if (cvt)
-            cvec_free(cvt);
-        if (cvr)
-            cvec_free(cvr);
+        /* Tokenize current string for match_pattern, previous tokens are in scratch */
         cvt = cvr = NULL;
         if (mr)
             mr_free(mr);
@@ -224,7 +222,7 @@ cli_tab_hook(cligen_handle h,
             }
             strncpy(s, s0, slen);
             s[cursor] = '\0';
-            if (cligen_str2cvv(s, &cvt, &cvr) < 0){
+            if (cligen_str2cvv_scratch(s, cligen_scratch_request(h), &cvt, &cvr) < 0){
                 free(s);
                 goto done;
             }
@@ -270,15 +268,11 @@ cli_tab_hook(cligen_handle h,
         (cligen_tabmode(h) & CLIGEN_TABMODE_SHOW) != 0x0){
         /* Recompute match result after completion loop if cursor changed */
         if (prev_cursor != *cursorp){
-            if (cvt)
-                cvec_free(cvt);
-            if (cvr)
-                cvec_free(cvr);
             cvt = cvr = NULL;
             if (mr)
                 mr_free(mr);
             mr = NULL;
-            if (cligen_str2cvv(cligen_buf(h), &cvt, &cvr) < 0)
+            if (cligen_str2cvv_scratch(cligen_buf(h), cligen_scratch_request(h), &cvt, &cvr) < 0)
                 goto done;
             if (match_pattern(h, cvt, cvr,
                               ptn,
@@ -298,18 +292,15 @@ cli_tab_hook(cligen_handle h,
  ok:
     retval = 0;
  done:
-    if (cvt)
-        cvec_free(cvt);
-    if (cvr)
-        cvec_free(cvr);
     if (mr)
         mr_free(mr);
     if (cvv)
         cvec_free(cvv);
-    if (ptn && pt_free(ptn, 0) < 0)
-        return -1;
-    if (pt && pt_expand_cleanup(h, pt) < 0)
-        return -1;
+    if (ptn && pt_expand_release(h, ptn) < 0)
+        retval = -1;
+    else if (pt && pt_expand_cleanup(h, pt) < 0)
+        retval = -1;
+    cligen_scratch_end(h);
     return retval;
 }
 
@@ -493,16 +484,17 @@ show_help_line(cligen_handle h,
     cvec         *cvt = NULL;      /* Tokenized string: vector of tokens */
     cvec         *cvr = NULL;      /* Rest variant,  eg remaining string in each step */
     cg_var       *cvlastt;         /* Last element in cvt */
-    cg_var       *cvlastr;         /* Last element in cvr */
     cligen_result result;
     match_result *mr = NULL;
 
     if (string == NULL){
         errno = EINVAL;
-        goto done;
+        return -1;
     }
+    if (cligen_scratch_begin(h) < 0)
+        return -1;
     /* Tokenize the string and transform it into two CLIgen vectors: tokens and rests */
-    if (cligen_str2cvv(string, &cvt, &cvr) < 0) /* XXX cvr leaks memory */
+    if (cligen_str2cvv_scratch(string, cligen_scratch_request(h), &cvt, &cvr) < 0)
         goto done;
     if (match_pattern(h,
                       cvt, cvr, /* token string */
@@ -529,13 +521,8 @@ show_help_line(cligen_handle h,
            help for y and z and a 'cr' for 'x'.
         */
 
-        /* Remove the last elements. Awkward: first free the cv then truncate the cvec */
-        if (cvlastt)
-            cv_reset(cvlastt);
+        /* Remove the last elements, their strings are in the scratch arena */
         cvec_del_i(cvt, cvec_len(cvt)-1); /* We really just want to truncate len-1 */
-
-        if ((cvlastr = cvec_i(cvr, cvec_len(cvr)-1)) != NULL)
-            cv_reset(cvlastr);
         cvec_del_i(cvr, cvec_len(cvr)-1);
 
         if (match_pattern_exact(h, cvt, cvr, pt,
@@ -559,13 +546,10 @@ show_help_line(cligen_handle h,
         goto done;
     retval = 0;
   done:
-    if (cvt)
-        cvec_free(cvt);
-    if (cvr)
-        cvec_free(cvr);
     if (mr){
         mr_free(mr);
     }
+    cligen_scratch_end(h);
     return retval;
 }
 
@@ -593,22 +577,19 @@ show_help_line_mr(cligen_handle h,
     cvec         *cvt = NULL;
     cvec         *cvr = NULL;
     cg_var       *cvlastt;
-    cg_var       *cvlastr;
     cligen_result result;
 
     if (string == NULL){
         errno = EINVAL;
-        goto done;
+        return -1;
     }
-    if (cligen_str2cvv(string, &cvt, &cvr) < 0)
+    if (cligen_scratch_begin(h) < 0)
+        return -1;
+    if (cligen_str2cvv_scratch(string, cligen_scratch_request(h), &cvt, &cvr) < 0)
         goto done;
     cvlastt = cvec_i(cvt, cvec_len(cvt)-1);
     if (cvec_len(cvt) > 2 && strcmp(cv_string_get(cvlastt), "")==0){
-        if (cvlastt)
-            cv_reset(cvlastt);
         cvec_del_i(cvt, cvec_len(cvt)-1);
-        if ((cvlastr = cvec_i(cvr, cvec_len(cvr)-1)) != NULL)
-            cv_reset(cvlastr);
         cvec_del_i(cvr, cvec_len(cvr)-1);
         if (match_pattern_exact(h, cvt, cvr, pt,
                                 cvv,
@@ -629,10 +610,7 @@ show_help_line_mr(cligen_handle h,
         goto done;
     retval = 0;
   done:
-    if (cvt)
-        cvec_free(cvt);
-    if (cvr)
-        cvec_free(cvr);
+    cligen_scratch_end(h);
     return retval;
 }
 
@@ -687,6 +665,83 @@ cli_trim(char **line,
     *line = s;
 }
 
+/*! Parse one line given an expanded top-level parse-tree, or expand it
+ *
+ * @param[in]     h         Cligen handle
+ * @param[in,out] string    Input string to match, can be trimmed
+ * @param[in]     pt        Parse-tree
+ * @param[in,out] ptnp      Expanded pt. If NULL on entry, expand and return, release with
+ *                          pt_expand_release
+ * @param[out]    co_orig   Object that matches (if retval == 1). Free with co_free(co, 0)
+ * @param[out]    cvvp      Vector of cligen variables present in the input string
+ * @param[out]    result    Result, < 0: errors, >=0 number of matches
+ * @param[out]    reason    Error reason if result is nomatch. Need to be free:d
+ * @retval        0         OK
+ * @retval       -1         Error
+ * @see cliread_parse
+ */
+static int
+cliread_parse1(cligen_handle  h,
+               char          *string,
+               parse_tree    *pt,
+               parse_tree   **ptnp,
+               cg_obj       **co_orig,
+               cvec         **cvvp,
+               cligen_result *result,
+               char         **reason)
+{
+    int         retval = -1;
+    cg_obj     *match_obj = NULL;
+    cvec       *cvt = NULL;      /* Tokenized string: vector of tokens */
+    cvec       *cvr = NULL;      /* Rest variant,  eg remaining string in each step */
+    cg_var     *cv;
+    cvec       *cvv = NULL;
+
+    if (cligen_logsyntax(h) > 0){
+        fprintf(stderr, "%s:\n", __FUNCTION__);
+        pt_print1(stderr, pt, 0);
+    }
+    cli_trim(&string, cligen_comment(h));
+    /* Tokens and match results of this line are in the scratch arena */
+    if (cligen_scratch_begin(h) < 0)
+        return -1;
+    /* Tokenize the string and transform it into two CLIgen vectors: tokens and rests */
+    if (cligen_str2cvv_scratch(string, cligen_scratch_request(h), &cvt, &cvr) < 0)
+        goto done;
+    if ((cvv = cvec_new(0)) == NULL)
+        goto done;;
+    if ((cv = cvec_add(cvv, CGV_REST)) == NULL)
+        goto done;
+    cv_name_set(cv, "cmd"); /* the whole command string */
+    /* The whole command string as user entered. */
+    cv_string_set(cv, string);
+    /* Cached: then the command index of large top-levels is reused, see match_vec */
+    if (*ptnp == NULL &&
+        pt_expand_cached(h, NULL,
+                         pt, cvt, cvv,
+                         0,  /* Do not include hidden commands */
+                         0,  /* VARS are not expanded, eg ? <tab> */
+                         NULL, NULL,
+                         ptnp) < 0) /* sub-tree expansion, ie choice, expand function */
+        goto done;
+    if (match_pattern_exact(h, cvt, cvr,
+                            *ptnp,
+                            cvv,
+                            &match_obj,
+                            result, reason) < 0)
+        goto done;
+    /* Map from ghost object match_obj to real object */
+    *co_orig = match_obj;
+    *cvvp = cvv;
+    cvv = NULL;
+    retval = 0;
+  done:
+    if (cvv)
+        cvec_free(cvv);
+    cligen_scratch_end(h);
+    return retval;
+}
+
 /*! Given an input string, return a parse-tree.
  *
  * Given an input string and a parse-tree, return a matching parse-tree node, a
@@ -725,67 +780,116 @@ cliread_parse(cligen_handle  h,
               char         **reason)
 {
     int         retval = -1;
-    cg_obj     *match_obj = NULL;
     parse_tree *ptn = NULL;      /* Expanded */
-    cvec       *cvt = NULL;      /* Tokenized string: vector of tokens */
-    cvec       *cvr = NULL;      /* Rest variant,  eg remaining string in each step */
-    cg_var     *cv;
-    cvec       *cvv = NULL;
 
     if (cvvp == NULL || *cvvp != NULL){
         errno = EINVAL;
         goto done;
     }
-    if (cligen_logsyntax(h) > 0){
-        fprintf(stderr, "%s:\n", __FUNCTION__);
-        pt_print1(stderr, pt, 0);
-    }
-    cli_trim(&string, cligen_comment(h));
-    /* Tokenize the string and transform it into two CLIgen vectors: tokens and rests */
-    if (cligen_str2cvv(string, &cvt, &cvr) < 0)
+    if (cliread_parse1(h, string, pt, &ptn, co_orig, cvvp, result, reason) < 0)
         goto done;
-    if ((cvv = cvec_new(0)) == NULL)
-        goto done;;
-    if ((cv = cvec_add(cvv, CGV_REST)) == NULL)
-        goto done;
-    cv_name_set(cv, "cmd"); /* the whole command string */
-    /* The whole command string as user entered. */
-    cv_string_set(cv, string);
-    if ((ptn = pt_new()) == NULL)
-        goto done;
-    if (pt_expand(h, NULL,
-                  pt, cvt, cvv,
-                  0,  /* Do not include hidden commands */
-                  0,  /* VARS are not expanded, eg ? <tab> */
-                  NULL, NULL,
-                  ptn) < 0) /* sub-tree expansion, ie choice, expand function */
-        goto done;
-    if (match_pattern_exact(h, cvt, cvr,
-                            ptn,
-                            cvv,
-                            &match_obj,
-                            result, reason) < 0)
+    retval = 0;
+  done:
+    if (ptn)
+        if (pt_expand_release(h, ptn) < 0)
+            return -1;
+    if (pt_expand_cleanup(h, pt) < 0)
+        return -1;
+    return retval;
+}
+
+/*! Parse a vector of lines, eg replay of a configuration file
+ *
+ * Same as calling cliread_parse() for each line, but the expansion of the top-level of
+ * pt is made once and shared by all lines, unless it depends on the input (eg expand
+ * callbacks). Deeper levels shared by consecutive lines with the same keyword prefix
+ * are reused from the expand and match caches.
+ * A line that does not match does not stop the batch, its result and reason are set.
+ * @param[in]     h       Cligen handle
+ * @param[in,out] lines   Vector of input strings, can be trimmed
+ * @param[in]     nlines  Length of lines and plv
+ * @param[in]     pt      Parse-tree
+ * @param[out]    plv     Vector of per-line results. Free with cliread_parse_batch_free
+ * @retval        0       OK, see result of each line
+ * @retval       -1       Error
+ * @code
+ *   cligen_parse_line *plv;
+ *   if ((plv = calloc(n, sizeof(*plv))) == NULL)
+ *      err;
+ *   if (cliread_parse_batch(h, lines, n, pt, plv) < 0)
+ *      err;
+ *   for (i=0; i<n; i++)
+ *      if (plv[i].pl_result != CG_MATCH)
+ *         fprintf(stderr, "%d: %s\n", i, plv[i].pl_reason);
+ *   cliread_parse_batch_free(plv, n);
+ *   free(plv);
+ * @endcode
+ */
+int
+cliread_parse_batch(cligen_handle      h,
+                    char             **lines,
+                    int                nlines,
+                    parse_tree        *pt,
+                    cligen_parse_line *plv)
+{
+    int                retval = -1;
+    parse_tree        *ptn = NULL; /* Expanded top-level, shared if cached */
+    cligen_parse_line *pl;
+    int                i;
+
+    if (lines == NULL || plv == NULL){
+        errno = EINVAL;
         goto done;
-    /* Map from ghost object match_obj to real object */
-    *co_orig = match_obj;
-    *cvvp = cvv;
-    cvv = NULL;
+    }
+    for (i=0; i<nlines; i++){
+        pl = &plv[i];
+        memset(pl, 0, sizeof(*pl));
+        if (cliread_parse1(h, lines[i], pt, &ptn,
+                           &pl->pl_co, &pl->pl_cvv, &pl->pl_result, &pl->pl_reason) < 0)
+            goto done;
+        /* Only keep expansion that does not depend on input and is not stale */
+        if (ptn && pt_expand_cached_id(h, ptn) == 0){
+            if (pt_expand_release(h, ptn) < 0)
+                goto done;
+            ptn = NULL;
+        }
+    }
     retval = 0;
   done:
-    if (cvv)
-        cvec_free(cvv);
-    if (cvt)
-        cvec_free(cvt);
-    if (cvr)
-        cvec_free(cvr);
     if (ptn)
-        if (pt_free(ptn, 0) < 0)
+        if (pt_expand_release(h, ptn) < 0)
             return -1;
     if (pt_expand_cleanup(h, pt) < 0)
         return -1;
     return retval;
 }
 
+/*! Free the contents of results of cliread_parse_batch, not the vector itself
+ *
+ * @param[in]  plv     Vector of per-line results
+ * @param[in]  nlines  Length of plv
+ * @retval     0       OK
+ */
+int
+cliread_parse_batch_free(cligen_parse_line *plv,
+                         int                nlines)
+{
+    cligen_parse_line *pl;
+    int                i;
+
+    for (i=0; i<nlines; i++){
+        pl = &plv[i];
+        if (pl->pl_co)
+            co_free(pl->pl_co, 0);
+        if (pl->pl_cvv)
+            cvec_free(pl->pl_cvv);
+        if (pl->pl_reason)
+            free(pl->pl_reason);
+        memset(pl, 0, sizeof(*pl));
+    }
+    return 0;
+}
+
 /*! Read line interactively from terminal using getline (completion, etc)
  *
  * @param[in]  h       CLIgen handle
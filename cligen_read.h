@@ -43,6 +43,19 @@
 /*! Timeout for forked cli output pipe modification function in us */
 #define CLI_PIPE_TIMEOUT_US 1000000 /* 1 s */
 
+/*
+ * Types
+ */
+/*! Result of parsing one line, see cliread_parse_batch
+ */
+struct cligen_parse_line{
+    cg_obj        *pl_co;     /* Object that matches, free with co_free(co, 0) */
+    cvec          *pl_cvv;    /* Vector of cligen variables of the line */
+    cligen_result  pl_result; /* Result, < 0: errors, >=0 number of matches */
+    char          *pl_reason; /* Error reason if result is nomatch (malloced) */
+};
+typedef struct cligen_parse_line cligen_parse_line;
+
 /*
  * Function Prototypes
  */
@@ -51,6 +64,9 @@ int  cliread(cligen_handle h, char **stringp);
 void cli_trim(char **line, char comment);
 int  cliread_parse(cligen_handle h, char *string, parse_tree *pt, cg_obj **,
                    cvec **cvvp, cligen_result *result, char **reason);
+int  cliread_parse_batch(cligen_handle h, char **lines, int nlines, parse_tree *pt,
+                         cligen_parse_line *plv);
+int  cliread_parse_batch_free(cligen_parse_line *plv, int nlines);
 int  hist_expand_callback(cligen_handle h, const char *line, cvec *cvv);
 int  cliread_eval(cligen_handle h, char **line, int *cb_ret, cligen_result *result, char **reason);
 int  cligen_eval(cligen_handle h, cg_obj *co_match, cvec *cvv);
@@ -50,6 +50,7 @@
 #include "cligen_buf.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
+#include "cligen_arena.h"
 #include "cligen_callback.h"
 #include "cligen_object.h"
 #include "cligen_parsetree.h"
@@ -68,6 +69,9 @@ struct match_result{
     char        *mr_token;  /* Direct, not copied */
     cg_obj      *mr_co_match_orig; /* Kludge, save (latest) matched object, see
                                       mr_flags_set_co_match() */
+    cligen_arena *mr_arena;  /* Scratch arena of mr and mr_pt, or NULL if malloced */
+    int          mr_common; /* Common prefix length of matching commands, -1 if not known */
+    int          mr_unique; /* Matching commands are equal, if mr_common is known */
 };
 
 int
@@ -83,9 +87,11 @@ mr_pt_len_get(match_result *mr)
 int
 mr_pt_reset(match_result *mr)
 {
+    mr->mr_common = -1;
     pt_free(mr->mr_pt, 0);
-    if ((mr->mr_pt = pt_new()) == NULL)
+    if ((mr->mr_pt = pt_new_arena(mr->mr_arena)) == NULL)
         return -1;
+    pt_transient_set(mr->mr_pt, 1);
     return 0;
 }
 
@@ -99,6 +105,7 @@ int
 mr_pt_trunc(match_result *mr,
             int           len)
 {
+    mr->mr_common = -1;
     return pt_trunc(mr->mr_pt, len);
 }
 
@@ -117,10 +124,11 @@ mr_pt_append(match_result *mr,
 {
     cg_obj *co1 = NULL;
 
-    if (co_copy1(co, NULL, 0, 0x0, &co1) < 0)
+    if (co_copy1_arena(co, NULL, 0, 0x0, mr->mr_arena, &co1) < 0)
         return -1;
     mr->mr_co_match_orig = co;
     mr->mr_token = token;
+    mr->mr_common = -1;
     return pt_vec_append(mr->mr_pt, co1);
 }
 
@@ -205,6 +213,41 @@ mr_last_set(match_result *mr)
     return 0;
 }
 
+/*! Get common prefix of the matching commands, if known from the command index
+ *
+ * @param[in]  mr      Match result
+ * @param[out] unique  Set if all matching commands are equal
+ * @retval     len     Length of common prefix of the commands
+ * @retval    -1       Not known, eg the matches are not only commands of an index range
+ * @see mr_common_set
+ */
+int
+mr_common_get(match_result *mr,
+              int          *unique)
+{
+    if (mr->mr_common >= 0 && unique)
+        *unique = mr->mr_unique;
+    return mr->mr_common;
+}
+
+/*! Set common prefix of the matching commands
+ *
+ * Call when all matching commands are appended, it is reset if the matches change
+ * @param[in]  mr      Match result
+ * @param[in]  common  Length of common prefix, -1 if not known
+ * @param[in]  unique  Set if all matching commands are equal
+ * @see pt_index_candidates
+ */
+int
+mr_common_set(match_result *mr,
+              int           common,
+              int           unique)
+{
+    mr->mr_common = common;
+    mr->mr_unique = unique;
+    return 0;
+}
+
 /*! Move an error reason from one mr to the next
  *
  * There is a case for keeping the first error reason in case of multiple
@@ -229,16 +272,36 @@ mr_mv_reason(match_result *from,
  */
 match_result *
 mr_new(void)
+{
+    return mr_new_arena(NULL);
+}
+
+/*! Create new CLIgen match result in a scratch arena
+ *
+ * The result and its parse-tree struct are in the arena, the matched objects are not.
+ * @param[in]  ca   Scratch arena, eg of a request, or NULL to use malloc
+ * @see cligen_scratch_request
+ */
+match_result *
+mr_new_arena(cligen_arena *ca)
 {
     match_result *mr;
 
-    if ((mr = malloc(sizeof(*mr))) == NULL)
+    if (ca)
+        mr = cligen_arena_alloc(ca, sizeof(*mr));
+    else
+        mr = malloc(sizeof(*mr));
+    if (mr == NULL)
         return NULL;
     memset(mr, 0, sizeof(*mr));
-    if ((mr->mr_pt = pt_new()) == NULL){
-        free(mr);
+    mr->mr_arena = ca;
+    mr->mr_common = -1;
+    if ((mr->mr_pt = pt_new_arena(ca)) == NULL){
+        if (ca == NULL)
+            free(mr);
         return NULL;
     }
+    pt_transient_set(mr->mr_pt, 1);
     return mr;
 }
 
@@ -254,7 +317,8 @@ mr_free(match_result *mr)
     }
     if (mr->mr_reason)
         free(mr->mr_reason);
-    free(mr);
+    if (mr->mr_arena == NULL)
+        free(mr);
     return 0;
 }
 
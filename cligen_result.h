@@ -72,8 +72,11 @@ int   mr_pref_set(match_result *mr, uint32_t pref);
 char *mr_token_get(match_result *mr);
 int   mr_last_get(match_result *mr);
 int   mr_last_set(match_result *mr);
+int   mr_common_get(match_result *mr, int *unique);
+int   mr_common_set(match_result *mr, int common, int unique);
 int   mr_mv_reason(match_result *from, match_result *to);
 match_result *mr_new(void);
+match_result *mr_new_arena(struct cligen_arena *ca);
 int   mr_free(match_result *mr);
 cligen_result mr2result(match_result *mr);
 int   mr_flags_set_co_match(match_result *mr, cg_obj *co);
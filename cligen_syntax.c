@@ -40,6 +40,7 @@
 #include <netinet/in.h>
 
 #include "cligen_buf.h"
+#include "cligen_arena.h"
 #include "cligen_cv.h"
 #include "cligen_cvec.h"
 #include "cligen_parsetree.h"
@@ -69,6 +70,8 @@
  * @see cligen_parse_file
  * @note parse-trees can be added as side-effect:s using the treename clispec:s. The tree returned
  * in pt is only the "latest" one.
+ * @note If cligen_parse_arena_set() is set, objects of each parsed tree are allocated in an
+ * arena of the tree, see pt_arena_set
  */
 int
 clispec_parse_str(cligen_handle h,
@@ -86,6 +89,7 @@ clispec_parse_str(cligen_handle h,
     parse_tree        *pt = NULL;
     pt_head           *ph;
     cg_var            *cv;
+    cligen_arena      *ca;
 
     /* "Fake" top-level object that is removed on exit */
     if ((cot = co_new(NULL, NULL)) == NULL)
@@ -108,6 +112,15 @@ clispec_parse_str(cligen_handle h,
         if ((pt = pt_new()) == NULL)
             goto done;
     co_pt_set(cot, pt);
+    /* Allocate objects of the tree in its arena, see cligen_parse_arena_set */
+    if (cligen_parse_arena_get(h)){
+        if (pt_arena_get(pt) == NULL){
+            if ((ca = cligen_arena_new(0)) == NULL)
+                goto done;
+            pt_arena_set(pt, ca);
+        }
+        cy.cy_arena = pt_arena_get(pt);
+    }
     if (cvv)
         cy.cy_globals  = cvv;
     else
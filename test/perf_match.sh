@@ -0,0 +1,120 @@
+#!/usr/bin/env bash
+# Match performance of a large parse-tree, not run by all.sh
+# Prints the size of cg_obj, the number of objects and bytes of the tree (pt_stats), and
+# the time to match lines with commands, variables and sub-commands with cliread_parse.
+# Typical run:  ./perf_match.sh
+# Change the size of the tree or the number of loops:  nr=2000 loops=100 ./perf_match.sh
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+# Number of top-level commands
+: ${nr:=500}
+# Number of loops of 20 lines each
+: ${loops:=200}
+
+app="$dir/perf_match"
+cfile="${app}.c"
+fspec="$dir/spec.cli"
+
+echo 'prompt="cli> ";' > $fspec
+echo 'treename="perf";' >> $fspec
+for i in $(seq 0 $((nr-1))); do
+    echo "cmdx$i(\"Command $i\") { v$i(\"Value\") <a:int32>(\"Int\") { sub0, callback(); sub1, callback(); sub2, callback(); sub3, callback(); sub4, callback(); sub5, callback(); sub6, callback(); <s:string>, callback(); } w$i <b:string>, callback(); }" >> $fspec
+done
+
+cat > $cfile <<EOF
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <cligen/cligen.h>
+
+int
+main(int   argc,
+     char *argv[])
+{
+    int             retval = -1;
+    cligen_handle   h;
+    FILE           *f = NULL;
+    cvec           *globals = NULL;
+    pt_head        *ph;
+    parse_tree     *pt;
+    struct timespec t0;
+    struct timespec t1;
+    char            line[64];
+    uint64_t        nrobj = 0;
+    size_t          sz = 0;
+    int             i;
+    int             k;
+
+    if ((h = cligen_init()) == NULL)
+        goto done;
+    if ((f = fopen(argv[1], "r")) == NULL)
+        goto done;
+    if ((globals = cvec_new(0)) == NULL)
+        goto done;
+    if (clispec_parse_file(h, f, "perf", NULL, NULL, globals) < 0)
+        goto done;
+    if ((ph = cligen_ph_find(h, "perf")) == NULL)
+        goto done;
+    pt = cligen_ph_parsetree_get(ph);
+    if (pt_stats(pt, &nrobj, &sz) < 0)
+        goto done;
+    printf("sizeof cg_obj:%zu objects:%llu bytes:%zu\n",
+           sizeof(cg_obj), (unsigned long long)nrobj, sz);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (k=0; k<$loops; k++){
+        for (i=0; i<20; i++){
+            cg_obj       *co = NULL;
+            cvec         *cvv = NULL;
+            cligen_result result;
+            char         *reason = NULL;
+
+            snprintf(line, sizeof(line), "cmdx%d v%d 42 sub%d", (i*97)%$nr, (i*97)%$nr, i%7);
+            if (cliread_parse(h, line, pt, &co, &cvv, &result, &reason) < 0)
+                goto done;
+            if (result != CG_MATCH){
+                printf("no match: %s\n", line);
+                goto done;
+            }
+            if (cvv)
+                cvec_free(cvv);
+            if (reason)
+                free(reason);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("match %d lines: %.3f ms\n", $loops*20,
+           (t1.tv_sec-t0.tv_sec)*1e3 + (t1.tv_nsec-t0.tv_nsec)/1e6);
+    retval = 0;
+ done:
+    if (globals)
+        cvec_free(globals);
+    if (f)
+        fclose(f);
+    if (h)
+        cligen_exit(h);
+    if (retval < 0)
+        printf("error\n");
+    return retval;
+}
+EOF
+
+if [ "$LINKAGE" = static ]; then
+    newtest "compile $cfile (static)"
+    COMPILE="$CC -DHAVE_CONFIG_H -O2 -Wall $CFLAGS -I.. $cfile ../libcligen.a -o $app"
+else
+    newtest "compile $cfile"
+    COMPILE="$CC -DHAVE_CONFIG_H -O2 -Wall $CFLAGS -I.. $cfile ../libcligen.so.${CLIGEN_VERSION_MAJOR}.${CLIGEN_VERSION_MINOR} -o $app"
+fi
+expectpart "$($COMPILE 2>&1)" 0 ""
+
+newtest "match $nr commands"
+ret=$(LD_LIBRARY_PATH=.. $app $fspec 2>&1)
+expectpart "$ret" 0 "match" --not-- "error"
+echo "$ret"
+
+newtest "endtest"
+endtest
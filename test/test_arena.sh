@@ -0,0 +1,150 @@
+#!/usr/bin/env bash
+# Test cligen_arena.c (scratch arena) API coverage:
+#   cligen_arena_new, cligen_arena_alloc, cligen_arena_strdup,
+#   cligen_arena_reset, cligen_arena_size, cligen_arena_free,
+#   cligen_arena_mmap, cligen_arena_mmap_share,
+#   cv_parse_scratch, cv_reset_scratch, cligen_scratch
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+app="$dir/test_arena"
+cfile="${app}.c"
+
+cat <<'EOF' > $cfile
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <cligen/cligen.h>
+
+static void
+check(const char *label, int ok)
+{
+    printf("%s: %s\n", label, ok ? "OK" : "FAIL");
+}
+
+int
+main(void)
+{
+    cligen_handle h;
+    cligen_arena *ca;
+    cligen_arena *ca1;
+    FILE         *f;
+    char         *s;
+    char         *p;
+    size_t        sz;
+    cg_var       *cv;
+    char         *reason = NULL;
+    int           i;
+    int           ok;
+
+    /* cligen_arena_new: nothing allocated until used */
+    ca = cligen_arena_new(64);
+    check("arena_new", ca != NULL);
+    check("initial size=0", cligen_arena_size(ca) == 0);
+
+    /* cligen_arena_strdup */
+    s = cligen_arena_strdup(ca, "hello");
+    check("strdup content", s != NULL && strcmp(s, "hello") == 0);
+
+    /* cligen_arena_alloc: aligned and distinct */
+    p = cligen_arena_alloc(ca, 3);
+    check("alloc aligned", p != NULL && ((uintptr_t)p % sizeof(void*)) == 0);
+    check("alloc distinct", p != s && strcmp(s, "hello") == 0);
+
+    /* Grow beyond first chunk, also with a larger allocation than a chunk */
+    ok = 1;
+    for (i=0; i<100; i++)
+        if (cligen_arena_strdup(ca, "0123456789") == NULL)
+            ok = 0;
+    if (cligen_arena_alloc(ca, 1000) == NULL)
+        ok = 0;
+    check("grow", ok && strcmp(s, "hello") == 0);
+    sz = cligen_arena_size(ca);
+    check("size grows", sz > 64);
+
+    /* cligen_arena_reset: keeps current chunk, no new memory when reused */
+    cligen_arena_reset(ca);
+    sz = cligen_arena_size(ca);
+    check("reset keeps chunk", sz > 0);
+    s = cligen_arena_strdup(ca, "again");
+    check("reuse after reset", s != NULL && strcmp(s, "again") == 0 && cligen_arena_size(ca) == sz);
+    cligen_arena_free(ca);
+
+    /* cv_parse_scratch: string in arena, released with cv_reset_scratch */
+    ca = cligen_arena_new(0);
+    cv = cv_new(CGV_STRING);
+    check("parse_scratch string", cv_parse_scratch("a\\ b", cv, ca, &reason) == 1 &&
+          strcmp(cv_string_get(cv), "a b") == 0);
+    cv_reset_scratch(cv);
+    check("reset_scratch", cv_string_get(cv) == NULL && cv_type_get(cv) == CGV_STRING);
+    cv_type_set(cv, CGV_IPV4PFX);
+    check("parse_scratch prefix", cv_parse_scratch("10.0.0.0/8", cv, ca, &reason) == 1 &&
+          cv_ipv4masklen_get(cv) == 8);
+    cv_reset_scratch(cv);
+    cv_type_set(cv, CGV_IPV4ADDR);
+    check("parse_scratch fail", cv_parse_scratch("1.2.3", cv, ca, &reason) == 0 &&
+          reason != NULL && strcmp(reason, "Invalid IPv4 address") == 0);
+    free(reason);
+    cv_reset_scratch(cv);
+    cv_free(cv);
+    cligen_arena_free(ca);
+
+    /* cligen_arena_mmap_share: mapping is valid until the last arena is freed */
+    ca = cligen_arena_new(0);
+    ca1 = cligen_arena_new(0);
+    f = tmpfile();
+    fwrite("mapped", 1, 7, f);
+    fflush(f);
+    p = cligen_arena_mmap(ca, fileno(f), 7);
+    check("mmap", p != NULL && strcmp(p, "mapped") == 0);
+    check("mmap share", cligen_arena_mmap_share(ca1, ca, p) == 0 &&
+          cligen_arena_mmap_share(ca1, ca, "mapped") < 0);
+    cligen_arena_free(ca);
+    check("mmap shared after free", strcmp(p, "mapped") == 0);
+    cligen_arena_free(ca1);
+    fclose(f);
+
+    /* Scratch arena of a handle */
+    h = cligen_init();
+    check("cligen_scratch", cligen_scratch(h) != NULL && cligen_scratch(h) == cligen_scratch(h));
+    cligen_exit(h);
+    return 0;
+}
+EOF
+
+if [ "$LINKAGE" = static ]; then
+    newtest "compile $cfile (static)"
+    COMPILE="$CC -DHAVE_CONFIG_H -g -Wall $CFLAGS -I.. $cfile ../libcligen.a -o $app"
+else
+    newtest "compile $cfile"
+    COMPILE="$CC -DHAVE_CONFIG_H -g -Wall $CFLAGS -I.. $cfile ../libcligen.so.${CLIGEN_VERSION_MAJOR}.${CLIGEN_VERSION_MINOR} -o $app"
+fi
+expectpart "$($COMPILE 2>&1)" 0 ""
+
+newtest "cligen_arena_new"
+expectpart "$(LD_LIBRARY_PATH=.. $app 2>&1)" 0 "arena_new: OK" "initial size=0: OK"
+
+newtest "cligen_arena_strdup and alloc"
+expectpart "$(LD_LIBRARY_PATH=.. $app 2>&1)" 0 "strdup content: OK" "alloc aligned: OK" "alloc distinct: OK"
+
+newtest "cligen_arena growth"
+expectpart "$(LD_LIBRARY_PATH=.. $app 2>&1)" 0 "grow: OK" "size grows: OK"
+
+newtest "cligen_arena_reset"
+expectpart "$(LD_LIBRARY_PATH=.. $app 2>&1)" 0 "reset keeps chunk: OK" "reuse after reset: OK"
+
+newtest "cv_parse_scratch"
+expectpart "$(LD_LIBRARY_PATH=.. $app 2>&1)" 0 "parse_scratch string: OK" "reset_scratch: OK" "parse_scratch prefix: OK" "parse_scratch fail: OK" --not-- "FAIL"
+
+newtest "cligen_arena_mmap_share"
+expectpart "$(LD_LIBRARY_PATH=.. $app 2>&1)" 0 "mmap: OK" "mmap share: OK" "mmap shared after free: OK"
+
+newtest "cligen_scratch"
+expectpart "$(LD_LIBRARY_PATH=.. $app 2>&1)" 0 "cligen_scratch: OK"
+
+newtest "endtest"
+endtest
+
+rm -rf $dir
@@ -0,0 +1,164 @@
+#!/usr/bin/env bash
+# Binary file of parsed trees, see cligen_bin.c
+# Trees read from the binary file should behave as parsed trees
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+fspec=$dir/spec.cli
+fbin=$dir/spec.bin
+app=$dir/binsum
+cfile=${app}.c
+
+cat > $fspec <<EOF
+  prompt="cli> ";              # Assignment of prompt
+  comment="#";                 # Same comment as in syntax
+  treename="example";          # Name of syntax (used when referencing)
+  pipetree="|mypipe";
+
+  a("help a") <x:int32 range[1:10]>("x help"), callback("arg1", 42);
+  b <s:string regexp:"[a-z]+">, callback();
+  c <d:decimal64 fraction-digits:3 range[1.5:9.999]>, callback();
+  d @{
+     e <ip:ipv4addr>, callback();
+     f, hide, callback();
+     g <c:string choice:x|y|z>, callback();
+  }
+  r @sub, callback();
+  out, output_fn("line1 abc", "line2 def");
+
+  treename="sub";
+  pipetree="";
+  s1("help s1"), callback();
+  s2 <n:uint8>, callback();
+
+  treename="|mypipe";
+  \| {
+      grep <arg:rest>, pipe_shell_fn("grep -e", "arg");
+  }
+EOF
+
+newtest "$cligen_file -f $fspec -p"
+p0=$($cligen_file -f $fspec -p -1)
+expectpart "$p0" 0 "callback(\"arg1\",\"42\")" "s2 <n:uint8>"
+
+newtest "write binary file"
+rm -f $fbin
+p1=$($cligen_file -f $fspec -B $fbin -p -1)
+expectpart "$p1" 0 "callback(\"arg1\",\"42\")"
+if [ ! -f $fbin ]; then
+    err "$fbin" ""
+fi
+if [ "$p1" != "$p0" ]; then
+    err "$p0" "$p1"
+fi
+
+newtest "read binary file"
+p2=$($cligen_file -f $fspec -B $fbin -p -1)
+if [ "$p2" != "$p0" ]; then
+    err "$p0" "$p2"
+fi
+
+# Trees read from the binary file are allocated in arenas, parsed trees only with -A
+newtest "read binary file into arenas"
+expectpart "$($cligen_file -f $fspec -d -1)" 0 "nr:" --not-- "interned:"
+expectpart "$($cligen_file -f $fspec -B $fbin -d -1)" 0 "nr:" "interned:0"
+
+newtest "callback arguments"
+expectpart "$(echo "a 5" | $cligen_file -f $fspec -B $fbin 2>&1)" 0 "cli> " "arg 1: 42"
+
+newtest "range"
+expectpart "$(echo "a 11" | $cligen_file -f $fspec -B $fbin 2>&1)" 0 "Number 11 out of range: 1 - 10"
+
+newtest "regexp"
+expectpart "$(echo "b ABC" | $cligen_file -f $fspec -B $fbin 2>&1)" 0 "is invalid input for cli command: s"
+
+newtest "decimal64"
+expectpart "$(echo "c 2.5" | $cligen_file -f $fspec -B $fbin 2>&1)" 0 "type:decimal64 value:2.500"
+
+newtest "set and choice"
+expectpart "$(echo "d g y e 1.2.3.4" | $cligen_file -f $fspec -B $fbin 2>&1)" 0 "type:string value:y" "type:ipv4addr value:1.2.3.4"
+
+newtest "hide"
+expectpart "$(echo "d ?" | $cligen_file -f $fspec -B $fbin 2>&1)" 0 "e" "g" --not-- "  f  "
+
+newtest "tree reference"
+expectpart "$(echo "r ?" | $cligen_file -f $fspec -B $fbin 2>&1)" 0 "help s1" "s2"
+
+newtest "pipe"
+expectpart "$(echo "out \| grep abc" | $cligen_file -f $fspec -B $fbin 2>&1)" 0 "line1 abc" --not-- "line2 def"
+
+newtest "frozen"
+expectpart "$(echo "d g x" | $cligen_file -f $fspec -B $fbin -F 2>&1)" 0 "type:string value:x"
+
+newtest "stale binary file is rewritten"
+sed -i 's/s1("help s1")/s3("help s3")/' $fspec
+expectpart "$($cligen_file -f $fspec -B $fbin -p -1)" 0 "s3" --not-- "s1"
+expectpart "$($cligen_file -f $fspec -B $fbin -p -1)" 0 "s3" --not-- "s1"
+
+# Rewrite the checksum of an edited binary file: bh_sum at offset 16 is a hash of the
+# file from bh_version at offset 24, see struct bin_hdr
+cat <<EOF > $cfile
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <cligen/cligen.h>
+
+int
+main(int argc, char *argv[])
+{
+    FILE    *f;
+    char     buf[65536];
+    size_t   len;
+    uint64_t sum;
+
+    if (argc != 2 || (f = fopen(argv[1], "r+")) == NULL)
+        return 1;
+    if ((len = fread(buf, 1, sizeof(buf), f)) < 24)
+        return 1;
+    sum = clispec_bin_hash(CLISPEC_BIN_HASH_INIT, buf + 24, len - 24);
+    if (fseek(f, 16, SEEK_SET) < 0 || fwrite(&sum, sizeof(sum), 1, f) != 1)
+        return 1;
+    return fclose(f) == 0 ? 0 : 1;
+}
+EOF
+
+if [ "$LINKAGE" = static ]; then
+    newtest "compile $cfile (static)"
+    COMPILE="$CC -DHAVE_CONFIG_H -g -Wall $CFLAGS -I.. $cfile ../libcligen.a -o $app"
+else
+    newtest "compile $cfile"
+    COMPILE="$CC -DHAVE_CONFIG_H -g -Wall $CFLAGS -I.. $cfile ../libcligen.so.${CLIGEN_VERSION_MAJOR}.${CLIGEN_VERSION_MINOR} -o $app"
+fi
+expectpart "$($COMPILE 2>&1)" 0 ""
+
+# A corrupt file is detected by its checksum
+newtest "binary file with wrong checksum is reparsed"
+cp $fbin $fbin.orig
+sed -i 's/help s3/help s4/' $fbin
+expectpart "$($cligen_file -f $fspec -B $fbin -p -1 2>&1)" 0 "help s3" --not-- "help s4"
+
+newtest "binary file with edited string and checksum is read"
+cp $fbin.orig $fbin
+sed -i 's/help s3/help s4/' $fbin
+expectpart "$(LD_LIBRARY_PATH=.. $app $fbin 2>&1)" 0 ""
+expectpart "$($cligen_file -f $fspec -B $fbin -p -1 2>&1)" 0 "help s4" --not-- "help s3"
+
+# A value that cannot be parsed as its type makes the whole file invalid, no tree is loaded
+newtest "binary file with invalid value is reparsed"
+cp $fbin.orig $fbin
+sed -i 's/9\.999/9.9x9/' $fbin
+expectpart "$(LD_LIBRARY_PATH=.. $app $fbin 2>&1)" 0 ""
+expectpart "$($cligen_file -f $fspec -B $fbin -p -1 2>&1)" 0 "s3" "1.500:9.999" --not-- "bin_cv_load" "9.9x9"
+expectpart "$($cligen_file -f $fspec -B $fbin -p -1 2>&1)" 0 "s3" "1.500:9.999"
+
+newtest "invalid binary file"
+echo "CLIGENPT garbage" > $fbin
+expectpart "$($cligen_file -f $fspec -B $fbin -p -1)" 0 "s3" "s2 <n:uint8>"
+expectpart "$($cligen_file -f $fspec -B $fbin -p -1)" 0 "s3" "s2 <n:uint8>"
+
+newtest "endtest"
+endtest
+
+rm -rf $dir
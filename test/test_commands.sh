@@ -46,6 +46,98 @@ expectpart "$(echo "hello world" | $cligen_hello 2>&1)" 0 'hello world'
 newtest "run exec"
 expectpart "$(echo "exec foo" | $cligen_file -f $fspec 2>&1)" 0 foo
 
+# Large level: keywords are looked up in a sorted index
+fspec2=$dir/spec2.cli
+cat > $fspec2 <<EOF
+  prompt="cli> ";
+  treename="large";
+EOF
+for i in $(seq 1 40); do
+    echo "  a$i,callback();" >> $fspec2
+    echo "  key$i,callback();" >> $fspec2
+done
+echo '  <n:int32>,callback();' >> $fspec2
+echo '  "quoted",callback();' >> $fspec2
+echo '  unique1,callback();' >> $fspec2
+echo '  longcommand1,callback();' >> $fspec2
+echo '  longcommand2,callback();' >> $fspec2
+
+newtest "large a ambiguous"
+expectpart "$(echo "a" | $cligen_file -f $fspec2 2>&1)" 0 "Ambiguous command"
+
+newtest "large a1 exact ok"
+expectpart "$(echo "a1" | $cligen_file -f $fspec2 2>&1)" 0 "1 name:a1 type:string value:a1"
+
+newtest "large a10 ok"
+expectpart "$(echo "a10" | $cligen_file -f $fspec2 2>&1)" 0 "1 name:a10 type:string value:a10"
+
+newtest "large key3 ok"
+expectpart "$(echo "key3" | $cligen_file -f $fspec2 2>&1)" 0 "1 name:key3 type:string value:key3"
+
+newtest "large ke ambiguous"
+expectpart "$(echo "ke" | $cligen_file -f $fspec2 2>&1)" 0 "Ambiguous command"
+
+newtest "large variable ok"
+expectpart "$(echo "42" | $cligen_file -f $fspec2 2>&1)" 0 "1 name:n type:int32 value:42"
+
+newtest "large quoted ok"
+expectpart "$(echo "quoted" | $cligen_file -f $fspec2 2>&1)" 0 'type:string value:"quoted"'
+
+newtest "large b not a number"
+expectpart "$(echo "b" | $cligen_file -f $fspec2 2>&1)" 0 "'b' is not a number"
+
+# Completion uses the common prefix of the index
+newtest "large ke<tab> completes common prefix"
+expectpart "$(echo "ke	" | $cligen_file -f $fspec2 2>&1)" 0 "cli> key" "Ambiguous command"
+
+newtest "large lo<tab> completes common prefix"
+expectpart "$(echo "lo	" | $cligen_file -f $fspec2 2>&1)" 0 "cli> longcommand" "Ambiguous command"
+
+newtest "large un<tab> completes unique command"
+expectpart "$(echo "un	" | $cligen_file -f $fspec2 2>&1)" 0 "cli> unique1 " "name:unique1 type:string value:unique1"
+
+# Commands with a common prefix are merged, same tree as when written once
+fspec3=$dir/spec3.cli
+fspec4=$dir/spec4.cli
+cat > $fspec3 <<EOF
+  treename="merged";
+  m k1 a;
+  m k1 b, callback();
+  m { k1 { c; b { z; } } k2; }
+  m k1 b, callback("x");
+  m { k3; k1 { b { y; } d; } }
+EOF
+cat > $fspec4 <<EOF
+  treename="merged";
+  m {
+    k1 {
+      a;
+      b, callback(), callback("x"); {
+        y;
+        z;
+      }
+      c;
+      d;
+    }
+    k2;
+    k3;
+  }
+EOF
+for i in $(seq 1 40); do
+    echo "  m k2 v$i;" >> $fspec3
+    echo "  m { k3 v$i, callback(); }" >> $fspec3
+done
+
+newtest "merged tree"
+p3=$($cligen_file -f $fspec3 -p -1)
+expectpart "$p3" 0 "v40" --not-- "Error"
+p4=$($cligen_file -f $fspec4 -p -1)
+expectpart "$(echo "$p3" | grep -v "v[0-9]")" 0 "$(echo "$p4")"
+
+newtest "merged callbacks"
+expectpart "$(echo "m k1 b" | $cligen_file -f $fspec3 2>&1)" 0 'function: callback' 'arg 0: x'
+expectpart "$(echo "m k3 v17" | $cligen_file -f $fspec3 2>&1)" 0 "name:v17"
+
 newtest "endtest"
 endtest
 
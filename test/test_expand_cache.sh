@@ -0,0 +1,389 @@
+#!/usr/bin/env bash
+# Test that cached expanded parse-trees and memoized token matches are reused and
+# invalidated when the tree changes
+#   pt_expand_cached, pt_generation_get, pt_expand_cache_flush
+# and that a batch of lines gives the same results as one line at a time
+#   cliread_parse_batch
+# and that shallow expansions of tree references are reused and invalidated
+# and that only keywords of tree references matching the next token are expanded
+# and that parse-tree heads are found by name via the hash index
+#   cligen_ph_find, cligen_ph_find_ref
+# and that expand callback results are cached with a time-to-live
+#   pt_expand_fn_ttl_set, pt_expand_fn_invalidate
+# and that a slow expand callback does not block completion beyond the deadline
+#   pt_expand_fn_async_set, cligen_expand_deadline_set
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+app="$dir/test_expand_cache"
+cfile="${app}.c"
+fspec="$dir/spec.cli"
+
+cat > $fspec <<'CLIEOF'
+prompt="cli> ";
+treename="base";
+
+a {
+    b, callback();
+    c, callback();
+}
+e <n:int32 range[1:10]>, callback();
+x <v:string exp()>, callback();
+y <w:string slow()>, show();
+z <w:string hang()>, show();
+r {
+    <u:string exp()>, callback();
+    @sub;
+}
+
+treename="sub";
+s1, callback();
+CLIEOF
+
+cat <<'EOF' > $cfile
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <cligen/cligen.h>
+
+/* Number of expand callback invocations */
+static int expcalls = 0;
+
+static void
+check(const char *label, int ok)
+{
+    printf("%s: %s\n", label, ok ? "OK" : "FAIL");
+    fflush(stdout);
+}
+
+int
+callback(cligen_handle h, cvec *cvv, cvec *argv)
+{
+    return 0;
+}
+
+int
+show(cligen_handle h, cvec *cvv, cvec *argv)
+{
+    printf("w=%s\n", cv_string_get(cvec_find(cvv, "w")));
+    return 0;
+}
+
+cgv_fnstype_t *
+str2fn(const char *name, void *arg, char **error)
+{
+    if (strcmp(name, "callback") == 0)
+        return (cgv_fnstype_t *)callback;
+    if (strcmp(name, "show") == 0)
+        return (cgv_fnstype_t *)show;
+    return NULL;
+}
+
+int
+exp_cb(cligen_handle h,
+       const char   *name,
+       cvec         *cvv,
+       cvec         *argv,
+       cvec         *commands,
+       cvec         *helptexts)
+{
+    expcalls++;
+    cvec_add_string(commands, NULL, "e1");
+    cvec_add_string(helptexts, NULL, "Help e1");
+    cvec_add_string(commands, NULL, "e2");
+    cvec_add_string(helptexts, NULL, "Help e2");
+    return 0;
+}
+
+/* Slow expand callback, invoked in a worker thread if async */
+int
+slow_cb(cligen_handle h,
+        const char   *name,
+        cvec         *cvv,
+        cvec         *argv,
+        cvec         *commands,
+        cvec         *helptexts)
+{
+    usleep(300000);
+    cvec_add_string(commands, NULL, "s1");
+    cvec_add_string(helptexts, NULL, "Help s1");
+    return 0;
+}
+
+/* Expand callback that does not return before the application exits */
+int
+hang_cb(cligen_handle h,
+        const char   *name,
+        cvec         *cvv,
+        cvec         *argv,
+        cvec         *commands,
+        cvec         *helptexts)
+{
+    sleep(10);
+    return 0;
+}
+
+expand_cb *
+str2fn_exp(const char *name, void *arg, char **error)
+{
+    if (strcmp(name, "slow") == 0)
+        return slow_cb;
+    if (strcmp(name, "hang") == 0)
+        return hang_cb;
+    return exp_cb;
+}
+
+/* Parse string and return result, and reason if no match */
+static cligen_result
+parse_reason(cligen_handle h,
+             parse_tree   *pt,
+             char         *str,
+             char        **reasonp)
+{
+    cg_obj       *co = NULL;
+    cvec         *cvv = NULL;
+    cligen_result result = CG_ERROR;
+    char         *reason = NULL;
+    char          buf[64];
+
+    strncpy(buf, str, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = '\0';
+    if (cliread_parse(h, buf, pt, &co, &cvv, &result, &reason) < 0)
+        return CG_ERROR;
+    if (co)
+        co_free(co, 0);
+    if (cvv)
+        cvec_free(cvv);
+    if (reasonp)
+        *reasonp = reason;
+    else if (reason)
+        free(reason);
+    return result;
+}
+
+static cligen_result
+parse(cligen_handle h,
+      parse_tree   *pt,
+      char         *str)
+{
+    return parse_reason(h, pt, str, NULL);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int            retval = -1;
+    cligen_handle  h;
+    FILE          *f;
+    parse_tree    *pt;
+    cg_obj        *coa;
+    cg_obj        *cod;
+    parse_tree    *ptsub;
+    pt_head       *ph;
+    char           name[16];
+    uint64_t       gen;
+    uint64_t       gen0;
+    int            i;
+    int            n;
+    char          *r0 = NULL;
+    char          *r1 = NULL;
+    char          *r2 = NULL;
+    char           l0[] = "a b", l1[] = "a x", l2[] = "e 5", l3[] = "e 20", l4[] = "  a   c ";
+    char          *lines[] = {l0, l1, l2, l3, l4};
+    cligen_parse_line plv[5];
+    const char    *specfile = argc > 1 ? argv[1] : "spec.cli";
+
+    if ((h = cligen_init()) == NULL)
+        goto done;
+    if ((f = fopen(specfile, "r")) == NULL){ perror("fopen"); goto done; }
+    if (clispec_parse_file(h, f, "base", NULL, NULL, NULL) < 0){ fclose(f); goto done; }
+    fclose(f);
+    pt = cligen_ph_parsetree_get(cligen_ph_find(h, "base"));
+    if (cligen_expand_str2fn(pt, str2fn_exp, NULL) < 0)
+        goto done;
+    /* Interactive mode: read commands from stdin */
+    if (argc > 2){
+        if (strcmp(argv[2], "async") == 0){
+            cligen_expand_deadline_set(h, 50);
+            if (pt_expand_fn_async_set(h, "slow", 1) < 0 ||
+                pt_expand_fn_async_set(h, "hang", 1) < 0)
+                goto done;
+        }
+        if (cligen_callbackv_str2fn(pt, str2fn, NULL) < 0)
+            goto done;
+        if (cligen_loop(h) < 0)
+            goto done;
+        retval = 0;
+        goto done;
+    }
+    /* Repeated matches reuse the cached expansion */
+    for (i=0; i<3; i++)
+        check("match a b", parse(h, pt, "a b") == CG_MATCH);
+    check("nomatch a d", parse(h, pt, "a d") == CG_NOMATCH);
+    /* Edit last token: earlier tokens are resumed from memoized matches */
+    check("edit match a c", parse(h, pt, "a c") == CG_MATCH);
+    check("edit match a b", parse(h, pt, "a b") == CG_MATCH);
+    check("edit nomatch a x", parse(h, pt, "a x") == CG_NOMATCH);
+    check("edit match e 5", parse(h, pt, "e 5") == CG_MATCH);
+    check("edit nomatch e 20", parse_reason(h, pt, "e 20", &r0) == CG_NOMATCH);
+    check("edit nomatch e 20 again", parse_reason(h, pt, "e 20", &r1) == CG_NOMATCH);
+    check("same reason", r0 && r1 && strcmp(r0, r1) == 0);
+    /* Batch: errors in some lines do not stop the others */
+    check("batch ok", cliread_parse_batch(h, lines, 5, pt, plv) == 0);
+    check("batch match a b", plv[0].pl_result == CG_MATCH && plv[0].pl_co != NULL);
+    check("batch nomatch a x", plv[1].pl_result == CG_NOMATCH && plv[1].pl_reason != NULL);
+    check("batch match e 5", plv[2].pl_result == CG_MATCH &&
+          cv_int32_get(cvec_find(plv[2].pl_cvv, "n")) == 5);
+    check("batch same reason", plv[3].pl_result == CG_NOMATCH &&
+          plv[3].pl_reason && strcmp(plv[3].pl_reason, r0) == 0);
+    check("batch match a c", plv[4].pl_result == CG_MATCH);
+    cliread_parse_batch_free(plv, 5);
+    /* Modify tree: add "d" under "a" */
+    coa = pt_vec_i_get(pt, 0);
+    gen = pt_tree_generation_get(co_pt_get(coa));
+    gen0 = pt_generation_get();
+    if ((cod = co_new("d", coa)) == NULL)
+        goto done;
+    if (co_insert(co_pt_get(coa), cod) == NULL)
+        goto done;
+    if (pt_vec_append(co_pt_get(cod), NULL) < 0)
+        goto done;
+    check("generation bumped", pt_tree_generation_get(co_pt_get(coa)) != gen);
+    check("global generation unchanged", pt_generation_get() == gen0);
+    check("match a d", parse(h, pt, "a d") == CG_MATCH);
+    check("match a c", parse(h, pt, "a c") == CG_MATCH);
+    check("flush ok", pt_expand_cache_flush(h) == 0);
+    check("match a b after flush", parse(h, pt, "a b") == CG_MATCH);
+    /* Tree references: shallow expansion is reused until the referenced tree changes */
+    for (i=0; i<3; i++)
+        check("match r s1", parse(h, pt, "r s1") == CG_MATCH);
+    check("nomatch r s2", parse(h, pt, "r s2") == CG_NOMATCH);
+    ptsub = cligen_ph_parsetree_get(cligen_ph_find(h, "sub"));
+    if ((cod = co_new("s2", NULL)) == NULL)
+        goto done;
+    if (co_insert(ptsub, cod) == NULL)
+        goto done;
+    if (pt_vec_append(co_pt_get(cod), NULL) < 0)
+        goto done;
+    check("match r s2", parse(h, pt, "r s2") == CG_MATCH);
+    check("match r s1 again", parse(h, pt, "r s1") == CG_MATCH);
+    /* Keywords not matching are not expanded, but the result is the same */
+    check("nomatch r zz", parse_reason(h, pt, "r zz", &r2) == CG_NOMATCH &&
+          r2 && strcmp(r2, "Unknown command") == 0);
+    check("multiple r s", parse(h, pt, "r s") == CG_MULTIPLE);
+    check("match r S1 ignore case", cligen_caseignore_set(h, 1) == 0 &&
+          parse(h, pt, "r S1") == CG_MATCH &&
+          cligen_caseignore_set(h, 0) == 0);
+    /* Parse-tree head registry */
+    for (i=0; i<100; i++){
+        snprintf(name, sizeof(name), "t%d", i);
+        if ((ph = cligen_ph_add(h, name)) == NULL)
+            goto done;
+    }
+    check("find t57", (ph = cligen_ph_find(h, "t57")) != NULL &&
+          strcmp(cligen_ph_name_get(ph), "t57") == 0);
+    check("find nonexistent", cligen_ph_find(h, "t100") == NULL);
+    check("find first of duplicates", (ph = cligen_ph_add(h, "t3")) != NULL &&
+          cligen_ph_find(h, "t3") != ph && cligen_ph_find(h, "t3") == cligen_ph_i(h, 5));
+    check("find renamed", cligen_ph_name_set(ph, "t100") == 0 &&
+          cligen_ph_find(h, "t100") == ph);
+    ph = cligen_ph_find(h, "sub");
+    check("rename referenced tree", cligen_ph_name_set(ph, "sub2") == 0 &&
+          parse(h, pt, "r s1") == CG_ERROR);
+    check("rename back referenced tree", cligen_ph_name_set(ph, "sub") == 0 &&
+          parse(h, pt, "r s1") == CG_MATCH);
+    /* Expand callback is invoked on every parse unless cached */
+    n = expcalls;
+    check("match x e1", parse(h, pt, "x e1") == CG_MATCH && expcalls > n);
+    n = expcalls;
+    check("uncached callback", parse(h, pt, "x e1") == CG_MATCH && expcalls > n);
+    check("ttl set", pt_expand_fn_ttl_set(h, "exp", 60000) == 0);
+    check("cached match x e2", parse(h, pt, "x e2") == CG_MATCH);
+    n = expcalls;
+    check("cached callback", parse(h, pt, "x e1") == CG_MATCH &&
+          parse(h, pt, "x e2") == CG_MATCH && expcalls == n);
+    check("cached nomatch x e3", parse(h, pt, "x e3") == CG_NOMATCH && expcalls == n);
+    check("invalidate", pt_expand_fn_invalidate(h, "exp") == 0);
+    check("invalidated callback", parse(h, pt, "x e1") == CG_MATCH && expcalls > n);
+    check("ttl short", pt_expand_fn_ttl_set(h, NULL, 1) == 0 &&
+          pt_expand_fn_ttl_set(h, "exp", 0) == 0);
+    parse(h, pt, "x e1");
+    usleep(10000);
+    n = expcalls;
+    check("expired callback", parse(h, pt, "x e1") == CG_MATCH && expcalls > n);
+    retval = 0;
+ done:
+    if (r0)
+        free(r0);
+    if (r1)
+        free(r1);
+    if (r2)
+        free(r2);
+    if (h)
+        cligen_exit(h);
+    return retval;
+}
+EOF
+
+if [ "$LINKAGE" = static ]; then
+    newtest "compile $cfile (static)"
+    COMPILE="$CC -DHAVE_CONFIG_H -g -Wall $CFLAGS -I.. $cfile ../libcligen.a -o $app"
+else
+    newtest "compile $cfile"
+    COMPILE="$CC -DHAVE_CONFIG_H -g -Wall $CFLAGS -I.. $cfile ../libcligen.so.${CLIGEN_VERSION_MAJOR}.${CLIGEN_VERSION_MINOR} -o $app"
+fi
+expectpart "$($COMPILE 2>&1)" 0 ""
+
+newtest "repeated match uses cache"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "match a b: OK" "nomatch a d: OK" --not-- "FAIL"
+
+newtest "edited input resumes matching"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "edit match a c: OK" "edit match a b: OK" "edit nomatch a x: OK" "edit match e 5: OK" "edit nomatch e 20: OK" "same reason: OK" --not-- "FAIL"
+
+newtest "batch parse"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "batch ok: OK" "batch match a b: OK" "batch nomatch a x: OK" "batch match e 5: OK" "batch same reason: OK" "batch match a c: OK" --not-- "FAIL"
+
+newtest "tree change invalidates cache"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "generation bumped: OK" "global generation unchanged: OK" "match a d: OK" "match a c: OK" --not-- "FAIL"
+
+newtest "cache flush"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "flush ok: OK" "match a b after flush: OK"
+
+newtest "tree reference cache"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "match r s1: OK" "nomatch r s2: OK" "match r s2: OK" "match r s1 again: OK" --not-- "FAIL"
+
+newtest "tree reference prefix expansion"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "nomatch r zz: OK" "multiple r s: OK" "match r S1 ignore case: OK" --not-- "FAIL"
+
+newtest "parse-tree head registry"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "find t57: OK" "find nonexistent: OK" "find first of duplicates: OK" "find renamed: OK" "rename referenced tree: OK" "rename back referenced tree: OK" --not-- "FAIL"
+
+newtest "expand callback ttl cache"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" 2>&1)" 0 "match x e1: OK" "uncached callback: OK" "ttl set: OK" "cached match x e2: OK" "cached callback: OK" "cached nomatch x e3: OK" "invalidate: OK" "invalidated callback: OK" "ttl short: OK" "expired callback: OK" --not-- "FAIL"
+
+newtest "expand callback sync help waits"
+expectpart "$(echo "y ?" | LD_LIBRARY_PATH=.. $app "$fspec" sync 2>&1)" 0 "s1" "Help s1" --not-- "still loading"
+
+newtest "expand callback async help does not wait"
+expectpart "$(echo "y ?" | LD_LIBRARY_PATH=.. $app "$fspec" async 2>&1)" 0 "<w>" "(still loading)" --not-- "Help s1"
+
+newtest "expand callback async eval waits"
+expectpart "$(printf "y ?\ny s1\n" | LD_LIBRARY_PATH=.. $app "$fspec" async 2>&1)" 0 "(still loading)" "w=s1"
+
+newtest "expand callback async result picked up later"
+expectpart "$( (echo "y ?"; sleep 1; echo "y ?") | LD_LIBRARY_PATH=.. $app "$fspec" async 2>&1)" 0 "(still loading)" "Help s1"
+
+newtest "expand callback async exit does not wait"
+start=$(date +%s)
+expectpart "$(echo "z ?" | LD_LIBRARY_PATH=.. $app "$fspec" async 2>&1)" 0 "(still loading)"
+if [ $(($(date +%s) - start)) -ge 5 ]; then
+    err "exit within 5s" "$(($(date +%s) - start))s"
+fi
+
+newtest "endtest"
+endtest
+
+rm -rf $dir
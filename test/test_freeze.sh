@@ -0,0 +1,251 @@
+#!/usr/bin/env bash
+# Test frozen parse-trees shared by handles in several threads
+#   cligen_pt_freeze, cligen_pt_hold, pt_index_candidates
+# Each thread has its own handle holding the same frozen trees, and matches lines with
+# commands of an indexed level, variables, choices, expand callbacks and tree references
+# with labels, while the global generation is incremented. The threads hold and free the
+# trees, and close their handles themselves, the last one frees the trees.
+
+# Magic line must be first in script (see README.md)
+s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
+
+app="$dir/test_freeze"
+cfile="${app}.c"
+fspec="$dir/spec.cli"
+
+# Commands of the top level are more than PT_INDEX_MIN
+cat > $fspec <<'CLIEOF'
+prompt="cli> ";
+treename="base";
+
+CLIEOF
+for i in $(seq -w 0 39); do
+    echo "cmd$i x, callback();" >> $fspec
+done
+cat >> $fspec <<'CLIEOF'
+Upper, callback();
+e <n:int32 range[1:10]>, callback();
+ch <v:string choice:a|b|c>, callback();
+x <v:string exp()>, callback();
+ref @sub, @remove:hidden;
+
+treename="sub";
+s1, callback();
+s2, hidden, callback();
+CLIEOF
+
+cat <<'EOF' > $cfile
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <cligen/cligen.h>
+
+#define NTHREADS 8
+#define NLOOPS   500
+
+struct line{
+    char          *l_str;
+    cligen_result  l_result;
+};
+
+static struct line lines[] = {
+    {"cmd05 x",   CG_MATCH},
+    {"cmd3",      CG_MULTIPLE},
+    {"cmd39 x",   CG_MATCH},
+    {"cmd40",     CG_NOMATCH},
+    {"upper",     CG_MATCH},
+    {"e 5",       CG_MATCH},
+    {"e 20",      CG_NOMATCH},
+    {"ch b",      CG_MATCH},
+    {"ch d",      CG_NOMATCH},
+    {"x e1",      CG_MATCH},
+    {"ref s1",    CG_MATCH},
+    {"ref s2",    CG_NOMATCH},
+    {NULL,        CG_ERROR}
+};
+
+struct worker{
+    cligen_handle w_h;
+    parse_tree   *w_pt;
+    int           w_id;
+    int           w_errors;
+};
+
+static void
+check(const char *label, int ok)
+{
+    printf("%s: %s\n", label, ok ? "OK" : "FAIL");
+}
+
+int
+callback(cligen_handle h, cvec *cvv, cvec *argv)
+{
+    return 0;
+}
+
+cgv_fnstype_t *
+str2fn(const char *name, void *arg, char **error)
+{
+    return (cgv_fnstype_t *)callback;
+}
+
+/* Called concurrently, does not modify any state */
+int
+exp_cb(cligen_handle h,
+       const char   *name,
+       cvec         *cvv,
+       cvec         *argv,
+       cvec         *commands,
+       cvec         *helptexts)
+{
+    cvec_add_string(commands, NULL, "e1");
+    cvec_add_string(helptexts, NULL, "Help e1");
+    cvec_add_string(commands, NULL, "e2");
+    cvec_add_string(helptexts, NULL, "Help e2");
+    return 0;
+}
+
+expand_cb *
+str2fn_exp(const char *name, void *arg, char **error)
+{
+    return exp_cb;
+}
+
+static cligen_result
+parse(cligen_handle h,
+      char         *str)
+{
+    cg_obj       *co = NULL;
+    cvec         *cvv = NULL;
+    cligen_result result = CG_ERROR;
+    char         *reason = NULL;
+    char          buf[64];
+
+    strncpy(buf, str, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = '\0';
+    if (cliread_parse(h, buf, cligen_pt_active_get(h), &co, &cvv, &result, &reason) < 0)
+        return CG_ERROR;
+    if (co)
+        co_free(co, 0);
+    if (cvv)
+        cvec_free(cvv);
+    if (reason)
+        free(reason);
+    return result;
+}
+
+static void *
+worker_fn(void *arg)
+{
+    struct worker *w = arg;
+    struct line   *l;
+    int            i;
+
+    for (i=0; i<NLOOPS; i++){
+        for (l = lines; l->l_str; l++)
+            if (parse(w->w_h, l->l_str) != l->l_result){
+                if (w->w_errors++ == 0)
+                    fprintf(stderr, "thread %d: %s\n", w->w_id, l->l_str);
+            }
+        /* Invalidates derived data of trees that are not frozen */
+        if (w->w_id == 0 && i % 50 == 0)
+            pt_generation_inc();
+        if (cligen_pt_hold(w->w_pt) == NULL || pt_free(w->w_pt, 1) < 0)
+            w->w_errors++;
+    }
+    cligen_exit(w->w_h);
+    return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int            retval = -1;
+    cligen_handle  h;
+    FILE          *f;
+    pt_head       *ph;
+    pt_head       *ph1;
+    parse_tree    *pt;
+    struct worker  wv[NTHREADS];
+    pthread_t      tv[NTHREADS];
+    pt_candidates  cd;
+    int            i;
+    int            errors = 0;
+    const char    *specfile = argc > 1 ? argv[1] : "spec.cli";
+
+    if ((h = cligen_init()) == NULL)
+        goto done;
+    cligen_caseignore_set(h, 1);
+    if ((f = fopen(specfile, "r")) == NULL){ perror("fopen"); goto done; }
+    if (clispec_parse_file(h, f, "base", NULL, NULL, NULL) < 0){ fclose(f); goto done; }
+    fclose(f);
+    ph = NULL;
+    while ((ph = cligen_ph_each(h, ph)) != NULL){
+        pt = cligen_ph_parsetree_get(ph);
+        if (cligen_callbackv_str2fn(pt, str2fn, NULL) < 0 ||
+            cligen_expand_str2fn(pt, str2fn_exp, NULL) < 0 ||
+            cligen_pt_freeze(pt) < 0)
+            goto done;
+    }
+    pt = cligen_ph_parsetree_get(cligen_ph_find(h, "base"));
+    check("index built when frozen",
+          pt_index_candidates(pt, "cmd0", 0, &cd) == 0 && cd.cd_cmdlen == 10 &&
+          pt_index_candidates(pt, "UP", 1, &cd) == 0 && cd.cd_cmdlen == 1);
+    check("single match", parse(h, "ref s1") == CG_MATCH && parse(h, "ref s2") == CG_NOMATCH);
+    /* Sessions are set up by the main thread and closed by the threads */
+    for (i=0; i<NTHREADS; i++){
+        wv[i].w_pt = pt;
+        wv[i].w_id = i;
+        wv[i].w_errors = 0;
+        if ((wv[i].w_h = cligen_init()) == NULL)
+            goto done;
+        cligen_caseignore_set(wv[i].w_h, 1);
+        ph = NULL;
+        while ((ph = cligen_ph_each(h, ph)) != NULL){
+            if ((ph1 = cligen_ph_add(wv[i].w_h, cligen_ph_name_get(ph))) == NULL)
+                goto done;
+            if (cligen_ph_parsetree_set(ph1, cligen_pt_hold(cligen_ph_parsetree_get(ph))) < 0)
+                goto done;
+        }
+        if (cligen_ph_active_set_byname(wv[i].w_h, "base") < 0)
+            goto done;
+    }
+    for (i=0; i<NTHREADS; i++)
+        if (pthread_create(&tv[i], NULL, worker_fn, &wv[i]) != 0)
+            goto done;
+    /* The trees are freed by the thread closing its handle last */
+    cligen_exit(h);
+    for (i=0; i<NTHREADS; i++){
+        pthread_join(tv[i], NULL);
+        errors += wv[i].w_errors;
+    }
+    check("threads match", errors == 0);
+    retval = 0;
+ done:
+    if (retval < 0)
+        printf("error\n");
+    return retval;
+}
+EOF
+
+if [ "$LINKAGE" = static ]; then
+    newtest "compile $cfile (static)"
+    COMPILE="$CC -DHAVE_CONFIG_H -g -Wall $CFLAGS -I.. $cfile ../libcligen.a -lpthread -o $app"
+else
+    newtest "compile $cfile"
+    COMPILE="$CC -DHAVE_CONFIG_H -g -Wall $CFLAGS -I.. $cfile ../libcligen.so.${CLIGEN_VERSION_MAJOR}.${CLIGEN_VERSION_MINOR} -lpthread -o $app"
+fi
+expectpart "$($COMPILE 2>&1)" 0 ""
+
+newtest "frozen trees are indexed"
+expectpart "$(LD_LIBRARY_PATH=.. $app $fspec 2>&1)" 0 "index built when frozen: OK"
+
+newtest "frozen trees shared by handles in several threads"
+expectpart "$(LD_LIBRARY_PATH=.. $app $fspec 2>&1)" 0 "threads match: OK" "single match: OK" --not-- "FAIL" "error"
+
+newtest "endtest"
+endtest
+
+rm -rf $dir
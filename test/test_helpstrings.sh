@@ -1,6 +1,7 @@
 #!/usr/bin/env bash
 # CLI helpstring functionality
 # Includes: UTF-8, multi-lines, Multi-instance
+# Also with parsed trees allocated in arenas (-A), where strings are interned
 
 # Magic line must be first in script (see README.md)
 s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
@@ -27,9 +28,22 @@ newtest "$cligen_file -f $fspec"
 newtest "multi-line help"
 expectpart "$(echo "?" | $cligen_file -f $fspec )" 0 "cli>" "Theodoric the bold" "chief of sea-warriors" "ruled over the shores of the Hreiðsea"
 
+newtest "multi-line help in arena"
+expectpart "$(echo "?" | $cligen_file -A -f $fspec )" 0 "cli>" "Theodoric the bold" "chief of sea-warriors" "ruled over the shores of the Hreiðsea"
+
 newtest "same command different help query"
 expectpart "$(echo "help ?" | $cligen_file -f $fspec 2>&1)" 0 "cli>" "<peer>" "IPv4 address" "Peer group name"
 
+newtest "same command different help query in arena"
+expectpart "$(echo "help ?" | $cligen_file -A -f $fspec 2>&1)" 0 "cli>" "<peer>" "IPv4 address" "Peer group name"
+
+# aaa, bbb, peer and their helptexts are stored once
+newtest "commands and helptexts interned in arena"
+expectpart "$($cligen_file -A -d -1 -f $fspec 2>&1)" 0 "interned:13, size:220, saved:123"
+
+newtest "no interned strings without arena"
+expectpart "$($cligen_file -d -1 -f $fspec 2>&1)" 0 "nr:39" --not-- "interned:"
+
 newtest "same command different help tab"
 expectpart "$(echo "help 	" | $cligen_file -f $fspec 2>&1)" 0 "cli>" "<peer>" --not-- "IPv4 address" "Peer group name"
 
@@ -3,6 +3,8 @@
 # Tests that cligen_node_filter_fn can hide individual nodes from completion,
 # including nodes at nested levels (containers/lists) and that variable nodes
 # (CO_VARIABLE) are not affected by the filter.
+# Also the batched variant cligen_node_filter_batch_fn (-N option), including nodes
+# of tree references, and combined with the per-node callback.
 
 # Magic line must be first in script (see README.md)
 s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
@@ -24,6 +26,11 @@ cat > $fspec <<EOF
   d {
     <val:string>, callback();
   }
+  e @sub;
+
+  treename="sub";
+  sa, callback();
+  sb, callback();
 EOF
 
 newtest "$cligen_file -f $fspec"
@@ -59,6 +66,25 @@ expectpart "$(echo "?" | $cligen_file -n ca -n cb -n cc -f $fspec)" 0 "c"
 newtest "7b: All c children hidden - 'c ?' gives no completions"
 expectpart "$(echo "c ?" | $cligen_file -n ca -n cb -n cc -f $fspec)" 0 --not-- "ca" --not-- "cb" --not-- "cc"
 
+# 8. Batched filter
+newtest "8: Batched hide b - only a, c, d visible"
+expectpart "$(echo "?" | $cligen_file -N b -f $fspec)" 0 "a" "c" "d" --not-- "b"
+
+newtest "8b: Batched hide nested ca inside c"
+expectpart "$(echo "c ?" | $cligen_file -N ca -f $fspec)" 0 "cb" "cc" --not-- "ca"
+
+newtest "8c: Batched hide node of tree reference"
+expectpart "$(echo "e ?" | $cligen_file -N sa -f $fspec)" 0 "sb" --not-- "sa"
+
+newtest "8d: Batched hidden node of tree reference does not match"
+expectpart "$(echo "e sa" | $cligen_file -N sa -f $fspec 2>&1)" 0 "Unknown command" --not-- "name:sa"
+
+newtest "8e: Batched filter does not hide variables"
+expectpart "$(echo "d ?" | $cligen_file -N val -f $fspec)" 0 "<val>"
+
+newtest "9: Per-node and batched filters combined"
+expectpart "$(echo "?" | $cligen_file -n a -N b -f $fspec)" 0 "c" "d" --not-- "a" --not-- "b"
+
 newtest "endtest"
 endtest
 
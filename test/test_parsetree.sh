@@ -64,6 +64,36 @@ str2fn(const char *name, void *arg, char **error)
     return NULL;
 }
 
+/* Make a parse-tree of commands in the given order */
+static parse_tree *
+pt_make(const char *cmds)
+{
+    parse_tree *pt;
+    char        cmd[2] = {0,};
+
+    if ((pt = pt_new()) == NULL)
+        return NULL;
+    for (; *cmds; cmds++){
+        cmd[0] = *cmds;
+        if (pt_vec_append(pt, co_new(cmd, NULL)) < 0)
+            return NULL;
+    }
+    return pt;
+}
+
+/* Commands of a parse-tree as a string */
+static char *
+pt_cmds(parse_tree *pt)
+{
+    static char buf[64];
+    int         i;
+
+    for (i=0; i<pt_len_get(pt) && i<sizeof(buf)-1; i++)
+        buf[i] = pt_vec_i_get(pt, i)->co_command[0];
+    buf[i] = '\0';
+    return buf;
+}
+
 /* Callback for pt_apply: count nodes */
 static int
 count_fn(cg_obj *co, void *arg)
@@ -143,6 +173,37 @@ main(int argc, char *argv[])
         check("merge increased nodes", after > before);
     }
 
+    /* Merge into sorted and unsorted trees, objects already in pt0 are kept */
+    {
+        parse_tree *pt0;
+        parse_tree *pt1;
+        cg_obj     *co0;
+        cg_obj     *co1;
+
+        pt0 = pt_make("abd");
+        pt1 = pt_make("ecac");
+        co0 = pt_vec_i_get(pt0, 0);
+        co1 = pt_vec_i_get(pt0, 2);
+        check("merge sorted",
+              cligen_parsetree_merge(pt0, NULL, pt1) == 0 &&
+              strcmp(pt_cmds(pt0), "abcde") == 0 &&
+              pt_vec_i_get(pt0, 0) == co0 && pt_vec_i_get(pt0, 3) == co1);
+        pt_free(pt0, 1);
+        pt_free(pt1, 1);
+        /* Equal objects of an unsorted tree are not merged */
+        pt0 = pt_make("dbab");
+        pt1 = pt_make("cacb");
+        co0 = pt_vec_i_get(pt0, 0);
+        co1 = pt_vec_i_get(pt0, 3);
+        check("merge unsorted",
+              cligen_parsetree_merge(pt0, NULL, pt1) == 0 &&
+              strcmp(pt_cmds(pt0), "abbcd") == 0 &&
+              pt_vec_i_get(pt0, 4) == co0 &&
+              (pt_vec_i_get(pt0, 1) == co1 || pt_vec_i_get(pt0, 2) == co1));
+        pt_free(pt0, 1);
+        pt_free(pt1, 1);
+    }
+
     /* pt_trunc: truncate tree to 1 entry (must be > 0 and < current length) */
     {
         uint64_t nr2 = 0;
@@ -189,6 +250,9 @@ expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" "${fspec}.extra" 2>&1)" 0 "pt_dup
 newtest "cligen_parsetree_merge adds nodes"
 expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" "${fspec}.extra" 2>&1)" 0 "parsetree_merge ok: OK" "merge increased nodes: OK"
 
+newtest "cligen_parsetree_merge keeps objects of sorted and unsorted trees"
+expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" "${fspec}.extra" 2>&1)" 0 "merge sorted: OK" "merge unsorted: OK"
+
 newtest "pt_trunc succeeds"
 expectpart "$(LD_LIBRARY_PATH=.. $app "$fspec" "${fspec}.extra" 2>&1)" 0 "pt_trunc ok: OK"
 
@@ -2,6 +2,7 @@
 # CLI variable preference
 # tests multiple variable matches with different preferences
 # Also test reference using filter statements: @<tree>, @remove:<label>
+# including long labels and many labels whose signatures overlap, which are compared by name
 
 # Magic line must be first in script (see README.md)
 s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
@@ -19,6 +20,8 @@ cat > $fspec <<EOF
   # Parametrized reference 
   parameter @subtree, @remove:local, callback("x1","x2");
 #  parameter @subtree, callback();
+  longparam @subtree, @remove:a-label-longer-than-thirty-one-characters, callback();
+  manyparam @subtree, @remove:l70, callback();
 
   treename="subtree";           
   xx{
@@ -29,6 +32,9 @@ cat > $fspec <<EOF
     zz3, local, template(); # filter sub-tree
     zz4, template("a1", "a2"); # overwritten by @subtree above
   }
+  zz5, a-label-longer-than-thirty-one-characters, template();
+  zz6, $(seq -s ", " -f "l%g" 0 69), template();
+  zz7, l70, template();
 EOF
 
 # Run reftree tests
@@ -60,6 +66,15 @@ function runtest()
     newtest "parameter reference zz2 zz3"
     expectpart "$(echo "parameter zz2 zz3" | $cligen_file -f $fspec 2>&1)" 0 "CLI syntax error in:" --not-- "1 name:parameter type:string value:parameter" "2 name:zz2 type:string value:zz2" "3 name:zz3 type:string value:zz3"
 
+    newtest "long label reference ?"
+    expectpart "$(echo "longparam ?" | $cligen_file -f $fspec 2>&1)" 0 "xx" "zz1" --not-- "zz5"
+
+    newtest "long label not removed in other reference"
+    expectpart "$(echo "parameter ?" | $cligen_file -f $fspec 2>&1)" 0 "zz5" --not-- "zz1"
+
+    newtest "many labels reference ?"
+    expectpart "$(echo "manyparam ?" | $cligen_file -f $fspec 2>&1)" 0 "zz1" "zz6" --not-- "zz7"
+
     newtest "parameter reference zz2 zz4 and args"
     expectpart "$(echo "parameter zz2 zz4" | $cligen_file -f $fspec 2>&1)" 0 "1 name:parameter type:string value:parameter" "2 name:zz2 type:string value:zz2" "3 name:zz4 type:string value:zz4" "arg 0: a1" "arg 1: a2" "arg 2: x1" "arg 3: x2"
 }
@@ -67,6 +82,33 @@ function runtest()
 newtest "$cligen_file -f $fspec"
 runtest
 
+# Trees allocated in arenas, one per treename
+newtest "cligen ref 42 in arena"
+expectpart "$(echo "values ? 42" | $cligen_file -A -f $fspec 2>&1)" 0 "cli> values" "<int64>" "xx" "2 name:int64 type:int64 value:42" "zz1"
+
+newtest "parameter reference zz2 zz4 and args in arena"
+expectpart "$(echo "parameter zz2 zz4" | $cligen_file -A -f $fspec 2>&1)" 0 "1 name:parameter type:string value:parameter" "2 name:zz2 type:string value:zz2" "3 name:zz4 type:string value:zz4" "arg 0: a1" "arg 1: a2" "arg 2: x1" "arg 3: x2"
+
+# Expanded objects borrow fields from the originals, also when expanding
+# expand and choice variables on top of a referenced tree
+cat > $fspec <<EOF
+  prompt="cli> ";
+  treename="example";
+  ref @exptree, @add:extra, callback();
+  treename="exptree";
+  e <x:string exp()>("Expand var");
+  c <y:string choice:c1|c2>("Choice var");
+  <z:string exp()>("Top expand");
+  <w:string choice:w1|w2>("Top choice");
+EOF
+
+newtest "reference top expand and choice"
+expectpart "$(printf 'ref exp2\nref w1\nref e exp3\nref c c2\nref ?\nref exp1\nref w2\n' | $cligen_file -e -f $fspec 2>&1)" 0 "2 name:z type:string value:exp2" "2 name:w type:string value:w1" "3 name:x type:string value:exp3" "3 name:y type:string value:c2" "exp3                  Help exp3" "w2                    Top choice" "2 name:z type:string value:exp1" "2 name:w type:string value:w2"
+
+# Labels added by the reference are added to a copy of the frozen expand variable
+newtest "reference top expand and choice in frozen tree"
+expectpart "$(printf 'ref exp2\nref w1\nref e exp3\nref c c2\nref ?\nref exp1\nref w2\n' | $cligen_file -F -e -f $fspec 2>&1)" 0 "2 name:z type:string value:exp2" "2 name:w type:string value:w1" "3 name:x type:string value:exp3" "3 name:y type:string value:c2" "exp3                  Help exp3" "w2                    Top choice" "2 name:z type:string value:exp1" "2 name:w type:string value:w2"
+
 newtest "endtest"
 endtest
 
@@ -1,5 +1,6 @@
 #!/usr/bin/env bash
 # CLI sets
+# Also in frozen parse-trees (-F) where match flags are only set on copies
 
 # Magic line must be first in script (see README.md)
 s="$_" ; . ./lib.sh || if [ "$s" = $0 ]; then exit 0; else return 0; fi
@@ -126,10 +127,16 @@ expectpart "$(echo "b f c d ?" | $cligen_file -f $fspec 2>&1)" 0 "  e" "1 name:b
 newtest "b f c d e ?"
 expectpart "$(echo "b f c d e ?" | $cligen_file -f $fspec 2>&1)" 0 "1 name:b type:string value:b" "2 name:f type:string value:f" "3 name:c type:string value:c" --not-- "  a" "  b" "  c" "  d" "  e"
 
+newtest "b f c d ? in frozen tree"
+expectpart "$(echo "b f c d ?" | $cligen_file -F -f $fspec 2>&1)" 0 "  e" "1 name:b type:string value:b" "2 name:f type:string value:f" "3 name:c type:string value:c" --not-- "  a" "  b" "  c" "  d"
+
 # Negative tests
 newtest "b c d d: Already matched"
 expectpart "$(echo "b c d d" | $cligen_file -f $fspec 2>&1)" 0 "Already matched"
 
+newtest "b c d d: Already matched in frozen tree, twice"
+expectpart "$(printf "b c d d\nb c d d\nb c d e\n" | $cligen_file -F -f $fspec 2>&1)" 0 "Already matched" "4 name:e type:string value:e"
+
 newtest "endtest"
 endtest
 
@@ -37,6 +37,8 @@ cat > $fspec <<EOF
   u0  <v:url>, callback();
   u1  <v:uuid>, callback();
   t0  <v:time>, callback();
+  m0  (<v:int32 range[1:100]>|<v:ipv4addr>|<v:ipv6addr>|<v:macaddr>|<v:uuid>), callback();
+  m1  (<v:int32>|<v:ipv4addr>|<v:ipv6addr>|<v:macaddr>|<v:string>), callback();
 EOF
 
 newtest "$cligen_file -f $fspec"
@@ -142,6 +144,31 @@ expectpart "$(echo "t0 2008-09-21T18:57:21.003" | $cligen_file -f $fspec 2> /dev
 newtest "time t0 fail"
 expectpart "$(echo "t0 foobar" | $cligen_file -f $fspec 2> /dev/null)" 0 "Invalid time"
 
+# Several typed alternatives: a token is only parsed as types it may be
+newtest "multi m0 int"
+expectpart "$(echo "m0 17" | $cligen_file -f $fspec 2>&1)" 0 "type:int32 value:17"
+
+newtest "multi m0 ipv4"
+expectpart "$(echo "m0 1.2.3.4" | $cligen_file -f $fspec 2>&1)" 0 "type:ipv4addr value:1.2.3.4"
+
+newtest "multi m0 ipv6"
+expectpart "$(echo "m0 1::5" | $cligen_file -f $fspec 2>&1)" 0 "type:ipv6addr value:1::5"
+
+newtest "multi m0 mac"
+expectpart "$(echo "m0 a4:4e:31:c9:d7:f4" | $cligen_file -f $fspec 2>&1)" 0 "type:macaddr value:a4:4e:31:c9:d7:f4"
+
+newtest "multi m0 uuid"
+expectpart "$(echo "m0 550e8400-e29b-41d4-a716-446655440000" | $cligen_file -f $fspec 2>&1)" 0 "type:uuid value:550e8400-e29b-41d4-a716-446655440000"
+
+newtest "multi m0 range fail"
+expectpart "$(echo "m0 200" | $cligen_file -f $fspec 2> /dev/null)" 0 "Number 200 out of range: 1 - 100"
+
+newtest "multi m0 fail"
+expectpart "$(echo "m0 1.2.3.4." | $cligen_file -f $fspec 2> /dev/null)" 0 "CLI syntax error" "'1.2.3.4.' is not a number"
+
+newtest "multi m1 string"
+expectpart "$(echo "m1 foobar" | $cligen_file -f $fspec 2>&1)" 0 "type:string value:foobar"
+
 newtest "endtest"
 endtest
 
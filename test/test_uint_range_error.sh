@@ -14,6 +14,8 @@ cat > $fspec <<EOF
   u16 <v:uint16>, callback();
   u32 <v:uint32>, callback();
   u64 <v:uint64>, callback();
+  u8r <v:uint8 range[1:10]>, callback();
+  i8r <v:int8 range[-100:100]>, callback();
 EOF
 
 newtest "$cligen_file -f $fspec"
@@ -48,6 +50,28 @@ expectpart "$(echo "u32 99999999999999999999" | $cligen_file -f $fspec 2> /dev/n
 newtest "uint64 overflow"
 expectpart "$(echo "u64 99999999999999999999" | $cligen_file -f $fspec 2> /dev/null)" 0 "CLI syntax error" "out of range: 0 - 18446744073709551615"
 
+# Range of specification has precedence over range of type
+newtest "uint8 range valid"
+expectpart "$(echo "u8r 0x0a" | $cligen_file -f $fspec 2>&1)" 0 "type:uint8 value:10" --not-- "CLI syntax error"
+
+newtest "uint8 out of spec range"
+expectpart "$(echo "u8r 11" | $cligen_file -f $fspec 2> /dev/null)" 0 "CLI syntax error" "Number 11 out of range: 1 - 10"
+
+newtest "uint8 out of uint8 range shows spec range"
+expectpart "$(echo "u8r 300" | $cligen_file -f $fspec 2> /dev/null)" 0 "CLI syntax error" "Number 300 out of range: 1 - 10" --not-- "out of range: 0 - 255"
+
+newtest "uint8 negative shows uint8 range"
+expectpart "$(echo "u8r -1" | $cligen_file -f $fspec 2> /dev/null)" 0 "CLI syntax error" "Number -1 out of range: 0 - 255"
+
+newtest "int8 out of int8 range shows spec range"
+expectpart "$(echo "i8r 200" | $cligen_file -f $fspec 2> /dev/null)" 0 "CLI syntax error" "Number 200 out of range: -100 - 100" --not-- "out of range: -128 - 127"
+
+newtest "int8 overflow int64 shows int8 range"
+expectpart "$(echo "i8r 99999999999999999999" | $cligen_file -f $fspec 2> /dev/null)" 0 "CLI syntax error" "out of range: -128 - 127"
+
+newtest "int8 not a number"
+expectpart "$(echo "i8r 1a" | $cligen_file -f $fspec 2> /dev/null)" 0 "CLI syntax error" "'1a' is not a number"
+
 newtest "endtest"
 endtest
 
@@ -24,6 +24,9 @@ cat > $fspec <<EOF
 # * Choice with variable
   extra (<crypto:string>|<crypto:string choice:mc:aes|mc:foo|des:des|des:des3>), callback();
   extra2 <crypto:string choice:mc:aes|mc:foo>, callback();
+
+# * Choice followed by a keyword: only choices matching the token are expanded
+  paint <col:string choice:red|green("Green color")|blue|black>("Color") mode, callback();
 EOF
 
 newtest "$cligen_file -f $fspec"
@@ -108,6 +111,22 @@ expectpart "$(echo -n "extra des:?" | $cligen_file -f $fspec 2>&1)" 0 "<crypto>"
 newtest "extra fo expand to foo"
 expectpart "$(echo "extra2 mc:fo" | $cligen_file -f $fspec 2>&1)" 0 "2 name:crypto type:string value:mc:foo"
 
+# * Choice followed by a keyword
+newtest "paint green mode"
+expectpart "$(echo "paint green mode" | $cligen_file -f $fspec 2>&1)" 0 "2 name:col type:string value:green" "3 name:mode type:string value:mode"
+
+newtest "paint gr mode expand to green"
+expectpart "$(echo "paint gr mode" | $cligen_file -f $fspec 2>&1)" 0 "2 name:col type:string value:green"
+
+newtest "paint bl mode ambiguous"
+expectpart "$(echo "paint bl mode" | $cligen_file -f $fspec 2>&1)" 0 "Ambiguous command"
+
+newtest "paint pink mode unknown"
+expectpart "$(echo "paint pink mode" | $cligen_file -f $fspec 2>&1)" 0 "Unknown command"
+
+newtest "paint ? with choice helptext"
+expectpart "$(echo -n "paint ?" | $cligen_file -f $fspec 2>&1)" 0 "black                 Color" "blue                  Color" "green                 Green color" "red                   Color"
+
 newtest "endtest"
 endtest
 